@@ -0,0 +1,397 @@
+#include "AccelerationStructureBuildQueue.h"
+#include "Pass/MemoryBarrier.h"
+
+#include <iostream>
+
+namespace {
+
+bool isCompactable(const Amano::AccelerationStructureInfo& info) {
+	return (info.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != 0;
+}
+
+// Hands the buffer of a structure from a queue family to the other
+// The same barrier is recorded twice: released by the source queue, then acquired by the destination one
+VkBufferMemoryBarrier getOwnershipTransferBarrier(const Amano::AccelerationStructureInfo& info, uint32_t srcQueueFamily, uint32_t dstQueueFamily) {
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = srcQueueFamily;
+	barrier.dstQueueFamilyIndex = dstQueueFamily;
+	barrier.buffer = info.result;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	return barrier;
+}
+
+}
+
+namespace Amano {
+
+AccelerationStructureBuildQueue::AccelerationStructureBuildQueue(Device* device)
+	: m_device{ device }
+	, m_jobs()
+{
+}
+
+AccelerationStructureBuildQueue::~AccelerationStructureBuildQueue() {
+	for (auto& job : m_jobs) {
+		vkWaitForFences(m_device->handle(), 1, &job.fence, VK_TRUE, UINT64_MAX);
+		for (auto& structure : job.structures)
+			structure.clean(m_device);
+		for (auto& structure : job.compactedStructures)
+			structure.clean(m_device);
+		destroy(job);
+	}
+}
+
+bool AccelerationStructureBuildQueue::push(const std::vector<BottomLevelBuildRequest>& requests) {
+	if (requests.empty())
+		return true;
+
+	uint32_t count = static_cast<uint32_t>(requests.size());
+	std::vector<VkAccelerationStructureGeometryKHR> geometries(count);
+	std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos(count);
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos(count);
+	std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos(count);
+	std::vector<VkAccelerationStructureKHR> handles(count);
+
+	// each job has its own scratch memory, the builds of the frames may run at the same time
+	Job job{};
+	job.isReleased = !m_device->isAsyncComputeFamilySeparate();
+	job.ids.resize(count);
+	job.structures.resize(count);
+	job.scratchBuffer = new ScratchBuffer(m_device);
+
+	VkDeviceSize scratchSize = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		const BottomLevelBuildRequest& request = requests[i];
+		geometries[i] = getMeshGeometry(request.mesh);
+
+		auto& buildRangeInfo = buildRangeInfos[i];
+		buildRangeInfo.primitiveCount = request.mesh->getIndexCount() / 3;
+		pBuildRangeInfos[i] = &buildRangeInfo;
+
+		auto& buildGeometryInfo = buildGeometryInfos[i];
+		buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		buildGeometryInfo.pNext = nullptr;
+		buildGeometryInfo.flags = getBottomLevelFlags(request.isDeformable);
+		buildGeometryInfo.geometryCount = 1;
+		buildGeometryInfo.pGeometries = &geometries[i];
+		buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+		buildGeometryInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+
+		VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo = getBuildSizesInfo(m_device, &buildRangeInfo.primitiveCount, &buildGeometryInfo, job.scratchBuffer->getOffsetAlignment());
+
+		auto& structure = job.structures[i];
+		job.ids[i] = request.id;
+		if (!createAccelerationStructure(m_device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, buildSizesInfo.accelerationStructureSize, structure)) {
+			for (auto& createdStructure : job.structures)
+				createdStructure.clean(m_device);
+			destroy(job);
+			return false;
+		}
+		structure.flags = buildGeometryInfo.flags;
+		structure.buildScratchSize = buildSizesInfo.buildScratchSize;
+		structure.updateScratchSize = buildSizesInfo.updateScratchSize;
+
+		buildGeometryInfo.dstAccelerationStructure = structure.handle;
+		handles[i] = structure.handle;
+		scratchSize += buildSizesInfo.buildScratchSize;
+	}
+
+	bool isScratchAllocated = job.scratchBuffer->beginBatch(scratchSize);
+	for (uint32_t i = 0; i < count && isScratchAllocated; ++i) {
+		buildGeometryInfos[i].scratchData.deviceAddress = job.scratchBuffer->allocate(job.structures[i].buildScratchSize);
+		isScratchAllocated = buildGeometryInfos[i].scratchData.deviceAddress != 0;
+	}
+
+	if (!isScratchAllocated) {
+		for (auto& structure : job.structures)
+			structure.clean(m_device);
+		destroy(job);
+		return false;
+	}
+
+	// the compacted sizes are read once the build is finished
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+	queryPoolInfo.queryCount = count;
+
+	if (vkCreateQueryPool(m_device->handle(), &queryPoolInfo, nullptr, &job.queryPool) != VK_SUCCESS) {
+		std::cerr << "failed to create the compacted size query pool!" << std::endl;
+		job.queryPool = VK_NULL_HANDLE;
+	}
+
+	Queue* pQueue = m_device->getQueue(QueueType::eAsyncCompute);
+	job.commandBuffer = pQueue->beginCommands();
+
+	if (job.queryPool != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(job.commandBuffer, job.queryPool, 0, count);
+
+	m_device->getExtensions().vkCmdBuildAccelerationStructuresKHR(job.commandBuffer, count, buildGeometryInfos.data(), pBuildRangeInfos.data());
+
+	if (job.queryPool != VK_NULL_HANDLE) {
+		memoryBarrier(job.commandBuffer,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR);
+
+		m_device->getExtensions().vkCmdWriteAccelerationStructuresPropertiesKHR(
+			job.commandBuffer,
+			count,
+			handles.data(),
+			VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+			job.queryPool,
+			0);
+	}
+
+	pQueue->endCommands(job.commandBuffer);
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	if (vkCreateFence(m_device->handle(), &fenceInfo, nullptr, &job.fence) != VK_SUCCESS) {
+		std::cerr << "failed to create the acceleration structure build fence!" << std::endl;
+		for (auto& structure : job.structures)
+			structure.clean(m_device);
+		destroy(job);
+		return false;
+	}
+
+	if (!submit(job)) {
+		vkQueueWaitIdle(pQueue->handle());
+		for (auto& structure : job.structures)
+			structure.clean(m_device);
+		destroy(job);
+		return false;
+	}
+
+	m_jobs.push_back(job);
+
+	return true;
+}
+
+void AccelerationStructureBuildQueue::poll(std::vector<BottomLevelBuildResult>& results) {
+	for (size_t jobIndex = 0; jobIndex < m_jobs.size();) {
+		Job& job = m_jobs[jobIndex];
+		if (vkGetFenceStatus(m_device->handle(), job.fence) != VK_SUCCESS) {
+			++jobIndex;
+			continue;
+		}
+
+		m_device->getQueue(QueueType::eAsyncCompute)->freeCommandBuffer(job.commandBuffer);
+		job.commandBuffer = VK_NULL_HANDLE;
+
+		// the structures are built, start their compaction
+		if (!job.isCompacting && !job.isReleasing && compact(job)) {
+			++jobIndex;
+			continue;
+		}
+
+		// the structures that aren't compacted are released by their own submission
+		if (!job.isReleased && release(job)) {
+			++jobIndex;
+			continue;
+		}
+
+		if (!job.isReleased) {
+			std::cerr << "failed to release the bottom acceleration structures to the graphics queue!" << std::endl;
+			for (auto& structure : job.structures)
+				structure.clean(m_device);
+			for (auto& structure : job.compactedStructures)
+				structure.clean(m_device);
+			destroy(job);
+			m_jobs.erase(m_jobs.begin() + jobIndex);
+			continue;
+		}
+
+		// the structures are ready, the graphics queue must acquire them when they come from another family
+		for (size_t i = 0; i < job.ids.size(); ++i) {
+			BottomLevelBuildResult result;
+			result.id = job.ids[i];
+			if (job.isCompacting && isCompactable(job.structures[i])) {
+				result.structure = job.compactedStructures[i];
+				job.structures[i].clean(m_device);
+			}
+			else {
+				result.structure = job.structures[i];
+			}
+			results.push_back(result);
+		}
+
+		destroy(job);
+		m_jobs.erase(m_jobs.begin() + jobIndex);
+	}
+}
+
+bool AccelerationStructureBuildQueue::submit(Job& job) {
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &job.commandBuffer;
+
+	return m_device->getQueue(QueueType::eAsyncCompute)->submit(&submitInfo, job.fence);
+}
+
+bool AccelerationStructureBuildQueue::compact(Job& job) {
+	// the build scratch memory isn't needed anymore
+	delete job.scratchBuffer;
+	job.scratchBuffer = nullptr;
+
+	if (job.queryPool == VK_NULL_HANDLE)
+		return false;
+
+	uint32_t count = static_cast<uint32_t>(job.structures.size());
+	std::vector<VkDeviceSize> compactedSizes(count);
+	VkResult result = vkGetQueryPoolResults(
+		m_device->handle(),
+		job.queryPool,
+		0,
+		count,
+		sizeof(VkDeviceSize) * compactedSizes.size(),
+		compactedSizes.data(),
+		sizeof(VkDeviceSize),
+		VK_QUERY_RESULT_64_BIT);
+
+	if (result != VK_SUCCESS) {
+		std::cerr << "failed to get the compacted sizes of the acceleration structures!" << std::endl;
+		return false;
+	}
+
+	job.compactedStructures.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!isCompactable(job.structures[i]))
+			continue;
+
+		if (!createAccelerationStructure(m_device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactedSizes[i], job.compactedStructures[i])) {
+			for (auto& compactedStructure : job.compactedStructures)
+				compactedStructure.clean(m_device);
+			job.compactedStructures.clear();
+			return false;
+		}
+		job.compactedStructures[i].flags = job.structures[i].flags;
+		job.compactedStructures[i].buildScratchSize = job.structures[i].buildScratchSize;
+		job.compactedStructures[i].updateScratchSize = job.structures[i].updateScratchSize;
+	}
+
+	Queue* pQueue = m_device->getQueue(QueueType::eAsyncCompute);
+	job.commandBuffer = pQueue->beginCommands();
+
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!isCompactable(job.structures[i]))
+			continue;
+
+		VkCopyAccelerationStructureInfoKHR copyInfo{};
+		copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+		copyInfo.pNext = nullptr;
+		copyInfo.src = job.structures[i].handle;
+		copyInfo.dst = job.compactedStructures[i].handle;
+		copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+		m_device->getExtensions().vkCmdCopyAccelerationStructureKHR(job.commandBuffer, &copyInfo);
+	}
+
+	// the structures are complete at the end of the copies
+	bool isReleased = job.isReleased;
+	if (!job.isReleased) {
+		std::vector<AccelerationStructureInfo> finalStructures(count);
+		for (uint32_t i = 0; i < count; ++i)
+			finalStructures[i] = isCompactable(job.structures[i]) ? job.compactedStructures[i] : job.structures[i];
+		recordRelease(job.commandBuffer, finalStructures);
+		job.isReleased = true;
+	}
+
+	pQueue->endCommands(job.commandBuffer);
+
+	vkResetFences(m_device->handle(), 1, &job.fence);
+	job.isCompacting = true;
+	if (!submit(job)) {
+		// keep the structures that aren't compacted
+		pQueue->freeCommandBuffer(job.commandBuffer);
+		job.commandBuffer = VK_NULL_HANDLE;
+		for (auto& compactedStructure : job.compactedStructures)
+			compactedStructure.clean(m_device);
+		job.compactedStructures.clear();
+		job.isCompacting = false;
+		job.isReleased = isReleased;
+		return false;
+	}
+
+	return true;
+}
+
+bool AccelerationStructureBuildQueue::release(Job& job) {
+	Queue* pQueue = m_device->getQueue(QueueType::eAsyncCompute);
+	job.commandBuffer = pQueue->beginCommands();
+	if (job.commandBuffer == VK_NULL_HANDLE)
+		return false;
+
+	recordRelease(job.commandBuffer, job.structures);
+	pQueue->endCommands(job.commandBuffer);
+
+	vkResetFences(m_device->handle(), 1, &job.fence);
+	if (!submit(job)) {
+		pQueue->freeCommandBuffer(job.commandBuffer);
+		job.commandBuffer = VK_NULL_HANDLE;
+		return false;
+	}
+
+	job.isReleasing = true;
+	job.isReleased = true;
+	return true;
+}
+
+void AccelerationStructureBuildQueue::recordRelease(VkCommandBuffer cmd, const std::vector<AccelerationStructureInfo>& structures) {
+	uint32_t asyncComputeFamily = m_device->getQueue(QueueType::eAsyncCompute)->familyIndex();
+	uint32_t graphicsFamily = m_device->getQueue(QueueType::eGraphics)->familyIndex();
+
+	std::vector<VkBufferMemoryBarrier> barriers;
+	for (const auto& structure : structures) {
+		VkBufferMemoryBarrier barrier = getOwnershipTransferBarrier(structure, asyncComputeFamily, graphicsFamily);
+		barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		barriers.push_back(barrier);
+	}
+
+	vkCmdPipelineBarrier(
+		cmd,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+}
+
+void AccelerationStructureBuildQueue::recordAcquire(VkCommandBuffer cmd, const std::vector<BottomLevelBuildResult>& results) {
+	if (results.empty() || !m_device->isAsyncComputeFamilySeparate())
+		return;
+
+	uint32_t asyncComputeFamily = m_device->getQueue(QueueType::eAsyncCompute)->familyIndex();
+	uint32_t graphicsFamily = m_device->getQueue(QueueType::eGraphics)->familyIndex();
+
+	std::vector<VkBufferMemoryBarrier> barriers;
+	for (const auto& result : results) {
+		VkBufferMemoryBarrier barrier = getOwnershipTransferBarrier(result.structure, asyncComputeFamily, graphicsFamily);
+		barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		barriers.push_back(barrier);
+	}
+
+	// the release is finished, its fence was signaled before the results were returned
+	vkCmdPipelineBarrier(
+		cmd,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+		0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+}
+
+void AccelerationStructureBuildQueue::destroy(Job& job) {
+	delete job.scratchBuffer;
+	job.scratchBuffer = nullptr;
+	if (job.commandBuffer != VK_NULL_HANDLE)
+		m_device->getQueue(QueueType::eAsyncCompute)->freeCommandBuffer(job.commandBuffer);
+	job.commandBuffer = VK_NULL_HANDLE;
+	vkDestroyQueryPool(m_device->handle(), job.queryPool, nullptr);
+	job.queryPool = VK_NULL_HANDLE;
+	vkDestroyFence(m_device->handle(), job.fence, nullptr);
+	job.fence = VK_NULL_HANDLE;
+}
+
+}
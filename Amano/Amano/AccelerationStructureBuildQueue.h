@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Device.h"
+#include "Mesh.h"
+#include "ScratchBuffer.h"
+#include "Builder/RaytracingAccelerationStructureBuilder.h"
+
+#include <vector>
+
+namespace Amano {
+
+// A bottom level acceleration structure to build in the background
+struct BottomLevelBuildRequest {
+	uint32_t id;  // chosen by the caller, returned with the finished structure
+	const Mesh* mesh;
+	bool isDeformable;
+};
+
+// A bottom level acceleration structure whose build is finished
+struct BottomLevelBuildResult {
+	uint32_t id;
+	AccelerationStructureInfo structure;
+};
+
+// This class builds bottom level acceleration structures in the background, on the async compute queue
+// Each job builds a batch of structures in one call, then compacts the ones that aren't deformable with a second submission
+// The jobs are polled with their fences, so the frame loop never waits for them
+// When the async compute queue has its own family, the last submission of a job releases the structures to the graphics family
+class AccelerationStructureBuildQueue {
+public:
+	AccelerationStructureBuildQueue(Device* device);
+	~AccelerationStructureBuildQueue();
+
+	bool isEmpty() const { return m_jobs.empty(); }
+
+	// Submits the builds of the batch, the vertices and indices of the meshes must stay valid until they are finished
+	bool push(const std::vector<BottomLevelBuildRequest>& requests);
+
+	// Moves the jobs whose submission finished to their next step, and appends the finished structures to results
+	void poll(std::vector<BottomLevelBuildResult>& results);
+
+	// Records the acquisition of the finished structures by the graphics queue, before their first use
+	// Nothing is recorded when the async compute queue is from the graphics family
+	void recordAcquire(VkCommandBuffer cmd, const std::vector<BottomLevelBuildResult>& results);
+
+private:
+	struct Job {
+		std::vector<uint32_t> ids;
+		std::vector<AccelerationStructureInfo> structures;
+		std::vector<AccelerationStructureInfo> compactedStructures;
+		ScratchBuffer* scratchBuffer;
+		VkQueryPool queryPool;
+		VkCommandBuffer commandBuffer;
+		VkFence fence;
+		bool isCompacting;
+		bool isReleasing;  // the structures that aren't compacted are released by their own submission
+		bool isReleased;   // the structures are owned by the graphics family once the last submission is finished
+	};
+
+	bool submit(Job& job);
+	bool compact(Job& job);
+	bool release(Job& job);
+	void recordRelease(VkCommandBuffer cmd, const std::vector<AccelerationStructureInfo>& structures);
+	void destroy(Job& job);
+
+private:
+	Device* m_device;
+	std::vector<Job> m_jobs;
+};
+
+}
@@ -10,11 +10,16 @@
 #include "Builder/RenderPassBuilder.h"
 #include "Builder/SamplerBuilder.h"
 #include "Builder/TransitionImageBarrierBuilder.h"
+#include "Bvh.h"
 
 #include <imgui.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <random>
 #include <vector>
 
 // temporary
@@ -22,6 +27,21 @@
 const uint32_t WIDTH = 1280;
 const uint32_t HEIGHT = 720;
 const int MAX_FRAMES_IN_FLIGHT = 2;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 10.0f;
+// range of the render scale, for the slider and the dynamic resolution
+const float MIN_RENDER_SCALE = 0.5f;
+const float MAX_RENDER_SCALE = 1.0f;
+// in radians per second
+const float MODEL_ROTATION_SPEED = 0.5f;
+// the vertices move along their normals by a fraction of the radius of the model
+// it is small, the meshlet culling still uses the bounds of the loaded vertices
+const float MODEL_DEFORMATION_AMPLITUDE = 0.02f;
+const float MODEL_DEFORMATION_WAVES = 8.0f;  // over the radius
+const float MODEL_DEFORMATION_SPEED = 4.0f;  // in radians per second
+
+// Uncomment to print the performance of the CPU raytracing at startup
+//#define AMANO_BVH_BENCHMARK
 
 namespace {
 
@@ -44,6 +64,14 @@ Application::Application()
 	, m_framebufferResized{ false }
 	, m_width{ 0 }
 	, m_height{ 0 }
+	, m_renderWidth{ 0 }
+	, m_renderHeight{ 0 }
+	, m_currentRenderScale{ 1.0f }
+	, m_renderScale{ 1.0f }
+	, m_useDynamicResolution{ false }
+	, m_targetFrameTime{ 1000.0f / 60.0f }
+	, m_dynamicResolution()
+	, m_gpuFrameTimer{ nullptr }
 	, m_device{ nullptr }
 	, m_inputSystem{ nullptr }
 	, m_guiSystem{ nullptr }
@@ -55,11 +83,36 @@ Application::Application()
 	, m_inFlightFence{ VK_NULL_HANDLE }
 	, m_gBufferPass{ nullptr }
 	, m_deferredLightingPass{ nullptr }
+	, m_isLightingOnTile{ false }
+	, m_raytracingScene{ nullptr }
 	, m_raytracingPass{ nullptr }
+	, m_isModelRotating{ true }
+	, m_modelAngle{ 0.0f }
+	, m_previousModel(1.0f)
+	, m_isModelDeforming{ false }
+	, m_isModelDeformed{ false }
+	, m_deformedVertices()
+	, m_computeShadowPass{ nullptr }
+	, m_shadowDenoisingPass{ nullptr }
+	, m_shadowTraceSettings()
+	, m_shadowResolution{ 1 }
+	, m_useCheckerboardShadows{ false }
+	, m_lightProbeRelightingPass{ nullptr }
+	, m_temporalAntiAliasingPass{ nullptr }
+	, m_useTemporalAntiAliasing{ true }
+	, m_previousViewProj(1.0f)
 	, m_toneMappingPass{ nullptr }
 	, m_blitToSwapChainPass{ nullptr }
 	// light information
 	, m_lightPosition(1.0f, 1.0f, 1.0f)
+	, m_lightRadius{ 0.1f }
+	, m_frameIndex{ 0 }
+	, m_pointLights()
+	, m_pointLightOrbits()
+	, m_pointLightCount{ 256 }
+	, m_useTiledLightCulling{ false }
+	, m_maxLodPixelError{ 1.0f }
+	, m_selectedLod{ 0 }
 {
 }
 
@@ -69,9 +122,17 @@ Application::~Application() {
 
 	delete m_blitToSwapChainPass;
 	delete m_toneMappingPass;
+	delete m_temporalAntiAliasingPass;
+	delete m_lightProbeRelightingPass;
+	delete m_shadowDenoisingPass;
+	delete m_computeShadowPass;
 	delete m_raytracingPass;
-	delete m_deferredLightingPass;
+	delete m_raytracingScene;
+	// the GBuffer pass cleans the lighting pass when it is on tile
 	delete m_gBufferPass;
+	delete m_deferredLightingPass;
+
+	delete m_gpuFrameTimer;
 
 	vkDestroySemaphore(m_device->handle(), m_imageAvailableSemaphore, nullptr);
 	vkDestroyFence(m_device->handle(), m_inFlightFence, nullptr);
@@ -151,28 +212,53 @@ void Application::createSizeDependentObjects() {
 		// from here, this is a test application
 		/////////////////////////////////////////////
 
+		// the images of the passes before the upscaling have the maximum resolution, see applyRenderScale
+		// on tile, the GBuffer pass recreates the lighting pass
 		m_gBufferPass->recreateOnRenderTargetResized(m_width, m_height, m_mesh, m_modelTexture);
-		m_deferredLightingPass->recreateOnRenderTargetResized(m_width, m_height, m_gBufferPass->albedoImage(), m_gBufferPass->normalImage(), m_gBufferPass->depthImage());
+		if (!m_isLightingOnTile)
+			m_deferredLightingPass->recreateOnRenderTargetResized(m_width, m_height, m_gBufferPass->albedoImage(), m_gBufferPass->normalImage(), m_gBufferPass->depthImage());
 
 		if (m_raytracingPass != nullptr)
-			m_raytracingPass->recreateOnRenderTargetResized(m_width, m_height, m_gBufferPass->depthImage(), m_gBufferPass->normalImage(), m_deferredLightingPass->outputImage());
-#ifdef AMANO_USE_RAYTRACING
-		m_toneMappingPass->recreateOnRenderTargetResized(m_width, m_height, m_raytracingPass->outputImage());
-#else
-		m_toneMappingPass->recreateOnRenderTargetResized(m_width, m_height, m_deferredLightingPass->outputImage());
-#endif
-		m_blitToSwapChainPass->recreateOnRenderTargetResized(m_width, m_height, m_toneMappingPass->outputImage());
+			m_raytracingPass->recreateOnRenderTargetResized(m_width, m_height, m_gBufferPass->depthImage(), m_gBufferPass->normalImage());
+		if (m_computeShadowPass != nullptr)
+			m_computeShadowPass->recreateOnRenderTargetResized(m_width, m_height, m_gBufferPass->depthImage(), m_gBufferPass->normalImage());
+		if (m_shadowDenoisingPass != nullptr) {
+			Image* visibilityImage = (m_raytracingPass != nullptr) ? m_raytracingPass->outputImage() : m_computeShadowPass->outputImage();
+			m_shadowDenoisingPass->recreateOnRenderTargetResized(m_width, m_height, visibilityImage, m_gBufferPass->depthImage(), m_gBufferPass->normalImage(), m_deferredLightingPass->outputImage());
+		}
+		// the lit color, with the shadows when there are some
+		Image* colorImage = (m_shadowDenoisingPass != nullptr) ? m_shadowDenoisingPass->outputImage() : m_deferredLightingPass->outputImage();
+		if (m_temporalAntiAliasingPass != nullptr) {
+			m_temporalAntiAliasingPass->recreateOnRenderTargetResized(m_width, m_height, colorImage, m_gBufferPass->depthImage(), m_gBufferPass->velocityImage());
+			colorImage = m_temporalAntiAliasingPass->outputImage();
+		}
+		if (m_toneMappingPass != nullptr) {
+			m_toneMappingPass->recreateOnRenderTargetResized(m_width, m_height, colorImage);
+			m_blitToSwapChainPass->recreateOnRenderTargetResized(m_width, m_height, m_toneMappingPass->outputImage());
+		}
+		else {
+			// the lighting is already tone mapped
+			m_blitToSwapChainPass->recreateOnRenderTargetResized(m_width, m_height, m_deferredLightingPass->outputImage());
+		}
 		m_guiSystem->recreateOnRenderTargetResized(m_width, m_height);
+
+		applyRenderScale();
 	}
 }
 
 void Application::cleanSizedependentObjects() {
 	if (m_gBufferPass != nullptr)
 		m_gBufferPass->cleanOnRenderTargetResized();
-	if (m_deferredLightingPass != nullptr)
+	if (m_deferredLightingPass != nullptr && !m_isLightingOnTile)
 		m_deferredLightingPass->cleanOnRenderTargetResized();
 	if (m_raytracingPass != nullptr)
 		m_raytracingPass->cleanOnRenderTargetResized();
+	if (m_computeShadowPass != nullptr)
+		m_computeShadowPass->cleanOnRenderTargetResized();
+	if (m_shadowDenoisingPass != nullptr)
+		m_shadowDenoisingPass->cleanOnRenderTargetResized();
+	if (m_temporalAntiAliasingPass != nullptr)
+		m_temporalAntiAliasingPass->cleanOnRenderTargetResized();
 	if (m_toneMappingPass != nullptr)
 		m_toneMappingPass->cleanOnRenderTargetResized();
 	if (m_blitToSwapChainPass != nullptr)
@@ -210,60 +296,162 @@ bool Application::init() {
 		return false;
 	}
 
+	// the dynamic resolution follows the GPU time of the frames
+	// it starts when the GBuffer pass gets the swapchain image, see the wait of the GBuffer pass
+	m_gpuFrameTimer = new GpuFrameTimer(m_device);
+	if (!m_gpuFrameTimer->init(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)) {
+		delete m_gpuFrameTimer;
+		m_gpuFrameTimer = nullptr;
+	}
+
 	// load the model to display
 	m_mesh = new Mesh(m_device);
 	m_mesh->create("assets/models/sphere.obj");
 
+#ifdef AMANO_BVH_BENCHMARK
+	Bvh meshBvh;
+	meshBvh.build(*m_mesh);
+	meshBvh.benchmark(1 << 20);
+#endif
+
 	// load the texture of the model
 	m_modelTexture = new Image(m_device);
 	m_modelTexture->create2D("assets/textures/white.png", *m_device->getQueue(QueueType::eGraphics), true);
 	m_modelTexture->createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR);
 
+	// on tile based GPUs, the GBuffer can stay in the tile memory, at the cost of the shadows, the probe relighting and the TAA
+	// it is opt-in with the AMANO_LIGHTING_ON_TILE environment variable, and needs a lazily allocated memory type
+	const char* lightingOnTile = std::getenv("AMANO_LIGHTING_ON_TILE");
+	if (lightingOnTile != nullptr && std::strcmp(lightingOnTile, "0") != 0) {
+		m_isLightingOnTile = m_device->getCapabilities().lazilyAllocatedMemory;
+		if (!m_isLightingOnTile)
+			std::cerr << "AMANO_LIGHTING_ON_TILE ignored, the device has no lazily allocated memory" << std::endl;
+	}
+
 	/////////////////////////////////////////////
 	// GBuffer pass
 	/////////////////////////////////////////////
+	m_deferredLightingPass = new DeferredLightingPass(m_device);
 	m_gBufferPass = new GBufferPass(m_device);
 	m_gBufferPass->addWaitSemaphore(m_imageAvailableSemaphore, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT); // VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
-	if (!m_gBufferPass->init())
+	m_gBufferPass->setFrameTimer(m_gpuFrameTimer);
+	if (!m_gBufferPass->init(m_isLightingOnTile ? m_deferredLightingPass : nullptr))
 		return false;
 
 	/////////////////////////////////////////////
 	// Deferred lighting
 	/////////////////////////////////////////////
-	m_deferredLightingPass = new DeferredLightingPass(m_device);
-	m_deferredLightingPass->addWaitSemaphore(m_gBufferPass->signalSemaphore(), m_gBufferPass->pipelineStage());
-	if (!m_deferredLightingPass->init())
-		return false;
+	// the shadow passes and the TAA read the HDR lighting, so the tone mapping has its own pass
+	// without them, it is done by the lighting shader, which saves a full screen read and write
+	// it is opt-in with the AMANO_FUSED_TONE_MAPPING environment variable, at the cost of the shadows and the TAA
+	const char* fusedToneMapping = std::getenv("AMANO_FUSED_TONE_MAPPING");
+	bool fuseToneMapping = fusedToneMapping != nullptr && std::strcmp(fusedToneMapping, "0") != 0;
+	if (m_isLightingOnTile) {
+		// the lighting is the second subpass of the GBuffer pass, it is always tone mapped
+		// the shadow passes would need the GBuffer in memory, there are no shadows on this path
+		fuseToneMapping = true;
+		if (!m_deferredLightingPass->initOnTile(m_mesh->getBoundingSphere(), m_gBufferPass->renderPass(), cOnTileLightingSubpass))
+			return false;
+	}
+	else {
+		m_deferredLightingPass->addWaitSemaphore(m_gBufferPass->signalSemaphore(), m_gBufferPass->pipelineStage());
+		if (!m_deferredLightingPass->init(m_mesh->getBoundingSphere(), fuseToneMapping))
+			return false;
+	}
+	createPointLights();
 
 	/////////////////////////////////////////////
 	// Raytracing
 	/////////////////////////////////////////////
-#ifdef AMANO_USE_RAYTRACING
-	std::vector<Mesh*> meshes;
-	meshes.push_back(m_mesh);
-	m_raytracingPass = new RaytracingShadowPass(m_device);
-	m_raytracingPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
-	if (!m_raytracingPass->init(meshes))
-		return false;
-#endif
+	// the device is picked with a preference for the raytracing extensions, the compute path covers the others
+	// the shadow passes need the GBuffer in memory, there are none when the lighting is on tile
+	if (!m_isLightingOnTile && m_device->getCapabilities().raytracing) {
+		std::vector<Mesh*> meshes;
+		meshes.push_back(m_mesh);
+		// the model can be deformed from the UI
+		m_raytracingScene = new RaytracingScene(m_device);
+		if (!m_raytracingScene->create(meshes, meshes))
+			return false;
+
+		if (!fuseToneMapping) {
+			m_raytracingPass = new RaytracingShadowPass(m_device);
+			m_raytracingPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
+			if (!m_raytracingPass->init(m_raytracingScene))
+				return false;
+		}
+
+		// a few probes of the grid are relit every frame, before the lighting reads them
+		m_lightProbeRelightingPass = new LightProbeRelightingPass(m_device);
+		if (!m_lightProbeRelightingPass->init(m_raytracingScene, m_deferredLightingPass, m_modelTexture))
+			return false;
+		m_deferredLightingPass->addWaitSemaphore(m_lightProbeRelightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
+		m_deferredLightingPass->lightProbeGrid()->setEnabled(true);
+	}
+	else if (!m_isLightingOnTile && !fuseToneMapping) {
+		// the shadows are traced in a compute shader, against a BVH of the same meshes as the raytracing scene
+		Bvh sceneBvh;
+		sceneBvh.build(*m_mesh);
+
+		m_computeShadowPass = new ComputeShadowPass(m_device);
+		m_computeShadowPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
+		if (!m_computeShadowPass->init(sceneBvh))
+			return false;
+	}
+
+	// both shadow passes trace one ray per pixel toward the area light
+	if (m_raytracingPass != nullptr || m_computeShadowPass != nullptr) {
+		m_shadowDenoisingPass = new ShadowDenoisingPass(m_device);
+		if (m_raytracingPass != nullptr)
+			m_shadowDenoisingPass->addWaitSemaphore(m_raytracingPass->signalSemaphore(), m_raytracingPass->pipelineStage());
+		else
+			m_shadowDenoisingPass->addWaitSemaphore(m_computeShadowPass->signalSemaphore(), m_computeShadowPass->pipelineStage());
+		if (!m_shadowDenoisingPass->init())
+			return false;
+	}
+	applyShadowTraceSettings();
+
+	/////////////////////////////////////////////
+	// Temporal anti-aliasing
+	/////////////////////////////////////////////
+	// it resolves the HDR color, which is only stored when the lighting isn't on tile
+	// it also upscales the frame when the render resolution is lower than the window one
+	if (!m_isLightingOnTile && !fuseToneMapping) {
+		m_temporalAntiAliasingPass = new TemporalAntiAliasingPass(m_device);
+		if (m_shadowDenoisingPass != nullptr)
+			m_temporalAntiAliasingPass->addWaitSemaphore(m_shadowDenoisingPass->signalSemaphore(), m_shadowDenoisingPass->pipelineStage());
+		else
+			m_temporalAntiAliasingPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
+		if (!m_temporalAntiAliasingPass->init())
+			return false;
+		m_dynamicResolution.setScaleRange(MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+	}
 
 	/////////////////////////////////////////////
 	// Tone mapping
 	/////////////////////////////////////////////
-	m_toneMappingPass = new ToneMappingPass(m_device);
-#ifdef AMANO_USE_RAYTRACING
-	m_toneMappingPass->addWaitSemaphore(m_raytracingPass->signalSemaphore(), m_raytracingPass->pipelineStage());
-#else
-	m_toneMappingPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
-#endif
-	if (!m_toneMappingPass->init())
-		return false;
+	if (!fuseToneMapping) {
+		m_toneMappingPass = new ToneMappingPass(m_device);
+		if (m_temporalAntiAliasingPass != nullptr)
+			m_toneMappingPass->addWaitSemaphore(m_temporalAntiAliasingPass->signalSemaphore(), m_temporalAntiAliasingPass->pipelineStage());
+		else if (m_shadowDenoisingPass != nullptr)
+			m_toneMappingPass->addWaitSemaphore(m_shadowDenoisingPass->signalSemaphore(), m_shadowDenoisingPass->pipelineStage());
+		else
+			m_toneMappingPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), m_deferredLightingPass->pipelineStage());
+		if (!m_toneMappingPass->init())
+			return false;
+	}
 
 	/////////////////////////////////////////////
 	// Blit
 	/////////////////////////////////////////////
 	m_blitToSwapChainPass = new BlitToSwapChainPass(m_device);
-	m_blitToSwapChainPass->addWaitSemaphore(m_toneMappingPass->signalSemaphore(), m_toneMappingPass->pipelineStage());
+	m_blitToSwapChainPass->setFrameTimer(m_gpuFrameTimer);
+	if (m_toneMappingPass != nullptr)
+		m_blitToSwapChainPass->addWaitSemaphore(m_toneMappingPass->signalSemaphore(), m_toneMappingPass->pipelineStage());
+	else if (m_isLightingOnTile)
+		m_blitToSwapChainPass->addWaitSemaphore(m_gBufferPass->signalSemaphore(), VK_PIPELINE_STAGE_TRANSFER_BIT);
+	else
+		m_blitToSwapChainPass->addWaitSemaphore(m_deferredLightingPass->signalSemaphore(), VK_PIPELINE_STAGE_TRANSFER_BIT);
 	
 	/////////////////////////////////////////////
 	// UI
@@ -305,6 +493,26 @@ void Application::drawFrame() {
 		recreateSwapChain();
 	}
 
+	// switch the light culling of the lighting pass
+	auto lightCullingMode = m_useTiledLightCulling ? DeferredLightingPass::LightCullingMode::eTiled : DeferredLightingPass::LightCullingMode::eClustered;
+	if (lightCullingMode != m_deferredLightingPass->getLightCullingMode()) {
+		m_device->waitIdle();
+		m_deferredLightingPass->setLightCullingMode(lightCullingMode);
+		m_deferredLightingPass->recordCommands(m_renderWidth, m_renderHeight);
+	}
+
+	// switch the resolution of the shadow rays, the visibility images are resized
+	ShadowTraceSettings shadowTraceSettings = getShadowTraceSettings();
+	if (shadowTraceSettings != m_shadowTraceSettings) {
+		applyShadowTraceSettings();
+		recreateSwapChain();
+	}
+
+	// switch the render resolution, only the commands of the passes before the upscaling are recorded again
+	m_dynamicResolution.setTargetFrameTime(m_targetFrameTime);
+	if (getRenderScale() != m_currentRenderScale)
+		applyRenderScale();
+
 	// get the next image in the swapchain
 	uint32_t imageIndex;
 	auto result = m_device->acquireNextImage(m_imageAvailableSemaphore, imageIndex);
@@ -320,26 +528,55 @@ void Application::drawFrame() {
 	// now that we know that the previous frame is finished, we can update the buffers
 	updateUniformBuffers();
 
+	// the frame time measures the GPU work of the frame, between the timestamps of the timer
+	// without them, it is measured on the CPU from the first submit until the queue is idle
+	auto frameStartTime = std::chrono::high_resolution_clock::now();
+	if (m_gpuFrameTimer != nullptr)
+		m_gpuFrameTimer->startFrame();
+
 	// submit GBuffer
 	if (!m_gBufferPass->submit())
 		return;
 
-	// submit deferred lighting
-	if (!m_deferredLightingPass->submit())
+	// refit or rebuild the top level acceleration structure before tracing rays
+	if (m_raytracingScene != nullptr && !m_raytracingScene->submit())
+		return;
+
+	// submit light probe relighting
+	if (m_lightProbeRelightingPass != nullptr && !m_lightProbeRelightingPass->submit())
+		return;
+
+	// submit deferred lighting, on tile it is submitted with the GBuffer
+	if (!m_isLightingOnTile && !m_deferredLightingPass->submit())
 		return;
 
 	// submit raytracing
 	if (m_raytracingPass != nullptr && !m_raytracingPass->submit())
 		return;
 
+	// submit the compute shadows
+	if (m_computeShadowPass != nullptr && !m_computeShadowPass->submit())
+		return;
+
+	// submit the shadow denoising
+	if (m_shadowDenoisingPass != nullptr && !m_shadowDenoisingPass->submit())
+		return;
+
+	// submit the temporal anti-aliasing
+	if (m_temporalAntiAliasingPass != nullptr && !m_temporalAntiAliasingPass->submit())
+		return;
+
 	// submit tone mapping
-	if (!m_toneMappingPass->submit())
+	if (m_toneMappingPass != nullptr && !m_toneMappingPass->submit())
 		return;
 
 	// submit blit
 	if (!m_blitToSwapChainPass->submit(imageIndex, VK_NULL_HANDLE))
 		return;
 
+	if (m_gpuFrameTimer != nullptr)
+		m_gpuFrameTimer->endFrame();
+
 	// udpate UI
 	drawUI(imageIndex);
 	
@@ -357,6 +594,13 @@ void Application::drawFrame() {
 	}
 
 	m_device->wait();
+
+	// reading the timestamps waits for the end of the frame, the next one can then reset them
+	auto frameEndTime = std::chrono::high_resolution_clock::now();
+	float frameTime = std::chrono::duration<float, std::chrono::milliseconds::period>(frameEndTime - frameStartTime).count();
+	bool isFrameTimeValid = (m_gpuFrameTimer == nullptr) || m_gpuFrameTimer->getFrameTime(frameTime);
+	if (m_useDynamicResolution && isFrameTimeValid)
+		m_dynamicResolution.update(frameTime);
 }
 
 void Application::drawUI(uint32_t imageIndex) {
@@ -367,15 +611,141 @@ void Application::drawUI(uint32_t imageIndex) {
 
 	ImGui::Begin("Light information");
 	ImGui::DragFloat3("position", &m_lightPosition[0], 0.01f, 1.0f, 1.0f);
+	ImGui::SliderFloat("radius", &m_lightRadius, 0.0f, 0.5f);
+	ImGui::SliderInt("point lights", &m_pointLightCount, 0, static_cast<int>(cMaxPointLights));
+	// the light culling can't be tiled in the lighting subpass
+	if (!m_isLightingOnTile)
+		ImGui::Checkbox("tiled light culling", &m_useTiledLightCulling);
+	ImGui::End();
+
+	if (m_raytracingScene != nullptr) {
+		ImGui::Begin("Scene");
+		ImGui::Checkbox("rotate model", &m_isModelRotating);
+		ImGui::Checkbox("deform model", &m_isModelDeforming);
+		ImGui::End();
+	}
+
+	if (m_shadowDenoisingPass != nullptr) {
+		ImGui::Begin("Shadows");
+		ImGui::Combo("ray resolution", &m_shadowResolution, "full\0half\0quarter\0");
+		ImGui::Checkbox("checkerboard", &m_useCheckerboardShadows);
+		ImGui::End();
+	}
+
+	if (m_temporalAntiAliasingPass != nullptr) {
+		ImGui::Begin("Anti-aliasing");
+		ImGui::Checkbox("temporal", &m_useTemporalAntiAliasing);
+		ImGui::End();
+
+		ImGui::Begin("Resolution");
+		ImGui::Checkbox("dynamic resolution", &m_useDynamicResolution);
+		if (m_useDynamicResolution) {
+			ImGui::SliderFloat("target frame time (ms)", &m_targetFrameTime, 4.0f, 33.3f);
+			ImGui::Text("%s frame time: %.2f ms", (m_gpuFrameTimer != nullptr) ? "GPU" : "CPU", m_dynamicResolution.averageFrameTime());
+		}
+		else {
+			ImGui::SliderFloat("render scale", &m_renderScale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+		}
+		ImGui::Text("render: %u x %u", m_renderWidth, m_renderHeight);
+		ImGui::End();
+	}
+
+	ImGui::Begin("Level of detail");
+	ImGui::SliderFloat("max pixel error", &m_maxLodPixelError, 0.0f, 16.0f);
+	ImGui::Text("lod: %u / %u", m_selectedLod, m_mesh->getLodCount());
 	ImGui::End();
 
 	m_guiSystem->endFrame(imageIndex, m_width, m_height, m_inFlightFence);
 }
 
+float Application::getRenderScale() const {
+	// without the temporal anti-aliasing, nothing upscales the frame
+	if (m_temporalAntiAliasingPass == nullptr)
+		return 1.0f;
+	return m_useDynamicResolution ? m_dynamicResolution.scale() : m_renderScale;
+}
+
+void Application::applyRenderScale() {
+	m_currentRenderScale = getRenderScale();
+	m_renderWidth = std::max(1u, static_cast<uint32_t>(m_currentRenderScale * m_width + 0.5f));
+	m_renderHeight = std::max(1u, static_cast<uint32_t>(m_currentRenderScale * m_height + 0.5f));
+
+	// the previous frame is finished, its command buffers can be recorded again
+	// the passes render in the top left area of their images, nothing is reallocated
+	m_gBufferPass->recordCommands(m_renderWidth, m_renderHeight, m_mesh);
+	if (!m_isLightingOnTile)
+		m_deferredLightingPass->recordCommands(m_renderWidth, m_renderHeight);
+	if (m_raytracingPass != nullptr)
+		m_raytracingPass->recordCommands(m_renderWidth, m_renderHeight);
+	if (m_computeShadowPass != nullptr)
+		m_computeShadowPass->recordCommands(m_renderWidth, m_renderHeight);
+	if (m_shadowDenoisingPass != nullptr)
+		m_shadowDenoisingPass->recordCommands(m_renderWidth, m_renderHeight);
+}
+
+ShadowTraceSettings Application::getShadowTraceSettings() const {
+	ShadowTraceSettings settings;
+	settings.resolutionScale = 1u << static_cast<uint32_t>(m_shadowResolution);
+	settings.isCheckerboarded = m_useCheckerboardShadows;
+	return settings;
+}
+
+void Application::applyShadowTraceSettings() {
+	m_shadowTraceSettings = getShadowTraceSettings();
+	if (m_raytracingPass != nullptr)
+		m_raytracingPass->setTraceSettings(m_shadowTraceSettings);
+	if (m_computeShadowPass != nullptr)
+		m_computeShadowPass->setTraceSettings(m_shadowTraceSettings);
+	if (m_shadowDenoisingPass != nullptr)
+		m_shadowDenoisingPass->setTraceSettings(m_shadowTraceSettings);
+}
+
+void Application::createPointLights() {
+	// the lights are randomly placed around the model, the seed is fixed to get the same scene every time
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	m_pointLights.resize(cMaxPointLights);
+	m_pointLightOrbits.resize(cMaxPointLights);
+	for (uint32_t i = 0; i < cMaxPointLights; ++i) {
+		m_pointLightOrbits[i] = glm::vec4(
+			0.6f + 2.0f * unit(generator),              // radius
+			2.0f * unit(generator) - 1.0f,              // height
+			glm::two_pi<float>() * unit(generator),     // phase
+			0.2f + 0.8f * unit(generator));             // angular speed
+
+		m_pointLights[i].positionAndRadius = glm::vec4(0.0f, 0.0f, 0.0f, 0.4f);
+		m_pointLights[i].colorAndIntensity = glm::vec4(unit(generator), unit(generator), unit(generator), 1.0f);
+	}
+}
+
+void Application::deformModel(float time) {
+	// the previous frame is finished, the GBuffer doesn't read the vertex buffer anymore
+	const std::vector<Vertex>& vertices = m_mesh->getVertices();
+	glm::vec4 boundingSphere = m_mesh->getBoundingSphere();
+	float amplitude = m_isModelDeforming ? MODEL_DEFORMATION_AMPLITUDE * boundingSphere.w : 0.0f;
+	float waveNumber = MODEL_DEFORMATION_WAVES / boundingSphere.w;
+
+	// waves along the vertical axis, the normals are kept
+	m_deformedVertices.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		m_deformedVertices[i] = vertices[i];
+		m_deformedVertices[i].pos += vertices[i].normal * (amplitude * sinf(waveNumber * vertices[i].pos.z - MODEL_DEFORMATION_SPEED * time));
+	}
+
+	if (!m_mesh->updateVertices(m_deformedVertices))
+		return;
+	m_raytracingScene->updateMeshVertices(0);
+	m_isModelDeformed = m_isModelDeforming;
+}
+
 void Application::updateUniformBuffers() {
 	static auto startTime = std::chrono::high_resolution_clock::now();
 	auto currentTime = std::chrono::high_resolution_clock::now();
 	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+	static float previousTime = time;
+	float deltaTime = time - previousTime;
+	previousTime = time;
 	//glm::vec3 origin = glm::vec3(2.8f * cosf(time), 2.8f * sinf(time), 2.0f);
 
 	//float angleRadians = glm::radians(m_cameraAngle);
@@ -384,15 +754,44 @@ void Application::updateUniformBuffers() {
 
 	// update the gbuffer shader uniform
 	PerFrameUniformBufferObject ubo{};
-	//ubo.model = glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.model = glm::mat4(1.0f);
+	// the BVH of the compute shadows is built once, the model only turns with the raytracing scene
+	// the instance of the model has the id 0, it is the first mesh given to the scene
+	bool isModelRotating = m_raytracingScene != nullptr && m_isModelRotating;
+	if (isModelRotating)
+		m_modelAngle += MODEL_ROTATION_SPEED * deltaTime;
+	ubo.model = glm::rotate(glm::mat4(1.0f), m_modelAngle, glm::vec3(0.0f, 0.0f, 1.0f));
+	if (isModelRotating)
+		m_raytracingScene->setInstanceTransform(0, ubo.model);
+	if (m_raytracingScene != nullptr && (m_isModelDeforming || m_isModelDeformed))
+		deformModel(time);
 	ubo.view = glm::lookAt(origin, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.proj = glm::perspective(glm::radians(45.0f), m_width / (float)m_height, 0.1f, 10.0f);
+	float fovy = glm::radians(45.0f);
+	ubo.proj = glm::perspective(fovy, m_width / (float)m_height, NEAR_PLANE, FAR_PLANE);
 
 	// glm uses the opengl convention, so we need to flip the Y axis of the projection
 	// TODO: fix this by implementing our own projection method
 	ubo.proj[1][1] *= -1;
 
+	// the velocity and the temporal anti-aliasing reproject without the jitter
+	// the GBuffer applies previousViewProj to the current world position, so it also brings it back to the previous model transform
+	glm::mat4 viewProj = ubo.proj * ubo.view;
+	ubo.previousViewProj = (m_frameIndex == 0) ? viewProj : m_previousViewProj * m_previousModel * glm::inverse(ubo.model);
+	m_previousViewProj = viewProj;
+	m_previousModel = ubo.model;
+
+	// the projection is offset by a different sub-pixel amount every frame, the temporal anti-aliasing accumulates the samples
+	bool isJittered = m_temporalAntiAliasingPass != nullptr && m_useTemporalAntiAliasing;
+	if (m_temporalAntiAliasingPass != nullptr)
+		m_temporalAntiAliasingPass->setEnabled(isJittered);
+	glm::vec2 jitterPixels = glm::vec2(0.0f);
+	if (isJittered) {
+		// the offset is a fraction of a render pixel
+		jitterPixels = getTemporalJitter(m_frameIndex, m_currentRenderScale);
+		glm::vec2 jitter = jitterPixels * glm::vec2(2.0f / m_renderWidth, 2.0f / m_renderHeight);
+		ubo.proj = glm::translate(glm::mat4(1.0f), glm::vec3(jitter, 0.0f)) * ubo.proj;
+		ubo.jitter = glm::vec4(jitter, 0.0f, 0.0f);
+	}
+
 	// update the raytracing shader uniform
 	RayParams rayUbo{};
 	rayUbo.viewInverse = glm::inverse(ubo.view);
@@ -402,20 +801,62 @@ void Application::updateUniformBuffers() {
 	// update the light position
 	LightInformation lightUbo;
 	lightUbo.lightPosition = m_lightPosition;
+	lightUbo.lightRadius = m_lightRadius;
+	lightUbo.frameIndex = m_frameIndex++;
+
+	// animate the point lights
+	uint32_t pointLightCount = static_cast<uint32_t>(m_pointLightCount);
+	for (uint32_t i = 0; i < pointLightCount; ++i) {
+		const glm::vec4& orbit = m_pointLightOrbits[i];
+		float angle = orbit.z + orbit.w * time;
+		m_pointLights[i].positionAndRadius.x = orbit.x * cosf(angle);
+		m_pointLights[i].positionAndRadius.y = orbit.x * sinf(angle);
+		m_pointLights[i].positionAndRadius.z = orbit.y;
+	}
+
+	LightClusterParams lightClusterUbo{};
+	lightClusterUbo.view = ubo.view;
+	lightClusterUbo.projInverse = rayUbo.projInverse;
+	lightClusterUbo.screenSizeAndDepthRange.z = NEAR_PLANE;
+	lightClusterUbo.screenSizeAndDepthRange.w = FAR_PLANE;
+
+	// select the level of detail of the mesh from its error projected on screen
+	float projectionScale = m_renderHeight / (2.0f * tanf(0.5f * fovy));
+	m_selectedLod = m_mesh->selectLod(ubo.model, origin, projectionScale, m_maxLodPixelError);
 
 	if (m_gBufferPass != nullptr) {
-		m_gBufferPass->updateUniformBuffer(ubo);
+		m_gBufferPass->updateUniformBuffer(ubo, m_selectedLod);
 	}
 
 	if (m_deferredLightingPass != nullptr) {
 		m_deferredLightingPass->updateUniformBuffer(rayUbo);
 		m_deferredLightingPass->updateLightUniformBuffer(lightUbo);
+		m_deferredLightingPass->updatePointLights(m_pointLights.data(), pointLightCount);
+		m_deferredLightingPass->updateLightClusterUniformBuffer(lightClusterUbo);
 	}
 
 	if (m_raytracingPass != nullptr) {
 		m_raytracingPass->updateRayUniformBuffer(rayUbo);
 		m_raytracingPass->updateLightUniformBuffer(lightUbo);
 	}
+
+	if (m_computeShadowPass != nullptr) {
+		m_computeShadowPass->updateRayUniformBuffer(rayUbo);
+		m_computeShadowPass->updateLightUniformBuffer(lightUbo);
+	}
+
+	if (m_shadowDenoisingPass != nullptr) {
+		m_shadowDenoisingPass->updateUniformBuffer(ubo.proj * ubo.view, lightUbo.frameIndex);
+	}
+
+	if (m_temporalAntiAliasingPass != nullptr) {
+		m_temporalAntiAliasingPass->updateUniformBuffer(viewProj, jitterPixels, glm::uvec2(m_renderWidth, m_renderHeight));
+	}
+
+	if (m_lightProbeRelightingPass != nullptr) {
+		m_lightProbeRelightingPass->updateUniformBuffer(pointLightCount);
+		m_lightProbeRelightingPass->updateLightUniformBuffer(lightUbo);
+	}
 }
 
 }
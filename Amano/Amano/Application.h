@@ -4,18 +4,25 @@
 #include "glm.h"
 #include "DebugOrbitCamera.h"
 #include "Device.h"
+#include "DynamicResolution.h"
+#include "GpuFrameTimer.h"
 #include "Image.h"
 #include "InputSystem.h"
 #include "Mesh.h"
+#include "RaytracingScene.h"
 #include "Ubo.h"
 #include "UniformBuffer.h"
 #include "Builder/RaytracingAccelerationStructureBuilder.h"
 #include "Builder/ShaderBindingTableBuilder.h"
 #include "Pass/BlitToSwapChainPass.h"
+#include "Pass/ComputeShadowPass.h"
 #include "Pass/DeferredLightingPass.h"
 #include "Pass/GBufferPass.h"
 #include "Pass/ImGuiSystem.h"
+#include "Pass/LightProbeRelightingPass.h"
 #include "Pass/RaytracingShadowPass.h"
+#include "Pass/ShadowDenoisingPass.h"
+#include "Pass/TemporalAntiAliasingPass.h"
 #include "Pass/ToneMappingPass.h"
 
 namespace Amano {
@@ -49,7 +56,17 @@ private:
 
 	void drawFrame();
 	void drawUI(uint32_t imageIndex);
+	// the scale of the render resolution, the temporal anti-aliasing upscales the frame to the window
+	float getRenderScale() const;
 	void updateUniformBuffers();
+	void createPointLights();
+	// moves the vertices of the model, its bottom level structure follows
+	void deformModel(float time);
+	// the settings of the shadow passes, from the UI
+	ShadowTraceSettings getShadowTraceSettings() const;
+	void applyShadowTraceSettings();
+	// the passes before the upscaling record their commands for the resolution of getRenderScale
+	void applyRenderScale();
 
 private:
 	GLFWwindow* m_window;
@@ -63,6 +80,17 @@ private:
 	// The height of the window
 	uint32_t m_height;
 
+	// The resolution of the passes before the upscaling
+	// Their images keep the window resolution, only the rendered area of the images changes
+	uint32_t m_renderWidth;
+	uint32_t m_renderHeight;
+	float m_currentRenderScale;  // the commands are recorded again when getRenderScale changes
+	float m_renderScale;         // from the UI, when the dynamic resolution is disabled
+	bool m_useDynamicResolution;
+	float m_targetFrameTime;     // in milliseconds, from the UI
+	DynamicResolution m_dynamicResolution;
+	GpuFrameTimer* m_gpuFrameTimer;  // null when the device has no timestamps, the frame time is measured on the CPU instead
+
 	Device* m_device;
 
 	InputSystem* m_inputSystem;
@@ -81,9 +109,36 @@ private:
 
 	// for lighting shader
 	DeferredLightingPass* m_deferredLightingPass;
+	bool m_isLightingOnTile;  // the lighting is a subpass of the GBuffer pass, opt-in for tile based GPUs
 
 	// for raytracing
+	RaytracingScene* m_raytracingScene;
 	RaytracingShadowPass* m_raytracingPass;
+	// the model turns with its instance of the raytracing scene, the top level structure is refitted every frame
+	bool m_isModelRotating;
+	float m_modelAngle;
+	glm::mat4 m_previousModel;  // for the velocity of the GBuffer
+	// the vertices of the model are written every frame while it deforms, its bottom level structure is refitted
+	bool m_isModelDeforming;
+	bool m_isModelDeformed;  // the loaded vertices are written back once the deformation stops
+	std::vector<Vertex> m_deformedVertices;
+
+	// traces the same shadows against a BVH when the raytracing extensions are missing
+	ComputeShadowPass* m_computeShadowPass;
+
+	// converges the shadows traced at one ray per pixel
+	ShadowDenoisingPass* m_shadowDenoisingPass;
+	ShadowTraceSettings m_shadowTraceSettings;  // the shadow passes are recreated when they change
+	int m_shadowResolution;                     // index in full, half and quarter resolution
+	bool m_useCheckerboardShadows;
+
+	// relights the light probe grid of the lighting pass
+	LightProbeRelightingPass* m_lightProbeRelightingPass;
+
+	// accumulates the jittered frames, the projection is only jittered when it is enabled
+	TemporalAntiAliasingPass* m_temporalAntiAliasingPass;
+	bool m_useTemporalAntiAliasing;
+	glm::mat4 m_previousViewProj;  // without the jitter, for the velocity of the GBuffer
 
 	// for tone mapping
 	ToneMappingPass* m_toneMappingPass;
@@ -93,6 +148,18 @@ private:
 
 	// light information
 	glm::vec3 m_lightPosition;
+	float m_lightRadius;
+	uint32_t m_frameIndex;  // the shadow passes sample other points of the light every frame
+
+	// point lights, they orbit around the model
+	std::vector<PointLight> m_pointLights;
+	std::vector<glm::vec4> m_pointLightOrbits;  // radius, height, phase and angular speed
+	int m_pointLightCount;
+	bool m_useTiledLightCulling;  // the lighting pass is recorded again when it changes
+
+	// level of detail selection
+	float m_maxLodPixelError;
+	uint32_t m_selectedLod;
 };
 
 }
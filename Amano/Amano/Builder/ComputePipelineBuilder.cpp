@@ -20,20 +20,47 @@ ComputePipelineBuilder& ComputePipelineBuilder::addShader(const std::string& fil
 	return *this;
 }
 
+ComputePipelineBuilder& ComputePipelineBuilder::addSpecializationConstant(uint32_t constantId, uint32_t value) {
+	VkSpecializationMapEntry entry{};
+	entry.constantID = constantId;
+	entry.offset = static_cast<uint32_t>(sizeof(uint32_t) * m_specializationData.size());
+	entry.size = sizeof(uint32_t);
+	m_specializationEntries.push_back(entry);
+	m_specializationData.push_back(value);
+	return *this;
+}
+
+ComputePipelineBuilder& ComputePipelineBuilder::setWorkgroupSize(uint32_t x, uint32_t y, uint32_t z) {
+	return addSpecializationConstant(cWorkgroupSizeXConstantId, x)
+		.addSpecializationConstant(cWorkgroupSizeYConstantId, y)
+		.addSpecializationConstant(cWorkgroupSizeZConstantId, z);
+}
+
+ComputePipelineBuilder& ComputePipelineBuilder::setWorkgroupSize(VkExtent2D workgroupSize) {
+	return setWorkgroupSize(workgroupSize.width, workgroupSize.height);
+}
+
 VkPipeline ComputePipelineBuilder::build(VkPipelineLayout pipelineLayout) {
+	VkSpecializationInfo specializationInfo{};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(m_specializationEntries.size());
+	specializationInfo.pMapEntries = m_specializationEntries.data();
+	specializationInfo.dataSize = sizeof(uint32_t) * m_specializationData.size();
+	specializationInfo.pData = m_specializationData.data();
 
 	VkComputePipelineCreateInfo pipelineInfo{};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 	pipelineInfo.pNext = nullptr;
 	pipelineInfo.flags = 0;
 	pipelineInfo.stage = m_shaderStages[0];
+	if (!m_specializationEntries.empty())
+		pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;  // Optional
 	pipelineInfo.basePipelineIndex = 0;  // Optional
 	
 	VkPipeline pipeline = VK_NULL_HANDLE;
 	if (vkCreateComputePipelines(m_device->handle(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
-		std::cerr << "failed to create graphics pipeline!" << std::endl;
+		std::cerr << "failed to create compute pipeline!" << std::endl;
 	}
 
 	return pipeline;
@@ -5,6 +5,12 @@
 
 namespace Amano {
 
+// Specialization constant ids of the work group size
+// The shaders declare: layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
+const uint32_t cWorkgroupSizeXConstantId = 0;
+const uint32_t cWorkgroupSizeYConstantId = 1;
+const uint32_t cWorkgroupSizeZConstantId = 2;
+
 class ComputePipelineBuilder : public PipelineBuilderBase
 {
 public:
@@ -13,9 +19,18 @@ public:
 
 	ComputePipelineBuilder& addShader(const std::string& filename, VkShaderStageFlagBits stage);
 
+	// Sets the value of a 32 bits specialization constant of the shader
+	ComputePipelineBuilder& addSpecializationConstant(uint32_t constantId, uint32_t value);
+
+	// Sets the work group size through the specialization constants
+	ComputePipelineBuilder& setWorkgroupSize(uint32_t x, uint32_t y, uint32_t z = 1);
+	ComputePipelineBuilder& setWorkgroupSize(VkExtent2D workgroupSize);
+
 	VkPipeline build(VkPipelineLayout pipelineLayout);
 
 private:
+	std::vector<VkSpecializationMapEntry> m_specializationEntries;
+	std::vector<uint32_t> m_specializationData;
 };
 
 }
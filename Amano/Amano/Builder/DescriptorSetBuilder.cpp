@@ -4,8 +4,8 @@
 
 namespace Amano {
 
-Descriptor::Descriptor(VkBuffer buffer, VkDeviceSize range, uint32_t binding)
-	: m_type{ DescriptorType::eBuffer }
+Descriptor::Descriptor(VkBuffer buffer, VkDeviceSize range, uint32_t binding, DescriptorType type)
+	: m_type{ type }
 	, m_binding{ binding }
 {
 	m_bufferInfo.buffer = buffer;
@@ -31,6 +31,15 @@ Descriptor::Descriptor(VkImageView imageView, uint32_t binding)
 	m_imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 }
 
+Descriptor::Descriptor(VkImageView imageView, VkImageLayout layout, uint32_t binding)
+	: m_type{ DescriptorType::eInputAttachment }
+	, m_binding{ binding }
+{
+	m_imageInfo.sampler = VK_NULL_HANDLE;
+	m_imageInfo.imageView = imageView;
+	m_imageInfo.imageLayout = layout;
+}
+
 Descriptor::Descriptor(VkAccelerationStructureKHR* acc, uint32_t binding)
 	: m_type{ DescriptorType::eAccelerationStructure }
 	, m_binding{ binding }
@@ -58,6 +67,10 @@ void Descriptor::set(VkWriteDescriptorSet& writeDescriptor, VkDescriptorSet desc
 		writeDescriptor.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		writeDescriptor.pBufferInfo = &m_bufferInfo;
 		break;
+	case Amano::Descriptor::eStorageBuffer:
+		writeDescriptor.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptor.pBufferInfo = &m_bufferInfo;
+		break;
 	case Amano::Descriptor::eImage:
 		writeDescriptor.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		writeDescriptor.pImageInfo = &m_imageInfo;
@@ -66,6 +79,10 @@ void Descriptor::set(VkWriteDescriptorSet& writeDescriptor, VkDescriptorSet desc
 		writeDescriptor.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 		writeDescriptor.pImageInfo = &m_imageInfo;
 		break;
+	case Amano::Descriptor::eInputAttachment:
+		writeDescriptor.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		writeDescriptor.pImageInfo = &m_imageInfo;
+		break;
 	case Amano::Descriptor::eAccelerationStructure:
 		writeDescriptor.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
 		writeDescriptor.pNext = &m_accelerationStructure;
@@ -98,6 +115,12 @@ DescriptorSetBuilder& DescriptorSetBuilder::addUniformBuffer(VkBuffer buffer, Vk
 	return *this;
 }
 
+DescriptorSetBuilder& DescriptorSetBuilder::addStorageBuffer(VkBuffer buffer, VkDeviceSize range, uint32_t binding) {
+	m_descriptors.emplace_back(buffer, range, binding, Descriptor::eStorageBuffer);
+
+	return *this;
+}
+
 DescriptorSetBuilder& DescriptorSetBuilder::addImage(VkSampler sampler, VkImageView imageView, uint32_t binding) {
 	m_descriptors.emplace_back(sampler, imageView, binding);
 
@@ -110,6 +133,12 @@ DescriptorSetBuilder& DescriptorSetBuilder::addStorageImage(VkImageView imageVie
 	return *this;
 }
 
+DescriptorSetBuilder& DescriptorSetBuilder::addInputAttachment(VkImageView imageView, VkImageLayout layout, uint32_t binding) {
+	m_descriptors.emplace_back(imageView, layout, binding);
+
+	return *this;
+}
+
 DescriptorSetBuilder& DescriptorSetBuilder::addAccelerationStructure(VkAccelerationStructureKHR* acc, uint32_t binding) {
 	m_descriptors.emplace_back(acc, binding);
 
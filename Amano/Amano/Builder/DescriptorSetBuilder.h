@@ -8,22 +8,27 @@ namespace Amano {
 
 class Descriptor {
 public:
-	Descriptor(VkBuffer buffer, VkDeviceSize range, uint32_t binding);
-	Descriptor(VkSampler sampler, VkImageView imageView, uint32_t binding);
-	Descriptor(VkImageView imageView, uint32_t binding);
-	Descriptor(VkAccelerationStructureKHR* acc, uint32_t binding);
-
-	void set(VkWriteDescriptorSet& writeDescriptor, VkDescriptorSet descriptorSet);
-
-private:
 	// More types will be added later
 	enum DescriptorType {
 		eBuffer,
+		eStorageBuffer,
 		eImage,
 		eStorageImage,
+		eInputAttachment,
 		eAccelerationStructure
 	};
 
+public:
+	// type can be eBuffer or eStorageBuffer
+	Descriptor(VkBuffer buffer, VkDeviceSize range, uint32_t binding, DescriptorType type = eBuffer);
+	Descriptor(VkSampler sampler, VkImageView imageView, uint32_t binding);
+	Descriptor(VkImageView imageView, uint32_t binding);
+	// input attachment, layout is the one of the subpass reading it
+	Descriptor(VkImageView imageView, VkImageLayout layout, uint32_t binding);
+	Descriptor(VkAccelerationStructureKHR* acc, uint32_t binding);
+
+	void set(VkWriteDescriptorSet& writeDescriptor, VkDescriptorSet descriptorSet);
+
 private:
 	DescriptorType m_type;
 	uint32_t m_binding;
@@ -39,8 +44,10 @@ public:
 	DescriptorSetBuilder(Device* device, uint32_t count, VkDescriptorSetLayout layout);
 
 	DescriptorSetBuilder& addUniformBuffer(VkBuffer buffer, VkDeviceSize range, uint32_t binding);
+	DescriptorSetBuilder& addStorageBuffer(VkBuffer buffer, VkDeviceSize range, uint32_t binding);
 	DescriptorSetBuilder& addImage(VkSampler sampler, VkImageView imageView, uint32_t binding);
 	DescriptorSetBuilder& addStorageImage(VkImageView imageView, uint32_t binding);
+	DescriptorSetBuilder& addInputAttachment(VkImageView imageView, VkImageLayout layout, uint32_t binding);
 	DescriptorSetBuilder& addAccelerationStructure(VkAccelerationStructureKHR* acc, uint32_t binding);
 
 	VkDescriptorSet buildAndUpdate();
@@ -1,63 +1,49 @@
 #include "RaytracingAccelerationStructureBuilder.h"
+#include "../Pass/MemoryBarrier.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace {
 
-struct AccelerationStructures{
-	VkAccelerationStructureKHR top;
-	VkAccelerationStructureKHR bottom;
-};
+// AccelerationStructure offset needs to be 256 bytes aligned
+// official Vulkan specs, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/html/vkspec.html#acceleration-structure-def
+const uint64_t cAccelerationStructureAlignment = 256;
 
 uint64_t RoundUp(uint64_t size, uint64_t alignment) {
 	const uint64_t t = (size + alignment - 1) / alignment;
 	return t * alignment;
 }
 
-// TODO: wrap device memory into a small class to perform those calls
-VkDeviceAddress GetDeviceAddress(Amano::Device* device, VkBuffer buffer) {
-	VkBufferDeviceAddressInfo info = {};
-	info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-	info.pNext = nullptr;
-	info.buffer = buffer;
-
-	return vkGetBufferDeviceAddress(device->handle(), &info);
+bool isCompactable(const Amano::AccelerationStructureInfo& info) {
+	return (info.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != 0;
 }
 
+// The builds must be done before their results are read by another build, a copy or a query
+void accelerationStructureBarrier(VkCommandBuffer cmd) {
+	const VkAccessFlags accessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+	Amano::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, accessMask,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, accessMask);
 }
 
-namespace Amano {
-
-void AccelerationStructureInfo::clean(Device* device) {
-	device->getExtensions().vkDestroyAccelerationStructureKHR(device->handle(), handle, nullptr);
-	device->freeDeviceMemory(resultMemory);
-	device->freeDeviceMemory(scratchMemory);
-	device->destroyBuffer(result);
-	device->destroyBuffer(scratch);
-
-	if (instanceMemory != VK_NULL_HANDLE)
-		device->freeDeviceMemory(instanceMemory);
-	if (instance != VK_NULL_HANDLE)
-		device->destroyBuffer(instance);
 }
 
-void AccelerationStructures::clean(Device* device) {
-	top.clean(device);
-	bottom.clean(device);
-};
+namespace Amano {
 
+VkTransformMatrixKHR getTransformMatrix(const glm::mat4& transform) {
+	// glm matrices are column-major
+	VkTransformMatrixKHR matrix;
+	for (uint32_t row = 0; row < 3; ++row) {
+		for (uint32_t column = 0; column < 4; ++column)
+			matrix.matrix[row][column] = transform[column][row];
+	}
 
-RaytracingAccelerationStructureBuilder::RaytracingAccelerationStructureBuilder(Device* device, VkPipeline pipeline)
-	: m_device{ device }
-	, m_pipeline{ pipeline }
-	, m_geometries()
-	, m_buildRangeInfo()
-	, m_accelerationStructures{}
-{
+	return matrix;
 }
 
-RaytracingAccelerationStructureBuilder& RaytracingAccelerationStructureBuilder::addGeometry(Mesh& mesh) {
-	auto& geometry = m_geometries.emplace_back();
+VkAccelerationStructureGeometryKHR getMeshGeometry(const Mesh* mesh) {
+	VkAccelerationStructureGeometryKHR geometry{};
 	geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
 	geometry.pNext = nullptr;
 	geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
@@ -66,205 +52,348 @@ RaytracingAccelerationStructureBuilder& RaytracingAccelerationStructureBuilder::
 	geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
 	geometry.geometry.triangles.pNext = nullptr;
 	geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-	geometry.geometry.triangles.vertexData.deviceAddress = mesh.getVertexBufferAddress();
-	geometry.geometry.triangles.vertexData.hostAddress = nullptr;
+	geometry.geometry.triangles.vertexData.deviceAddress = mesh->getVertexBufferAddress();
 	geometry.geometry.triangles.vertexStride = sizeof(Vertex);
-	geometry.geometry.triangles.maxVertex = mesh.getVertexCount();
+	geometry.geometry.triangles.maxVertex = mesh->getVertexCount();
 	geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
-	geometry.geometry.triangles.indexData.deviceAddress = mesh.getIndexBufferAddress();
-	geometry.geometry.triangles.indexData.hostAddress = nullptr;
+	geometry.geometry.triangles.indexData.deviceAddress = mesh->getIndexBufferAddress();
 	geometry.geometry.triangles.transformData = {};
 
-	geometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR;
-	geometry.geometry.aabbs.pNext = nullptr;
-	// NOTE: should AABB be set manually?
-
-	geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-	geometry.geometry.instances.pNext = nullptr;
-	// NOTE: should instances be set manually?
+	return geometry;
+}
 
-	auto& buildRangeInfo = m_buildRangeInfo.emplace_back();
-	buildRangeInfo.firstVertex = 0;  // no offset
-	buildRangeInfo.primitiveOffset = 0;  // no offset
-	buildRangeInfo.primitiveCount = mesh.getIndexCount() / 3;
-	buildRangeInfo.transformOffset = 0;
+VkBuildAccelerationStructureFlagsKHR getBottomLevelFlags(bool isDeformable) {
+	if (isDeformable)
+		return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
 
-	return *this;
+	return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
 }
 
-
-VkAccelerationStructureBuildSizesInfoKHR RaytracingAccelerationStructureBuilder::getBuildSizesInfo(VkAccelerationStructureKHR accStructure, const uint32_t* pMaxPrimitiveCounts, const VkAccelerationStructureBuildGeometryInfoKHR* pBuildGeomtryInfo) {
+VkAccelerationStructureBuildSizesInfoKHR getBuildSizesInfo(Device* device, const uint32_t* pMaxPrimitiveCounts, const VkAccelerationStructureBuildGeometryInfoKHR* pBuildGeomtryInfo, VkDeviceSize scratchAlignment) {
 	VkAccelerationStructureBuildSizesInfoKHR sizeInfo{};
 	sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
 	sizeInfo.pNext = nullptr;
 
-	m_device->getExtensions().vkGetAccelerationStructureBuildSizesKHR(
-		m_device->handle(),
+	device->getExtensions().vkGetAccelerationStructureBuildSizesKHR(
+		device->handle(),
 		VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
 		pBuildGeomtryInfo,
 		pMaxPrimitiveCounts,
 		&sizeInfo);
 
-	// AccelerationStructure offset needs to be 256 bytes aligned
-	// official Vulkan specs, https://www.khronos.org/registry/vulkan/specs/1.1-extensions/html/vkspec.html#acceleration-structure-def
-	const uint64_t cAccelerationStructureAlignment = 256;
-	const uint64_t cScratchAlignment = m_device->getPhysicalAccelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment;
-
+	// the scratch memory of a batch is packed in one buffer, so each range must be aligned
 	sizeInfo.accelerationStructureSize = RoundUp(sizeInfo.accelerationStructureSize, cAccelerationStructureAlignment);
-	sizeInfo.buildScratchSize = RoundUp(sizeInfo.buildScratchSize, cScratchAlignment);
+	sizeInfo.buildScratchSize = RoundUp(sizeInfo.buildScratchSize, scratchAlignment);
+	sizeInfo.updateScratchSize = RoundUp(sizeInfo.updateScratchSize, scratchAlignment);
 
 	return sizeInfo;
 }
 
-bool RaytracingAccelerationStructureBuilder::createBottomLevelAccelerationStructure(VkCommandBuffer cmd) {
-	// we can create one bottom acceleration structure per model/geometry, or group them into 1 bottom structure
+bool createAccelerationStructure(Device* device, VkAccelerationStructureTypeKHR type, VkDeviceSize size, AccelerationStructureInfo& info) {
+	size = RoundUp(size, cAccelerationStructureAlignment);
+	if (!device->createBufferAndMemory(
+		size,
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		info.result,
+		info.resultMemory))
+		return false;
 
-	VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
-	buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-	buildGeometryInfo.pNext = nullptr;
-	buildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR; // TODO: check that
-	buildGeometryInfo.geometryCount = static_cast<uint32_t>(m_geometries.size());
-	buildGeometryInfo.pGeometries = m_geometries.data();
-	buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-	buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-	buildGeometryInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+	VkAccelerationStructureCreateInfoKHR accelerationInfo{};
+	accelerationInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+	accelerationInfo.pNext = nullptr;
+	accelerationInfo.type = type;
+	accelerationInfo.size = size;
+	accelerationInfo.buffer = info.result;
+	accelerationInfo.offset = 0;
+	// accelerationInfo.deviceAddress isn't used
+
+	if (device->getExtensions().vkCreateAccelerationStructureKHR(device->handle(), &accelerationInfo, nullptr, &info.handle) != VK_SUCCESS) {
+		std::cerr << "failed to create acceleration structure!" << std::endl;
+		return false;
+	}
 
-	std::vector<uint32_t> maxPrimitiveCounts(m_buildRangeInfo.size());
+	return true;
+}
 
-	for (size_t i = 0; i < maxPrimitiveCounts.size(); ++i)
-		maxPrimitiveCounts[i] = m_buildRangeInfo[i].primitiveCount;
+void AccelerationStructureInfo::clean(Device* device) {
+	if (mappedInstances != nullptr)
+		vkUnmapMemory(device->handle(), instanceMemory);
+	device->getExtensions().vkDestroyAccelerationStructureKHR(device->handle(), handle, nullptr);
+	device->freeDeviceMemory(resultMemory);
+	device->destroyBuffer(result);
 
-	VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo = getBuildSizesInfo(m_accelerationStructures.bottom.handle, maxPrimitiveCounts.data(), &buildGeometryInfo);
+	if (instanceMemory != VK_NULL_HANDLE)
+		device->freeDeviceMemory(instanceMemory);
+	if (instance != VK_NULL_HANDLE)
+		device->destroyBuffer(instance);
 
-	// allocate the memory
-	// if we had multiple bottom acceleration structure, we woud sum all the sizes and allocate a big chunk of memory for them all, then use offsets
-	// this would require some refactoring here since we only support 1 bottom acceleration structure
+	*this = AccelerationStructureInfo();
+}
 
-	m_device->createBufferAndMemory(
-		buildSizesInfo.accelerationStructureSize,
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_accelerationStructures.bottom.result,
-		m_accelerationStructures.bottom.resultMemory);
+void AccelerationStructures::clean(Device* device) {
+	top.clean(device);
+	for (auto& bottom : bottoms)
+		bottom.clean(device);
+	bottoms.clear();
+};
 
-	m_device->createBufferAndMemory(
-		buildSizesInfo.buildScratchSize,
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_accelerationStructures.bottom.scratch,
-		m_accelerationStructures.bottom.scratchMemory);
 
+RaytracingAccelerationStructureBuilder::RaytracingAccelerationStructureBuilder(Device* device, VkPipeline pipeline)
+	: m_device{ device }
+	, m_pipeline{ pipeline }
+	, m_meshes()
+	, m_deformableMeshes()
+	, m_instances()
+	, m_maxInstanceCount{ 0 }
+	, m_scratchBuffer{ nullptr }
+	, m_accelerationStructures{}
+{
+}
+
+RaytracingAccelerationStructureBuilder& RaytracingAccelerationStructureBuilder::addInstance(const Mesh* mesh, const glm::mat4& transform, uint32_t mask, uint32_t hitGroupOffset) {
+	auto it = std::find(m_meshes.begin(), m_meshes.end(), mesh);
+	uint32_t meshIndex = static_cast<uint32_t>(it - m_meshes.begin());
+	if (it == m_meshes.end())
+		m_meshes.push_back(mesh);
+
+	Instance instance;
+	instance.meshIndex = meshIndex;
+	instance.transform = transform;
+	instance.mask = mask;
+	instance.hitGroupOffset = hitGroupOffset;
+	m_instances.push_back(instance);
+
+	return *this;
+}
+
+RaytracingAccelerationStructureBuilder& RaytracingAccelerationStructureBuilder::setDeformable(const Mesh* mesh) {
+	m_deformableMeshes.push_back(mesh);
 
-	VkAccelerationStructureCreateInfoKHR bottomAccelerationInfo{};
-	bottomAccelerationInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-	bottomAccelerationInfo.pNext = nullptr;
-	bottomAccelerationInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-	bottomAccelerationInfo.size = buildSizesInfo.accelerationStructureSize;
-	bottomAccelerationInfo.buffer = m_accelerationStructures.bottom.result;
-	bottomAccelerationInfo.offset = 0;  // i * buildSizesInfo.accelerationStructureSize if we had multiple bottom acceleration structures
-	// bottomAccelerationInfo.deviceAddress isn't used
+	return *this;
+}
+
+RaytracingAccelerationStructureBuilder& RaytracingAccelerationStructureBuilder::setMaxInstanceCount(uint32_t maxInstanceCount) {
+	m_maxInstanceCount = maxInstanceCount;
 
-	if (m_device->getExtensions().vkCreateAccelerationStructureKHR(m_device->handle(), &bottomAccelerationInfo, nullptr, &m_accelerationStructures.bottom.handle) != VK_SUCCESS) {
-		std::cerr << "failed to create bottom acceleration structure!" << std::endl;
+	return *this;
+}
+
+bool RaytracingAccelerationStructureBuilder::createBottomLevelAccelerationStructures() {
+	// one bottom acceleration structure per mesh, so that the instances of a mesh share it
+	uint32_t meshCount = static_cast<uint32_t>(m_meshes.size());
+	std::vector<VkAccelerationStructureGeometryKHR> geometries(meshCount);
+	std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos(meshCount);
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos(meshCount);
+	std::vector<VkDeviceSize> scratchSizes(meshCount);
+	VkDeviceSize scratchSize = 0;
+
+	m_accelerationStructures.bottoms.resize(meshCount);
+	for (uint32_t i = 0; i < meshCount; ++i) {
+		geometries[i] = getMeshGeometry(m_meshes[i]);
+
+		auto& buildRangeInfo = buildRangeInfos[i];
+		buildRangeInfo.firstVertex = 0;  // no offset
+		buildRangeInfo.primitiveOffset = 0;  // no offset
+		buildRangeInfo.primitiveCount = m_meshes[i]->getIndexCount() / 3;
+		buildRangeInfo.transformOffset = 0;
+
+		bool isDeformable = std::find(m_deformableMeshes.begin(), m_deformableMeshes.end(), m_meshes[i]) != m_deformableMeshes.end();
+
+		auto& buildGeometryInfo = buildGeometryInfos[i];
+		buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		buildGeometryInfo.pNext = nullptr;
+		buildGeometryInfo.flags = getBottomLevelFlags(isDeformable);
+		buildGeometryInfo.geometryCount = 1;
+		buildGeometryInfo.pGeometries = &geometries[i];
+		buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+		buildGeometryInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+
+		VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo = getBuildSizesInfo(m_device, &buildRangeInfo.primitiveCount, &buildGeometryInfo, m_scratchBuffer->getOffsetAlignment());
+		if (!createAccelerationStructure(m_device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, buildSizesInfo.accelerationStructureSize, m_accelerationStructures.bottoms[i]))
+			return false;
+
+		auto& bottom = m_accelerationStructures.bottoms[i];
+		bottom.flags = buildGeometryInfo.flags;
+		bottom.buildScratchSize = buildSizesInfo.buildScratchSize;
+		bottom.updateScratchSize = buildSizesInfo.updateScratchSize;
+
+		buildGeometryInfo.dstAccelerationStructure = bottom.handle;
+		scratchSizes[i] = buildSizesInfo.buildScratchSize;
+		scratchSize += buildSizesInfo.buildScratchSize;
+	}
+
+	// the builds of a batch run at the same time, each of them needs its own range of the scratch buffer
+	if (!m_scratchBuffer->beginBatch(scratchSize))
 		return false;
+
+	std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos(meshCount);
+	std::vector<VkAccelerationStructureKHR> handles(meshCount);
+	for (uint32_t i = 0; i < meshCount; ++i) {
+		buildGeometryInfos[i].scratchData.deviceAddress = m_scratchBuffer->allocate(scratchSizes[i]);
+		if (buildGeometryInfos[i].scratchData.deviceAddress == 0)
+			return false;
+		pBuildRangeInfos[i] = &buildRangeInfos[i];
+		handles[i] = m_accelerationStructures.bottoms[i].handle;
 	}
 
-	const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = m_buildRangeInfo.data();
-	buildGeometryInfo.dstAccelerationStructure = m_accelerationStructures.bottom.handle;
-	buildGeometryInfo.scratchData.deviceAddress = GetDeviceAddress(m_device, m_accelerationStructures.bottom.scratch);
-	
+	// the compacted sizes are only known once the structures are built
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+	queryPoolInfo.queryCount = meshCount;
+
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	if (vkCreateQueryPool(m_device->handle(), &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+		std::cerr << "failed to create the compacted size query pool!" << std::endl;
+		queryPool = VK_NULL_HANDLE;
+	}
+
+	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
+	VkCommandBuffer cmd = pQueue->beginSingleTimeCommands();
+
+	if (queryPool != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(cmd, queryPool, 0, meshCount);
+
 	m_device->getExtensions().vkCmdBuildAccelerationStructuresKHR(
 		cmd,
-		1,
-		&buildGeometryInfo,
-		&pBuildRangeInfo);
+		meshCount,
+		buildGeometryInfos.data(),
+		pBuildRangeInfos.data());
+
+	if (queryPool != VK_NULL_HANDLE) {
+		accelerationStructureBarrier(cmd);
+		m_device->getExtensions().vkCmdWriteAccelerationStructuresPropertiesKHR(
+			cmd,
+			meshCount,
+			handles.data(),
+			VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+			queryPool,
+			0);
+	}
+
+	// this call is blocking, the queries are available afterwards
+	pQueue->endSingleTimeCommands(cmd);
+
+	// without the compacted sizes, the structures are kept as they are
+	if (queryPool == VK_NULL_HANDLE)
+		return true;
+
+	std::vector<VkDeviceSize> compactedSizes(meshCount);
+	VkResult result = vkGetQueryPoolResults(
+		m_device->handle(),
+		queryPool,
+		0,
+		meshCount,
+		sizeof(VkDeviceSize) * compactedSizes.size(),
+		compactedSizes.data(),
+		sizeof(VkDeviceSize),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	vkDestroyQueryPool(m_device->handle(), queryPool, nullptr);
+
+	if (result != VK_SUCCESS) {
+		std::cerr << "failed to get the compacted sizes of the acceleration structures!" << std::endl;
+		return true;
+	}
+
+	return compactBottomLevelAccelerationStructures(compactedSizes);
+}
+
+bool RaytracingAccelerationStructureBuilder::compactBottomLevelAccelerationStructures(const std::vector<VkDeviceSize>& compactedSizes) {
+	std::vector<AccelerationStructureInfo> compactedStructures(compactedSizes.size());
+	for (size_t i = 0; i < compactedSizes.size(); ++i) {
+		if (!isCompactable(m_accelerationStructures.bottoms[i]))
+			continue;
+
+		if (!createAccelerationStructure(m_device, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactedSizes[i], compactedStructures[i])) {
+			for (auto& compactedStructure : compactedStructures)
+				compactedStructure.clean(m_device);
+			return false;
+		}
+	}
+
+	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
+	VkCommandBuffer cmd = pQueue->beginSingleTimeCommands();
+
+	for (size_t i = 0; i < compactedSizes.size(); ++i) {
+		if (!isCompactable(m_accelerationStructures.bottoms[i]))
+			continue;
+
+		VkCopyAccelerationStructureInfoKHR copyInfo{};
+		copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+		copyInfo.pNext = nullptr;
+		copyInfo.src = m_accelerationStructures.bottoms[i].handle;
+		copyInfo.dst = compactedStructures[i].handle;
+		copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+		m_device->getExtensions().vkCmdCopyAccelerationStructureKHR(cmd, &copyInfo);
+	}
+
+	// this call is blocking, the original structures can be destroyed afterwards
+	pQueue->endSingleTimeCommands(cmd);
+
+	for (size_t i = 0; i < compactedSizes.size(); ++i) {
+		auto& bottom = m_accelerationStructures.bottoms[i];
+		if (!isCompactable(bottom))
+			continue;
+
+		compactedStructures[i].flags = bottom.flags;
+		compactedStructures[i].buildScratchSize = bottom.buildScratchSize;
+		compactedStructures[i].updateScratchSize = bottom.updateScratchSize;
+		bottom.clean(m_device);
+		bottom = compactedStructures[i];
+	}
 
 	return true;
 }
 
 bool RaytracingAccelerationStructureBuilder::createTopLevelAccelerationStructure(VkCommandBuffer cmd) {
-	// TODO: only one instance of per geometry is supported for now. Change that afterwards
-	std::vector<VkAccelerationStructureInstanceKHR> instances(m_geometries.size());
-	for (uint32_t instanceId = 0; instanceId < m_geometries.size(); ++instanceId) {
-		auto& instance = instances[instanceId];
+	uint32_t instancesCount = static_cast<uint32_t>(m_instances.size());
+	uint32_t maxInstancesCount = std::max(m_maxInstanceCount, instancesCount);
+
+	// the instances are written by the CPU every time they change, so the buffer is host visible and stays mapped
+	VkDeviceSize instancesSizes = sizeof(VkAccelerationStructureInstanceKHR) * maxInstancesCount;
+	if (!m_device->createBufferAndMemory(
+		instancesSizes,
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+		VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_accelerationStructures.top.instance,
+		m_accelerationStructures.top.instanceMemory))
+		return false;
+
+	void* data;
+	if (vkMapMemory(m_device->handle(), m_accelerationStructures.top.instanceMemory, 0, instancesSizes, 0, &data) != VK_SUCCESS) {
+		std::cerr << "failed to map the instance buffer!" << std::endl;
+		return false;
+	}
+	m_accelerationStructures.top.mappedInstances = static_cast<VkAccelerationStructureInstanceKHR*>(data);
+
+	for (uint32_t instanceId = 0; instanceId < instancesCount; ++instanceId) {
+		const Instance& sceneInstance = m_instances[instanceId];
 
 		VkAccelerationStructureDeviceAddressInfoKHR addressInfo = {};
 		addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-		addressInfo.accelerationStructure = m_accelerationStructures.bottom.handle;  // should get the associated bottom AS, we only have one for now
+		addressInfo.accelerationStructure = m_accelerationStructures.bottoms[sceneInstance.meshIndex].handle;
 
 		const VkDeviceAddress address = m_device->getExtensions().vkGetAccelerationStructureDeviceAddressKHR(m_device->handle(), &addressInfo);
 
-		glm::mat4 transform = glm::mat4(1); // TODO: support transformation - should we transpose it?
-		// The instance.transform value only contains 12 values, corresponding to a 4x3 matrix,
-		// hence saving the last row that is anyway always (0,0,0,1).
-		// Since the matrix is row-major, we simply copy the first 12 values of the original 4x4 matrix
-		std::memcpy(&instance.transform, &transform, sizeof(transform));
+		VkAccelerationStructureInstanceKHR instance{};
+		instance.transform = getTransformMatrix(sceneInstance.transform);
 		instance.instanceCustomIndex = instanceId;
-		instance.mask = 0xFF; // The visibility mask is always set of 0xFF, but if some instances would need to be ignored in some cases, this flag should be passed by the application.
-		instance.instanceShaderBindingTableRecordOffset = 0; // Set the hit group index, that will be used to find the shader code to execute when hitting the geometry.
+		instance.mask = sceneInstance.mask;
+		instance.instanceShaderBindingTableRecordOffset = sceneInstance.hitGroupOffset;
 		instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR; // Disable culling - more fine control could be provided by the application
 		instance.accelerationStructureReference = address;
+		m_accelerationStructures.top.mappedInstances[instanceId] = instance;
 	}
 
-	// create the buffer for instances
-	size_t instancesSizes = sizeof(VkAccelerationStructureInstanceKHR) * instances.size();
-	m_device->createBufferAndMemory(
-		instancesSizes,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_accelerationStructures.top.instance,
-		m_accelerationStructures.top.instanceMemory);
-
-	// copy from staging buffer
-	{
-		// create staging buffer
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		m_device->createBufferAndMemory(
-			instancesSizes,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuffer,
-			stagingBufferMemory);
-
-		// copy the data into it
-		void* data;
-		vkMapMemory(m_device->handle(), stagingBufferMemory, 0, instancesSizes, 0, &data);
-		memcpy(data, instances.data(), (size_t)instancesSizes);
-		vkUnmapMemory(m_device->handle(), stagingBufferMemory);
-
-		// copy command
-		m_device->copyBuffer(stagingBuffer, m_accelerationStructures.top.instance, instancesSizes, QueueType::eGraphics);
-
-		// delete buffer and memory
-		// TODO: destroy buffer then memory?
-		m_device->destroyBuffer(stagingBuffer);
-		m_device->freeDeviceMemory(stagingBufferMemory);
-	}
-
-	// Wait for the builder to complete by setting a barrier on the resulting buffer. This is
-	// particularly important as the construction of the top-level hierarchy may be called right
-	// afterwards, before executing the command list.
-	VkMemoryBarrier memoryBarrier = {};
-	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-	memoryBarrier.pNext = nullptr;
-	memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-	memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-
-	vkCmdPipelineBarrier(
-		cmd,
-		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-		0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
-
-	
 	VkAccelerationStructureGeometryInstancesDataKHR instancesData{};
 	instancesData.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
 	instancesData.pNext = nullptr;
 	instancesData.arrayOfPointers = VK_FALSE;
-	instancesData.data.deviceAddress = GetDeviceAddress(m_device, m_accelerationStructures.top.instance);
-	instancesData.data.hostAddress = nullptr;
+	instancesData.data.deviceAddress = m_device->getBufferAddress(m_accelerationStructures.top.instance);
 
 	VkAccelerationStructureGeometryKHR topAccelerationStructureGeometry{};
 	topAccelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
@@ -274,82 +403,57 @@ bool RaytracingAccelerationStructureBuilder::createTopLevelAccelerationStructure
 	VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
 	buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
 	buildGeometryInfo.pNext = nullptr;
-	buildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+	buildGeometryInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
 	buildGeometryInfo.geometryCount = 1;
 	buildGeometryInfo.pGeometries = &topAccelerationStructureGeometry;
 	buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
 	buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
 	buildGeometryInfo.srcAccelerationStructure = VK_NULL_HANDLE;
 
-	uint32_t instancesCount = static_cast<uint32_t>(instances.size());
-	VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo = getBuildSizesInfo(m_accelerationStructures.top.handle, &instancesCount, &buildGeometryInfo);
+	VkAccelerationStructureBuildSizesInfoKHR buildSizesInfo = getBuildSizesInfo(m_device, &maxInstancesCount, &buildGeometryInfo, m_scratchBuffer->getOffsetAlignment());
 
-	m_device->createBufferAndMemory(
-		buildSizesInfo.accelerationStructureSize,
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_accelerationStructures.top.result,
-		m_accelerationStructures.top.resultMemory);
+	if (!createAccelerationStructure(m_device, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, buildSizesInfo.accelerationStructureSize, m_accelerationStructures.top))
+		return false;
 
-	m_device->createBufferAndMemory(
-		buildSizesInfo.buildScratchSize,
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR,
-		VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_accelerationStructures.top.scratch,
-		m_accelerationStructures.top.scratchMemory);
-
-	// create the acceleration structure
-	VkAccelerationStructureCreateInfoKHR topAccelerationInfo{};
-	topAccelerationInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-	topAccelerationInfo.pNext = nullptr;
-	topAccelerationInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-	topAccelerationInfo.size = buildSizesInfo.accelerationStructureSize;
-	topAccelerationInfo.buffer = m_accelerationStructures.top.result;
-	topAccelerationInfo.offset = 0;  // i * buildSizesInfo.accelerationStructureSize if we had multiple bottom acceleration structures
-	// bottomAccelerationInfo.deviceAddress isn't used
-
-	if (m_device->getExtensions().vkCreateAccelerationStructureKHR(m_device->handle(), &topAccelerationInfo, nullptr, &m_accelerationStructures.top.handle) != VK_SUCCESS) {
-		std::cerr << "failed to create top acceleration structure!" << std::endl;
+	m_accelerationStructures.top.flags = buildGeometryInfo.flags;
+	m_accelerationStructures.top.buildScratchSize = buildSizesInfo.buildScratchSize;
+	m_accelerationStructures.top.updateScratchSize = buildSizesInfo.updateScratchSize;
+
+	// the bottom structures are already built, so their scratch memory can be reused
+	if (!m_scratchBuffer->beginBatch(buildSizesInfo.buildScratchSize))
 		return false;
-	}
 
-	// Build the actual bottom-level acceleration structure
+	// Build the actual top-level acceleration structure
 	VkAccelerationStructureBuildRangeInfoKHR buildOffsetInfo = {};
 	buildOffsetInfo.primitiveCount = instancesCount;
 
 	const VkAccelerationStructureBuildRangeInfoKHR* pBuildOffsetInfo = &buildOffsetInfo;
 
 	buildGeometryInfo.dstAccelerationStructure = m_accelerationStructures.top.handle;
-	buildGeometryInfo.scratchData.deviceAddress = GetDeviceAddress(m_device, m_accelerationStructures.top.scratch);
+	buildGeometryInfo.scratchData.deviceAddress = m_scratchBuffer->allocate(buildSizesInfo.buildScratchSize);
+	if (buildGeometryInfo.scratchData.deviceAddress == 0)
+		return false;
 
 	m_device->getExtensions().vkCmdBuildAccelerationStructuresKHR(cmd, 1, &buildGeometryInfo, &pBuildOffsetInfo);
 
 	return true;
 }
 
-AccelerationStructures RaytracingAccelerationStructureBuilder::build() {
+AccelerationStructures RaytracingAccelerationStructureBuilder::build(ScratchBuffer* scratchBuffer) {
+	m_scratchBuffer = scratchBuffer;
+
+	// without instances, only the top level structure is created
+	if (!m_meshes.empty() && !createBottomLevelAccelerationStructures()) {
+		std::cerr << "failed to create the bottom acceleration structures!" << std::endl;
+		return m_accelerationStructures;
+	}
+
 	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
 	VkCommandBuffer cmd = pQueue->beginSingleTimeCommands();
 
-	createBottomLevelAccelerationStructure(cmd);
-	
-	// Wait for the builder to complete by setting a barrier on the resulting buffer. This is
-		// particularly important as the construction of the top-level hierarchy may be called right
-		// afterwards, before executing the command list.
-	VkMemoryBarrier memoryBarrier = {};
-	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-	memoryBarrier.pNext = nullptr;
-	memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-	memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-
-	vkCmdPipelineBarrier(
-		cmd,
-		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-		0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
-
-	createTopLevelAccelerationStructure(cmd);
+	// the bottom structures were built by previous submissions that are already finished
+	if (!createTopLevelAccelerationStructure(cmd))
+		std::cerr << "failed to create the top acceleration structure!" << std::endl;
 
 	pQueue->endSingleTimeCommands(cmd);
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "../Device.h"
+#include "../glm.h"
 #include "../Mesh.h"
+#include "../ScratchBuffer.h"
 
 #include <vector>
 
@@ -11,44 +13,87 @@ struct AccelerationStructureInfo {
 	VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
 	VkBuffer result = VK_NULL_HANDLE;
 	VkDeviceMemory resultMemory = VK_NULL_HANDLE;
-	VkBuffer scratch = VK_NULL_HANDLE;
-	VkDeviceMemory scratchMemory = VK_NULL_HANDLE;
 
-	// only for top
+	// the scratch memory comes from a ScratchBuffer shared by all the structures
+	// the flags are needed to update the structure, they must be the same as the ones of the build
+	VkBuildAccelerationStructureFlagsKHR flags = 0;
+	VkDeviceSize buildScratchSize = 0;
+	VkDeviceSize updateScratchSize = 0;
+
+	// only for top, the instance buffer stays mapped
 	VkBuffer instance = VK_NULL_HANDLE;
 	VkDeviceMemory instanceMemory = VK_NULL_HANDLE;
+	VkAccelerationStructureInstanceKHR* mappedInstances = nullptr;
 
 	void clean(Device* device);
 };
 
 struct AccelerationStructures {
 	AccelerationStructureInfo top;
-	AccelerationStructureInfo bottom;
+	std::vector<AccelerationStructureInfo> bottoms;  // one per unique mesh, in the order the meshes were first added
 
 	void clean(Device* device);
 };
 
+// VkTransformMatrixKHR is a row-major 3x4 matrix, the last row of the transform is dropped
+VkTransformMatrixKHR getTransformMatrix(const glm::mat4& transform);
+
+// The triangles of the full resolution mesh, read from its vertex and index buffers
+VkAccelerationStructureGeometryKHR getMeshGeometry(const Mesh* mesh);
+
+// A deformable mesh is built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR and isn't compacted, so that it can be refitted or rebuilt in place
+// The other meshes are compacted after their build
+VkBuildAccelerationStructureFlagsKHR getBottomLevelFlags(bool isDeformable);
+
+// The scratch sizes are aligned on scratchAlignment, so that the scratch memory of several builds can be packed
+VkAccelerationStructureBuildSizesInfoKHR getBuildSizesInfo(Device* device, const uint32_t* pMaxPrimitiveCounts, const VkAccelerationStructureBuildGeometryInfoKHR* pBuildGeomtryInfo, VkDeviceSize scratchAlignment);
 
+// Creates the structure and its buffer, only handle, result and resultMemory are set
+bool createAccelerationStructure(Device* device, VkAccelerationStructureTypeKHR type, VkDeviceSize size, AccelerationStructureInfo& info);
+
+// This class builds the acceleration structures of a scene made of mesh instances
+// Each unique mesh gets its own bottom level structure, they are built in one batch then compacted
+// The top level structure holds one instance per call to addInstance
+// It is built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR, so that it can be refitted when the instances move
 class RaytracingAccelerationStructureBuilder {
 public:
 	RaytracingAccelerationStructureBuilder(Device* device, VkPipeline pipeline);
 
-	// instancing isn't supported for now
-	// transformation isn't supported either
-	RaytracingAccelerationStructureBuilder& addGeometry(Mesh& mesh);
+	// The instances of a mesh share its bottom level structure
+	// mask is tested against the cull mask of traceRayEXT, hitGroupOffset selects the hit group in the shader binding table
+	// gl_InstanceCustomIndexEXT is the index of the instance in the order of the calls
+	RaytracingAccelerationStructureBuilder& addInstance(const Mesh* mesh, const glm::mat4& transform = glm::mat4(1.0f), uint32_t mask = 0xFF, uint32_t hitGroupOffset = 0);
+
+	// The bottom level structure of the mesh is built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR and isn't compacted
+	// so that it can be refitted or rebuilt in place when the vertices of the mesh change
+	RaytracingAccelerationStructureBuilder& setDeformable(const Mesh* mesh);
 
-	AccelerationStructures build();
+	// The top level structure is allocated for this number of instances, so that instances can be added later without reallocating it
+	RaytracingAccelerationStructureBuilder& setMaxInstanceCount(uint32_t maxInstanceCount);
+
+	// The builds use scratchBuffer, which grows to the size of the largest batch
+	AccelerationStructures build(ScratchBuffer* scratchBuffer);
 
 private:
-	VkAccelerationStructureBuildSizesInfoKHR getBuildSizesInfo(VkAccelerationStructureKHR accStructure, const uint32_t* pMaxPrimitiveCounts, const VkAccelerationStructureBuildGeometryInfoKHR* pBuildGeomtryInfo);
-	bool createBottomLevelAccelerationStructure(VkCommandBuffer cmd);
+	struct Instance {
+		uint32_t meshIndex;
+		glm::mat4 transform;
+		uint32_t mask;
+		uint32_t hitGroupOffset;
+	};
+
+	bool createBottomLevelAccelerationStructures();
+	bool compactBottomLevelAccelerationStructures(const std::vector<VkDeviceSize>& compactedSizes);
 	bool createTopLevelAccelerationStructure(VkCommandBuffer cmd);
 
 private:
 	Device* m_device;
 	VkPipeline m_pipeline;
-	std::vector<VkAccelerationStructureGeometryKHR> m_geometries;
-	std::vector<VkAccelerationStructureBuildRangeInfoKHR> m_buildRangeInfo;
+	std::vector<const Mesh*> m_meshes;
+	std::vector<const Mesh*> m_deformableMeshes;
+	std::vector<Instance> m_instances;
+	uint32_t m_maxInstanceCount;
+	ScratchBuffer* m_scratchBuffer;
 	AccelerationStructures m_accelerationStructures;
 };
 
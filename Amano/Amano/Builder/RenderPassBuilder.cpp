@@ -2,6 +2,18 @@
 
 #include <iostream>
 
+namespace {
+
+bool isDepthFormat(VkFormat format) {
+	return format == VK_FORMAT_D16_UNORM
+		|| format == VK_FORMAT_D32_SFLOAT
+		|| format == VK_FORMAT_D16_UNORM_S8_UINT
+		|| format == VK_FORMAT_D24_UNORM_S8_UINT
+		|| format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+}
+
 namespace Amano {
 
 RenderPassBuilder::RenderPassBuilder()
@@ -39,24 +51,55 @@ RenderPassBuilder& RenderPassBuilder::addDepthAttachment(VkFormat format, VkImag
 	return *this;
 }
 
+RenderPassBuilder& RenderPassBuilder::addOverwrittenColorAttachment(VkFormat format, VkImageLayout finalLayout) {
+	VkAttachmentDescription& colorAttachment = m_attachments.emplace_back();
+	colorAttachment.format = format;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = finalLayout;
+
+	return *this;
+}
+
+RenderPassBuilder& RenderPassBuilder::addTransientAttachment(VkFormat format, VkImageLayout finalLayout) {
+	VkAttachmentDescription& attachment = m_attachments.emplace_back();
+	attachment.format = format;
+	attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachment.finalLayout = finalLayout;
+
+	return *this;
+}
+
 RenderPassBuilder& RenderPassBuilder::addSubpass(VkPipelineBindPoint bindPoint, std::vector<uint32_t> colorAttachmentIndices, uint32_t depthAttachmentIndex) {
-	auto& subpass = m_subpasses.emplace_back(colorAttachmentIndices.size());
+	return addSubpass(bindPoint, colorAttachmentIndices, depthAttachmentIndex, {});
+}
+
+RenderPassBuilder& RenderPassBuilder::addSubpass(VkPipelineBindPoint bindPoint, std::vector<uint32_t> colorAttachmentIndices, uint32_t depthAttachmentIndex, std::vector<uint32_t> inputAttachmentIndices) {
+	auto& subpass = m_subpasses.emplace_back(colorAttachmentIndices.size(), inputAttachmentIndices.size());
 
 	for (size_t i = 0; i < colorAttachmentIndices.size(); ++i) {
 		subpass.colorAttachmentReferences[i].attachment = colorAttachmentIndices[i];
 		subpass.colorAttachmentReferences[i].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	}
-	subpass.desc.pipelineBindPoint = bindPoint;
-	subpass.desc.colorAttachmentCount = static_cast<uint32_t>(subpass.colorAttachmentReferences.size());
-	subpass.desc.pColorAttachments = subpass.colorAttachmentReferences.data();
-	if (depthAttachmentIndex >= 0) {
-		subpass.depthAttachmentReference.attachment = depthAttachmentIndex;
-		subpass.depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		subpass.desc.pDepthStencilAttachment = &subpass.depthAttachmentReference;
-	}
-	else {
-		subpass.desc.pDepthStencilAttachment = nullptr;
+	for (size_t i = 0; i < inputAttachmentIndices.size(); ++i) {
+		uint32_t index = inputAttachmentIndices[i];
+		subpass.inputAttachmentReferences[i].attachment = index;
+		subpass.inputAttachmentReferences[i].layout = isDepthFormat(m_attachments[index].format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
+	subpass.desc.pipelineBindPoint = bindPoint;
+	subpass.depthAttachmentReference.attachment = depthAttachmentIndex;
+	subpass.depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	// the pointers to the references are set in build, the descriptions move when more subpasses are added
 
 	return *this;
 }
@@ -73,11 +116,33 @@ RenderPassBuilder& RenderPassBuilder::addSubpassDependency(uint32_t srcSubpass,
 	return *this;
 }
 
+RenderPassBuilder& RenderPassBuilder::addInputAttachmentDependency(uint32_t srcSubpass, uint32_t dstSubpass) {
+	auto& dependency = m_dependencies.emplace_back();
+	dependency.srcSubpass = srcSubpass;
+	dependency.dstSubpass = dstSubpass;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependency.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	// each pixel only reads its own attachments, the tile based GPUs can keep them in the tile memory
+	dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	return *this;
+}
+
 VkRenderPass RenderPassBuilder::build(Device& device) {
 	std::vector<VkSubpassDescription> subpasses;
 	subpasses.reserve(m_subpasses.size());
-	for (auto& desc : m_subpasses) {
-		subpasses.push_back(desc.desc);
+	for (auto& subpass : m_subpasses) {
+		VkSubpassDescription& desc = subpasses.emplace_back(subpass.desc);
+		desc.colorAttachmentCount = static_cast<uint32_t>(subpass.colorAttachmentReferences.size());
+		desc.pColorAttachments = subpass.colorAttachmentReferences.data();
+		desc.inputAttachmentCount = static_cast<uint32_t>(subpass.inputAttachmentReferences.size());
+		desc.pInputAttachments = subpass.inputAttachmentReferences.data();
+		if (subpass.depthAttachmentReference.attachment != VK_ATTACHMENT_UNUSED)
+			desc.pDepthStencilAttachment = &subpass.depthAttachmentReference;
+		else
+			desc.pDepthStencilAttachment = nullptr;
 	}
 
 	VkRenderPassCreateInfo renderPassInfo{};
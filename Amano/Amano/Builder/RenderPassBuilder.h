@@ -11,15 +11,17 @@ class RenderPassBuilder
 private:
 	struct SubpassDescription
 	{
-		SubpassDescription(size_t colorCount)
+		SubpassDescription(size_t colorCount, size_t inputCount)
 			: desc{}
 			, colorAttachmentReferences(colorCount)
+			, inputAttachmentReferences(inputCount)
 			, depthAttachmentReference{}
 		{
 		}
 
 		VkSubpassDescription desc;
 		std::vector<VkAttachmentReference> colorAttachmentReferences;
+		std::vector<VkAttachmentReference> inputAttachmentReferences;
 		VkAttachmentReference depthAttachmentReference;
 	};
 
@@ -30,10 +32,18 @@ public:
 
 	RenderPassBuilder& addColorAttachment(VkFormat format, VkImageLayout finalLayout);
 	RenderPassBuilder& addDepthAttachment(VkFormat format, VkImageLayout finalLayout);
+	// the attachment is entirely written by the render pass, its previous content is discarded
+	RenderPassBuilder& addOverwrittenColorAttachment(VkFormat format, VkImageLayout finalLayout);
+	// color or depth attachment which is cleared and never stored, it only lives during the render pass
+	RenderPassBuilder& addTransientAttachment(VkFormat format, VkImageLayout finalLayout);
 
+	// depthAttachmentIndex can be VK_ATTACHMENT_UNUSED
 	RenderPassBuilder& addSubpass(VkPipelineBindPoint bindPoint, std::vector<uint32_t> colorAttachmentIndices, uint32_t depthAttachmentIndex);
+	RenderPassBuilder& addSubpass(VkPipelineBindPoint bindPoint, std::vector<uint32_t> colorAttachmentIndices, uint32_t depthAttachmentIndex, std::vector<uint32_t> inputAttachmentIndices);
 
 	RenderPassBuilder& addSubpassDependency(uint32_t srcSubpass, uint32_t dstSubpass);
+	// dstSubpass reads the color and depth attachments written by srcSubpass as input attachments, pixel by pixel
+	RenderPassBuilder& addInputAttachmentDependency(uint32_t srcSubpass, uint32_t dstSubpass);
 
 	VkRenderPass build(Device& device);
 
@@ -17,6 +17,14 @@ uint32_t computeGroupSize(uint32_t inlineSize, uint32_t handleSize, uint32_t ali
 
 namespace Amano {
 
+VkStridedDeviceAddressRegionKHR ShaderGroupBindingTable::getRegion(Device* device) const {
+	VkStridedDeviceAddressRegionKHR region = {};
+	region.deviceAddress = device->getBufferAddress(buffer);
+	region.stride = groupSize;
+	region.size = groupSize;
+	return region;
+}
+
 void ShaderGroupBindingTable::clean(Device* device) {
 	if (bufferMemory != VK_NULL_HANDLE)
 		device->freeDeviceMemory(bufferMemory);
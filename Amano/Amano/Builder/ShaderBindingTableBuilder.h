@@ -9,6 +9,8 @@ struct ShaderGroupBindingTable {
 	VkDeviceMemory bufferMemory = VK_NULL_HANDLE;
 	uint32_t groupSize = 0;
 
+	// Region of the table for vkCmdTraceRaysKHR, the table holds a single shader
+	VkStridedDeviceAddressRegionKHR getRegion(Device* device) const;
 	void clean(Device* device);
 };
 
@@ -0,0 +1,633 @@
+#include "Bvh.h"
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+
+// SSE2 is part of x64, the packets fall back to single rays on the other architectures
+#if defined(_M_X64) || defined(__SSE2__)
+#define AMANO_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Number of bins per axis when evaluating the splits
+const uint32_t cBinCount = 16;
+
+// Leaves with more triangles are always split
+const uint32_t cMaxLeafTriangles = 4;
+
+// Cost of visiting a node, relative to the cost of intersecting a triangle
+const float cTraversalCost = 1.0f;
+
+// Subtrees with fewer triangles are built on the thread of their parent
+const uint32_t cParallelBuildMinTriangles = 4096;
+
+// Determinants below this are rays parallel to the triangle
+const float cDeterminantEpsilon = 1e-12f;
+
+struct Aabb {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void grow(const glm::vec3& point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const Aabb& other) {
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	float area() const {
+		glm::vec3 extent = max - min;
+		return extent.x < 0.0f ? 0.0f : 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+};
+
+struct Bin {
+	Aabb bounds;
+	uint32_t count = 0;
+};
+
+// The build creates a pointer tree, which is flattened depth first once complete
+struct BuildNode {
+	Aabb bounds;
+	uint32_t first;
+	uint32_t count;  // 0 for interior nodes
+	std::unique_ptr<BuildNode> children[2];
+};
+
+// The triangles of a node are a range of references, the ranges of two subtrees never overlap so they can be partitioned in parallel
+struct BuildContext {
+	const std::vector<Aabb>& triangleBounds;
+	const std::vector<glm::vec3>& centroids;
+	std::vector<uint32_t>& references;
+};
+
+uint32_t getBinIndex(float centroid, float centroidMin, float scale) {
+	return std::min(cBinCount - 1, static_cast<uint32_t>((centroid - centroidMin) * scale));
+}
+
+std::unique_ptr<BuildNode> buildNode(const BuildContext& context, uint32_t first, uint32_t count, uint32_t depth, uint32_t parallelDepth) {
+	auto node = std::make_unique<BuildNode>();
+	node->first = first;
+	node->count = count;
+
+	Aabb centroidBounds;
+	for (uint32_t i = first; i < first + count; ++i) {
+		uint32_t reference = context.references[i];
+		node->bounds.grow(context.triangleBounds[reference]);
+		centroidBounds.grow(context.centroids[reference]);
+	}
+
+	if (count == 1 || depth + 1 >= Amano::cBvhMaxDepth)
+		return node;
+
+	// the cost of a split is the number of triangles of each side weighted by its area
+	// it is only evaluated between the bins, which is much faster than sorting the triangles and nearly as good
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (centroidExtent[axis] <= 0.0f)
+			continue;
+
+		Bin bins[cBinCount];
+		float scale = cBinCount / centroidExtent[axis];
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t reference = context.references[i];
+			Bin& bin = bins[getBinIndex(context.centroids[reference][axis], centroidBounds.min[axis], scale)];
+			bin.bounds.grow(context.triangleBounds[reference]);
+			++bin.count;
+		}
+
+		// sweep from the left then from the right, the split b is between the bins b - 1 and b
+		float leftAreas[cBinCount];
+		uint32_t leftCounts[cBinCount];
+		Aabb leftBounds;
+		uint32_t leftCount = 0;
+		for (uint32_t b = 1; b < cBinCount; ++b) {
+			leftBounds.grow(bins[b - 1].bounds);
+			leftCount += bins[b - 1].count;
+			leftAreas[b] = leftBounds.area();
+			leftCounts[b] = leftCount;
+		}
+
+		Aabb rightBounds;
+		uint32_t rightCount = 0;
+		for (uint32_t b = cBinCount - 1; b > 0; --b) {
+			rightBounds.grow(bins[b].bounds);
+			rightCount += bins[b].count;
+			if (leftCounts[b] == 0 || rightCount == 0)
+				continue;
+
+			float cost = leftAreas[b] * leftCounts[b] + rightBounds.area() * rightCount;
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis >= 0) {
+		float area = node->bounds.area();
+		float splitCost = cTraversalCost + (area > 0.0f ? bestCost / area : 0.0f);
+		if (count <= cMaxLeafTriangles && splitCost >= static_cast<float>(count))
+			return node;
+
+		float scale = cBinCount / centroidExtent[bestAxis];
+		auto begin = context.references.begin();
+		auto it = std::partition(begin + first, begin + first + count, [&](uint32_t reference) {
+			return getBinIndex(context.centroids[reference][bestAxis], centroidBounds.min[bestAxis], scale) < bestSplit;
+		});
+		middle = static_cast<uint32_t>(it - begin);
+	}
+	else {
+		if (count <= cMaxLeafTriangles)
+			return node;
+
+		// all the centroids are at the same place, any split is as good as the others
+		middle = first + count / 2;
+	}
+
+	uint32_t leftCount = middle - first;
+	if (parallelDepth > 0 && count >= cParallelBuildMinTriangles) {
+		// the left subtree is built by another thread while this one builds the right subtree
+		auto left = std::async(std::launch::async, buildNode, std::cref(context), first, leftCount, depth + 1, parallelDepth - 1);
+		node->children[1] = buildNode(context, middle, count - leftCount, depth + 1, parallelDepth - 1);
+		node->children[0] = left.get();
+	}
+	else {
+		node->children[0] = buildNode(context, first, leftCount, depth + 1, 0);
+		node->children[1] = buildNode(context, middle, count - leftCount, depth + 1, 0);
+	}
+	node->count = 0;
+
+	return node;
+}
+
+void flatten(const BuildNode& buildNode, std::vector<Amano::BvhNode>& nodes) {
+	uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back(Amano::BvhNode());
+	nodes[index].boundsMin = buildNode.bounds.min;
+	nodes[index].boundsMax = buildNode.bounds.max;
+	nodes[index].triangleCount = buildNode.count;
+
+	if (buildNode.count > 0) {
+		nodes[index].offset = buildNode.first;
+		return;
+	}
+
+	flatten(*buildNode.children[0], nodes);
+	nodes[index].offset = static_cast<uint32_t>(nodes.size());
+	flatten(*buildNode.children[1], nodes);
+}
+
+// Slab test, tEntry receives the distance where the ray enters the box
+bool intersectBounds(const Amano::BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMin, float tMax, float& tEntry) {
+	glm::vec3 t0 = (node.boundsMin - origin) * inverseDirection;
+	glm::vec3 t1 = (node.boundsMax - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	tEntry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, tMin));
+	float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+
+	return tEntry <= tExit;
+}
+
+// Moller-Trumbore, both faces are hit
+bool intersectTriangle(const Amano::Ray& ray, float tMax, const glm::vec4* positions, float& t, glm::vec2& barycentrics) {
+	glm::vec3 v0(positions[0]);
+	glm::vec3 edge1 = glm::vec3(positions[1]) - v0;
+	glm::vec3 edge2 = glm::vec3(positions[2]) - v0;
+
+	glm::vec3 p = glm::cross(ray.direction, edge2);
+	float determinant = glm::dot(edge1, p);
+	if (std::abs(determinant) < cDeterminantEpsilon)
+		return false;
+
+	float inverseDeterminant = 1.0f / determinant;
+	glm::vec3 s = ray.origin - v0;
+	float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	glm::vec3 q = glm::cross(s, edge1);
+	float v = glm::dot(ray.direction, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	t = glm::dot(edge2, q) * inverseDeterminant;
+	if (t < ray.tMin || t > tMax)
+		return false;
+
+	barycentrics = glm::vec2(u, v);
+	return true;
+}
+
+#ifdef AMANO_BVH_SSE
+
+// The packet transposed, each register holds one component of the four rays
+struct PacketRegisters {
+	__m128 originX, originY, originZ;
+	__m128 directionX, directionY, directionZ;
+	__m128 inverseDirectionX, inverseDirectionY, inverseDirectionZ;
+	__m128 tMin;
+};
+
+__m128 select(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Returns the mask of the rays hitting the box before tMax
+__m128 intersectBounds(const Amano::BvhNode& node, const PacketRegisters& packet, __m128 tMax, __m128& tEntry) {
+	__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), packet.originX), packet.inverseDirectionX);
+	__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), packet.originY), packet.inverseDirectionY);
+	__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), packet.originZ), packet.inverseDirectionZ);
+	__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), packet.originX), packet.inverseDirectionX);
+	__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), packet.originY), packet.inverseDirectionY);
+	__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), packet.originZ), packet.inverseDirectionZ);
+
+	tEntry = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), packet.tMin));
+	__m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), tMax));
+
+	return _mm_cmple_ps(tEntry, tExit);
+}
+
+// Distance where the first of the rays of the mask enters the box
+float getNearestEntry(__m128 tEntry, __m128 mask) {
+	alignas(16) float entries[Amano::cBvhPacketSize];
+	_mm_store_ps(entries, select(mask, tEntry, _mm_set1_ps(FLT_MAX)));
+	return std::min(std::min(entries[0], entries[1]), std::min(entries[2], entries[3]));
+}
+
+// Moller-Trumbore for the four rays against one triangle, returns the mask of the rays hitting it before tMax
+__m128 intersectTriangle(const PacketRegisters& packet, __m128 tMax, const glm::vec4* positions, __m128& t, __m128& u, __m128& v) {
+	glm::vec3 v0(positions[0]);
+	glm::vec3 edge1 = glm::vec3(positions[1]) - v0;
+	glm::vec3 edge2 = glm::vec3(positions[2]) - v0;
+	__m128 edge1X = _mm_set1_ps(edge1.x), edge1Y = _mm_set1_ps(edge1.y), edge1Z = _mm_set1_ps(edge1.z);
+	__m128 edge2X = _mm_set1_ps(edge2.x), edge2Y = _mm_set1_ps(edge2.y), edge2Z = _mm_set1_ps(edge2.z);
+
+	__m128 pX = _mm_sub_ps(_mm_mul_ps(packet.directionY, edge2Z), _mm_mul_ps(packet.directionZ, edge2Y));
+	__m128 pY = _mm_sub_ps(_mm_mul_ps(packet.directionZ, edge2X), _mm_mul_ps(packet.directionX, edge2Z));
+	__m128 pZ = _mm_sub_ps(_mm_mul_ps(packet.directionX, edge2Y), _mm_mul_ps(packet.directionY, edge2X));
+	__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ));
+	__m128 absoluteDeterminant = _mm_andnot_ps(_mm_set1_ps(-0.0f), determinant);
+	__m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+	__m128 sX = _mm_sub_ps(packet.originX, _mm_set1_ps(v0.x));
+	__m128 sY = _mm_sub_ps(packet.originY, _mm_set1_ps(v0.y));
+	__m128 sZ = _mm_sub_ps(packet.originZ, _mm_set1_ps(v0.z));
+	u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, pX), _mm_mul_ps(sY, pY)), _mm_mul_ps(sZ, pZ)), inverseDeterminant);
+
+	__m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(sZ, edge1Y));
+	__m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(sX, edge1Z));
+	__m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(sY, edge1X));
+	v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(packet.directionX, qX), _mm_mul_ps(packet.directionY, qY)), _mm_mul_ps(packet.directionZ, qZ)), inverseDeterminant);
+	t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), inverseDeterminant);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 mask = _mm_cmpge_ps(absoluteDeterminant, _mm_set1_ps(cDeterminantEpsilon));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t, packet.tMin));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(t, tMax));
+
+	return mask;
+}
+
+#endif
+
+glm::vec3 getRandomDirection(std::mt19937& generator) {
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	float z = 2.0f * distribution(generator) - 1.0f;
+	float phi = 2.0f * glm::pi<float>() * distribution(generator);
+	float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+	return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+}
+
+namespace Amano {
+
+Bvh::Bvh()
+	: m_nodes()
+	, m_trianglePositions()
+	, m_triangleIndices()
+{
+}
+
+void Bvh::build(const Mesh& mesh) {
+	if (mesh.getLodCount() == 0) {
+		build(mesh.getVertices(), nullptr, 0);
+		return;
+	}
+
+	const MeshLod& lod = mesh.getLod(0);
+	build(mesh.getVertices(), mesh.getIndices().data() + lod.firstIndex, lod.indexCount);
+}
+
+void Bvh::build(const std::vector<Vertex>& vertices, const uint32_t* indices, uint32_t indexCount) {
+	m_nodes.clear();
+	m_trianglePositions.clear();
+	m_triangleIndices.clear();
+
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	std::vector<Aabb> triangleBounds(triangleCount);
+	std::vector<glm::vec3> centroids(triangleCount);
+	std::vector<uint32_t> references(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		for (uint32_t j = 0; j < 3; ++j)
+			triangleBounds[i].grow(vertices[indices[3 * i + j]].pos);
+		centroids[i] = (triangleBounds[i].min + triangleBounds[i].max) * 0.5f;
+		references[i] = i;
+	}
+
+	// each parallel level doubles the number of threads building the tree
+	uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t parallelDepth = 0;
+	while ((1u << parallelDepth) < threadCount)
+		++parallelDepth;
+
+	BuildContext context{ triangleBounds, centroids, references };
+	std::unique_ptr<BuildNode> root = buildNode(context, 0, triangleCount, 0, parallelDepth);
+
+	m_nodes.reserve(2 * triangleCount - 1);
+	flatten(*root, m_nodes);
+
+	// the triangles are stored in the order of the leaves, so that a leaf reads contiguous memory
+	m_triangleIndices = references;
+	m_trianglePositions.resize(3 * triangleCount);
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		for (uint32_t j = 0; j < 3; ++j)
+			m_trianglePositions[3 * i + j] = glm::vec4(vertices[indices[3 * references[i] + j]].pos, 1.0f);
+	}
+}
+
+bool Bvh::intersect(const Ray& ray, RayHit& hit) const {
+	return traverse(ray, hit, false);
+}
+
+bool Bvh::isOccluded(const Ray& ray) const {
+	RayHit hit;
+	return traverse(ray, hit, true);
+}
+
+void Bvh::intersect(const RayPacket& packet, RayHit (&hits)[cBvhPacketSize]) const {
+	for (auto& hit : hits)
+		hit = RayHit();
+
+#ifdef AMANO_BVH_SSE
+	if (m_nodes.empty())
+		return;
+
+	alignas(16) float components[10][cBvhPacketSize];
+	alignas(16) float tMaxs[cBvhPacketSize];
+	for (uint32_t i = 0; i < cBvhPacketSize; ++i) {
+		const Ray& ray = packet.rays[i];
+		components[0][i] = ray.origin.x;
+		components[1][i] = ray.origin.y;
+		components[2][i] = ray.origin.z;
+		components[3][i] = ray.direction.x;
+		components[4][i] = ray.direction.y;
+		components[5][i] = ray.direction.z;
+		components[6][i] = 1.0f / ray.direction.x;
+		components[7][i] = 1.0f / ray.direction.y;
+		components[8][i] = 1.0f / ray.direction.z;
+		components[9][i] = ray.tMin;
+		tMaxs[i] = ray.tMax;
+	}
+
+	PacketRegisters registers;
+	registers.originX = _mm_load_ps(components[0]);
+	registers.originY = _mm_load_ps(components[1]);
+	registers.originZ = _mm_load_ps(components[2]);
+	registers.directionX = _mm_load_ps(components[3]);
+	registers.directionY = _mm_load_ps(components[4]);
+	registers.directionZ = _mm_load_ps(components[5]);
+	registers.inverseDirectionX = _mm_load_ps(components[6]);
+	registers.inverseDirectionY = _mm_load_ps(components[7]);
+	registers.inverseDirectionZ = _mm_load_ps(components[8]);
+	registers.tMin = _mm_load_ps(components[9]);
+	__m128 tMax = _mm_load_ps(tMaxs);
+
+	// a node is visited while at least one ray of the packet hits it
+	uint32_t stack[cBvhMaxDepth];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+
+	__m128 tEntry;
+	if (_mm_movemask_ps(intersectBounds(m_nodes[0], registers, tMax, tEntry)) == 0)
+		return;
+
+	while (true) {
+		const BvhNode& node = m_nodes[nodeIndex];
+		if (node.triangleCount > 0) {
+			for (uint32_t i = node.offset; i < node.offset + node.triangleCount; ++i) {
+				__m128 t, u, v;
+				__m128 mask = intersectTriangle(registers, tMax, &m_trianglePositions[3 * i], t, u, v);
+				int hitMask = _mm_movemask_ps(mask);
+				if (hitMask == 0)
+					continue;
+
+				tMax = select(mask, t, tMax);
+
+				alignas(16) float ts[cBvhPacketSize], us[cBvhPacketSize], vs[cBvhPacketSize];
+				_mm_store_ps(ts, t);
+				_mm_store_ps(us, u);
+				_mm_store_ps(vs, v);
+				for (uint32_t ray = 0; ray < cBvhPacketSize; ++ray) {
+					if ((hitMask & (1 << ray)) == 0)
+						continue;
+					hits[ray].t = ts[ray];
+					hits[ray].triangle = m_triangleIndices[i];
+					hits[ray].barycentrics = glm::vec2(us[ray], vs[ray]);
+				}
+			}
+		}
+		else {
+			uint32_t first = nodeIndex + 1;
+			uint32_t second = node.offset;
+			__m128 firstEntry, secondEntry;
+			__m128 firstMask = intersectBounds(m_nodes[first], registers, tMax, firstEntry);
+			__m128 secondMask = intersectBounds(m_nodes[second], registers, tMax, secondEntry);
+			bool isFirstHit = _mm_movemask_ps(firstMask) != 0;
+			bool isSecondHit = _mm_movemask_ps(secondMask) != 0;
+
+			if (isFirstHit && isSecondHit) {
+				if (getNearestEntry(secondEntry, secondMask) < getNearestEntry(firstEntry, firstMask))
+					std::swap(first, second);
+				stack[stackSize++] = second;
+				nodeIndex = first;
+				continue;
+			}
+			if (isFirstHit) {
+				nodeIndex = first;
+				continue;
+			}
+			if (isSecondHit) {
+				nodeIndex = second;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		nodeIndex = stack[--stackSize];
+	}
+#else
+	for (uint32_t i = 0; i < cBvhPacketSize; ++i)
+		traverse(packet.rays[i], hits[i], false);
+#endif
+}
+
+bool Bvh::intersectInstance(const Ray& ray, const glm::mat4& model, RayHit& hit) const {
+	glm::mat4 inverseModel = glm::inverse(model);
+
+	Ray modelRay = ray;
+	modelRay.origin = glm::vec3(inverseModel * glm::vec4(ray.origin, 1.0f));
+	modelRay.direction = glm::vec3(inverseModel * glm::vec4(ray.direction, 0.0f));
+
+	return traverse(modelRay, hit, false);
+}
+
+void Bvh::benchmark(uint32_t rayCount) const {
+	if (m_nodes.empty())
+		return;
+
+	// coherent packets: the rays of a packet leave the same point toward close points of the mesh bounds
+	const BvhNode& root = m_nodes[0];
+	glm::vec3 center = (root.boundsMin + root.boundsMax) * 0.5f;
+	glm::vec3 extent = root.boundsMax - root.boundsMin;
+	float radius = glm::length(extent) * 0.5f;
+
+	std::mt19937 generator(0);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	auto random3 = [&]() { return glm::vec3(distribution(generator), distribution(generator), distribution(generator)); };
+
+	uint32_t packetCount = (rayCount + cBvhPacketSize - 1) / cBvhPacketSize;
+	std::vector<RayPacket> packets(packetCount);
+	for (auto& packet : packets) {
+		glm::vec3 origin = center + 2.0f * radius * getRandomDirection(generator);
+		glm::vec3 target = root.boundsMin + extent * random3();
+		for (auto& ray : packet.rays) {
+			ray.origin = origin;
+			ray.direction = glm::normalize(target + (random3() - 0.5f) * 0.02f * radius - origin);
+		}
+	}
+
+	uint32_t singleHitCount = 0;
+	auto singleStart = std::chrono::high_resolution_clock::now();
+	for (const auto& packet : packets) {
+		for (const auto& ray : packet.rays) {
+			RayHit hit;
+			singleHitCount += intersect(ray, hit) ? 1 : 0;
+		}
+	}
+	auto singleEnd = std::chrono::high_resolution_clock::now();
+
+	uint32_t packetHitCount = 0;
+	for (const auto& packet : packets) {
+		RayHit hits[cBvhPacketSize];
+		intersect(packet, hits);
+		for (const auto& hit : hits)
+			packetHitCount += hit.triangle != UINT32_MAX ? 1 : 0;
+	}
+	auto packetEnd = std::chrono::high_resolution_clock::now();
+
+	double tracedRayCount = static_cast<double>(packetCount * cBvhPacketSize);
+	double singleSeconds = std::chrono::duration<double>(singleEnd - singleStart).count();
+	double packetSeconds = std::chrono::duration<double>(packetEnd - singleEnd).count();
+
+	std::cout << "bvh benchmark: " << m_nodes.size() << " nodes, " << m_triangleIndices.size() << " triangles, " << tracedRayCount << " rays" << std::endl;
+	std::cout << "  single rays: " << tracedRayCount / singleSeconds * 1e-6 << " Mrays/s, " << singleHitCount << " hits" << std::endl;
+	std::cout << "  packets of " << cBvhPacketSize << ": " << tracedRayCount / packetSeconds * 1e-6 << " Mrays/s, " << packetHitCount << " hits" << std::endl;
+}
+
+bool Bvh::traverse(const Ray& ray, RayHit& hit, bool isAnyHit) const {
+	if (m_nodes.empty())
+		return false;
+
+	glm::vec3 inverseDirection = 1.0f / ray.direction;
+	float tMax = ray.tMax;
+
+	uint32_t stack[cBvhMaxDepth];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+
+	float tEntry;
+	if (!intersectBounds(m_nodes[0], ray.origin, inverseDirection, ray.tMin, tMax, tEntry))
+		return false;
+
+	bool isHit = false;
+	while (true) {
+		const BvhNode& node = m_nodes[nodeIndex];
+		if (node.triangleCount > 0) {
+			for (uint32_t i = node.offset; i < node.offset + node.triangleCount; ++i) {
+				float t;
+				glm::vec2 barycentrics;
+				if (!intersectTriangle(ray, tMax, &m_trianglePositions[3 * i], t, barycentrics))
+					continue;
+
+				tMax = t;
+				hit.t = t;
+				hit.triangle = m_triangleIndices[i];
+				hit.barycentrics = barycentrics;
+				isHit = true;
+				if (isAnyHit)
+					return true;
+			}
+		}
+		else {
+			uint32_t first = nodeIndex + 1;
+			uint32_t second = node.offset;
+			float firstEntry, secondEntry;
+			bool isFirstHit = intersectBounds(m_nodes[first], ray.origin, inverseDirection, ray.tMin, tMax, firstEntry);
+			bool isSecondHit = intersectBounds(m_nodes[second], ray.origin, inverseDirection, ray.tMin, tMax, secondEntry);
+
+			// the nearest child is visited first, the farthest one is often culled by its hits
+			if (isFirstHit && isSecondHit) {
+				if (secondEntry < firstEntry)
+					std::swap(first, second);
+				stack[stackSize++] = second;
+				nodeIndex = first;
+				continue;
+			}
+			if (isFirstHit) {
+				nodeIndex = first;
+				continue;
+			}
+			if (isSecondHit) {
+				nodeIndex = second;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		nodeIndex = stack[--stackSize];
+	}
+
+	return isHit;
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "glm.h"
+#include "Vertex.h"
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+namespace Amano {
+
+class Mesh;
+
+// Number of rays traced together by the packet traversal, one per SSE lane
+const uint32_t cBvhPacketSize = 4;
+
+// Deeper nodes become leaves, so that the traversal stacks never overflow
+// The value must match BVH_MAX_DEPTH of bvh.glsl
+const uint32_t cBvhMaxDepth = 64;
+
+// The direction doesn't need to be normalized, t is measured in units of the direction
+struct Ray {
+	glm::vec3 origin;
+	float tMin = 0.0f;
+	glm::vec3 direction;
+	float tMax = FLT_MAX;
+};
+
+struct RayHit {
+	float t = FLT_MAX;
+	uint32_t triangle = UINT32_MAX;  // index of the triangle in the mesh, UINT32_MAX when nothing is hit
+	glm::vec2 barycentrics = glm::vec2(0.0f);  // weights of the second and third vertices of the triangle
+};
+
+// Rays traced together, they should be coherent (same origin, close directions) for the packet to be faster than single rays
+struct RayPacket {
+	Ray rays[cBvhPacketSize];
+};
+
+// A node of the flattened tree, 32 bytes so that two nodes fit in a cache line
+// The tree is stored depth first: the first child of an interior node follows it, offset is the index of the second child
+// The layout matches std430, so the nodes can be uploaded to the GPU as they are
+struct BvhNode {
+	glm::vec3 boundsMin;
+	uint32_t offset;         // first triangle of a leaf, second child of an interior node
+	glm::vec3 boundsMax;
+	uint32_t triangleCount;  // 0 for interior nodes
+};
+
+// This class is a CPU bounding volume hierarchy over the triangles of a mesh
+// It gives host side ray queries (picking, visibility) and a reference for the raytracing passes, without depending on the driver
+//   - the tree is built with the surface area heuristic, evaluated on bins of the triangle centroids
+//   - the large subtrees are built in parallel
+//   - the packets are traversed with SSE, each lane tracing one ray
+class Bvh
+{
+public:
+	Bvh();
+
+	// Builds the tree over the full resolution triangles of the mesh
+	void build(const Mesh& mesh);
+	void build(const std::vector<Vertex>& vertices, const uint32_t* indices, uint32_t indexCount);
+
+	bool isEmpty() const { return m_nodes.empty(); }
+	const std::vector<BvhNode>& getNodes() const { return m_nodes; }
+
+	// The triangles are stored in the order of the leaves: three positions per triangle, w is 1
+	const std::vector<glm::vec4>& getTrianglePositions() const { return m_trianglePositions; }
+	// Index of the mesh triangle of each stored triangle
+	const std::vector<uint32_t>& getTriangleIndices() const { return m_triangleIndices; }
+
+	// Finds the closest hit between ray.tMin and ray.tMax, returns false when nothing is hit
+	bool intersect(const Ray& ray, RayHit& hit) const;
+	// Stops at the first hit, enough for shadows and visibility
+	bool isOccluded(const Ray& ray) const;
+	// Finds the closest hit of each ray of the packet
+	void intersect(const RayPacket& packet, RayHit (&hits)[cBvhPacketSize]) const;
+
+	// The ray is in world space, model is the transform of an instance of the mesh
+	// t is the same in both spaces, since the ray direction isn't normalized after the transform
+	bool intersectInstance(const Ray& ray, const glm::mat4& model, RayHit& hit) const;
+
+	// Traces rayCount random rays against the tree, single and in packets, and prints the number of Mrays/s
+	void benchmark(uint32_t rayCount) const;
+
+private:
+	bool traverse(const Ray& ray, RayHit& hit, bool isAnyHit) const;
+
+private:
+	std::vector<BvhNode> m_nodes;
+	std::vector<glm::vec4> m_trianglePositions;
+	std::vector<uint32_t> m_triangleIndices;
+};
+
+}
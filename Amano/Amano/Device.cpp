@@ -1,7 +1,10 @@
 #include "Device.h"
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <optional>
 #include <set>
@@ -10,12 +13,28 @@ namespace {
 
 const std::vector<const char*> cDeviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-#ifdef AMANO_USE_RAYTRACING
+};
+
+// Optional, only enabled when the device supports all of them
+const std::vector<const char*> cRaytracingExtensions = {
 	VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
 	VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
-#endif
+	VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
 };
 
+// Scores of the device types, the largest heap and the raytracing support are added to them
+const int cDiscreteGpuScore = 4000;
+const int cIntegratedGpuScore = 2000;
+const int cVirtualGpuScore = 1000;
+const int cRaytracingScore = 1000;
+// one point per 64 MiB of device local memory
+const VkDeviceSize cScoreHeapSizeUnit = 64 * 1024 * 1024;
+
+// PCI vendor ids of the tile based GPUs
+const uint32_t cVendorIdArm = 0x13B5;
+const uint32_t cVendorIdImgTec = 0x1010;
+const uint32_t cVendorIdQualcomm = 0x5143;
+
 const std::vector<const char*> cValidationLayers = {
 	"VK_LAYER_KHRONOS_validation"
 };
@@ -140,14 +159,14 @@ QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice, VkSurfaceK
 	return indices;
 }
 
-bool checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice) {
+bool checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice, const std::vector<const char*>& extensions) {
 	uint32_t extensionCount;
 	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
 
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(cDeviceExtensions.begin(), cDeviceExtensions.end());
+	std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 	for (const auto& extension : availableExtensions) {
 		requiredExtensions.erase(extension.extensionName);
@@ -200,7 +219,7 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>
 bool isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice, surface);
 
-	bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice);
+	bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice, cDeviceExtensions);
 
 	bool swapChainAdequate = false;
 	if (extensionsSupported) {
@@ -219,26 +238,128 @@ bool isDeviceSuitable(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
 	return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
 }
 
-int rateDeviceSuitability(VkPhysicalDevice physicalDevice) {
+bool isVulkan12Supported(VkPhysicalDevice physicalDevice) {
 	VkPhysicalDeviceProperties deviceProperties;
-	VkPhysicalDeviceFeatures deviceFeatures;
 	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
-	vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
+	return deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+}
 
-	int score = 0;
+// Features of the optional capabilities, chained to VkPhysicalDeviceFeatures2
+// The same chain is used to query the features and to enable them
+struct OptionalFeatures {
+	VkPhysicalDeviceFeatures2 features2{};
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
+	VkPhysicalDeviceRayTracingPipelineFeaturesKHR raytracingPipelineFeatures{};
+
+	// The structures are only chained when the device knows them, the unknown structures are not allowed in the chain
+	// The Vulkan 1.2 structure needs a Vulkan 1.2 device, the raytracing ones need the extensions
+	void chain(bool hasVulkan12, bool hasRaytracingExtensions) {
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = nullptr;
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.pNext = nullptr;
+		accelerationStructureFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+		accelerationStructureFeatures.pNext = nullptr;
+		raytracingPipelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
+		raytracingPipelineFeatures.pNext = nullptr;
+
+		void** next = &features2.pNext;
+		if (hasVulkan12) {
+			*next = &vulkan12Features;
+			next = &vulkan12Features.pNext;
+		}
+		if (hasRaytracingExtensions) {
+			*next = &accelerationStructureFeatures;
+			accelerationStructureFeatures.pNext = &raytracingPipelineFeatures;
+		}
+	}
+};
+
+bool isRaytracingSupported(VkPhysicalDevice physicalDevice) {
+	// the raytracing code uses the buffer device addresses of Vulkan 1.2
+	if (!isVulkan12Supported(physicalDevice) || !checkDeviceExtensionSupport(physicalDevice, cRaytracingExtensions))
+		return false;
 
-	// Discrete GPUs have a significant performance advantage
-	if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-		score += 1000;
+	OptionalFeatures features;
+	features.chain(true, true);
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features.features2);
+
+	return features.accelerationStructureFeatures.accelerationStructure
+		&& features.raytracingPipelineFeatures.rayTracingPipeline
+		&& features.vulkan12Features.bufferDeviceAddress;
+}
+
+// Only valid when the raytracing is supported
+bool isTraceRaysIndirectSupported(VkPhysicalDevice physicalDevice) {
+	OptionalFeatures features;
+	features.chain(true, true);
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &features.features2);
+
+	return features.raytracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect;
+}
+
+bool isAsyncComputeSupported(VkPhysicalDevice physicalDevice) {
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	for (const auto& queueFamily : queueFamilies) {
+		if ((queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			return true;
 	}
+	return false;
+}
 
-	// Maximum possible size of textures affects graphics quality
-	score += deviceProperties.limits.maxImageDimension2D;
+bool isLazilyAllocatedMemorySupported(VkPhysicalDevice physicalDevice) {
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+		if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+			return true;
+	}
+	return false;
+}
 
-	// Application can't function without geometry shaders
-	if (!deviceFeatures.geometryShader) {
+// Returns 0 for the devices which can't run the application
+int rateDeviceSuitability(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface) {
+	if (!isDeviceSuitable(physicalDevice, surface))
 		return 0;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	// the CPU implementations keep the score of 1, they are only picked when nothing else is available
+	int score = 1;
+	switch (deviceProperties.deviceType) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		score += cDiscreteGpuScore;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		score += cIntegratedGpuScore;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		score += cVirtualGpuScore;
+		break;
+	default:
+		break;
+	}
+
+	if (isRaytracingSupported(physicalDevice))
+		score += cRaytracingScore;
+
+	// between two devices of the same type, the one with more memory is usually the faster one
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	VkDeviceSize largestHeapSize = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+			largestHeapSize = std::max(largestHeapSize, memoryProperties.memoryHeaps[i].size);
 	}
+	score += static_cast<int>(largestHeapSize / cScoreHeapSizeUnit);
 
 	return score;
 }
@@ -288,7 +409,13 @@ Device::Device()
 	, m_swapChainImageFormat{ VK_FORMAT_UNDEFINED }
 	, m_swapChainExtent{ 0, 0 }
 	, m_descriptorPool{ VK_NULL_HANDLE }
+	, m_computeWorkgroupSize{ 16, 16 }
+	, m_capabilities()
+	, m_accelerationStructureProperties{}
+	, m_raytracingPipelineProperties{}
 	, m_queues{}
+	, m_asyncComputeFamily{ 0 }
+	, m_asyncComputeQueueIndex{ 0 }
 	, m_extensions()
 {
 	for (int i = 0; i < static_cast<int>(QueueType::eCount); ++i)
@@ -315,46 +442,12 @@ bool Device::init(GLFWwindow* window) {
 		&& setupDebugMessenger()
 		&& createSurface(window)
 		&& pickPhysicalDevice()
+		&& chooseComputeWorkgroupSize()
 		&& createLogicalDevice()
 		&& createQueues()
 		&& createSwapChain(window)
 		&& createDescriptorPool()
-		&& m_extensions.queryRaytracingFunctions(m_instance);
-}
-
-VkPhysicalDeviceAccelerationStructurePropertiesKHR Device::getPhysicalAccelerationStructureProperties() {
-	// TODO: cache that
-	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationProperties{};
-	accelerationProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
-	accelerationProperties.pNext = nullptr;
-
-	VkPhysicalDeviceRayTracingPipelinePropertiesKHR raytracingPipelineProperties{};
-	raytracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
-	raytracingPipelineProperties.pNext = &accelerationProperties;
-
-	VkPhysicalDeviceProperties2 props{};
-	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
-	props.pNext = &raytracingPipelineProperties;
-	vkGetPhysicalDeviceProperties2(m_physicalDevice, &props);
-	return accelerationProperties;
-}
-
-VkPhysicalDeviceRayTracingPipelinePropertiesKHR Device::getPhysicalRaytracingPipelineProperties() {
-	// TODO: cache that
-	// it's the same code as above
-	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationProperties{};
-	accelerationProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
-	accelerationProperties.pNext = nullptr;
-
-	VkPhysicalDeviceRayTracingPipelinePropertiesKHR raytracingPipelineProperties{};
-	raytracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
-	raytracingPipelineProperties.pNext = &accelerationProperties;
-
-	VkPhysicalDeviceProperties2 props{};
-	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
-	props.pNext = &raytracingPipelineProperties;
-	vkGetPhysicalDeviceProperties2(m_physicalDevice, &props);
-	return raytracingPipelineProperties;
+		&& (!m_capabilities.raytracing || m_extensions.queryRaytracingFunctions(m_instance));
 }
 
 void Device::waitIdle() {
@@ -427,6 +520,14 @@ bool Device::createBufferAndMemory(VkDeviceSize size, VkBufferUsageFlags usage,
 	bufferInfo.usage = usage;
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+	// the acceleration structures are built on the async compute queue from meshes that the graphics queue keeps drawing
+	uint32_t queueFamilyIndices[] = { getQueue(QueueType::eGraphics)->familyIndex(), getQueue(QueueType::eAsyncCompute)->familyIndex() };
+	if ((usage & VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR) && isAsyncComputeFamilySeparate()) {
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = 2;
+		bufferInfo.pQueueFamilyIndices = queueFamilyIndices;
+	}
+
 	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer)) {
 		std::cerr << "failed to create buffer!" << std::endl;
 	}
@@ -448,6 +549,14 @@ void Device::destroyBuffer(VkBuffer buffer) {
 	vkDestroyBuffer(m_device, buffer, nullptr);
 }
 
+VkDeviceAddress Device::getBufferAddress(VkBuffer buffer) {
+	VkBufferDeviceAddressInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	info.buffer = buffer;
+
+	return vkGetBufferDeviceAddress(m_device, &info);
+}
+
 VkDeviceMemory Device::allocateMemory(VkMemoryRequirements requirements, VkMemoryPropertyFlags propertyFlags) {
 	return allocateMemory(requirements, 0, propertyFlags);
 }
@@ -632,10 +741,12 @@ bool Device::pickPhysicalDevice() {
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
 
+	int bestScore = 0;
 	for (const auto& device : devices) {
-		if (isDeviceSuitable(device, m_surface)) {
+		int score = rateDeviceSuitability(device, m_surface);
+		if (score > bestScore) {
 			m_physicalDevice = device;
-			break;
+			bestScore = score;
 		}
 	}
 
@@ -644,39 +755,147 @@ bool Device::pickPhysicalDevice() {
 		return false;
 	}
 
+	queryCapabilities();
+
+	return true;
+}
+
+void Device::queryCapabilities() {
+	m_capabilities.raytracing = isRaytracingSupported(m_physicalDevice);
+	m_capabilities.traceRaysIndirect = m_capabilities.raytracing && isTraceRaysIndirectSupported(m_physicalDevice);
+	m_capabilities.asyncCompute = isAsyncComputeSupported(m_physicalDevice);
+	m_capabilities.lazilyAllocatedMemory = isLazilyAllocatedMemorySupported(m_physicalDevice);
+
+	if (!m_capabilities.raytracing)
+		return;
+
+	m_accelerationStructureProperties = {};
+	m_accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+	m_accelerationStructureProperties.pNext = nullptr;
+
+	m_raytracingPipelineProperties = {};
+	m_raytracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+	m_raytracingPipelineProperties.pNext = &m_accelerationStructureProperties;
+
+	VkPhysicalDeviceProperties2 props{};
+	props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props.pNext = &m_raytracingPipelineProperties;
+	vkGetPhysicalDeviceProperties2(m_physicalDevice, &props);
+
+	// the copies given to the passes must not point to the members
+	m_raytracingPipelineProperties.pNext = nullptr;
+}
+
+bool Device::chooseComputeWorkgroupSize() {
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+
+	// 256 invocations fill the wavefronts of the desktop GPUs and keep enough registers per invocation
+	// the tile based GPUs prefer smaller work groups
+	VkExtent2D workgroupSize = { 16, 16 };
+	switch (deviceProperties.vendorID) {
+	case cVendorIdArm:
+	case cVendorIdImgTec:
+	case cVendorIdQualcomm:
+		workgroupSize = { 8, 8 };
+		break;
+	default:
+		break;
+	}
+
+	// manual override to tune the size on a given GPU
+	const char* overrideSize = std::getenv("AMANO_COMPUTE_WORKGROUP_SIZE");
+	if (overrideSize != nullptr) {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		if (sscanf(overrideSize, "%ux%u", &width, &height) == 2 && width > 0 && height > 0)
+			workgroupSize = { width, height };
+		else
+			std::cerr << "invalid AMANO_COMPUTE_WORKGROUP_SIZE, expected WIDTHxHEIGHT" << std::endl;
+	}
+
+	// stay within the limits of the device
+	const VkPhysicalDeviceLimits& limits = deviceProperties.limits;
+	workgroupSize.width = std::min(workgroupSize.width, limits.maxComputeWorkGroupSize[0]);
+	workgroupSize.height = std::min(workgroupSize.height, limits.maxComputeWorkGroupSize[1]);
+	while (workgroupSize.width * workgroupSize.height > limits.maxComputeWorkGroupInvocations) {
+		if (workgroupSize.width >= workgroupSize.height)
+			workgroupSize.width /= 2;
+		else
+			workgroupSize.height /= 2;
+	}
+
+	m_computeWorkgroupSize = workgroupSize;
 	return true;
 }
 
 bool Device::createLogicalDevice() {
 	QueueFamilyIndices indices = findQueueFamilies(m_physicalDevice, m_surface);
 
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	// the async compute queue must not be the one of the frames, which is waited every frame
+	// a second queue of the graphics family avoids the ownership transfers, the compute family is used otherwise
+	if (queueFamilies[indices.graphicsFamily.value()].queueCount > 1) {
+		m_asyncComputeFamily = indices.graphicsFamily.value();
+		m_asyncComputeQueueIndex = 1;
+	}
+	else if (m_capabilities.asyncCompute && indices.computeFamily.has_value()) {
+		m_asyncComputeFamily = indices.computeFamily.value();
+		m_asyncComputeQueueIndex = 0;
+	}
+	else {
+		std::cerr << "no queue for async compute, the background work runs on the graphics queue" << std::endl;
+		m_asyncComputeFamily = indices.graphicsFamily.value();
+		m_asyncComputeQueueIndex = 0;
+	}
+
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	// TODO: activate more queues
-	// create a compute queue to run in parallel
-	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+	std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value(), m_asyncComputeFamily };
 
-	float queuePriority = 1.0f;
+	// the background work has a lower priority than the frames
+	const float queuePriorities[] = { 1.0f, 0.5f };
 	for (uint32_t queueFamily : uniqueQueueFamilies) {
 		VkDeviceQueueCreateInfo queueCreateInfo{};
 		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueCreateInfo.queueFamilyIndex = queueFamily;
-		queueCreateInfo.queueCount = 1;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		queueCreateInfo.queueCount = queueFamily == m_asyncComputeFamily ? m_asyncComputeQueueIndex + 1 : 1;
+		// the async queue of a separate compute family is the first one of its family
+		bool isSeparateAsyncFamily = queueFamily == m_asyncComputeFamily && queueFamily != indices.graphicsFamily.value();
+		queueCreateInfo.pQueuePriorities = isSeparateAsyncFamily ? &queuePriorities[1] : queuePriorities;
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	VkPhysicalDeviceFeatures deviceFeatures{};
-	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	std::vector<const char*> extensions = cDeviceExtensions;
+	if (m_capabilities.raytracing)
+		extensions.insert(extensions.end(), cRaytracingExtensions.begin(), cRaytracingExtensions.end());
+
+	// the features are enabled through the pNext chain, pEnabledFeatures must stay null
+	// only the raytracing needs the Vulkan 1.2 features, which are then known to be supported
+	OptionalFeatures enabledFeatures;
+	enabledFeatures.chain(m_capabilities.raytracing, m_capabilities.raytracing);
+	enabledFeatures.features2.features.samplerAnisotropy = VK_TRUE;
+	if (m_capabilities.raytracing) {
+		enabledFeatures.vulkan12Features.bufferDeviceAddress = VK_TRUE;
+		enabledFeatures.accelerationStructureFeatures.accelerationStructure = VK_TRUE;
+		enabledFeatures.raytracingPipelineFeatures.rayTracingPipeline = VK_TRUE;
+		enabledFeatures.raytracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect = m_capabilities.traceRaysIndirect ? VK_TRUE : VK_FALSE;
+	}
 
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &enabledFeatures.features2;
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
-	createInfo.pEnabledFeatures = &deviceFeatures;
+	createInfo.pEnabledFeatures = nullptr;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(cDeviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = cDeviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	// this is ignored in new version of Vulkan. Keep the code for compatibility
 	if (cEnableValidationLayers) {
@@ -702,6 +921,7 @@ bool Device::createQueues() {
 	m_queues[static_cast<uint32_t>(QueueType::eCompute)] = new Queue(this, queueFamilyIndices.graphicsFamily.value());
 	// TODO: transfer
 	m_queues[static_cast<uint32_t>(QueueType::ePresent)] = new Queue(this, queueFamilyIndices.presentFamily.value());
+	m_queues[static_cast<uint32_t>(QueueType::eAsyncCompute)] = new Queue(this, m_asyncComputeFamily, m_asyncComputeQueueIndex);
 
 	return true;
 }
@@ -812,21 +1032,27 @@ bool Device::createDescriptorPool() {
 	// creates a pool of descriptors for uniform buffers, textures etc.
 	// each pool has one descriptor per swapchain image
 	uint32_t swapChainImagesCount = static_cast<uint32_t>(m_swapChainImages.size());
-	std::array<VkDescriptorPoolSize, 4> poolSizes{};
+	std::array<VkDescriptorPoolSize, 6> poolSizes{};
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSizes[0].descriptorCount = 100;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSizes[1].descriptorCount = 100;
 	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	poolSizes[2].descriptorCount = 100;
-	poolSizes[3].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	poolSizes[3].descriptorCount = 100;
+	// the GBuffer read by the lighting subpass
+	poolSizes[4].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+	poolSizes[4].descriptorCount = 10;
+	// the acceleration structure descriptors are only valid when the extension is enabled, so they stay last
+	poolSizes[5].type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+	poolSizes[5].descriptorCount = 100;
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.pNext = nullptr;
 	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.poolSizeCount = static_cast<uint32_t>(m_capabilities.raytracing ? poolSizes.size() : poolSizes.size() - 1);
 	poolInfo.pPoolSizes = poolSizes.data();
 	poolInfo.maxSets = 100 * static_cast<uint32_t>(m_swapChainImages.size());  // 100 per frame
 
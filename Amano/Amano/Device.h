@@ -1,7 +1,5 @@
 #pragma once
 
-#define AMANO_USE_RAYTRACING
-
 #include "glfw.h"
 #include "Extensions.h"
 #include "Queue.h"
@@ -14,8 +12,23 @@ enum class QueueType : uint32_t {
 	eGraphics = 0,
 	eCompute = 1,
 	ePresent = 2,
+	// background work that must not stall the frames, like the acceleration structure builds
+	eAsyncCompute = 3,
 	// eTransfer
-	eCount = 3
+	eCount = 4
+};
+
+// Optional capabilities of the physical device, probed once when it is picked
+// The extensions and features of a capability are only enabled when the device supports all of them
+struct DeviceCapabilities {
+	// VK_KHR_acceleration_structure, VK_KHR_ray_tracing_pipeline and buffer device addresses
+	bool raytracing = false;
+	// vkCmdTraceRaysIndirectKHR, the dimensions of a trace are read from a buffer written on the GPU
+	bool traceRaysIndirect = false;
+	// a queue family supports compute without graphics
+	bool asyncCompute = false;
+	// a memory type is lazily allocated, the tile based GPUs keep the transient attachments in their tile memory
+	bool lazilyAllocatedMemory = false;
 };
 
 class Device {
@@ -30,12 +43,22 @@ public:
 	VkPhysicalDevice physicalDevice() { return m_physicalDevice; }
 	VkDevice handle() { return m_device; };
 	const Extensions& getExtensions() const { return m_extensions; }
-	VkPhysicalDeviceAccelerationStructurePropertiesKHR getPhysicalAccelerationStructureProperties();
-	VkPhysicalDeviceRayTracingPipelinePropertiesKHR getPhysicalRaytracingPipelineProperties();
+	const DeviceCapabilities& getCapabilities() const { return m_capabilities; }
+
+	// Only valid when the device supports raytracing
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR getPhysicalAccelerationStructureProperties() const { return m_accelerationStructureProperties; }
+	VkPhysicalDeviceRayTracingPipelinePropertiesKHR getPhysicalRaytracingPipelineProperties() const { return m_raytracingPipelineProperties; }
+
+	// Work group size of the compute shaders working on images, chosen for the physical device
+	// It can be overridden with the AMANO_COMPUTE_WORKGROUP_SIZE environment variable, e.g. "16x8"
+	VkExtent2D getComputeWorkgroupSize() const { return m_computeWorkgroupSize; }
 
 	void recreateSwapChain(GLFWwindow* window);
 
 	Queue* getQueue(QueueType type) { return m_queues[static_cast<uint32_t>(type)]; }
+	// The async compute queue is a second queue of the graphics family when it has one, otherwise the first queue of the compute family
+	// In that case, the exclusive resources it writes must be released to the graphics family before their use
+	bool isAsyncComputeFamilySeparate() { return getQueue(QueueType::eAsyncCompute)->familyIndex() != getQueue(QueueType::eGraphics)->familyIndex(); }
 	VkDescriptorPool getDescriptorPool() { return m_descriptorPool; }
 	VkFormat getSwapChainFormat() const { return m_swapChainImageFormat; }
 	std::vector<VkImage>& getSwapChainImages() { return m_swapChainImages; }
@@ -52,6 +75,8 @@ public:
 	bool createBufferAndMemory(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags propertyFlags, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 	bool createBufferAndMemory(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryAllocateFlags allocateFlags, VkMemoryPropertyFlags propertyFlags, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 	void destroyBuffer(VkBuffer buffer);
+	// The buffer must have been created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+	VkDeviceAddress getBufferAddress(VkBuffer buffer);
 	VkDeviceMemory allocateMemory(VkMemoryRequirements requirements, VkMemoryPropertyFlags propertyFlags);
 	VkDeviceMemory allocateMemory(VkMemoryRequirements requirements, VkMemoryAllocateFlags allocateFlags, VkMemoryPropertyFlags propertyFlags);
 	void freeDeviceMemory(VkDeviceMemory deviceMemory);
@@ -67,6 +92,8 @@ private:
 	bool setupDebugMessenger();
 	bool createSurface(GLFWwindow* window);
 	bool pickPhysicalDevice();
+	void queryCapabilities();
+	bool chooseComputeWorkgroupSize();
 	bool createLogicalDevice();
 	bool createQueues();
 	bool createSwapChain(GLFWwindow* window);
@@ -88,8 +115,16 @@ private:
 	VkFormat m_swapChainImageFormat;
 	VkExtent2D m_swapChainExtent;
 	VkDescriptorPool m_descriptorPool;
+	VkExtent2D m_computeWorkgroupSize;
+
+	// cached when the physical device is picked
+	DeviceCapabilities m_capabilities;
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR m_accelerationStructureProperties;
+	VkPhysicalDeviceRayTracingPipelinePropertiesKHR m_raytracingPipelineProperties;
 
 	Queue* m_queues[static_cast<uint32_t>(QueueType::eCount)];
+	uint32_t m_asyncComputeFamily;
+	uint32_t m_asyncComputeQueueIndex;
 
 	Extensions m_extensions;
 };
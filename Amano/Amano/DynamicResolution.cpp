@@ -0,0 +1,57 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// weight of the last frame in the average frame time
+const float cFrameTimeSmoothing = 0.1f;
+// the scale changes by multiples of this step, so that small variations of the frame time are ignored
+const float cScaleStep = 0.05f;
+// frames to wait after a change, the average frame time must settle at the new scale
+const uint32_t cFramesBetweenChanges = 8;
+
+}
+
+namespace Amano {
+
+DynamicResolution::DynamicResolution()
+	: m_targetFrameTime{ 1000.0f / 60.0f }
+	, m_minScale{ 0.5f }
+	, m_maxScale{ 1.0f }
+	, m_scale{ 1.0f }
+	, m_averageFrameTime{ 0.0f }
+	, m_framesSinceChange{ 0 }
+{
+}
+
+void DynamicResolution::setScaleRange(float minScale, float maxScale) {
+	m_minScale = minScale;
+	m_maxScale = maxScale;
+	m_scale = maxScale;
+	m_averageFrameTime = 0.0f;
+	m_framesSinceChange = 0;
+}
+
+bool DynamicResolution::update(float frameTime) {
+	m_averageFrameTime = (m_averageFrameTime > 0.0f) ? m_averageFrameTime + cFrameTimeSmoothing * (frameTime - m_averageFrameTime) : frameTime;
+	if (++m_framesSinceChange < cFramesBetweenChanges)
+		return false;
+
+	// the scale whose pixel count fits the target, rounded toward the current scale
+	float idealScale = m_scale * std::sqrt(m_targetFrameTime / m_averageFrameTime);
+	float steps = (idealScale - m_scale) / cScaleStep;
+	float scale = m_scale + cScaleStep * ((steps > 0.0f) ? std::floor(steps) : std::ceil(steps));
+	scale = std::clamp(scale, m_minScale, m_maxScale);
+	if (std::abs(scale - m_scale) < 0.5f * cScaleStep)
+		return false;
+
+	// the frame time of the new scale is predicted until it is measured
+	m_averageFrameTime *= (scale * scale) / (m_scale * m_scale);
+	m_scale = scale;
+	m_framesSinceChange = 0;
+	return true;
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Amano {
+
+// This class adjusts the scale of the render resolution to hold a target frame time
+// The cost of a frame is assumed to be proportional to its number of pixels, so to the square of the scale
+// The scale moves by steps and waits a few frames between two changes
+// A change is cheap, the passes keep their images and only render a smaller part of them
+class DynamicResolution {
+public:
+	DynamicResolution();
+
+	float scale() const { return m_scale; }
+	float targetFrameTime() const { return m_targetFrameTime; }
+	float averageFrameTime() const { return m_averageFrameTime; }
+
+	void setTargetFrameTime(float milliseconds) { m_targetFrameTime = milliseconds; }
+	// the scale is reset to maxScale
+	void setScaleRange(float minScale, float maxScale);
+
+	// frameTime is the GPU duration of the last frame in milliseconds
+	// Returns true when the scale changed
+	bool update(float frameTime);
+
+private:
+	float m_targetFrameTime;
+	float m_minScale;
+	float m_maxScale;
+	float m_scale;
+	float m_averageFrameTime;
+	uint32_t m_framesSinceChange;
+};
+
+}
@@ -7,11 +7,14 @@ namespace Amano {
 bool Extensions::queryRaytracingFunctions(VkInstance instance) {
 	GET_PROC_ADDRESS(vkCreateRayTracingPipelinesKHR);
 	GET_PROC_ADDRESS(vkCmdTraceRaysKHR);
+	GET_PROC_ADDRESS(vkCmdTraceRaysIndirectKHR);
 	vkCreateAccelerationStructureKHR = (PFN_vkCreateAccelerationStructureKHR)vkGetInstanceProcAddr(instance, "vkCreateAccelerationStructureKHR");
 	vkDestroyAccelerationStructureKHR = (PFN_vkDestroyAccelerationStructureKHR)vkGetInstanceProcAddr(instance, "vkDestroyAccelerationStructureKHR");
 	GET_PROC_ADDRESS(vkGetAccelerationStructureBuildSizesKHR);
 	GET_PROC_ADDRESS(vkGetAccelerationStructureDeviceAddressKHR);
 	GET_PROC_ADDRESS(vkCmdBuildAccelerationStructuresKHR);
+	GET_PROC_ADDRESS(vkCmdWriteAccelerationStructuresPropertiesKHR);
+	GET_PROC_ADDRESS(vkCmdCopyAccelerationStructureKHR);
 	GET_PROC_ADDRESS(vkGetRayTracingShaderGroupHandlesKHR);
 	vkGetPhysicalDeviceProperties2 = (PFN_vkGetPhysicalDeviceProperties2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2");
 
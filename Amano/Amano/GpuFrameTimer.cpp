@@ -0,0 +1,98 @@
+#include "GpuFrameTimer.h"
+
+#include <iostream>
+#include <vector>
+
+namespace Amano {
+
+GpuFrameTimer::GpuFrameTimer(Device* device)
+	: m_device{ device }
+	, m_queryPool{ VK_NULL_HANDLE }
+	, m_beginStage{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT }
+	, m_timestampPeriod{ 0.0f }
+	, m_timestampMask{ 0 }
+	, m_isMeasuring{ false }
+{
+}
+
+GpuFrameTimer::~GpuFrameTimer() {
+	if (m_queryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(m_device->handle(), m_queryPool, nullptr);
+}
+
+bool GpuFrameTimer::init(VkPipelineStageFlagBits beginStage) {
+	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
+
+	// the queue family tells how many bits of the timestamps are valid, none when it doesn't support them
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_device->physicalDevice(), &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_device->physicalDevice(), &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[pQueue->familyIndex()].timestampValidBits;
+	if (validBits == 0)
+		return false;
+	m_timestampMask = (validBits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(m_device->physicalDevice(), &deviceProperties);
+	m_timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2;
+
+	if (vkCreateQueryPool(m_device->handle(), &queryPoolInfo, nullptr, &m_queryPool) != VK_SUCCESS) {
+		std::cerr << "failed to create the timestamp query pool!" << std::endl;
+		m_queryPool = VK_NULL_HANDLE;
+		return false;
+	}
+
+	m_beginStage = beginStage;
+
+	return true;
+}
+
+void GpuFrameTimer::recordBegin(VkCommandBuffer cmd) {
+	// the first timestamp is written once the wait of the first pass is over
+	vkCmdResetQueryPool(cmd, m_queryPool, 0, 2);
+	vkCmdWriteTimestamp(cmd, m_beginStage, m_queryPool, 0);
+}
+
+void GpuFrameTimer::recordEnd(VkCommandBuffer cmd) {
+	// the second one once all the previous commands of the queue are finished
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 1);
+}
+
+void GpuFrameTimer::startFrame() {
+	m_isMeasuring = false;
+}
+
+void GpuFrameTimer::endFrame() {
+	m_isMeasuring = true;
+}
+
+bool GpuFrameTimer::getFrameTime(float& milliseconds) {
+	if (!m_isMeasuring)
+		return false;
+
+	uint64_t timestamps[2] = {};
+	VkResult result = vkGetQueryPoolResults(
+		m_device->handle(),
+		m_queryPool,
+		0,
+		2,
+		sizeof(timestamps),
+		timestamps,
+		sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	if (result != VK_SUCCESS)
+		return false;
+
+	uint64_t ticks = (timestamps[1] - timestamps[0]) & m_timestampMask;
+	milliseconds = static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod * 1e-6);
+	return true;
+}
+
+}
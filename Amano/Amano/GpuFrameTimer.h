@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Device.h"
+
+namespace Amano {
+
+// This class measures the duration of the GPU work of a frame with two timestamps
+// The first one is recorded at the beginning of the command buffer of the first pass, the second one at the end of the command buffer of the last pass
+// Both passes run on the graphics queue, which runs the compute passes too, so the timestamps surround the work of every pass
+// The first pass waits for the swapchain image, its timestamp is written at the stage of that wait so the time spent waiting is not measured
+class GpuFrameTimer {
+public:
+	GpuFrameTimer(Device* device);
+	~GpuFrameTimer();
+
+	// beginStage is the stage at which the first pass waits for the swapchain image
+	// Returns false when the graphics queue doesn't support the timestamps
+	bool init(VkPipelineStageFlagBits beginStage);
+
+	// Resets the queries then writes the first timestamp, must be recorded outside of a render pass
+	void recordBegin(VkCommandBuffer cmd);
+	void recordEnd(VkCommandBuffer cmd);
+
+	// Must be called before submitting the first pass of the frame, and after submitting its last pass
+	// The frame is measured only when both were submitted
+	void startFrame();
+	void endFrame();
+
+	// Duration between the two timestamps of the last frame, in milliseconds
+	// Waits for the end timestamp to be written, returns false when the frame wasn't measured
+	bool getFrameTime(float& milliseconds);
+
+private:
+	Device* m_device;
+	VkQueryPool m_queryPool;
+	VkPipelineStageFlagBits m_beginStage;
+	float m_timestampPeriod;   // nanoseconds per tick
+	uint64_t m_timestampMask;  // the bits of the timestamps written by the queue
+	bool m_isMeasuring;
+};
+
+}
@@ -0,0 +1,341 @@
+#include "IBLBaker.h"
+#include "Image.h"
+#include "Queue.h"
+#include "Pass/CubemapSpecularFilteringPass.h"
+#include "Pass/IBLLutPass.h"
+#include "Pass/MemoryBarrier.h"
+#include "Pass/SHProjectionPass.h"
+
+#include "Builder/TransitionImageBarrierBuilder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+const uint32_t cCacheMagic = 0x4C424941;  // "AIBL"
+const uint32_t cCacheVersion = 3;
+
+// must match SAMPLES_COUNT of the LUT shader
+// the specular filter sample counts are part of cCacheVersion
+const uint32_t cFilterSampleCount = 4096;
+
+const VkFormat cSpecularFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+const VkFormat cBrdfLutFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+struct CacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t dataSize;
+};
+
+// 64 bits FNV-1a
+const uint64_t cHashSeed = 14695981039346656037ull;
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t hashValue(uint32_t value, uint64_t hash) {
+	return hashBytes(&value, sizeof(value), hash);
+}
+
+VkDeviceSize getPixelSize(VkFormat format) {
+	return format == VK_FORMAT_R32G32B32A32_SFLOAT ? 16 : 8;
+}
+
+// One region per mip level, all the layers of a mip level are contiguous
+// The same regions are used to read back and to upload the images, so the layout of the cache file is symmetric
+void addCopyRegions(const Amano::Image* image, uint32_t layerCount, std::vector<VkBufferImageCopy>& regions, VkDeviceSize& bufferOffset) {
+	uint32_t width = image->getWidth();
+	uint32_t height = image->getHeight();
+	for (uint32_t mip = 0; mip < image->getMipLevels(); ++mip) {
+		VkBufferImageCopy region{};
+		region.bufferOffset = bufferOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = mip;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = layerCount;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { width, height, 1 };
+		regions.push_back(region);
+
+		bufferOffset += getPixelSize(image->getFormat()) * width * height * layerCount;
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+}
+
+void transitionImages(VkCommandBuffer cmd, const Amano::IBLImages& images,
+	VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+	VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask) {
+	Amano::TransitionImageBarrierBuilder<2> transition;
+	transition
+		.setImage(0, images.specular->handle())
+		.setLayerCount(0, 6)
+		.setLevelCount(0, images.specular->getMipLevels())
+		.setImage(1, images.brdfLut->handle())
+		.setLevelCount(1, images.brdfLut->getMipLevels());
+	for (uint32_t i = 0; i < transition.getCount(); ++i) {
+		transition
+			.setLayouts(i, oldLayout, newLayout)
+			.setAccessMasks(i, srcAccessMask, dstAccessMask);
+	}
+	transition.execute(cmd, srcStageMask, dstStageMask);
+}
+
+}
+
+namespace Amano {
+
+IBLBaker::IBLBaker(Device* device, const std::string& cacheDirectory)
+	: m_device{ device }
+	, m_cacheDirectory{ cacheDirectory }
+{
+}
+
+IBLBaker::~IBLBaker() {
+}
+
+bool IBLBaker::bake(const std::vector<std::string>& sourceFilenames, Image* environmentImage, IBLImages& images) {
+	if (!createImages(images))
+		return false;
+
+	uint64_t key = computeCacheKey(sourceFilenames);
+	std::string filename = getCacheFilename(key);
+	if (loadCache(filename, key, images))
+		return true;
+
+	return filterAndSave(environmentImage, filename, key, images);
+}
+
+uint64_t IBLBaker::computeCacheKey(const std::vector<std::string>& sourceFilenames) {
+	uint64_t hash = cHashSeed;
+	for (const std::string& sourceFilename : sourceFilenames) {
+		std::ifstream file(sourceFilename, std::ios::binary);
+		std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		hash = hashBytes(content.data(), content.size(), hash);
+	}
+
+	// the filter parameters
+	hash = hashValue(cCacheVersion, hash);
+	hash = hashValue(cFilterSampleCount, hash);
+	hash = hashValue(cSHProjectionFaceSize, hash);
+	hash = hashValue(cSpecularMapSize, hash);
+	hash = hashValue(cSpecularMipCount, hash);
+	hash = hashValue(cBrdfLutSize, hash);
+	hash = hashValue(cSpecularFormat, hash);
+	hash = hashValue(cBrdfLutFormat, hash);
+	return hash;
+}
+
+std::string IBLBaker::getCacheFilename(uint64_t key) {
+	char name[32];
+	snprintf(name, sizeof(name), "ibl_%016llx.bin", static_cast<unsigned long long>(key));
+	return (std::filesystem::path(m_cacheDirectory) / name).string();
+}
+
+bool IBLBaker::createImages(IBLImages& images) {
+	const VkImageUsageFlags usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	images.specular = new Image(m_device);
+	images.brdfLut = new Image(m_device);
+
+	return images.specular->createCube(cSpecularMapSize, cSpecularMapSize, cSpecularMipCount, cSpecularFormat, usage)
+		&& images.specular->createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR)
+		&& images.brdfLut->create2D(cBrdfLutSize, cBrdfLutSize, 1, cBrdfLutFormat, usage)
+		&& images.brdfLut->createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR);
+}
+
+bool IBLBaker::loadCache(const std::string& filename, uint64_t key, IBLImages& images) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	// the spherical harmonics come first, their size is a multiple of the pixel sizes
+	std::vector<VkBufferImageCopy> specularRegions, brdfLutRegions;
+	VkDeviceSize dataSize = sizeof(IrradianceSH);
+	addCopyRegions(images.specular, 6, specularRegions, dataSize);
+	addCopyRegions(images.brdfLut, 1, brdfLutRegions, dataSize);
+
+	CacheHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || header.magic != cCacheMagic || header.version != cCacheVersion || header.key != key || header.dataSize != dataSize) {
+		std::cerr << "ignoring the invalid IBL cache " << filename << std::endl;
+		return false;
+	}
+
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+	if (!m_device->createBufferAndMemory(
+		dataSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		stagingBuffer,
+		stagingBufferMemory))
+		return false;
+
+	void* data;
+	vkMapMemory(m_device->handle(), stagingBufferMemory, 0, dataSize, 0, &data);
+	file.read(static_cast<char*>(data), static_cast<std::streamsize>(dataSize));
+	bool isComplete = static_cast<bool>(file);
+	if (isComplete)
+		memcpy(&images.irradianceSH, data, sizeof(IrradianceSH));
+	vkUnmapMemory(m_device->handle(), stagingBufferMemory);
+
+	if (isComplete) {
+		Queue* pQueue = m_device->getQueue(QueueType::eCompute);
+		VkCommandBuffer cmd = pQueue->beginSingleTimeCommands();
+
+		transitionImages(cmd, images,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			0, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		vkCmdCopyBufferToImage(cmd, stagingBuffer, images.specular->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(specularRegions.size()), specularRegions.data());
+		vkCmdCopyBufferToImage(cmd, stagingBuffer, images.brdfLut->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(brdfLutRegions.size()), brdfLutRegions.data());
+
+		transitionImages(cmd, images,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		pQueue->endSingleTimeCommands(cmd);
+	}
+	else {
+		std::cerr << "failed to read the IBL cache " << filename << std::endl;
+	}
+
+	m_device->destroyBuffer(stagingBuffer);
+	m_device->freeDeviceMemory(stagingBufferMemory);
+
+	return isComplete;
+}
+
+bool IBLBaker::filterAndSave(Image* environmentImage, const std::string& filename, uint64_t key, IBLImages& images) {
+	SHProjectionPass shProjectionPass(m_device);
+	CubemapSpecularFilteringPass specularFilteringPass(m_device);
+	IBLLutPass lutPass(m_device);
+	if (!shProjectionPass.init() || !specularFilteringPass.init() || !lutPass.init())
+		return false;
+
+	// the spherical harmonics come first, their size is a multiple of the pixel sizes
+	std::vector<VkBufferImageCopy> specularRegions, brdfLutRegions;
+	VkDeviceSize dataSize = sizeof(IrradianceSH);
+	addCopyRegions(images.specular, 6, specularRegions, dataSize);
+	addCopyRegions(images.brdfLut, 1, brdfLutRegions, dataSize);
+
+	VkBuffer readbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory readbackBufferMemory = VK_NULL_HANDLE;
+	if (!m_device->createBufferAndMemory(
+		dataSize,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		readbackBuffer,
+		readbackBufferMemory))
+		return false;
+
+	VkBuffer shBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory shBufferMemory = VK_NULL_HANDLE;
+	if (!m_device->createBufferAndMemory(
+		sizeof(IrradianceSH),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		shBuffer,
+		shBufferMemory)) {
+		m_device->destroyBuffer(readbackBuffer);
+		m_device->freeDeviceMemory(readbackBufferMemory);
+		return false;
+	}
+
+	Queue* pQueue = m_device->getQueue(QueueType::eCompute);
+	VkCommandBuffer cmd = pQueue->beginSingleTimeCommands();
+
+	transitionImages(cmd, images,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		0, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	shProjectionPass.setupAndRecord(cmd, environmentImage, shBuffer);
+	if (!specularFilteringPass.setupAndRecord(cmd, environmentImage, images.specular)) {
+		pQueue->endCommands(cmd);
+		pQueue->freeCommandBuffer(cmd);
+		m_device->destroyBuffer(shBuffer);
+		m_device->freeDeviceMemory(shBufferMemory);
+		m_device->destroyBuffer(readbackBuffer);
+		m_device->freeDeviceMemory(readbackBufferMemory);
+		return false;
+	}
+	lutPass.setupAndRecord(cmd, images.brdfLut);
+
+	// read the results back
+	transitionImages(cmd, images,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	// the image barriers don't cover the coefficients
+	memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+	VkBufferCopy shRegion{};
+	shRegion.srcOffset = 0;
+	shRegion.dstOffset = 0;
+	shRegion.size = sizeof(IrradianceSH);
+	vkCmdCopyBuffer(cmd, shBuffer, readbackBuffer, 1, &shRegion);
+	vkCmdCopyImageToBuffer(cmd, images.specular->handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, static_cast<uint32_t>(specularRegions.size()), specularRegions.data());
+	vkCmdCopyImageToBuffer(cmd, images.brdfLut->handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, static_cast<uint32_t>(brdfLutRegions.size()), brdfLutRegions.data());
+
+	transitionImages(cmd, images,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// this call is blocking, the buffer can be read afterwards
+	pQueue->endSingleTimeCommands(cmd);
+
+	void* data;
+	vkMapMemory(m_device->handle(), readbackBufferMemory, 0, dataSize, 0, &data);
+	memcpy(&images.irradianceSH, data, sizeof(IrradianceSH));
+
+	// a failure to write the cache isn't fatal, the images are ready anyway
+	std::error_code error;
+	std::filesystem::create_directories(m_cacheDirectory, error);
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (file.is_open()) {
+		CacheHeader header{};
+		header.magic = cCacheMagic;
+		header.version = cCacheVersion;
+		header.key = key;
+		header.dataSize = dataSize;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(dataSize));
+	}
+	if (!file) {
+		std::cerr << "failed to write the IBL cache " << filename << std::endl;
+	}
+	vkUnmapMemory(m_device->handle(), readbackBufferMemory);
+
+	m_device->destroyBuffer(shBuffer);
+	m_device->freeDeviceMemory(shBufferMemory);
+	m_device->destroyBuffer(readbackBuffer);
+	m_device->freeDeviceMemory(readbackBufferMemory);
+
+	return true;
+}
+
+}
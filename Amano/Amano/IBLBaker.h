@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Device.h"
+#include "Ubo.h"
+
+#include <string>
+#include <vector>
+
+namespace Amano {
+
+class Image;
+
+// Parameters of the baked images
+// Changing them invalidates the cache files
+const uint32_t cSpecularMapSize = 256;
+const uint32_t cSpecularMipCount = 6;   // the roughness goes from 0 to 1 along the mips
+const uint32_t cBrdfLutSize = 256;
+
+// Image based lighting of an environment map
+// The images are owned by the caller and are in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+struct IBLImages {
+	IrradianceSH irradianceSH{};   // diffuse part of the environment
+	Image* specular = nullptr;     // environment prefiltered with GGX
+	Image* brdfLut = nullptr;      // scale and bias of F0 in x and y, diffuse term in z
+};
+
+// This class bakes the image based lighting of an environment map with the filtering passes
+// The diffuse part is projected onto spherical harmonics instead of being convolved into a cubemap
+// The filters are expensive, so the results are read back and stored in a cache file
+// The file is keyed by a hash of the source images and of the filter parameters:
+// the next runs load it instead of filtering again
+class IBLBaker {
+public:
+	IBLBaker(Device* device, const std::string& cacheDirectory);
+	~IBLBaker();
+
+	// sourceFilenames are the files environmentImage was loaded from, they are only used for the cache key
+	// environmentImage must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with a sampler
+	bool bake(const std::vector<std::string>& sourceFilenames, Image* environmentImage, IBLImages& images);
+
+private:
+	uint64_t computeCacheKey(const std::vector<std::string>& sourceFilenames);
+	std::string getCacheFilename(uint64_t key);
+	bool createImages(IBLImages& images);
+	bool loadCache(const std::string& filename, uint64_t key, IBLImages& images);
+	bool filterAndSave(Image* environmentImage, const std::string& filename, uint64_t key, IBLImages& images);
+
+private:
+	Device* m_device;
+	std::string m_cacheDirectory;
+};
+
+}
@@ -374,7 +374,7 @@ VkImageView Image::createViewHandle(uint32_t mipLevel) {
 	return createView(getAspect(m_format), mipLevel, 1);
 }
 
-bool Image::create2D(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage) {
+bool Image::create2D(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
 	m_type = Type::eTexture2D;
 	m_width = width;
 	m_height = height;
@@ -405,7 +405,7 @@ bool Image::create2D(uint32_t width, uint32_t height, uint32_t mipLevels, VkForm
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(m_device->handle(), m_image, &memRequirements);
 
-	m_imageMemory = m_device->allocateMemory(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	m_imageMemory = m_device->allocateMemory(memRequirements, memoryProperties);
 	if (m_imageMemory == VK_NULL_HANDLE)
 		return false;
 
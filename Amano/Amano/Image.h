@@ -34,7 +34,8 @@ public:
 
 	VkImageView createViewHandle(uint32_t mipLevel);
 
-	bool create2D(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage);
+	// the transient attachments can use VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, see DeviceCapabilities
+	bool create2D(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	bool create2D(const std::string& filename, Queue& queue, bool generateMips);
 	// only loads DDS files
 	bool create2D(const std::string& filename, Queue& queue);
@@ -0,0 +1,79 @@
+#include "LightProbeGrid.h"
+
+#include <cstring>
+#include <vector>
+
+namespace Amano {
+
+LightProbeGrid::LightProbeGrid(Device* device)
+	: m_device{ device }
+	, m_uniformBuffer(device)
+	, m_params{}
+	, m_probeBuffer{ VK_NULL_HANDLE }
+	, m_probeBufferMemory{ VK_NULL_HANDLE }
+{
+}
+
+LightProbeGrid::~LightProbeGrid() {
+	destroy();
+}
+
+bool LightProbeGrid::create(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::uvec3& probeCounts, const IrradianceSH& environmentIrradiance) {
+	destroy();
+
+	glm::uvec3 counts = glm::max(probeCounts, glm::uvec3(2));
+	uint32_t probeCount = counts.x * counts.y * counts.z;
+
+	m_params.origin = glm::vec4(boundsMin, 0.0f);
+	m_params.spacing = glm::vec4((boundsMax - boundsMin) / glm::vec3(counts - glm::uvec3(1)), 0.0f);
+	m_params.probeCounts = glm::uvec4(counts, probeCount);
+	m_uniformBuffer.update(m_params);
+
+	// every probe starts with the environment irradiance, so the lighting doesn't change when the grid is enabled
+	std::vector<IrradianceSH> probes(probeCount, environmentIrradiance);
+	VkDeviceSize bufferSize = sizeof(IrradianceSH) * probes.size();
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	if (!m_device->createBufferAndMemory(
+		bufferSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		stagingBuffer,
+		stagingBufferMemory))
+		return false;
+
+	void* data;
+	vkMapMemory(m_device->handle(), stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, probes.data(), static_cast<size_t>(bufferSize));
+	vkUnmapMemory(m_device->handle(), stagingBufferMemory);
+
+	bool isCreated = m_device->createBufferAndMemory(
+		bufferSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_probeBuffer,
+		m_probeBufferMemory);
+	if (isCreated)
+		m_device->copyBuffer(stagingBuffer, m_probeBuffer, bufferSize, QueueType::eCompute);
+
+	m_device->destroyBuffer(stagingBuffer);
+	m_device->freeDeviceMemory(stagingBufferMemory);
+
+	return isCreated;
+}
+
+void LightProbeGrid::setEnabled(bool enabled) {
+	m_params.origin.w = enabled ? 1.0f : 0.0f;
+	m_uniformBuffer.update(m_params);
+}
+
+void LightProbeGrid::destroy() {
+	m_device->destroyBuffer(m_probeBuffer);
+	m_device->freeDeviceMemory(m_probeBufferMemory);
+	m_probeBuffer = VK_NULL_HANDLE;
+	m_probeBufferMemory = VK_NULL_HANDLE;
+	m_params = {};
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Device.h"
+#include "Ubo.h"
+#include "UniformBuffer.h"
+
+namespace Amano {
+
+// Number of probes along each axis of the grid
+const uint32_t cLightProbeGridSize = 8;
+
+// A regular 3D grid of irradiance probes placed over the scene bounds
+// Each probe stores the L2 spherical harmonics of its irradiance, like IrradianceSH, in the same axes as the environment
+// The probes start with the irradiance of the environment, a few of them are relit every frame by LightProbeRelightingPass
+// The lighting samples the grid only when it is enabled, otherwise it uses the environment irradiance directly
+class LightProbeGrid {
+public:
+	LightProbeGrid(Device* device);
+	~LightProbeGrid();
+
+	VkBuffer probeBuffer() const { return m_probeBuffer; }
+	VkBuffer paramsBuffer() { return m_uniformBuffer.getBuffer(); }
+	size_t paramsSize() { return m_uniformBuffer.getSize(); }
+	uint32_t getProbeCount() const { return m_params.probeCounts.w; }
+
+	// The first and the last probes are placed on the corners of the box
+	bool create(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::uvec3& probeCounts, const IrradianceSH& environmentIrradiance);
+
+	// The grid should only be enabled when the probes are relit
+	void setEnabled(bool enabled);
+
+private:
+	void destroy();
+
+private:
+	Device* m_device;
+	UniformBuffer<LightProbeGridParams> m_uniformBuffer;
+	LightProbeGridParams m_params;
+
+	// SH coefficients of the probes, read and written on the GPU
+	VkBuffer m_probeBuffer;
+	VkDeviceMemory m_probeBufferMemory;
+};
+
+}
@@ -1,9 +1,12 @@
 #include "Mesh.h"
 #include "Device.h"
+#include "MeshSimplifier.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 namespace std {
@@ -21,13 +24,85 @@ namespace std {
 }
 
 namespace {
-	VkDeviceAddress getBufferAddress(VkDevice device, VkBuffer buffer) {
-		VkBufferDeviceAddressInfo info = {};
-		info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-		info.pNext = nullptr;
-		info.buffer = buffer;
+	// Each level of detail targets half the indices of the previous one
+	const uint32_t cMaxLodCount = 8;
+	const float cLodIndexRatio = 0.5f;
+	const size_t cMinLodIndexCount = 3 * 64;
+
+	// A level is only kept when it removes enough triangles from the previous one
+	const float cMaxLodIndexRatio = 0.9f;
+
+	// Maximum simplification error, relative to the radius of the mesh
+	const float cMaxLodRelativeError = 0.1f;
+
+	// Marks a vertex which isn't part of the meshlet being built
+	const uint8_t cUnusedLocalIndex = 0xFF;
+
+	// The acceleration structure builds read the vertices and indices through their device addresses
+	const VkBufferUsageFlags cRaytracingInputUsage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+
+	// Computes the bounding sphere and the normal cone of a meshlet
+	// The cone test follows the meshoptimizer formulation:
+	// the meshlet is backfacing if dot(center - camera, axis) >= cutoff * length(center - camera) + radius
+	void computeMeshletBounds(
+		Amano::Meshlet& meshlet,
+		const std::vector<Amano::Vertex>& vertices,
+		const std::vector<uint32_t>& meshletVertices,
+		const std::vector<uint32_t>& meshletTriangles)
+	{
+		// bounding sphere centered on the bounding box
+		glm::vec3 minPosition = vertices[meshletVertices[meshlet.vertexOffset]].pos;
+		glm::vec3 maxPosition = minPosition;
+		for (uint32_t i = 1; i < meshlet.vertexCount; ++i) {
+			const glm::vec3& position = vertices[meshletVertices[meshlet.vertexOffset + i]].pos;
+			minPosition = glm::min(minPosition, position);
+			maxPosition = glm::max(maxPosition, position);
+		}
+
+		glm::vec3 center = 0.5f * (minPosition + maxPosition);
+		float radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			radius = std::max(radius, glm::length(vertices[meshletVertices[meshlet.vertexOffset + i]].pos - center));
+		meshlet.boundingSphere = glm::vec4(center, radius);
+
+		// normal cone
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangleCount);
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = 0; i < meshlet.triangleCount; ++i) {
+			uint32_t packed = meshletTriangles[meshlet.triangleOffset + i];
+			const glm::vec3& a = vertices[meshletVertices[meshlet.vertexOffset + (packed & 0xFF)]].pos;
+			const glm::vec3& b = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xFF)]].pos;
+			const glm::vec3& c = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xFF)]].pos;
+
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float area = glm::length(normal);
+			if (area <= 1e-12f)
+				continue;  // ignore degenerate triangles
+
+			normal /= area;
+			normals.push_back(normal);
+			axis += normal;
+		}
+
+		// a cutoff of 1 means the meshlet is never culled
+		meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+		float axisLength = glm::length(axis);
+		if (normals.empty() || axisLength <= 1e-6f)
+			return;
+
+		axis /= axisLength;
+		float minDot = 1.0f;
+		for (const auto& normal : normals)
+			minDot = std::min(minDot, glm::dot(axis, normal));
+
+		// the cone is too wide to ever be fully backfacing
+		if (minDot <= 0.1f) {
+			meshlet.cone = glm::vec4(axis, 1.0f);
+			return;
+		}
 
-		return vkGetBufferDeviceAddress(device, &info);
+		meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
 	}
 }
 
@@ -37,10 +112,24 @@ Mesh::Mesh(Device* device)
 	: m_device{ device }
 	, m_vertices()
 	, m_indices()
+	, m_lods()
+	, m_boundingSphere(0.0f)
 	, m_vertexBuffer{ VK_NULL_HANDLE }
 	, m_vertexBufferMemory{ VK_NULL_HANDLE }
 	, m_indexBuffer{ VK_NULL_HANDLE }
 	, m_indexBufferMemory{ VK_NULL_HANDLE }
+	, m_vertexStagingBuffer{ VK_NULL_HANDLE }
+	, m_vertexStagingBufferMemory{ VK_NULL_HANDLE }
+	, m_mappedVertexStagingBuffer{ nullptr }
+	, m_meshlets()
+	, m_meshletVertices()
+	, m_meshletTriangles()
+	, m_meshletBuffer{ VK_NULL_HANDLE }
+	, m_meshletBufferMemory{ VK_NULL_HANDLE }
+	, m_meshletVertexBuffer{ VK_NULL_HANDLE }
+	, m_meshletVertexBufferMemory{ VK_NULL_HANDLE }
+	, m_meshletTriangleBuffer{ VK_NULL_HANDLE }
+	, m_meshletTriangleBufferMemory{ VK_NULL_HANDLE }
 {
 }
 
@@ -49,20 +138,80 @@ Mesh::~Mesh() {
 	m_device->destroyBuffer(m_indexBuffer);
 	m_device->freeDeviceMemory(m_vertexBufferMemory);
 	m_device->freeDeviceMemory(m_indexBufferMemory);
+	m_device->destroyBuffer(m_vertexStagingBuffer);
+	m_device->freeDeviceMemory(m_vertexStagingBufferMemory);
+	m_device->destroyBuffer(m_meshletBuffer);
+	m_device->destroyBuffer(m_meshletVertexBuffer);
+	m_device->destroyBuffer(m_meshletTriangleBuffer);
+	m_device->freeDeviceMemory(m_meshletBufferMemory);
+	m_device->freeDeviceMemory(m_meshletVertexBufferMemory);
+	m_device->freeDeviceMemory(m_meshletTriangleBufferMemory);
 }
 
 bool Mesh::create(const std::string& filename) {
-	return load(filename)
-		&& createVertexBuffer()
-		&& createIndexBuffer();
+	if (!load(filename))
+		return false;
+
+	buildLods();
+	buildMeshlets();
+
+	return createVertexBuffer()
+		&& createIndexBuffer()
+		&& createMeshletBuffers();
+}
+
+bool Mesh::updateVertices(const std::vector<Vertex>& vertices) {
+	if (vertices.size() != m_vertices.size()) {
+		std::cerr << "the vertex count of a mesh can't change!" << std::endl;
+		return false;
+	}
+
+	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+	if (m_vertexStagingBuffer == VK_NULL_HANDLE) {
+		if (!m_device->createBufferAndMemory(
+			bufferSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			m_vertexStagingBuffer,
+			m_vertexStagingBufferMemory))
+			return false;
+
+		if (vkMapMemory(m_device->handle(), m_vertexStagingBufferMemory, 0, bufferSize, 0, &m_mappedVertexStagingBuffer) != VK_SUCCESS) {
+			std::cerr << "failed to map the vertex staging buffer!" << std::endl;
+			return false;
+		}
+	}
+
+	memcpy(m_mappedVertexStagingBuffer, vertices.data(), static_cast<size_t>(bufferSize));
+	m_device->copyBuffer(m_vertexStagingBuffer, m_vertexBuffer, bufferSize, QueueType::eGraphics);
+	return true;
 }
 
 VkDeviceAddress Mesh::getVertexBufferAddress() const {
-	return getBufferAddress(m_device->handle(), m_vertexBuffer);
+	return m_device->getBufferAddress(m_vertexBuffer);
 }
 
 VkDeviceAddress Mesh::getIndexBufferAddress() const {
-	return getBufferAddress(m_device->handle(), m_indexBuffer);
+	return m_device->getBufferAddress(m_indexBuffer);
+}
+
+uint32_t Mesh::selectLod(const glm::mat4& model, const glm::vec3& cameraPosition, float projectionScale, float maxPixelError) const {
+	// the errors are scaled by the largest scale of the model matrix
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(m_boundingSphere), 1.0f));
+
+	// use the closest point of the bounding sphere, so that the error is never underestimated
+	float distance = std::max(glm::length(center - cameraPosition) - m_boundingSphere.w * scale, 1e-4f);
+
+	uint32_t selectedLod = 0;
+	for (uint32_t i = 1; i < static_cast<uint32_t>(m_lods.size()); ++i) {
+		float projectedError = m_lods[i].error * scale * projectionScale / distance;
+		if (projectedError > maxPixelError)
+			break;
+		selectedLod = i;
+	}
+
+	return selectedLod;
 }
 
 bool Mesh::load(const std::string& filename) {
@@ -111,46 +260,179 @@ bool Mesh::load(const std::string& filename) {
 		}
 	}
 
+	if (m_vertices.empty())
+		return true;
+
+	// bounding sphere centered on the bounding box
+	glm::vec3 minPosition = m_vertices[0].pos;
+	glm::vec3 maxPosition = minPosition;
+	for (const auto& vertex : m_vertices) {
+		minPosition = glm::min(minPosition, vertex.pos);
+		maxPosition = glm::max(maxPosition, vertex.pos);
+	}
+
+	glm::vec3 center = 0.5f * (minPosition + maxPosition);
+	float radius = 0.0f;
+	for (const auto& vertex : m_vertices)
+		radius = std::max(radius, glm::length(vertex.pos - center));
+	m_boundingSphere = glm::vec4(center, radius);
+
 	return true;
 }
 
 bool Mesh::createVertexBuffer() {
 	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+	return createDeviceLocalBuffer(
+		m_vertices.data(),
+		bufferSize,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | (m_device->getCapabilities().raytracing ? cRaytracingInputUsage : 0),
+		m_vertexBuffer,
+		m_vertexBufferMemory);
+}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	if (!m_device->createBufferAndMemory(
+bool Mesh::createIndexBuffer() {
+	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
+	return createDeviceLocalBuffer(
+		m_indices.data(),
 		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer,
-		stagingBufferMemory))
-		return false;
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | (m_device->getCapabilities().raytracing ? cRaytracingInputUsage : 0),
+		m_indexBuffer,
+		m_indexBufferMemory);
+}
 
-	void* data;
-	vkMapMemory(m_device->handle(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(m_device->handle(), stagingBufferMemory);
+void Mesh::buildLods() {
+	m_lods.clear();
+	if (m_indices.empty())
+		return;
+
+	MeshLod fullResolutionLod{};
+	fullResolutionLod.firstIndex = 0;
+	fullResolutionLod.indexCount = static_cast<uint32_t>(m_indices.size());
+	fullResolutionLod.error = 0.0f;
+	m_lods.push_back(fullResolutionLod);
+
+	// every level is simplified from the full resolution mesh, so that the error is measured against it
+	const std::vector<uint32_t> sourceIndices = m_indices;
+	MeshSimplifier simplifier(m_vertices, sourceIndices);
+	float maxError = cMaxLodRelativeError * m_boundingSphere.w;
+
+	size_t targetIndexCount = sourceIndices.size();
+	while (m_lods.size() < cMaxLodCount) {
+		targetIndexCount = static_cast<size_t>(targetIndexCount * cLodIndexRatio) / 3 * 3;
+		if (targetIndexCount < cMinLodIndexCount)
+			break;
+
+		float error = 0.0f;
+		std::vector<uint32_t> lodIndices = simplifier.simplify(targetIndexCount, maxError, error);
+
+		MeshLod previousLod = m_lods.back();
+		if (lodIndices.empty() || lodIndices.size() > cMaxLodIndexRatio * previousLod.indexCount)
+			break;
+
+		MeshLod lod{};
+		lod.firstIndex = static_cast<uint32_t>(m_indices.size());
+		lod.indexCount = static_cast<uint32_t>(lodIndices.size());
+		lod.error = std::max(error, previousLod.error);  // keep the errors increasing for the selection
+		m_indices.insert(m_indices.end(), lodIndices.begin(), lodIndices.end());
+		m_lods.push_back(lod);
+
+		targetIndexCount = lodIndices.size();
+	}
+}
 
-	if (!m_device->createBufferAndMemory(
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_vertexBuffer,
-		m_vertexBufferMemory))
-		return false;
+void Mesh::buildMeshlets() {
+	m_meshlets.clear();
+	m_meshletVertices.clear();
+	m_meshletTriangles.clear();
 
-	m_device->copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize, QueueType::eGraphics);
+	// local index of each vertex in the meshlet being built
+	std::vector<uint8_t> localIndices(m_vertices.size(), cUnusedLocalIndex);
 
-	m_device->destroyBuffer(stagingBuffer);
-	m_device->freeDeviceMemory(stagingBufferMemory);
+	Meshlet meshlet{};
 
-	return true;
+	auto flushMeshlet = [&]() {
+		if (meshlet.triangleCount == 0)
+			return;
+
+		computeMeshletBounds(meshlet, m_vertices, m_meshletVertices, m_meshletTriangles);
+		m_meshlets.push_back(meshlet);
+
+		// the vertices can be used by the next meshlet
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			localIndices[m_meshletVertices[meshlet.vertexOffset + i]] = cUnusedLocalIndex;
+
+		meshlet = {};
+		meshlet.vertexOffset = static_cast<uint32_t>(m_meshletVertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(m_meshletTriangles.size());
+	};
+
+	auto addVertex = [&](uint32_t vertexIndex) -> uint32_t {
+		if (localIndices[vertexIndex] == cUnusedLocalIndex) {
+			localIndices[vertexIndex] = static_cast<uint8_t>(meshlet.vertexCount++);
+			m_meshletVertices.push_back(vertexIndex);
+		}
+		return localIndices[vertexIndex];
+	};
+
+	// Triangles are consumed in the index buffer order. Loaders output connected triangles next to each other,
+	// so this greedy approach gives compact enough clusters for culling.
+	for (auto& lod : m_lods) {
+		lod.firstMeshlet = static_cast<uint32_t>(m_meshlets.size());
+
+		for (uint32_t i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3) {
+			uint32_t a = m_indices[i + 0];
+			uint32_t b = m_indices[i + 1];
+			uint32_t c = m_indices[i + 2];
+
+			uint32_t newVertexCount = 0;
+			if (localIndices[a] == cUnusedLocalIndex)
+				++newVertexCount;
+			if (localIndices[b] == cUnusedLocalIndex && b != a)
+				++newVertexCount;
+			if (localIndices[c] == cUnusedLocalIndex && c != a && c != b)
+				++newVertexCount;
+
+			if (meshlet.vertexCount + newVertexCount > cMaxMeshletVertices || meshlet.triangleCount + 1 > cMaxMeshletTriangles)
+				flushMeshlet();
+
+			uint32_t localA = addVertex(a);
+			uint32_t localB = addVertex(b);
+			uint32_t localC = addVertex(c);
+			m_meshletTriangles.push_back(localA | (localB << 8) | (localC << 16));
+			++meshlet.triangleCount;
+		}
+
+		// meshlets don't cross levels of detail
+		flushMeshlet();
+		lod.meshletCount = static_cast<uint32_t>(m_meshlets.size()) - lod.firstMeshlet;
+	}
 }
 
-bool Mesh::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
+bool Mesh::createMeshletBuffers() {
+	if (m_meshlets.empty())
+		return true;
+
+	return createDeviceLocalBuffer(
+			m_meshlets.data(),
+			sizeof(Meshlet) * m_meshlets.size(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			m_meshletBuffer,
+			m_meshletBufferMemory)
+		&& createDeviceLocalBuffer(
+			m_meshletVertices.data(),
+			sizeof(uint32_t) * m_meshletVertices.size(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			m_meshletVertexBuffer,
+			m_meshletVertexBufferMemory)
+		&& createDeviceLocalBuffer(
+			m_meshletTriangles.data(),
+			sizeof(uint32_t) * m_meshletTriangles.size(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			m_meshletTriangleBuffer,
+			m_meshletTriangleBufferMemory);
+}
 
+bool Mesh::createDeviceLocalBuffer(const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 	if (!m_device->createBufferAndMemory(
@@ -161,20 +443,22 @@ bool Mesh::createIndexBuffer() {
 		stagingBufferMemory))
 		return false;
 
-	void* data;
-	vkMapMemory(m_device->handle(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_indices.data(), (size_t)bufferSize);
+	void* mappedData;
+	vkMapMemory(m_device->handle(), stagingBufferMemory, 0, bufferSize, 0, &mappedData);
+	memcpy(mappedData, data, (size_t)bufferSize);
 	vkUnmapMemory(m_device->handle(), stagingBufferMemory);
 
+	VkMemoryAllocateFlags allocateFlags = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
 	if (!m_device->createBufferAndMemory(
 		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
+		allocateFlags,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		m_indexBuffer,
-		m_indexBufferMemory))
+		buffer,
+		bufferMemory))
 		return false;
 
-	m_device->copyBuffer(stagingBuffer, m_indexBuffer, bufferSize, QueueType::eGraphics);
+	m_device->copyBuffer(stagingBuffer, buffer, bufferSize, QueueType::eGraphics);
 
 	m_device->destroyBuffer(stagingBuffer);
 	m_device->freeDeviceMemory(stagingBufferMemory);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Meshlet.h"
 #include "Vertex.h"
 
 #include <vulkan/vulkan.h>
@@ -10,6 +11,16 @@ namespace Amano {
 
 class Device;
 
+// A level of detail of a mesh
+// All the levels share the vertex buffer, their indices are stored one after the other in the index buffer
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+	float error;  // geometric error compared to the full resolution mesh, in model space
+};
+
 class Mesh
 {
 public:
@@ -23,7 +34,32 @@ public:
 	VkBuffer getVertexBuffer() const { return m_vertexBuffer; }
 	VkBuffer getIndexBuffer() const { return m_indexBuffer; }
 	uint32_t getVertexCount() const { return static_cast<uint32_t>(m_vertices.size()); }
-	uint32_t getIndexCount() const { return static_cast<uint32_t>(m_indices.size()); }
+	// Index count of the full resolution mesh
+	uint32_t getIndexCount() const { return m_lods.empty() ? 0 : m_lods[0].indexCount; }
+	glm::vec4 getBoundingSphere() const { return m_boundingSphere; }
+
+	// The CPU copy of the vertices and of the indices of all the levels of detail
+	const std::vector<Vertex>& getVertices() const { return m_vertices; }
+	const std::vector<uint32_t>& getIndices() const { return m_indices; }
+
+	// Writes the vertex buffer, the CPU copy keeps the loaded vertices and so do the meshlet bounds
+	// There must be getVertexCount() vertices. The call waits for the copy on the graphics queue
+	bool updateVertices(const std::vector<Vertex>& vertices);
+
+	// The levels of detail are generated when the mesh is loaded. Level 0 is the full resolution mesh
+	uint32_t getLodCount() const { return static_cast<uint32_t>(m_lods.size()); }
+	const MeshLod& getLod(uint32_t lod) const { return m_lods[lod]; }
+
+	// Returns the coarsest level of detail whose error projected on screen is below maxPixelError
+	// projectionScale is the number of pixels covered by one unit at a distance of one unit: height / (2 * tan(fovy / 2))
+	uint32_t selectLod(const glm::mat4& model, const glm::vec3& cameraPosition, float projectionScale, float maxPixelError) const;
+
+	// Meshlets are generated for each level of detail when the mesh is loaded
+	const std::vector<Meshlet>& getMeshlets() const { return m_meshlets; }
+	uint32_t getMeshletCount() const { return static_cast<uint32_t>(m_meshlets.size()); }
+	VkBuffer getMeshletBuffer() const { return m_meshletBuffer; }
+	VkBuffer getMeshletVertexBuffer() const { return m_meshletVertexBuffer; }
+	VkBuffer getMeshletTriangleBuffer() const { return m_meshletTriangleBuffer; }
 
 	// TODO: should abstract VkBuffer so that this method is available all the time
 	VkDeviceAddress getVertexBufferAddress() const;
@@ -33,15 +69,36 @@ private:
 	bool load(const std::string& filename);
 	bool createVertexBuffer();
 	bool createIndexBuffer();
+	void buildLods();
+	void buildMeshlets();
+	bool createMeshletBuffers();
+	bool createDeviceLocalBuffer(const void* data, VkDeviceSize bufferSize, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 
 private:
 	Device* m_device;
 	std::vector<Vertex> m_vertices;
 	std::vector<uint32_t> m_indices;
+	std::vector<MeshLod> m_lods;
+	glm::vec4 m_boundingSphere;
 	VkBuffer m_vertexBuffer;
 	VkDeviceMemory m_vertexBufferMemory;
 	VkBuffer m_indexBuffer;
 	VkDeviceMemory m_indexBufferMemory;
+	// created by the first updateVertices, persistently mapped
+	VkBuffer m_vertexStagingBuffer;
+	VkDeviceMemory m_vertexStagingBufferMemory;
+	void* m_mappedVertexStagingBuffer;
+
+	// meshlet data
+	std::vector<Meshlet> m_meshlets;
+	std::vector<uint32_t> m_meshletVertices;   // indices into m_vertices
+	std::vector<uint32_t> m_meshletTriangles;  // 3 local vertex indices packed per triangle
+	VkBuffer m_meshletBuffer;
+	VkDeviceMemory m_meshletBufferMemory;
+	VkBuffer m_meshletVertexBuffer;
+	VkDeviceMemory m_meshletVertexBufferMemory;
+	VkBuffer m_meshletTriangleBuffer;
+	VkDeviceMemory m_meshletTriangleBufferMemory;
 };
 
 }
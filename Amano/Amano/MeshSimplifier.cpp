@@ -0,0 +1,337 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+	// Weight of the planes constraining the boundaries, relative to the planes of the triangles
+	const double cBoundaryWeight = 10.0;
+
+	// Weight of the attribute differences, relative to the radius of the mesh
+	const double cAttributeWeight = 0.01;
+
+	enum VertexKind : uint8_t {
+		eManifold,  // interior vertex, can collapse onto any neighbour
+		eBorder,    // vertex on an open boundary, can only collapse along the boundary
+		eLocked,    // seam, corner of a boundary or non-manifold vertex, never collapses
+	};
+
+	// Quadric of the squared distances to a set of planes
+	// Only the upper triangle of the symmetric 4x4 matrix is stored
+	struct Quadric {
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+		double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+		double a22 = 0.0, a23 = 0.0;
+		double a33 = 0.0;
+		double weight = 0.0;  // area of the triangles, used to get an average distance
+
+		void addPlane(const glm::dvec3& n, double d, double w) {
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+		}
+
+		Quadric& operator+=(const Quadric& other) {
+			a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+			a11 += other.a11; a12 += other.a12; a13 += other.a13;
+			a22 += other.a22; a23 += other.a23;
+			a33 += other.a33;
+			weight += other.weight;
+			return *this;
+		}
+
+		// Returns the average squared distance of the point to the planes
+		double evaluate(const glm::dvec3& p) const {
+			double result =
+				a00 * p.x * p.x + 2.0 * a01 * p.x * p.y + 2.0 * a02 * p.x * p.z + 2.0 * a03 * p.x
+				+ a11 * p.y * p.y + 2.0 * a12 * p.y * p.z + 2.0 * a13 * p.y
+				+ a22 * p.z * p.z + 2.0 * a23 * p.z
+				+ a33;
+			return weight > 0.0 ? std::max(result, 0.0) / weight : 0.0;
+		}
+	};
+
+	uint64_t edgeKey(uint32_t a, uint32_t b) {
+		return a < b
+			? (static_cast<uint64_t>(a) << 32) | b
+			: (static_cast<uint64_t>(b) << 32) | a;
+	}
+
+	struct Collapse {
+		uint32_t source;
+		uint32_t target;
+		bool isBorder;
+		double cost;
+		double geometricError;
+	};
+}
+
+namespace Amano {
+
+MeshSimplifier::MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	: m_vertices{ vertices }
+	, m_indices{ indices }
+	, m_positionRemap(vertices.size())
+	, m_isSeam(vertices.size(), false)
+	, m_attributeWeight{ 0.0 }
+{
+	std::unordered_map<glm::vec3, uint32_t> firstVertices;
+	glm::vec3 minPosition(0.0f);
+	glm::vec3 maxPosition(0.0f);
+	for (uint32_t i = 0; i < static_cast<uint32_t>(m_vertices.size()); ++i) {
+		const glm::vec3& position = m_vertices[i].pos;
+		auto result = firstVertices.emplace(position, i);
+		m_positionRemap[i] = result.first->second;
+		if (!result.second)
+			m_isSeam[result.first->second] = true;
+
+		minPosition = i == 0 ? position : glm::min(minPosition, position);
+		maxPosition = i == 0 ? position : glm::max(maxPosition, position);
+	}
+
+	double radius = 0.5 * glm::length(glm::dvec3(maxPosition - minPosition));
+	m_attributeWeight = (cAttributeWeight * radius) * (cAttributeWeight * radius);
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(size_t targetIndexCount, float maxError, float& resultError) const {
+	std::vector<uint32_t> indices = m_indices;
+	resultError = 0.0f;
+
+	const size_t vertexCount = m_vertices.size();
+	const double maxCost = static_cast<double>(maxError) * static_cast<double>(maxError);
+	auto position = [&](uint32_t v) { return glm::dvec3(m_vertices[v].pos); };
+
+	// the quadrics are accumulated on the remapped vertices
+	std::vector<Quadric> quadrics(vertexCount);
+	std::unordered_map<uint64_t, uint32_t> edgeCounts;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		uint32_t corners[3] = { m_positionRemap[indices[i]], m_positionRemap[indices[i + 1]], m_positionRemap[indices[i + 2]] };
+		glm::dvec3 normal = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+		double doubleArea = glm::length(normal);
+		if (doubleArea > 0.0) {
+			normal /= doubleArea;
+			double d = -glm::dot(normal, position(corners[0]));
+			for (uint32_t corner : corners) {
+				quadrics[corner].addPlane(normal, d, 0.5 * doubleArea);
+				quadrics[corner].weight += 0.5 * doubleArea;
+			}
+		}
+		for (int e = 0; e < 3; ++e)
+			++edgeCounts[edgeKey(corners[e], corners[(e + 1) % 3])];
+	}
+
+	// constrain the boundaries with planes perpendicular to their triangles
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		uint32_t corners[3] = { m_positionRemap[indices[i]], m_positionRemap[indices[i + 1]], m_positionRemap[indices[i + 2]] };
+		glm::dvec3 normal = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+		for (int e = 0; e < 3; ++e) {
+			uint32_t a = corners[e];
+			uint32_t b = corners[(e + 1) % 3];
+			if (edgeCounts[edgeKey(a, b)] != 1)
+				continue;
+
+			glm::dvec3 edge = position(b) - position(a);
+			glm::dvec3 planeNormal = glm::cross(edge, normal);
+			double length = glm::length(planeNormal);
+			if (length <= 0.0)
+				continue;
+
+			planeNormal /= length;
+			double d = -glm::dot(planeNormal, position(a));
+			double w = cBoundaryWeight * glm::dot(edge, edge);
+			quadrics[a].addPlane(planeNormal, d, w);
+			quadrics[b].addPlane(planeNormal, d, w);
+		}
+	}
+
+	std::vector<uint8_t> kinds(vertexCount);
+	std::vector<uint8_t> borderEdgeCounts(vertexCount);
+	std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+	std::vector<uint32_t> vertexTriangles;
+	std::vector<uint32_t> collapseTargets(vertexCount);
+	std::vector<uint32_t> collapseIndices(vertexCount);
+	std::vector<bool> isTouched(vertexCount);
+	std::vector<Collapse> collapses;
+
+	// Each pass collapses a set of independent edges, cheapest first
+	bool areEdgeCountsValid = true;
+	while (indices.size() > targetIndexCount) {
+		if (!areEdgeCountsValid) {
+			edgeCounts.clear();
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				for (int e = 0; e < 3; ++e)
+					++edgeCounts[edgeKey(m_positionRemap[indices[i + e]], m_positionRemap[indices[i + (e + 1) % 3]])];
+			}
+		}
+
+		// classify the vertices
+		std::fill(borderEdgeCounts.begin(), borderEdgeCounts.end(), 0);
+		for (size_t v = 0; v < vertexCount; ++v)
+			kinds[v] = m_isSeam[v] ? eLocked : eManifold;
+		for (const auto& edgeCount : edgeCounts) {
+			uint32_t a = static_cast<uint32_t>(edgeCount.first >> 32);
+			uint32_t b = static_cast<uint32_t>(edgeCount.first & 0xFFFFFFFF);
+			if (edgeCount.second == 1) {
+				borderEdgeCounts[a] = static_cast<uint8_t>(std::min(borderEdgeCounts[a] + 1, 0xFF));
+				borderEdgeCounts[b] = static_cast<uint8_t>(std::min(borderEdgeCounts[b] + 1, 0xFF));
+			}
+			else if (edgeCount.second > 2) {
+				kinds[a] = eLocked;
+				kinds[b] = eLocked;
+			}
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			if (kinds[v] == eManifold && borderEdgeCounts[v] > 0)
+				kinds[v] = borderEdgeCounts[v] == 2 ? eBorder : eLocked;
+		}
+
+		// triangles around each remapped vertex
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (uint32_t index : indices)
+			++triangleOffsets[m_positionRemap[index] + 1];
+		for (size_t v = 0; v < vertexCount; ++v)
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		vertexTriangles.resize(indices.size());
+		{
+			std::vector<uint32_t> fillOffsets(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i)
+				vertexTriangles[fillOffsets[m_positionRemap[indices[i]]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// rejects the collapses flipping the triangles around the source vertex
+		auto flipsTriangles = [&](uint32_t source, uint32_t target) {
+			for (uint32_t t = triangleOffsets[source]; t < triangleOffsets[source + 1]; ++t) {
+				uint32_t triangle = vertexTriangles[t];
+				uint32_t corners[3] = {
+					m_positionRemap[indices[3 * triangle + 0]],
+					m_positionRemap[indices[3 * triangle + 1]],
+					m_positionRemap[indices[3 * triangle + 2]] };
+				if (corners[0] == target || corners[1] == target || corners[2] == target)
+					continue;  // this triangle disappears
+
+				glm::dvec3 before = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+				for (uint32_t& corner : corners) {
+					if (corner == source)
+						corner = target;
+				}
+				glm::dvec3 after = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+				if (glm::dot(before, after) <= 0.0)
+					return true;
+			}
+			return false;
+		};
+
+		// find the best direction of each edge
+		collapses.clear();
+		for (const auto& edgeCount : edgeCounts) {
+			uint32_t a = static_cast<uint32_t>(edgeCount.first >> 32);
+			uint32_t b = static_cast<uint32_t>(edgeCount.first & 0xFFFFFFFF);
+			bool isBorder = edgeCount.second == 1;
+
+			auto canCollapse = [&](uint32_t source, uint32_t target) {
+				if (kinds[source] == eManifold)
+					return true;
+				return kinds[source] == eBorder && isBorder && kinds[target] != eManifold;
+			};
+
+			Collapse best{ 0, 0, isBorder, 0.0, 0.0 };
+			bool isValid = false;
+			for (int direction = 0; direction < 2; ++direction) {
+				uint32_t source = direction == 0 ? a : b;
+				uint32_t target = direction == 0 ? b : a;
+				if (!canCollapse(source, target))
+					continue;
+
+				Quadric quadric = quadrics[source];
+				quadric += quadrics[target];
+				double geometricError = quadric.evaluate(position(target));
+				double cost = geometricError + attributeCost(source, target);
+				if (!isValid || cost < best.cost) {
+					best = { source, target, isBorder, cost, geometricError };
+					isValid = true;
+				}
+			}
+
+			if (isValid)
+				collapses.push_back(best);
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+		// collapse the independent edges
+		for (size_t v = 0; v < vertexCount; ++v) {
+			collapseTargets[v] = static_cast<uint32_t>(v);
+			isTouched[v] = false;
+		}
+
+		size_t removedTriangleGoal = (indices.size() - targetIndexCount + 2) / 3;
+		size_t removedTriangleCount = 0;
+		bool hasCollapsed = false;
+		for (const Collapse& collapse : collapses) {
+			if (collapse.cost > maxCost || removedTriangleCount >= removedTriangleGoal)
+				break;
+			if (isTouched[collapse.source] || isTouched[collapse.target])
+				continue;
+			if (flipsTriangles(collapse.source, collapse.target))
+				continue;
+
+			// the source isn't on a seam, so the triangles around it use the same vertex for the target
+			collapseIndices[collapse.source] = collapse.target;
+			for (uint32_t t = triangleOffsets[collapse.source]; t < triangleOffsets[collapse.source + 1]; ++t) {
+				uint32_t triangle = vertexTriangles[t];
+				for (uint32_t c = 0; c < 3; ++c) {
+					uint32_t index = indices[3 * triangle + c];
+					if (m_positionRemap[index] == collapse.target)
+						collapseIndices[collapse.source] = index;
+					isTouched[m_positionRemap[index]] = true;
+				}
+			}
+
+			collapseTargets[collapse.source] = collapse.target;
+			quadrics[collapse.target] += quadrics[collapse.source];
+			resultError = std::max(resultError, static_cast<float>(std::sqrt(collapse.geometricError)));
+			removedTriangleCount += collapse.isBorder ? 1 : 2;
+			hasCollapsed = true;
+		}
+
+		if (!hasCollapsed)
+			break;
+
+		// apply the collapses and remove the degenerate triangles
+		size_t writeIndex = 0;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			uint32_t triangle[3];
+			uint32_t corners[3];
+			for (int c = 0; c < 3; ++c) {
+				uint32_t index = indices[i + c];
+				uint32_t remapped = m_positionRemap[index];
+				if (collapseTargets[remapped] != remapped)
+					index = collapseIndices[remapped];
+				triangle[c] = index;
+				corners[c] = m_positionRemap[index];
+			}
+
+			if (corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0])
+				continue;
+
+			indices[writeIndex++] = triangle[0];
+			indices[writeIndex++] = triangle[1];
+			indices[writeIndex++] = triangle[2];
+		}
+		indices.resize(writeIndex);
+		areEdgeCountsValid = false;
+	}
+
+	return indices;
+}
+
+double MeshSimplifier::attributeCost(uint32_t source, uint32_t target) const {
+	glm::dvec3 normalDifference = glm::dvec3(m_vertices[source].normal) - glm::dvec3(m_vertices[target].normal);
+	glm::dvec2 texCoordDifference = glm::dvec2(m_vertices[source].texCoord) - glm::dvec2(m_vertices[target].texCoord);
+	return m_attributeWeight * (glm::dot(normalDifference, normalDifference) + glm::dot(texCoordDifference, texCoordDifference));
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Amano {
+
+// This class simplifies a triangle mesh with quadric error metrics (Garland and Heckbert)
+// Edges are collapsed onto existing vertices, so all the simplified meshes can share the vertex buffer of the source mesh
+//   - boundaries are preserved: boundary vertices only slide along the boundary and are constrained by extra planes
+//   - attribute seams are preserved: vertices sharing a position with different attributes are never moved
+//   - the normal and texture coordinate differences are added to the collapse cost
+// The vertices and indices must outlive the simplifier
+class MeshSimplifier
+{
+public:
+	MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+	// Simplifies the source mesh until it has at most targetIndexCount indices or the next collapse would exceed maxError
+	// resultError receives the geometric error of the simplified mesh, in the units of the vertex positions
+	std::vector<uint32_t> simplify(size_t targetIndexCount, float maxError, float& resultError) const;
+
+private:
+	double attributeCost(uint32_t source, uint32_t target) const;
+
+private:
+	const std::vector<Vertex>& m_vertices;
+	const std::vector<uint32_t>& m_indices;
+
+	// index of the first vertex with the same position, the topology is built on these indices
+	std::vector<uint32_t> m_positionRemap;
+
+	// true when several vertices share this position (indexed by the remapped vertex)
+	std::vector<bool> m_isSeam;
+
+	// converts attribute differences to a squared distance
+	double m_attributeWeight;
+};
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "glm.h"
+
+#include <cstdint>
+
+namespace Amano {
+
+// Limits used when splitting a mesh into meshlets
+// 64 vertices and 124 triangles is the usual sweet spot for current GPUs
+const uint32_t cMaxMeshletVertices = 64;
+const uint32_t cMaxMeshletTriangles = 124;
+
+// A meshlet is a small cluster of triangles of a mesh
+// The layout matches the std430 structure used by the culling shader
+//   - vertexOffset/vertexCount reference the meshlet vertices (indices into the mesh vertex buffer)
+//   - triangleOffset/triangleCount reference the meshlet triangles (3 local indices packed in 8 bits each)
+struct Meshlet {
+	glm::vec4 boundingSphere;  // xyz is the center, w is the radius
+	glm::vec4 cone;            // xyz is the normal cone axis, w is the cutoff. A cutoff of 1 disables cone culling
+	uint32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t triangleOffset;
+	uint32_t triangleCount;
+};
+
+}
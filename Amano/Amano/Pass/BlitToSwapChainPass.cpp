@@ -6,6 +6,7 @@ namespace Amano {
 BlitToSwapChainPass::BlitToSwapChainPass(Device* device)
 	: Pass(device, VK_PIPELINE_STAGE_TRANSFER_BIT)
 	, m_commandBuffers()
+	, m_frameTimer{ nullptr }
 {
 }
 
@@ -69,6 +70,9 @@ void BlitToSwapChainPass::recordCommands(uint32_t width, uint32_t height, Image*
 			.setAccessMasks(0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
 			.execute(blitCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 
+		if (m_frameTimer != nullptr)
+			m_frameTimer->recordEnd(blitCommandBuffer);
+
 		pQueue->endCommands(blitCommandBuffer);
 	}
 }
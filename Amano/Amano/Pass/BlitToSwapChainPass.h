@@ -2,6 +2,7 @@
 
 #include "Pass.h"
 #include "../Device.h"
+#include "../GpuFrameTimer.h"
 #include "../Image.h"
 #include "../Ubo.h"
 #include "../UniformBuffer.h"
@@ -17,6 +18,10 @@ public:
 	BlitToSwapChainPass(Device* device);
 	~BlitToSwapChainPass();
 
+	// The pass is the last one of the frame before the UI, its commands end with the second timestamp of the timer
+	// The commands must be recorded again for the timer to be used
+	void setFrameTimer(GpuFrameTimer* frameTimer) { m_frameTimer = frameTimer; }
+
 	void recordCommands(uint32_t width, uint32_t height, Image* blitSourceImage);
 
 	void cleanOnRenderTargetResized();
@@ -29,6 +34,7 @@ private:
 
 private:
 	std::vector<VkCommandBuffer> m_commandBuffers;
+	GpuFrameTimer* m_frameTimer;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace Amano {
+
+// Number of work groups of workgroupSize invocations needed to cover size invocations
+inline uint32_t getWorkgroupCount(uint32_t size, uint32_t workgroupSize) {
+	return (size + workgroupSize - 1) / workgroupSize;
+}
+
+// Dispatches one invocation per pixel of a width x height image
+// depth is the number of layers, each layer is processed by its own work groups
+inline void dispatchCompute2D(VkCommandBuffer cmd, VkExtent2D workgroupSize, uint32_t width, uint32_t height, uint32_t depth = 1) {
+	vkCmdDispatch(cmd, getWorkgroupCount(width, workgroupSize.width), getWorkgroupCount(height, workgroupSize.height), depth);
+}
+
+}
@@ -0,0 +1,278 @@
+#include "ComputeShadowPass.h"
+#include "ComputeDispatch.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+#include "../Builder/SamplerBuilder.h"
+#include "../Builder/TransitionImageBarrierBuilder.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Push constants of the shader, see ShadowTraceSettings
+struct ShadowTraceInformation {
+	uint32_t resolutionScale;
+	uint32_t isCheckerboarded;
+	uint32_t renderWidth;   // rendered area of the GBuffer, its images can be larger
+	uint32_t renderHeight;
+};
+
+// The buffer is filled once through a staging buffer
+bool createStorageBuffer(Amano::Device* device, const void* data, VkDeviceSize size, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	if (!device->createBufferAndMemory(
+		size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		stagingBuffer,
+		stagingBufferMemory))
+		return false;
+
+	void* mappedData;
+	vkMapMemory(device->handle(), stagingBufferMemory, 0, size, 0, &mappedData);
+	memcpy(mappedData, data, static_cast<size_t>(size));
+	vkUnmapMemory(device->handle(), stagingBufferMemory);
+
+	bool isCreated = device->createBufferAndMemory(
+		size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		buffer,
+		bufferMemory);
+	if (isCreated)
+		device->copyBuffer(stagingBuffer, buffer, size, Amano::QueueType::eCompute);
+
+	device->destroyBuffer(stagingBuffer);
+	device->freeDeviceMemory(stagingBufferMemory);
+
+	return isCreated;
+}
+
+}
+
+namespace Amano {
+
+ComputeShadowPass::ComputeShadowPass(Device* device)
+	: Pass(device, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+	, m_descriptorSetLayout{ VK_NULL_HANDLE }
+	, m_pipelineLayout{ VK_NULL_HANDLE }
+	, m_pipeline{ VK_NULL_HANDLE }
+	, m_descriptorSet{ VK_NULL_HANDLE }
+	, m_nodeBuffer{ VK_NULL_HANDLE }
+	, m_nodeBufferMemory{ VK_NULL_HANDLE }
+	, m_triangleBuffer{ VK_NULL_HANDLE }
+	, m_triangleBufferMemory{ VK_NULL_HANDLE }
+	, m_nearestSampler{ VK_NULL_HANDLE }
+	, m_rayUniformBuffer(device)
+	, m_lightUniformBuffer(device)
+	, m_outputImage{ nullptr }
+	, m_traceSettings()
+	, m_commandBuffer{ VK_NULL_HANDLE }
+{
+}
+
+ComputeShadowPass::~ComputeShadowPass() {
+	cleanOnRenderTargetResized();
+
+	m_device->destroyBuffer(m_triangleBuffer);
+	m_device->freeDeviceMemory(m_triangleBufferMemory);
+	m_device->destroyBuffer(m_nodeBuffer);
+	m_device->freeDeviceMemory(m_nodeBufferMemory);
+	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
+	vkDestroySampler(m_device->handle(), m_nearestSampler, nullptr);
+}
+
+bool ComputeShadowPass::init(const Bvh& bvh) {
+	if (!createBvhBuffers(bvh)) {
+		std::cerr << "failed to create the bvh buffers of the shadow pass!" << std::endl;
+		return false;
+	}
+
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)          // bvh nodes
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)          // bvh triangles
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // output image
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)          // ray parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // depth image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // normal image
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);         // light information
+	m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+
+	VkPushConstantRange range;
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	range.offset = 0;
+	range.size = sizeof(ShadowTraceInformation);
+
+	PipelineLayoutBuilder computePipelineLayoutBuilder;
+	computePipelineLayoutBuilder
+		.addDescriptorSetLayout(m_descriptorSetLayout)
+		.addPushConstantRange(range);
+	m_pipelineLayout = computePipelineLayoutBuilder.build(*m_device);
+
+	ComputePipelineBuilder computePipelineBuilder(m_device);
+	computePipelineBuilder
+		.addShader("compiled_shaders/shadow_bvh.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
+	m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
+
+	// create a sampler for the depth texture
+	SamplerBuilder samplerBuilder;
+	samplerBuilder
+		.setMaxLod(0)
+		.setFilter(VK_FILTER_NEAREST, VK_FILTER_NEAREST);
+	m_nearestSampler = samplerBuilder.build(*m_device);
+
+	return true;
+}
+
+void ComputeShadowPass::recordCommands(uint32_t width, uint32_t height) {
+	destroyCommandBuffer();
+
+	Queue* pQueue = m_device->getQueue(QueueType::eCompute);
+	m_commandBuffer = pQueue->beginCommands();
+
+	TransitionImageBarrierBuilder<1> transition;
+	transition
+		.setImage(0, m_outputImage->handle())
+		.setLayouts(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL)
+		.setAccessMasks(0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+		.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
+		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+	ShadowTraceInformation traceInformation{};
+	traceInformation.resolutionScale = m_traceSettings.resolutionScale;
+	traceInformation.isCheckerboarded = m_traceSettings.isCheckerboarded ? 1 : 0;
+	traceInformation.renderWidth = width;
+	traceInformation.renderHeight = height;
+	vkCmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ShadowTraceInformation), &traceInformation);
+
+	// one invocation per traced texel of the visibility
+	dispatchCompute2D(m_commandBuffer, m_device->getComputeWorkgroupSize(), m_traceSettings.getTraceWidth(width), m_traceSettings.getVisibilityHeight(height));
+
+	transition
+		.setLayouts(0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		.setAccessMasks(0, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+	pQueue->endCommands(m_commandBuffer);
+}
+
+void ComputeShadowPass::cleanOnRenderTargetResized() {
+	destroyDescriptorSet();
+	destroyCommandBuffer();
+	destroyOutputImage();
+}
+
+void ComputeShadowPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* depthImage, Image* normalImage) {
+	createOutputImage(width, height);
+	createDescriptorSet(depthImage, normalImage);
+	recordCommands(width, height);
+}
+
+void ComputeShadowPass::updateRayUniformBuffer(RayParams& ubo) {
+	m_rayUniformBuffer.update(ubo);
+}
+
+void ComputeShadowPass::updateLightUniformBuffer(LightInformation& ubo) {
+	m_lightUniformBuffer.update(ubo);
+}
+
+bool ComputeShadowPass::submit() {
+	if (m_commandBuffer == VK_NULL_HANDLE)
+		return false;
+
+	// submit the shadows
+	// 1. wait for the semaphores
+	// 2. signal the pass semaphore
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_waitSemaphores.size());
+	submitInfo.pWaitSemaphores = m_waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = m_waitPipelineStages.data();
+
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_commandBuffer;
+
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_signalSemaphore;
+
+	auto pComputeQueue = m_device->getQueue(QueueType::eCompute);
+	if (!pComputeQueue->submit(&submitInfo, VK_NULL_HANDLE))
+		return false;
+
+	return true;
+}
+
+bool ComputeShadowPass::createBvhBuffers(const Bvh& bvh) {
+	// an empty hierarchy gets a root that no ray can hit, so that the buffers are never empty
+	std::vector<BvhNode> nodes = bvh.getNodes();
+	std::vector<glm::vec4> trianglePositions = bvh.getTrianglePositions();
+	if (nodes.empty()) {
+		BvhNode emptyRoot{};
+		emptyRoot.boundsMin = glm::vec3(FLT_MAX);
+		emptyRoot.boundsMax = glm::vec3(-FLT_MAX);
+		nodes.push_back(emptyRoot);
+		trianglePositions.resize(3, glm::vec4(0.0f));
+	}
+
+	return createStorageBuffer(m_device, nodes.data(), sizeof(BvhNode) * nodes.size(), m_nodeBuffer, m_nodeBufferMemory)
+		&& createStorageBuffer(m_device, trianglePositions.data(), sizeof(glm::vec4) * trianglePositions.size(), m_triangleBuffer, m_triangleBufferMemory);
+}
+
+void ComputeShadowPass::createOutputImage(uint32_t width, uint32_t height) {
+	m_outputImage = new Image(m_device);
+	m_outputImage->create2D(
+		m_traceSettings.getVisibilityWidth(width),
+		m_traceSettings.getVisibilityHeight(height),
+		1,
+		VK_FORMAT_R32_SFLOAT,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	m_outputImage->transitionLayout(*m_device->getQueue(QueueType::eCompute), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void ComputeShadowPass::destroyOutputImage() {
+	delete m_outputImage;
+	m_outputImage = nullptr;
+}
+
+bool ComputeShadowPass::createDescriptorSet(Image* depthImage, Image* normalImage) {
+	DescriptorSetBuilder computeDescriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+	computeDescriptorSetBuilder
+		.addStorageBuffer(m_nodeBuffer, VK_WHOLE_SIZE, 0)
+		.addStorageBuffer(m_triangleBuffer, VK_WHOLE_SIZE, 1)
+		.addStorageImage(m_outputImage->viewHandle(), 2)
+		.addUniformBuffer(m_rayUniformBuffer.getBuffer(), m_rayUniformBuffer.getSize(), 3)
+		.addImage(m_nearestSampler, depthImage->viewHandle(), 4)
+		.addImage(m_nearestSampler, normalImage->viewHandle(), 5)
+		.addUniformBuffer(m_lightUniformBuffer.getBuffer(), m_lightUniformBuffer.getSize(), 6);
+	m_descriptorSet = computeDescriptorSetBuilder.buildAndUpdate();
+
+	return m_descriptorSet != VK_NULL_HANDLE;
+}
+
+void ComputeShadowPass::destroyDescriptorSet() {
+	if (m_descriptorSet != VK_NULL_HANDLE) {
+		vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_descriptorSet);
+		m_descriptorSet = VK_NULL_HANDLE;
+	}
+}
+
+void ComputeShadowPass::destroyCommandBuffer() {
+	if (m_commandBuffer != VK_NULL_HANDLE) {
+		m_device->getQueue(QueueType::eCompute)->freeCommandBuffer(m_commandBuffer);
+		m_commandBuffer = VK_NULL_HANDLE;
+	}
+}
+
+}
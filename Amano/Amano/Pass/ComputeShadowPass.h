@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Pass.h"
+#include "ShadowTraceSettings.h"
+#include "../Bvh.h"
+#include "../Device.h"
+#include "../Image.h"
+#include "../Ubo.h"
+#include "../UniformBuffer.h"
+
+namespace Amano {
+
+// This class computes the same shadows as RaytracingShadowPass, for the devices without the raytracing extensions
+// The shadow rays traverse a bounding volume hierarchy of the scene in a compute shader
+// TEMPORARY: to work correctly, the pass expect the following states for the images
+//   - outputImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - depthImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - normalImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+// After submitting, the images states are the same
+class ComputeShadowPass : public Pass {
+public:
+	ComputeShadowPass(Device* device);
+	~ComputeShadowPass();
+
+	Image* outputImage() const { return m_outputImage; }
+	// The nodes and triangles of the hierarchy are copied to the GPU, bvh can be destroyed afterwards
+	bool init(const Bvh& bvh);
+
+	// width and height are the rendered area of the GBuffer, they can be smaller than the size given to recreateOnRenderTargetResized
+	void recordCommands(uint32_t width, uint32_t height);
+
+	// The settings are applied when the pass is recreated, the output image is smaller when the resolution is scaled down
+	void setTraceSettings(const ShadowTraceSettings& settings) { m_traceSettings = settings; }
+
+	void cleanOnRenderTargetResized();
+	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* depthImage, Image* normalImage);
+
+	void updateRayUniformBuffer(RayParams& ubo);
+	void updateLightUniformBuffer(LightInformation& ubo);
+
+	bool submit();
+
+private:
+	bool createBvhBuffers(const Bvh& bvh);
+	void createOutputImage(uint32_t width, uint32_t height);
+	void destroyOutputImage();
+	bool createDescriptorSet(Image* depthImage, Image* normalImage);
+	void destroyDescriptorSet();
+	void destroyCommandBuffer();
+
+private:
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorSet m_descriptorSet;
+	VkBuffer m_nodeBuffer;
+	VkDeviceMemory m_nodeBufferMemory;
+	VkBuffer m_triangleBuffer;
+	VkDeviceMemory m_triangleBufferMemory;
+	VkSampler m_nearestSampler;
+	UniformBuffer<RayParams> m_rayUniformBuffer;
+	UniformBuffer<LightInformation> m_lightUniformBuffer;
+	Image* m_outputImage;
+	ShadowTraceSettings m_traceSettings;
+
+	VkCommandBuffer m_commandBuffer;
+};
+
+}
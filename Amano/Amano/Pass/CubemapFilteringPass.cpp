@@ -1,4 +1,5 @@
 #include "CubemapFilteringPass.h"
+#include "ComputeDispatch.h"
 #include "../Image.h"
 #include "../Builder/ComputePipelineBuilder.h"
 #include "../Builder/DescriptorSetBuilder.h"
@@ -43,7 +44,8 @@ bool CubemapFilteringPass::init(const std::string& filename) {
     // load the shaders and create the pipeline
     ComputePipelineBuilder computePipelineBuilder(m_device);
     computePipelineBuilder
-        .addShader(filename, VK_SHADER_STAGE_COMPUTE_BIT);
+        .addShader(filename, VK_SHADER_STAGE_COMPUTE_BIT)
+        .setWorkgroupSize(m_device->getComputeWorkgroupSize());
     m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
 
     return true;
@@ -63,12 +65,7 @@ void CubemapFilteringPass::recordCommands(VkCommandBuffer cmd, uint32_t width, u
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
-    // local size is 32 for x and y
-    const uint32_t locaSizeX = 32;
-    const uint32_t locaSizeY = 32;
-    uint32_t dispatchX = (width + locaSizeX - 1) / locaSizeX;
-    uint32_t dispatchY = (height + locaSizeY - 1) / locaSizeY;
-    vkCmdDispatch(cmd, dispatchX, dispatchY, 6);
+    dispatchCompute2D(cmd, m_device->getComputeWorkgroupSize(), width, height, 6);
 }
 
 bool CubemapFilteringPass::createDescriptorSet(Image* inputImage, Image* outputImage) {
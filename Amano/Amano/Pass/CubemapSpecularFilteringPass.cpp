@@ -1,9 +1,72 @@
 #include "CubemapSpecularFilteringPass.h"
+#include "ComputeDispatch.h"
 #include "../Image.h"
 #include "../Builder/ComputePipelineBuilder.h"
 #include "../Builder/DescriptorSetBuilder.h"
 #include "../Builder/DescriptorSetLayoutBuilder.h"
 #include "../Builder/PipelineLayoutBuilder.h"
+#include "../glm.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// must match the push constants of specular_filter.comp
+struct FilterInformation {
+    float mipRoughness;
+    uint32_t sampleOffset;
+    uint32_t sampleCount;
+};
+
+// the rough mips need more samples, their lobes are wider
+const uint32_t cMinSampleCount = 16;
+const uint32_t cMaxSampleCount = 128;
+
+float radicalInverse(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return static_cast<float>(bits) * 2.3283064365386963e-10f;
+}
+
+// GGX samples around N = (0, 0, 1), with V = N as in [Karis13]
+// xyz is the light direction, its z is the NdotL weight, w is the mip of the input to read
+// The mip covers the solid angle of the sample, see GPU Gems 3 chapter 20
+void computeFilterSamples(float roughness, uint32_t sampleCount, uint32_t inputSize, uint32_t inputMipCount, std::vector<glm::vec4>& samples) {
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float texelSolidAngle = 4.0f * glm::pi<float>() / (6.0f * static_cast<float>(inputSize) * static_cast<float>(inputSize));
+
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        float u = static_cast<float>(i) / static_cast<float>(sampleCount);
+        float v = radicalInverse(i);
+
+        float phi = 2.0f * glm::pi<float>() * v;
+        float cosTheta = std::sqrt((1.0f - u) / (1.0f + (a2 - 1.0f) * u));
+        float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        glm::vec3 H(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+        glm::vec3 L = 2.0f * cosTheta * H - glm::vec3(0.0f, 0.0f, 1.0f);
+        if (L.z <= 0.0f)
+            continue;
+
+        // pdf = D * NdotH / (4 * VdotH) and VdotH = NdotH
+        float denominator = cosTheta * cosTheta * (a2 - 1.0f) + 1.0f;
+        float D = a2 / (glm::pi<float>() * denominator * denominator);
+        float pdf = D / 4.0f;
+
+        float sampleSolidAngle = 1.0f / (static_cast<float>(sampleCount) * pdf + 0.0001f);
+        float lod = 0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f;
+        lod = std::clamp(lod, 0.0f, static_cast<float>(inputMipCount - 1));
+
+        samples.push_back(glm::vec4(L, lod));
+    }
+}
+
+}
 
 namespace Amano {
 
@@ -18,11 +81,16 @@ CubemapSpecularFilteringPass::CubemapSpecularFilteringPass(Device* device)
     , m_pipeline{ VK_NULL_HANDLE }
     , m_descriptorSets()
     , m_outputImageViews()
+    , m_sampleBuffer{ VK_NULL_HANDLE }
+    , m_sampleBufferMemory{ VK_NULL_HANDLE }
+    , m_sampleOffsets()
+    , m_sampleCounts()
 {
 }
 
 CubemapSpecularFilteringPass::~CubemapSpecularFilteringPass() {
     destroyDescriptorSets();
+    destroySampleBuffer();
 
     vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
     vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
@@ -33,13 +101,14 @@ bool CubemapSpecularFilteringPass::init() {
     DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
     descriptorSetLayoutbuilder
         .addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // input sampler
-        .addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);          // output image
+        .addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // output image
+        .addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);         // filter samples
     m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
 
     VkPushConstantRange range;
     range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
     range.offset = 0;
-    range.size = 4;
+    range.size = sizeof(FilterInformation);
 
     // create pipeline layout
     PipelineLayoutBuilder computePipelineLayoutBuilder;
@@ -51,20 +120,29 @@ bool CubemapSpecularFilteringPass::init() {
     // load the shaders and create the pipeline
     ComputePipelineBuilder computePipelineBuilder(m_device);
     computePipelineBuilder
-        .addShader("compiled_shaders/specular_filter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        .addShader("compiled_shaders/specular_filter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+        .setWorkgroupSize(m_device->getComputeWorkgroupSize());
     m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
 
     return true;
 }
 
-void CubemapSpecularFilteringPass::setupAndRecord(VkCommandBuffer cmd, Image* inputImage, Image* outputImage) {
+bool CubemapSpecularFilteringPass::setupAndRecord(VkCommandBuffer cmd, Image* inputImage, Image* outputImage) {
     destroyDescriptorSets();
-    createDescriptorSets(inputImage, outputImage);
+    destroySampleBuffer();
+    if (!createSampleBuffer(inputImage, outputImage)
+        || !createDescriptorSets(inputImage, outputImage)) {
+        std::cerr << "failed to set up the specular filtering!" << std::endl;
+        return false;
+    }
+
     recordCommands(cmd, outputImage->getWidth(), outputImage->getMipLevels());
+    return true;
 }
 
 void CubemapSpecularFilteringPass::clean() {
     destroyDescriptorSets();
+    destroySampleBuffer();
 }
 
 void CubemapSpecularFilteringPass::recordCommands(VkCommandBuffer cmd, uint32_t size, uint32_t mipCount) {
@@ -73,20 +151,64 @@ void CubemapSpecularFilteringPass::recordCommands(VkCommandBuffer cmd, uint32_t
     for (uint32_t i = 0; i < mipCount; ++i) {
         vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
 
-        float roughness = static_cast<float>(i) / static_cast<float>(mipCount - 1);
-        vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float), &roughness);
+        FilterInformation filterInformation;
+        filterInformation.mipRoughness = static_cast<float>(i) / static_cast<float>(mipCount - 1);
+        filterInformation.sampleOffset = m_sampleOffsets[i];
+        filterInformation.sampleCount = m_sampleCounts[i];
+        vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FilterInformation), &filterInformation);
 
-        // local size is 32 for x and y
-        const uint32_t locaSizeX = 32;
-        const uint32_t locaSizeY = 32;
-        uint32_t dispatchX = (size + locaSizeX - 1) / locaSizeX;
-        uint32_t dispatchY = (size + locaSizeY - 1) / locaSizeY;
-        vkCmdDispatch(cmd, dispatchX, dispatchY, 6);
+        dispatchCompute2D(cmd, m_device->getComputeWorkgroupSize(), size, size, 6);
 
         size >>= 1;
     }
 }
 
+bool CubemapSpecularFilteringPass::createSampleBuffer(Image* inputImage, Image* outputImage) {
+    uint32_t mipCount = outputImage->getMipLevels();
+    std::vector<glm::vec4> samples;
+    for (uint32_t i = 0; i < mipCount; ++i) {
+        m_sampleOffsets.push_back(static_cast<uint32_t>(samples.size()));
+
+        // the first mip is a copy of the input
+        float roughness = static_cast<float>(i) / static_cast<float>(std::max(mipCount - 1, 1u));
+        if (i > 0) {
+            uint32_t sampleCount = cMinSampleCount + static_cast<uint32_t>(roughness * static_cast<float>(cMaxSampleCount - cMinSampleCount));
+            computeFilterSamples(roughness, sampleCount, inputImage->getWidth(), inputImage->getMipLevels(), samples);
+        }
+
+        m_sampleCounts.push_back(static_cast<uint32_t>(samples.size()) - m_sampleOffsets.back());
+    }
+
+    // the buffer can't be empty
+    if (samples.empty())
+        samples.push_back(glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+
+    VkDeviceSize bufferSize = sizeof(glm::vec4) * samples.size();
+    if (!m_device->createBufferAndMemory(
+        bufferSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_sampleBuffer,
+        m_sampleBufferMemory))
+        return false;
+
+    void* data;
+    vkMapMemory(m_device->handle(), m_sampleBufferMemory, 0, bufferSize, 0, &data);
+    memcpy(data, samples.data(), static_cast<size_t>(bufferSize));
+    vkUnmapMemory(m_device->handle(), m_sampleBufferMemory);
+
+    return true;
+}
+
+void CubemapSpecularFilteringPass::destroySampleBuffer() {
+    m_device->destroyBuffer(m_sampleBuffer);
+    m_device->freeDeviceMemory(m_sampleBufferMemory);
+    m_sampleBuffer = VK_NULL_HANDLE;
+    m_sampleBufferMemory = VK_NULL_HANDLE;
+    m_sampleOffsets.clear();
+    m_sampleCounts.clear();
+}
+
 bool CubemapSpecularFilteringPass::createDescriptorSets(Image* inputImage, Image* outputImage) {
     uint32_t mipCount = outputImage->getMipLevels();
     m_descriptorSets.reserve(mipCount);
@@ -100,7 +222,8 @@ bool CubemapSpecularFilteringPass::createDescriptorSets(Image* inputImage, Image
         DescriptorSetBuilder descriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
         descriptorSetBuilder
             .addImage(inputImage->sampler(), inputImage->viewHandle(), 0)
-            .addStorageImage(o, 1);
+            .addStorageImage(o, 1)
+            .addStorageBuffer(m_sampleBuffer, VK_WHOLE_SIZE, 2);
         VkDescriptorSet descriptorSet = descriptorSetBuilder.buildAndUpdate();
         if (descriptorSet == VK_NULL_HANDLE)
             return false;
@@ -9,6 +9,9 @@ namespace Amano {
 class Image;
 
 // This class filters a cubemap to get the specular IBL
+// It uses filtered importance sampling: the GGX samples read a mip of the input chosen from their pdf,
+// so a few samples per texel are enough. The input image needs its full mip chain for that
+// The sample directions are computed once on the CPU and shared by all the invocations
 // TEMPORARY: to work correctly, it expects the following image states:
 //   - inputImage: VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_READ_BIT
 //   - outputImage: VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT
@@ -20,12 +23,14 @@ public:
 
     bool init();
 
-    void setupAndRecord(VkCommandBuffer cmd, Image* inputImage, Image* outputImage);
+    bool setupAndRecord(VkCommandBuffer cmd, Image* inputImage, Image* outputImage);
 
     void clean();
 
 private:
     void recordCommands(VkCommandBuffer cmd, uint32_t size, uint32_t mipCount);
+    bool createSampleBuffer(Image* inputImage, Image* outputImage);
+    void destroySampleBuffer();
     bool createDescriptorSets(Image* inputImage, Image* outputImage);
     void destroyDescriptorSets();
 
@@ -36,6 +41,12 @@ private:
     VkPipeline m_pipeline;
     std::vector<VkDescriptorSet> m_descriptorSets;
     std::vector<VkImageView> m_outputImageViews;
+
+    // samples of all the output mips, and the range of each mip
+    VkBuffer m_sampleBuffer;
+    VkDeviceMemory m_sampleBufferMemory;
+    std::vector<uint32_t> m_sampleOffsets;
+    std::vector<uint32_t> m_sampleCounts;
 };
 
 }
\ No newline at end of file
@@ -1,11 +1,21 @@
 #include "DeferredLightingPass.h"
+#include "ComputeDispatch.h"
+#include "MemoryBarrier.h"
 #include "../Builder/ComputePipelineBuilder.h"
 #include "../Builder/DescriptorSetBuilder.h"
 #include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/GraphicsPipelineBuilder.h"
 #include "../Builder/PipelineLayoutBuilder.h"
 #include "../Builder/SamplerBuilder.h"
 #include "../Builder/TransitionImageBarrierBuilder.h"
 
+namespace {
+
+// half size of the light probe grid, relative to the radius of the scene
+const float cLightProbeGridMargin = 1.25f;
+
+}
+
 namespace Amano {
 
 DeferredLightingPass::DeferredLightingPass(Device* device)
@@ -13,12 +23,20 @@ DeferredLightingPass::DeferredLightingPass(Device* device)
 	, m_descriptorSetLayout{ VK_NULL_HANDLE }
 	, m_pipelineLayout{ VK_NULL_HANDLE }
 	, m_pipeline{ VK_NULL_HANDLE }
+	, m_tiledPipeline{ VK_NULL_HANDLE }
 	, m_descriptorSet{ VK_NULL_HANDLE }
 	, m_nearestSampler{ VK_NULL_HANDLE }
 	, m_uniformBuffer(device)
 	, m_lightUniformBuffer(device)
+	, m_irradianceUniformBuffer(device)
 	, m_outputImage{ nullptr }
 	, m_environmentImage{ nullptr }
+	, m_iblImages()
+	, m_lightProbeGrid(device)
+	, m_lightClusteringPass(device)
+	, m_lightCullingMode{ LightCullingMode::eClustered }
+	, m_fuseToneMapping{ false }
+	, m_isOnTile{ false }
 	, m_commandBuffer{ VK_NULL_HANDLE }
 {
 }
@@ -29,32 +47,20 @@ DeferredLightingPass::~DeferredLightingPass() {
 	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
 	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
 	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_tiledPipeline, nullptr);
 	vkDestroySampler(m_device->handle(), m_nearestSampler, nullptr);
 	delete m_environmentImage;
+	delete m_iblImages.specular;
+	delete m_iblImages.brdfLut;
 }
 
-bool DeferredLightingPass::init() {
-	m_environmentImage = new Image(m_device);
-	m_environmentImage->createCube(
-		"assets/textures/Yokohama3/posx.jpg",
-		"assets/textures/Yokohama3/negx.jpg",
-		"assets/textures/Yokohama3/posy.jpg",
-		"assets/textures/Yokohama3/negy.jpg",
-		"assets/textures/Yokohama3/posz.jpg",
-		"assets/textures/Yokohama3/negz.jpg",
-		*m_device->getQueue(QueueType::eGraphics),
-		false);
-
-	DescriptorSetLayoutBuilder computeDescriptorSetLayoutbuilder;
-	computeDescriptorSetLayoutbuilder
-		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)    // albedo image
-		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)    // normal image
-		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)    // depth image
-		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)    // environment image
-		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)    // camera information
-		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)    // light information
-		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);   // output image
-	m_descriptorSetLayout = computeDescriptorSetLayoutbuilder.build(*m_device);
+bool DeferredLightingPass::init(const glm::vec4& sceneBoundingSphere, bool fuseToneMapping) {
+	m_fuseToneMapping = fuseToneMapping;
+
+	if (!initLightingResources(sceneBoundingSphere))
+		return false;
+
+	createDescriptorSetLayout();
 
 	// create raytracing pipeline layout
 	PipelineLayoutBuilder computePipelineLayoutBuilder;
@@ -62,11 +68,20 @@ bool DeferredLightingPass::init() {
 	m_pipelineLayout = computePipelineLayoutBuilder.build(*m_device);
 
 	// load the shaders and create the pipeline
+	// the fused variants declare the LDR format of their output image
 	ComputePipelineBuilder computePipelineBuilder(m_device);
 	computePipelineBuilder
-		.addShader("compiled_shaders/deferred_lighting.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		.addShader(m_fuseToneMapping ? "compiled_shaders/deferred_lighting_fused.comp.spv" : "compiled_shaders/deferred_lighting.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
 	m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
 
+	// the tiled variant uses the same descriptor set, the clusters are just ignored
+	ComputePipelineBuilder tiledPipelineBuilder(m_device);
+	tiledPipelineBuilder
+		.addShader(m_fuseToneMapping ? "compiled_shaders/deferred_lighting_tiled_fused.comp.spv" : "compiled_shaders/deferred_lighting_tiled.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
+	m_tiledPipeline = tiledPipelineBuilder.build(m_pipelineLayout);
+
 	// create a sampler for the textures
 	SamplerBuilder nearestSamplerBuilder;
 	nearestSamplerBuilder
@@ -74,19 +89,116 @@ bool DeferredLightingPass::init() {
 		.setFilter(VK_FILTER_NEAREST, VK_FILTER_NEAREST);
 	m_nearestSampler = nearestSamplerBuilder.build(*m_device);
 
+	if (!m_lightClusteringPass.init())
+		return false;
+
 	return true;
 }
 
+bool DeferredLightingPass::initOnTile(const glm::vec4& sceneBoundingSphere, VkRenderPass renderPass, uint32_t subpass) {
+	m_isOnTile = true;
+	m_fuseToneMapping = true;
+
+	if (!initLightingResources(sceneBoundingSphere))
+		return false;
+
+	createDescriptorSetLayout();
+
+	PipelineLayoutBuilder pipelineLayoutBuilder;
+	pipelineLayoutBuilder.addDescriptorSetLayout(m_descriptorSetLayout);
+	m_pipelineLayout = pipelineLayoutBuilder.build(*m_device);
+
+	// a full screen triangle, the light culling can't be tiled in a fragment shader
+	GraphicsPipelineBuilder pipelineBuilder(m_device);
+	pipelineBuilder
+		.addShader("compiled_shaders/deferred_lighting_subpass.vert.spv", VK_SHADER_STAGE_VERTEX_BIT)
+		.addShader("compiled_shaders/deferred_lighting_subpass.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
+		.setRasterizer(VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+	m_pipeline = pipelineBuilder.build(m_pipelineLayout, renderPass, subpass, 1, false);
+
+	if (!m_lightClusteringPass.init())
+		return false;
+
+	return m_pipeline != VK_NULL_HANDLE;
+}
+
+bool DeferredLightingPass::initLightingResources(const glm::vec4& sceneBoundingSphere) {
+	const std::vector<std::string> environmentFilenames = {
+		"assets/textures/Yokohama3/posx.jpg",
+		"assets/textures/Yokohama3/negx.jpg",
+		"assets/textures/Yokohama3/posy.jpg",
+		"assets/textures/Yokohama3/negy.jpg",
+		"assets/textures/Yokohama3/posz.jpg",
+		"assets/textures/Yokohama3/negz.jpg"
+	};
+
+	m_environmentImage = new Image(m_device);
+	m_environmentImage->createCube(
+		environmentFilenames[0],
+		environmentFilenames[1],
+		environmentFilenames[2],
+		environmentFilenames[3],
+		environmentFilenames[4],
+		environmentFilenames[5],
+		*m_device->getQueue(QueueType::eGraphics),
+		true);  // the specular filtering reads the mips
+	m_environmentImage->createSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR);
+
+	// the filtering only runs the first time this environment is used
+	IBLBaker iblBaker(m_device, "cache");
+	if (!iblBaker.bake(environmentFilenames, m_environmentImage, m_iblImages))
+		return false;
+	m_irradianceUniformBuffer.update(m_iblImages.irradianceSH);
+
+	// the margin keeps the outer probes out of the geometry
+	glm::vec3 gridExtent = glm::vec3(cLightProbeGridMargin * sceneBoundingSphere.w);
+	glm::vec3 sceneCenter = glm::vec3(sceneBoundingSphere);
+	if (!m_lightProbeGrid.create(sceneCenter - gridExtent, sceneCenter + gridExtent, glm::uvec3(cLightProbeGridSize), m_iblImages.irradianceSH))
+		return false;
+
+	return true;
+}
+
+void DeferredLightingPass::createDescriptorSetLayout() {
+	// on tile, the GBuffer is read from input attachments by the fragment shader, the output image is unused
+	VkShaderStageFlags stage = m_isOnTile ? VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
+	VkDescriptorType gBufferType = m_isOnTile ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(gBufferType, stage)    // albedo image
+		.addBinding(gBufferType, stage)    // normal image
+		.addBinding(gBufferType, stage)    // depth image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage)    // environment image
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stage)    // camera information
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stage)    // light information
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, stage)    // output image
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stage)   // light cluster information
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage)   // point lights
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage)   // light grid
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage)   // light indices
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stage)   // irradiance spherical harmonics
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage)    // prefiltered specular image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, stage)    // BRDF lookup table
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, stage)   // light probe grid information
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, stage);  // light probes
+	m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+}
+
 void DeferredLightingPass::cleanOnRenderTargetResized() {
 	destroyDescriptorSet();
 	destroyCommandBuffer();
 	destroyOutputImage();
+	m_lightClusteringPass.clean();
 }
 
 void DeferredLightingPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* albedoImage, Image* normalImage, Image* depthImage) {
 	createOutputImage(width, height);
+	m_lightClusteringPass.setup(width, height);
 	createDescriptorSet(albedoImage, normalImage, depthImage);
-	recordCommands(width, height);
+	// on tile, the commands are recorded by GBufferPass
+	if (!m_isOnTile)
+		recordCommands(width, height);
 }
 
 void DeferredLightingPass::updateUniformBuffer(RayParams& ubo) {
@@ -97,39 +209,92 @@ void DeferredLightingPass::updateLightUniformBuffer(LightInformation& ubo) {
 	m_lightUniformBuffer.update(ubo);
 }
 
+void DeferredLightingPass::updatePointLights(const PointLight* lights, uint32_t lightCount) {
+	m_lightClusteringPass.updateLights(lights, lightCount);
+}
+
+void DeferredLightingPass::updateLightClusterUniformBuffer(LightClusterParams& ubo) {
+	m_lightClusteringPass.updateUniformBuffer(ubo);
+}
+
 void DeferredLightingPass::recordCommands(uint32_t width, uint32_t height) {
 	destroyCommandBuffer();
 
+	// the lit area can be smaller than the images, the clusters cover it only
+	m_lightClusteringPass.setRenderExtent(width, height);
+
 	Queue* pQueue = m_device->getQueue(QueueType::eCompute);
 	m_commandBuffer = pQueue->beginCommands();
 
+	// the LDR output is read by the blit, the HDR output is sampled
+	VkImageLayout outputLayout = m_fuseToneMapping ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	VkAccessFlags outputAccessMask = m_fuseToneMapping ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+
 	TransitionImageBarrierBuilder<1> transition;
 	transition
 		.setImage(0, m_outputImage->handle())
-		.setLayouts(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL)
-		.setAccessMasks(0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+		.setLayouts(0, outputLayout, VK_IMAGE_LAYOUT_GENERAL)
+		.setAccessMasks(0, outputAccessMask, VK_ACCESS_SHADER_WRITE_BIT)
 		.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
 		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	if (m_lightCullingMode == LightCullingMode::eClustered) {
+		// assign the point lights to the clusters
+		m_lightClusteringPass.recordCommands(m_commandBuffer);
+		vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	}
+	else {
+		vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_tiledPipeline);
+	}
+
 	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
-	// local size is 32 for x and y
-	const uint32_t locaSizeX = 32;
-	const uint32_t locaSizeY = 32;
-	uint32_t dispatchX = (width + locaSizeX - 1) / locaSizeX;
-	uint32_t dispatchY = (height + locaSizeY - 1) / locaSizeY;
-	vkCmdDispatch(m_commandBuffer, dispatchX, dispatchY, 1);
+	dispatchCompute2D(m_commandBuffer, m_device->getComputeWorkgroupSize(), width, height);
 
-	// transition the compute image to shader sampler
+	// transition the compute image to shader sampler or blit source
 	transition
-		.setLayouts(0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-		.setAccessMasks(0, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.setLayouts(0, VK_IMAGE_LAYOUT_GENERAL, outputLayout)
+		.setAccessMasks(0, VK_ACCESS_SHADER_WRITE_BIT, outputAccessMask)
 		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
 	pQueue->endCommands(m_commandBuffer);
 }
 
+void DeferredLightingPass::recordOnTileLightClustering(VkCommandBuffer cmd) {
+	// the previous frame reads the clusters in its lighting subpass
+	memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	m_lightClusteringPass.recordCommands(cmd);
+
+	memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void DeferredLightingPass::recordOnTileSubpass(VkCommandBuffer cmd, uint32_t width, uint32_t height) {
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(width);
+	viewport.height = static_cast<float>(height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = { width, height };
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	// a full screen triangle, generated by the vertex shader
+	vkCmdDraw(cmd, 3, 1, 0, 0);
+}
+
 bool DeferredLightingPass::submit() {
 	// submit lighting compute
 	// 1. wait for the semaphores
@@ -156,13 +321,34 @@ bool DeferredLightingPass::submit() {
 
 void DeferredLightingPass::createOutputImage(uint32_t width, uint32_t height) {
 	m_outputImage = new Image(m_device);
-	m_outputImage->create2D(
-		width,
-		height,
-		1,
-		VK_FORMAT_R32G32B32A32_SFLOAT, //formats.colorFormat,
-		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	m_outputImage->transitionLayout(*m_device->getQueue(QueueType::eCompute), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	if (m_isOnTile) {
+		// written by the lighting subpass, it is the only attachment of the GBuffer render pass to reach the memory
+		m_outputImage->create2D(
+			width,
+			height,
+			1,
+			cOnTileLightingFormat,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		m_outputImage->transitionLayout(*m_device->getQueue(QueueType::eGraphics), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	}
+	else if (m_fuseToneMapping) {
+		m_outputImage->create2D(
+			width,
+			height,
+			1,
+			VK_FORMAT_R8G8B8A8_UNORM,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+		m_outputImage->transitionLayout(*m_device->getQueue(QueueType::eCompute), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+	}
+	else {
+		m_outputImage->create2D(
+			width,
+			height,
+			1,
+			VK_FORMAT_R16G16B16A16_SFLOAT,  // half of the bandwidth of 32 bits floats, enough range for the HDR lighting
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+		m_outputImage->transitionLayout(*m_device->getQueue(QueueType::eCompute), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
 }
 
 void DeferredLightingPass::destroyOutputImage() {
@@ -173,14 +359,33 @@ void DeferredLightingPass::destroyOutputImage() {
 bool DeferredLightingPass::createDescriptorSet(Image* albedoImage, Image* normalImage, Image* depthImage) {
 	// update the descriptor set
 	DescriptorSetBuilder computeDescriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+	if (m_isOnTile) {
+		// the output image is a color attachment of the subpass
+		computeDescriptorSetBuilder
+			.addInputAttachment(albedoImage->viewHandle(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0)
+			.addInputAttachment(normalImage->viewHandle(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1)
+			.addInputAttachment(depthImage->viewHandle(), VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, 2);
+	}
+	else {
+		computeDescriptorSetBuilder
+			.addImage(m_nearestSampler, albedoImage->viewHandle(), 0)
+			.addImage(m_nearestSampler, normalImage->viewHandle(), 1)
+			.addImage(m_nearestSampler, depthImage->viewHandle(), 2)
+			.addStorageImage(m_outputImage->viewHandle(), 6);
+	}
 	computeDescriptorSetBuilder
-		.addImage(m_nearestSampler, albedoImage->viewHandle(), 0)
-		.addImage(m_nearestSampler, normalImage->viewHandle(), 1)
-		.addImage(m_nearestSampler, depthImage->viewHandle(), 2)
 		.addImage(m_environmentImage->sampler(), m_environmentImage->viewHandle(), 3)
 		.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 4)
 		.addUniformBuffer(m_lightUniformBuffer.getBuffer(), m_lightUniformBuffer.getSize(), 5)
-		.addStorageImage(m_outputImage->viewHandle(), 6);
+		.addUniformBuffer(m_lightClusteringPass.paramsBuffer(), m_lightClusteringPass.paramsSize(), 7)
+		.addStorageBuffer(m_lightClusteringPass.lightBuffer(), VK_WHOLE_SIZE, 8)
+		.addStorageBuffer(m_lightClusteringPass.lightGridBuffer(), VK_WHOLE_SIZE, 9)
+		.addStorageBuffer(m_lightClusteringPass.lightIndexBuffer(), VK_WHOLE_SIZE, 10)
+		.addUniformBuffer(m_irradianceUniformBuffer.getBuffer(), m_irradianceUniformBuffer.getSize(), 11)
+		.addImage(m_iblImages.specular->sampler(), m_iblImages.specular->viewHandle(), 12)
+		.addImage(m_iblImages.brdfLut->sampler(), m_iblImages.brdfLut->viewHandle(), 13)
+		.addUniformBuffer(m_lightProbeGrid.paramsBuffer(), m_lightProbeGrid.paramsSize(), 14)
+		.addStorageBuffer(m_lightProbeGrid.probeBuffer(), VK_WHOLE_SIZE, 15);
 	m_descriptorSet = computeDescriptorSetBuilder.buildAndUpdate();
 
 	return m_descriptorSet != VK_NULL_HANDLE;
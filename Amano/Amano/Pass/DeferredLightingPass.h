@@ -1,14 +1,26 @@
 #pragma once
 
 #include "Pass.h"
+#include "LightClusteringPass.h"
 #include "../Device.h"
+#include "../IBLBaker.h"
 #include "../Image.h"
+#include "../LightProbeGrid.h"
 #include "../Ubo.h"
 #include "../UniformBuffer.h"
 
 namespace Amano {
 
+// Format of the output of the lighting subpass, the lighting is tone mapped
+const VkFormat cOnTileLightingFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
 // This class performs the lighting with a compute shader
+// The point lights are assigned to clusters before the lighting, see LightClusteringPass
+// The image based lighting of the environment is baked once and cached on disk, see IBLBaker
+// Its diffuse part is evaluated from spherical harmonics in a uniform buffer
+// When the light probe grid is enabled, the diffuse part comes from the probes around each pixel instead
+// With LightCullingMode::eTiled, the clusters are skipped: each work group culls the lights
+// against the depth bounds of its tile in shared memory
 // TEMPORARY: to work correctly, it expects the following image states:
 //   - albedoImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
 //   - normalImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
@@ -16,25 +28,63 @@ namespace Amano {
 //   - outputImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
 // After submitting, the images states are the same
 // Everything is ready to be sampled by the next passes
+// With fused tone mapping, the output image is the final LDR image:
+//   - outputImage: VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT
+// It is ready to be blitted to the swapchain, there is no need for a ToneMappingPass
+// On tile based GPUs, the lighting can be a subpass of the GBuffer render pass instead, see initOnTile
+//   - the GBuffer is read from input attachments and the output image is a color attachment
+//   - the lighting is always tone mapped, and the light culling is always clustered
+//   - GBufferPass records the commands and drives the resizing, the pass is never submitted on its own
+//   - outputImage: VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT
 class DeferredLightingPass : public Pass {
 public:
+	enum class LightCullingMode {
+		eClustered,
+		eTiled
+	};
+
 	DeferredLightingPass(Device* device);
 	~DeferredLightingPass();
 
 	Image* outputImage() const { return m_outputImage; }
+	Image* environmentImage() const { return m_environmentImage; }
+	LightProbeGrid* lightProbeGrid() { return &m_lightProbeGrid; }
+	// The lights, also read by the passes lighting other surfaces than the GBuffer
+	VkBuffer pointLightBuffer() const { return m_lightClusteringPass.lightBuffer(); }
+	VkBuffer irradianceBuffer() { return m_irradianceUniformBuffer.getBuffer(); }
+	size_t irradianceSize() { return m_irradianceUniformBuffer.getSize(); }
 
-	bool init();
+	// The light probe grid covers the bounding box of sceneBoundingSphere
+	// fuseToneMapping can be used when no pass needs the HDR lighting
+	bool init(const glm::vec4& sceneBoundingSphere, bool fuseToneMapping = false);
+	// The lighting is the given subpass of renderPass, which must match the one of GBufferPass::init
+	bool initOnTile(const glm::vec4& sceneBoundingSphere, VkRenderPass renderPass, uint32_t subpass);
+	// width and height are the rendered area, they can be smaller than the size of the images to render at a lower resolution
+	// The light cluster uniform buffer must be updated after this call
 	void recordCommands(uint32_t width, uint32_t height);
 
+	bool isOnTile() const { return m_isOnTile; }
+	// On tile, the clusters are filled before the render pass begins, then the lighting is drawn in its subpass
+	void recordOnTileLightClustering(VkCommandBuffer cmd);
+	void recordOnTileSubpass(VkCommandBuffer cmd, uint32_t width, uint32_t height);
+
+	// The commands must be recorded again for the mode to be used
+	LightCullingMode getLightCullingMode() const { return m_lightCullingMode; }
+	void setLightCullingMode(LightCullingMode mode) { m_lightCullingMode = mode; }
+
 	void cleanOnRenderTargetResized();
 	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* albedoImage, Image* normalImage, Image* depthImage);
 
 	void updateUniformBuffer(RayParams& ubo);
 	void updateLightUniformBuffer(LightInformation& ubo);
+	void updatePointLights(const PointLight* lights, uint32_t lightCount);
+	void updateLightClusterUniformBuffer(LightClusterParams& ubo);
 
 	bool submit();
 
 private:
+	bool initLightingResources(const glm::vec4& sceneBoundingSphere);
+	void createDescriptorSetLayout();
 	void createOutputImage(uint32_t width, uint32_t height);
 	void destroyOutputImage();
 	bool createDescriptorSet(Image* albedoImage, Image* normalImage, Image* depthImage);
@@ -45,12 +95,20 @@ private:
 	VkDescriptorSetLayout m_descriptorSetLayout;
 	VkPipelineLayout m_pipelineLayout;
 	VkPipeline m_pipeline;
+	VkPipeline m_tiledPipeline;
 	VkDescriptorSet m_descriptorSet;
 	VkSampler m_nearestSampler;
 	UniformBuffer<RayParams> m_uniformBuffer;
 	UniformBuffer<LightInformation> m_lightUniformBuffer;
+	UniformBuffer<IrradianceSH> m_irradianceUniformBuffer;
 	Image* m_outputImage;
 	Image* m_environmentImage;
+	IBLImages m_iblImages;
+	LightProbeGrid m_lightProbeGrid;
+	LightClusteringPass m_lightClusteringPass;
+	LightCullingMode m_lightCullingMode;
+	bool m_fuseToneMapping;
+	bool m_isOnTile;
 	VkCommandBuffer m_commandBuffer;
 };
 
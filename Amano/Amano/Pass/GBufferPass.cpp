@@ -24,6 +24,11 @@ GBufferPass::GBufferPass(Device* device)
 	, m_albedoImage{ nullptr }
 	, m_normalImage{ nullptr }
 	, m_depthImage{ nullptr }
+	, m_velocityImage{ nullptr }
+	, m_meshletCullingPass(device)
+	, m_useMeshletCulling{ false }
+	, m_onTileLightingPass{ nullptr }
+	, m_frameTimer{ nullptr }
 	, m_commandBuffer{ VK_NULL_HANDLE }
 {
 }
@@ -37,17 +42,34 @@ GBufferPass::~GBufferPass() {
 	vkDestroyRenderPass(m_device->handle(), m_renderPass, nullptr);
 }
 
-bool GBufferPass::init() {
+bool GBufferPass::init(DeferredLightingPass* onTileLightingPass) {
+	m_onTileLightingPass = onTileLightingPass;
 	Formats formats = getFormats();
 
 	// create the render pass
 	RenderPassBuilder renderPassBuilder;
-	renderPassBuilder
-		.addColorAttachment(formats.colorFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 0 for color
-		.addColorAttachment(formats.normalFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 1 for normal
-		.addDepthAttachment(formats.depthFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 2 for depth buffer
-		.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, { 0, 1 }, 2) // subpass 0
-		.addSubpassDependency(VK_SUBPASS_EXTERNAL, 0);
+	if (m_onTileLightingPass != nullptr) {
+		// the GBuffer stays in the tile memory, only the lit color is stored
+		renderPassBuilder
+			.addTransientAttachment(formats.colorFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 0 for color
+			.addTransientAttachment(formats.normalFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 1 for normal
+			.addTransientAttachment(formats.depthFormat, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL) // attachment 2 for depth buffer
+			.addOverwrittenColorAttachment(cOnTileLightingFormat, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) // attachment 3 for the lit color
+			.addTransientAttachment(formats.velocityFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 4 for velocity, unused on tile
+			.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, { 0, 1, 4 }, 2) // subpass 0
+			.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, { 3 }, VK_ATTACHMENT_UNUSED, { 0, 1, 2 }) // subpass 1, the lighting
+			.addSubpassDependency(VK_SUBPASS_EXTERNAL, 0)
+			.addInputAttachmentDependency(0, cOnTileLightingSubpass);
+	}
+	else {
+		renderPassBuilder
+			.addColorAttachment(formats.colorFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 0 for color
+			.addColorAttachment(formats.normalFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 1 for normal
+			.addDepthAttachment(formats.depthFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 2 for depth buffer
+			.addColorAttachment(formats.velocityFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) // attachment 3 for velocity
+			.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, { 0, 1, 3 }, 2) // subpass 0
+			.addSubpassDependency(VK_SUBPASS_EXTERNAL, 0);
+	}
 	m_renderPass = renderPassBuilder.build(*m_device);
 
 	// create layout for the next pipeline
@@ -68,7 +90,10 @@ bool GBufferPass::init() {
 		.addShader("compiled_shaders/gbuffer.vert.spv", VK_SHADER_STAGE_VERTEX_BIT)
 		.addShader("compiled_shaders/gbuffer.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
 		.setRasterizer(VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
-	m_pipeline = pipelineBuilder.build(m_pipelineLayout, m_renderPass, 0, 2, true);
+	m_pipeline = pipelineBuilder.build(m_pipelineLayout, m_renderPass, 0, 3, true);
+
+	if (!m_meshletCullingPass.init())
+		return false;
 
 	return true;
 }
@@ -79,22 +104,18 @@ void GBufferPass::recordCommands(uint32_t width, uint32_t height, const Mesh* me
 	auto pQueue = m_device->getQueue(QueueType::eGraphics);
 	m_commandBuffer = pQueue->beginCommands();
 
-	// transition images from shader sampler to render target
-	TransitionImageBarrierBuilder<3> transition;
-	transition
-		.setImage(0, m_albedoImage->handle())
-		.setLayouts(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.setAccessMasks(0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
-		.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
-		.setImage(1, m_normalImage->handle())
-		.setLayouts(1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.setAccessMasks(1, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
-		.setAspectMask(1, VK_IMAGE_ASPECT_COLOR_BIT)
-		.setImage(2, m_depthImage->handle())
-		.setLayouts(2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.setAccessMasks(2, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
-		.setAspectMask(2, VK_IMAGE_ASPECT_DEPTH_BIT)
-		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+	if (m_frameTimer != nullptr)
+		m_frameTimer->recordBegin(m_commandBuffer);
+
+	// generate the index buffer of the visible meshlets before rendering
+	if (m_useMeshletCulling)
+		m_meshletCullingPass.recordCommands(m_commandBuffer);
+
+	// the transient attachments start undefined every frame, no transition is needed
+	if (m_onTileLightingPass != nullptr)
+		m_onTileLightingPass->recordOnTileLightClustering(m_commandBuffer);
+	else
+		recordRenderTargetTransition();
 
 	VkRenderPassBeginInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -104,11 +125,13 @@ void GBufferPass::recordCommands(uint32_t width, uint32_t height, const Mesh* me
 	renderPassInfo.renderArea.extent.width = width;
 	renderPassInfo.renderArea.extent.height = height;
 
-	std::array<VkClearValue, 4> clearValues{};
+	// one per attachment, the velocity of the background is zero
+	std::array<VkClearValue, 5> clearValues{};
 	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
 	clearValues[1].color = { 0.0f, 0.0f, 0.0f, 0.0f };
-	clearValues[2].color = { 1.0f, 0.0f, 0.0f, 0.0f };
-	clearValues[3].depthStencil = { 1.0f, 0 };
+	clearValues[2].depthStencil = { 1.0f, 0 };
+	clearValues[3].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	clearValues[4].color = { 0.0f, 0.0f, 0.0f, 0.0f };
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassInfo.pClearValues = clearValues.data();
 
@@ -135,11 +158,22 @@ void GBufferPass::recordCommands(uint32_t width, uint32_t height, const Mesh* me
 	VkBuffer vertexBuffers[] = { mesh->getVertexBuffer() };
 	VkDeviceSize offsets[] = { 0 };
 	vkCmdBindVertexBuffers(m_commandBuffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(m_commandBuffer, mesh->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
 	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
-	vkCmdDrawIndexed(m_commandBuffer, mesh->getIndexCount(), 1, 0, 0, 0);
+	if (m_useMeshletCulling) {
+		// the index count is written by the culling shader
+		vkCmdBindIndexBuffer(m_commandBuffer, m_meshletCullingPass.indexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexedIndirect(m_commandBuffer, m_meshletCullingPass.drawCommandBuffer(), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else {
+		vkCmdBindIndexBuffer(m_commandBuffer, mesh->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		vkCmdDrawIndexed(m_commandBuffer, mesh->getIndexCount(), 1, 0, 0, 0);
+	}
+
+	if (m_onTileLightingPass != nullptr) {
+		vkCmdNextSubpass(m_commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+		m_onTileLightingPass->recordOnTileSubpass(m_commandBuffer, width, height);
+	}
 
 	// the render pass will transition the framebuffer from render target to shader sample
 	vkCmdEndRenderPass(m_commandBuffer);
@@ -147,20 +181,79 @@ void GBufferPass::recordCommands(uint32_t width, uint32_t height, const Mesh* me
 	pQueue->endCommands(m_commandBuffer);
 }
 
+void GBufferPass::recordRenderTargetTransition() {
+	// transition images from shader sampler to render target
+	TransitionImageBarrierBuilder<4> transition;
+	transition
+		.setImage(0, m_albedoImage->handle())
+		.setLayouts(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+		.setAccessMasks(0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+		.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
+		.setImage(1, m_normalImage->handle())
+		.setLayouts(1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+		.setAccessMasks(1, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+		.setAspectMask(1, VK_IMAGE_ASPECT_COLOR_BIT)
+		.setImage(2, m_depthImage->handle())
+		.setLayouts(2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		.setAccessMasks(2, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+		.setAspectMask(2, VK_IMAGE_ASPECT_DEPTH_BIT)
+		.setImage(3, m_velocityImage->handle())
+		.setLayouts(3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+		.setAccessMasks(3, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+		.setAspectMask(3, VK_IMAGE_ASPECT_COLOR_BIT)
+		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
+
 void GBufferPass::cleanOnRenderTargetResized() {
 	destroyDescriptorSet();
 	destroyCommandBuffer();
 	destroyGBufferImages();
+	m_meshletCullingPass.clean();
+	m_useMeshletCulling = false;
+
+	// the framebuffer holds the output of the lighting
+	if (m_onTileLightingPass != nullptr)
+		m_onTileLightingPass->cleanOnRenderTargetResized();
 }
 
 void GBufferPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, const Mesh* mesh, Image* texture) {
-	createGBufferImages(width, height);
+	if (m_onTileLightingPass != nullptr)
+		createOnTileImages(width, height);
+	else
+		createGBufferImages(width, height);
 	createDescriptorSet(texture);
+	m_useMeshletCulling = m_meshletCullingPass.setup(mesh);
 	recordCommands(width, height, mesh);
 }
 
-void GBufferPass::updateUniformBuffer(PerFrameUniformBufferObject& ubo) {
+void GBufferPass::updateUniformBuffer(PerFrameUniformBufferObject& ubo, uint32_t lod) {
 	m_uniformBuffer.update(ubo);
+
+	if (m_useMeshletCulling) {
+		MeshletCullingParams cullingParams{};
+		cullingParams.model = ubo.model;
+
+		// extract the frustum planes in world space (Gribb/Hartmann), the depth range is [0, 1]
+		glm::mat4 viewProj = ubo.proj * ubo.view;
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; ++i)
+			rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+		cullingParams.frustumPlanes[0] = rows[3] + rows[0]; // left
+		cullingParams.frustumPlanes[1] = rows[3] - rows[0]; // right
+		cullingParams.frustumPlanes[2] = rows[3] + rows[1]; // bottom
+		cullingParams.frustumPlanes[3] = rows[3] - rows[1]; // top
+		cullingParams.frustumPlanes[4] = rows[2];           // near
+		cullingParams.frustumPlanes[5] = rows[3] - rows[2]; // far
+		for (auto& plane : cullingParams.frustumPlanes)
+			plane /= glm::length(glm::vec3(plane));
+
+		// the bounding spheres are scaled by the largest scale of the model matrix
+		float scale = glm::max(glm::length(glm::vec3(ubo.model[0])), glm::max(glm::length(glm::vec3(ubo.model[1])), glm::length(glm::vec3(ubo.model[2]))));
+		glm::vec3 cameraPosition = glm::vec3(glm::inverse(ubo.view)[3]);
+		cullingParams.cameraPositionAndScale = glm::vec4(cameraPosition, scale);
+
+		m_meshletCullingPass.updateUniformBuffer(cullingParams, lod);
+	}
 }
 
 bool GBufferPass::submit() {
@@ -221,12 +314,78 @@ void GBufferPass::createGBufferImages(uint32_t width, uint32_t height) {
 		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 	m_normalImage->transitionLayout(*pQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
+	m_velocityImage = new Image(m_device);
+	m_velocityImage->create2D(
+		width,
+		height,
+		1,
+		formats.velocityFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	m_velocityImage->transitionLayout(*pQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
 	// create the framebuffer
 	FramebufferBuilder framebufferBuilder;
 	framebufferBuilder
 		.addAttachment(m_albedoImage->viewHandle())
 		.addAttachment(m_normalImage->viewHandle())
-		.addAttachment(m_depthImage->viewHandle());
+		.addAttachment(m_depthImage->viewHandle())
+		.addAttachment(m_velocityImage->viewHandle());
+	m_framebuffer = framebufferBuilder.build(*m_device, m_renderPass, width, height);
+}
+
+void GBufferPass::createOnTileImages(uint32_t width, uint32_t height) {
+	Formats formats = getFormats();
+
+	// the attachments only live in the tile memory, the memory is never committed if the driver can avoid it
+	VkMemoryPropertyFlags memoryProperties = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	m_depthImage = new Image(m_device);
+	m_depthImage->create2D(
+		width,
+		height,
+		1,
+		formats.depthFormat,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+		memoryProperties);
+
+	m_albedoImage = new Image(m_device);
+	m_albedoImage->create2D(
+		width,
+		height,
+		1,
+		formats.colorFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+		memoryProperties);
+
+	m_normalImage = new Image(m_device);
+	m_normalImage->create2D(
+		width,
+		height,
+		1,
+		formats.normalFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+		memoryProperties);
+
+	// the GBuffer shaders always write the velocity, there is no temporal anti-aliasing on tile to read it
+	m_velocityImage = new Image(m_device);
+	m_velocityImage->create2D(
+		width,
+		height,
+		1,
+		formats.velocityFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+		memoryProperties);
+
+	// the lighting reads the attachments, its output is the last attachment of the framebuffer
+	m_onTileLightingPass->recreateOnRenderTargetResized(width, height, m_albedoImage, m_normalImage, m_depthImage);
+
+	FramebufferBuilder framebufferBuilder;
+	framebufferBuilder
+		.addAttachment(m_albedoImage->viewHandle())
+		.addAttachment(m_normalImage->viewHandle())
+		.addAttachment(m_depthImage->viewHandle())
+		.addAttachment(m_onTileLightingPass->outputImage()->viewHandle())
+		.addAttachment(m_velocityImage->viewHandle());
 	m_framebuffer = framebufferBuilder.build(*m_device, m_renderPass, width, height);
 }
 
@@ -234,9 +393,11 @@ void GBufferPass::destroyGBufferImages() {
 	delete m_albedoImage;
 	delete m_normalImage;
 	delete m_depthImage;
+	delete m_velocityImage;
 	m_albedoImage = nullptr;
 	m_normalImage = nullptr;
 	m_depthImage = nullptr;
+	m_velocityImage = nullptr;
 
 	if (m_framebuffer != VK_NULL_HANDLE) {
 		vkDestroyFramebuffer(m_device->handle(), m_framebuffer, nullptr);
@@ -277,8 +438,16 @@ GBufferPass::Formats GBufferPass::getFormats() {
 		VK_IMAGE_TILING_OPTIMAL,
 		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
 	);
-	formats.colorFormat = VK_FORMAT_R8G8B8A8_UNORM; // VK_FORMAT_R8G8B8A8_SRGB
-	formats.normalFormat = VK_FORMAT_R16G16B16A16_SNORM;
+	// the layout is described in gbuffer.glsl: the alpha of the albedo is the roughness, the normals are octahedral encoded
+	formats.colorFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	// the snorm format isn't a mandatory color attachment, the half float one is
+	formats.normalFormat = m_device->findSupportedFormat(
+		{ VK_FORMAT_R16G16_SNORM, VK_FORMAT_R16G16_SFLOAT },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+	);
+	// the velocity is a fraction of the screen, the half floats are precise enough for the small motions
+	formats.velocityFormat = VK_FORMAT_R16G16_SFLOAT;
 	return formats;
 }
 
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "Pass.h"
+#include "DeferredLightingPass.h"
+#include "MeshletCullingPass.h"
 #include "../Device.h"
+#include "../GpuFrameTimer.h"
 #include "../Image.h"
 #include "../Mesh.h"
 #include "../Ubo.h"
@@ -9,7 +12,12 @@
 
 namespace Amano {
 
+// Subpass of the GBuffer render pass in which the lighting is done on tile
+const uint32_t cOnTileLightingSubpass = 1;
+
 // This class generates the GBuffer
+// On tile based GPUs, the lighting can be done in a second subpass, see DeferredLightingPass::initOnTile
+// The GBuffer is then made of transient attachments which never leave the tile memory and can't be read by other passes
 // TEMPORARY:
 // After submitting, the images states are  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
 class GBufferPass : public Pass {
@@ -20,20 +28,32 @@ public:
 	Image* albedoImage() const { return m_albedoImage; }
 	Image* normalImage() const { return m_normalImage; }
 	Image* depthImage()  const { return m_depthImage;  }
+	Image* velocityImage() const { return m_velocityImage; }
+	VkRenderPass renderPass() const { return m_renderPass; }
+
+	// onTileLightingPass must be initialized with initOnTile after this call, the GBufferPass records and resizes it
+	bool init(DeferredLightingPass* onTileLightingPass = nullptr);
 
-	bool init();
+	// The pass is the first one of the frame, its commands start with the first timestamp of the timer
+	// The commands must be recorded again for the timer to be used
+	void setFrameTimer(GpuFrameTimer* frameTimer) { m_frameTimer = frameTimer; }
 
+	// width and height are the rendered area, they can be smaller than the size given to recreateOnRenderTargetResized
+	// The viewport and the render area only cover the top left part of the images then
 	void recordCommands(uint32_t width, uint32_t height, const Mesh* mesh);
 
 	void cleanOnRenderTargetResized();
 	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, const Mesh* mesh, Image* texture);
 	
-	void updateUniformBuffer(PerFrameUniformBufferObject& ubo);
+	// lod is the level of detail of the mesh to render, it is only used when the meshlets are culled
+	void updateUniformBuffer(PerFrameUniformBufferObject& ubo, uint32_t lod);
 
 	bool submit();
 
 private:
+	void recordRenderTargetTransition();
 	void createGBufferImages(uint32_t width, uint32_t height);
+	void createOnTileImages(uint32_t width, uint32_t height);
 	void destroyGBufferImages();
 	bool createDescriptorSet(Image* texture);
 	void destroyDescriptorSet();
@@ -43,6 +63,7 @@ private:
 		VkFormat depthFormat;
 		VkFormat colorFormat;
 		VkFormat normalFormat;
+		VkFormat velocityFormat;
 	};
 	Formats getFormats();
 
@@ -57,6 +78,11 @@ private:
 	Image* m_albedoImage;
 	Image* m_normalImage;
 	Image* m_depthImage;
+	Image* m_velocityImage;
+	MeshletCullingPass m_meshletCullingPass;
+	bool m_useMeshletCulling;
+	DeferredLightingPass* m_onTileLightingPass;
+	GpuFrameTimer* m_frameTimer;
 
 	VkCommandBuffer m_commandBuffer;
 };
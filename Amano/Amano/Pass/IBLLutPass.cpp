@@ -1,4 +1,5 @@
 #include "IBLLutPass.h"
+#include "ComputeDispatch.h"
 #include "../Image.h"
 #include "../Builder/ComputePipelineBuilder.h"
 #include "../Builder/DescriptorSetBuilder.h"
@@ -38,7 +39,8 @@ bool IBLLutPass::init() {
     // load the shaders and create the pipeline
     ComputePipelineBuilder computePipelineBuilder(m_device);
     computePipelineBuilder
-        .addShader("compiled_shaders/ibl_lut.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+        .addShader("compiled_shaders/ibl_lut.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+        .setWorkgroupSize(m_device->getComputeWorkgroupSize());
     m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
 
     return true;
@@ -58,12 +60,7 @@ void IBLLutPass::recordCommands(VkCommandBuffer cmd, uint32_t width, uint32_t he
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
-    // local size is 32 for x and y
-    const uint32_t locaSizeX = 32;
-    const uint32_t locaSizeY = 32;
-    uint32_t dispatchX = (width + locaSizeX - 1) / locaSizeX;
-    uint32_t dispatchY = (height + locaSizeY - 1) / locaSizeY;
-    vkCmdDispatch(cmd, dispatchX, dispatchY, 6);
+    dispatchCompute2D(cmd, m_device->getComputeWorkgroupSize(), width, height, 6);
 }
 
 bool IBLLutPass::createDescriptorSet(Image* outputImage) {
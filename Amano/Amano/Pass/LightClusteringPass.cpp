@@ -0,0 +1,257 @@
+#include "LightClusteringPass.h"
+#include "ComputeDispatch.h"
+#include "MemoryBarrier.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// matches the overflow buffer of light_clustering.comp
+struct LightClusterOverflow {
+	uint32_t clusterCount;
+	uint32_t maxLightCount;
+};
+
+}
+
+namespace Amano {
+
+LightClusteringPass::LightClusteringPass(Device* device)
+	: m_device{ device }
+	, m_descriptorSetLayout{ VK_NULL_HANDLE }
+	, m_pipelineLayout{ VK_NULL_HANDLE }
+	, m_pipeline{ VK_NULL_HANDLE }
+	, m_descriptorSet{ VK_NULL_HANDLE }
+	, m_uniformBuffer(device)
+	, m_workgroupSize{ 0 }
+	, m_lightBuffer{ VK_NULL_HANDLE }
+	, m_lightBufferMemory{ VK_NULL_HANDLE }
+	, m_mappedLights{ nullptr }
+	, m_lightCount{ 0 }
+	, m_lightGridBuffer{ VK_NULL_HANDLE }
+	, m_lightGridBufferMemory{ VK_NULL_HANDLE }
+	, m_lightIndexBuffer{ VK_NULL_HANDLE }
+	, m_lightIndexBufferMemory{ VK_NULL_HANDLE }
+	, m_overflowBuffer{ VK_NULL_HANDLE }
+	, m_overflowBufferMemory{ VK_NULL_HANDLE }
+	, m_mappedOverflow{ nullptr }
+	, m_maxReportedLightCount{ 0 }
+	, m_width{ 0 }
+	, m_height{ 0 }
+	, m_clusterCounts(0)
+{
+}
+
+LightClusteringPass::~LightClusteringPass() {
+	clean();
+
+	if (m_mappedLights != nullptr)
+		vkUnmapMemory(m_device->handle(), m_lightBufferMemory);
+	m_device->destroyBuffer(m_lightBuffer);
+	m_device->freeDeviceMemory(m_lightBufferMemory);
+
+	if (m_mappedOverflow != nullptr)
+		vkUnmapMemory(m_device->handle(), m_overflowBufferMemory);
+	m_device->destroyBuffer(m_overflowBuffer);
+	m_device->freeDeviceMemory(m_overflowBufferMemory);
+
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+}
+
+bool LightClusteringPass::init() {
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // cluster parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // lights
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // light grid
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // light indices
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);  // overflow
+	m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+
+	// create pipeline layout
+	PipelineLayoutBuilder computePipelineLayoutBuilder;
+	computePipelineLayoutBuilder.addDescriptorSetLayout(m_descriptorSetLayout);
+	m_pipelineLayout = computePipelineLayoutBuilder.build(*m_device);
+
+	// the kernel is one dimensional, its work groups have as many invocations as the 2D ones
+	VkExtent2D workgroupSize = m_device->getComputeWorkgroupSize();
+	m_workgroupSize = workgroupSize.width * workgroupSize.height;
+
+	// load the shaders and create the pipeline
+	ComputePipelineBuilder computePipelineBuilder(m_device);
+	computePipelineBuilder
+		.addShader("compiled_shaders/light_clustering.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_workgroupSize, 1);
+	m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
+	if (m_pipeline == VK_NULL_HANDLE)
+		return false;
+
+	// create the light buffer
+	VkDeviceSize bufferSize = sizeof(PointLight) * cMaxPointLights;
+	if (!m_device->createBufferAndMemory(
+		bufferSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_lightBuffer,
+		m_lightBufferMemory))
+		return false;
+
+	if (vkMapMemory(m_device->handle(), m_lightBufferMemory, 0, bufferSize, 0, &m_mappedLights) != VK_SUCCESS) {
+		std::cerr << "failed to map the light buffer!" << std::endl;
+		m_mappedLights = nullptr;
+		return false;
+	}
+
+	// create the overflow buffer, the shader only increments it
+	if (!m_device->createBufferAndMemory(
+		sizeof(LightClusterOverflow),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_overflowBuffer,
+		m_overflowBufferMemory))
+		return false;
+
+	if (vkMapMemory(m_device->handle(), m_overflowBufferMemory, 0, sizeof(LightClusterOverflow), 0, &m_mappedOverflow) != VK_SUCCESS) {
+		std::cerr << "failed to map the light cluster overflow buffer!" << std::endl;
+		m_mappedOverflow = nullptr;
+		return false;
+	}
+	memset(m_mappedOverflow, 0, sizeof(LightClusterOverflow));
+
+	return true;
+}
+
+bool LightClusteringPass::setup(uint32_t width, uint32_t height) {
+	clean();
+
+	setRenderExtent(width, height);
+
+	return createClusterBuffers()
+		&& createDescriptorSet();
+}
+
+void LightClusteringPass::setRenderExtent(uint32_t width, uint32_t height) {
+	m_width = width;
+	m_height = height;
+	m_clusterCounts = glm::uvec3(
+		(width + cLightClusterTileSize - 1) / cLightClusterTileSize,
+		(height + cLightClusterTileSize - 1) / cLightClusterTileSize,
+		cLightClusterSliceCount);
+}
+
+void LightClusteringPass::recordCommands(VkCommandBuffer cmd) {
+	// the previous lighting must be done with the clusters before they are overwritten
+	computeMemoryBarrier(cmd, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+	// one invocation per cluster
+	uint32_t clusterCount = m_clusterCounts.x * m_clusterCounts.y * m_clusterCounts.z;
+	vkCmdDispatch(cmd, getWorkgroupCount(clusterCount, m_workgroupSize), 1, 1);
+
+	computeMemoryBarrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+	// the overflow is read on the CPU once the frame is finished
+	memoryBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
+
+void LightClusteringPass::clean() {
+	destroyDescriptorSet();
+	destroyClusterBuffers();
+	m_clusterCounts = glm::uvec3(0);
+}
+
+void LightClusteringPass::updateLights(const PointLight* lights, uint32_t lightCount) {
+	m_lightCount = std::min(lightCount, cMaxPointLights);
+	if (m_mappedLights != nullptr && m_lightCount > 0)
+		memcpy(m_mappedLights, lights, sizeof(PointLight) * m_lightCount);
+}
+
+void LightClusteringPass::updateUniformBuffer(LightClusterParams& ubo) {
+	reportOverflow();
+
+	ubo.clusterCounts = glm::uvec4(m_clusterCounts, m_lightCount);
+	ubo.screenSizeAndDepthRange.x = static_cast<float>(m_width);
+	ubo.screenSizeAndDepthRange.y = static_cast<float>(m_height);
+	m_uniformBuffer.update(ubo);
+}
+
+void LightClusteringPass::reportOverflow() {
+	if (m_mappedOverflow == nullptr)
+		return;
+
+	LightClusterOverflow* overflow = static_cast<LightClusterOverflow*>(m_mappedOverflow);
+	if (overflow->clusterCount > 0 && overflow->maxLightCount > m_maxReportedLightCount) {
+		std::cerr << overflow->clusterCount << " light clusters have more than " << cMaxLightsPerCluster
+			<< " lights, up to " << overflow->maxLightCount << ", the other lights are dropped" << std::endl;
+		m_maxReportedLightCount = overflow->maxLightCount;
+	}
+
+	// the host writes are visible to the next submission
+	overflow->clusterCount = 0;
+	overflow->maxLightCount = 0;
+}
+
+bool LightClusteringPass::createClusterBuffers() {
+	uint32_t clusterCount = m_clusterCounts.x * m_clusterCounts.y * m_clusterCounts.z;
+
+	if (!m_device->createBufferAndMemory(
+		sizeof(uint32_t) * clusterCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_lightGridBuffer,
+		m_lightGridBufferMemory))
+		return false;
+
+	if (!m_device->createBufferAndMemory(
+		sizeof(uint32_t) * clusterCount * cMaxLightsPerCluster,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_lightIndexBuffer,
+		m_lightIndexBufferMemory))
+		return false;
+
+	return true;
+}
+
+void LightClusteringPass::destroyClusterBuffers() {
+	m_device->destroyBuffer(m_lightGridBuffer);
+	m_device->freeDeviceMemory(m_lightGridBufferMemory);
+	m_device->destroyBuffer(m_lightIndexBuffer);
+	m_device->freeDeviceMemory(m_lightIndexBufferMemory);
+	m_lightGridBuffer = VK_NULL_HANDLE;
+	m_lightGridBufferMemory = VK_NULL_HANDLE;
+	m_lightIndexBuffer = VK_NULL_HANDLE;
+	m_lightIndexBufferMemory = VK_NULL_HANDLE;
+}
+
+bool LightClusteringPass::createDescriptorSet() {
+	DescriptorSetBuilder descriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+	descriptorSetBuilder
+		.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 0)
+		.addStorageBuffer(m_lightBuffer, VK_WHOLE_SIZE, 1)
+		.addStorageBuffer(m_lightGridBuffer, VK_WHOLE_SIZE, 2)
+		.addStorageBuffer(m_lightIndexBuffer, VK_WHOLE_SIZE, 3)
+		.addStorageBuffer(m_overflowBuffer, VK_WHOLE_SIZE, 4);
+	m_descriptorSet = descriptorSetBuilder.buildAndUpdate();
+
+	return m_descriptorSet != VK_NULL_HANDLE;
+}
+
+void LightClusteringPass::destroyDescriptorSet() {
+	if (m_descriptorSet != VK_NULL_HANDLE) {
+		vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_descriptorSet);
+		m_descriptorSet = VK_NULL_HANDLE;
+	}
+}
+
+}
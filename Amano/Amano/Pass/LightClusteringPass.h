@@ -0,0 +1,91 @@
+#pragma once
+
+#include "../Device.h"
+#include "../Ubo.h"
+#include "../UniformBuffer.h"
+
+namespace Amano {
+
+// Size of the light clusters
+// cLightClusterTileSize and cMaxLightsPerCluster must match the values of light_clusters.glsl
+const uint32_t cLightClusterTileSize = 64;     // in pixels
+const uint32_t cLightClusterSliceCount = 24;   // exponential depth slices between the near and far planes
+const uint32_t cMaxLightsPerCluster = 128;
+const uint32_t cMaxPointLights = 4096;
+
+// This class assigns the point lights to clusters (screen tiles x depth slices) with a compute shader
+// The lighting shader then only iterates over the lights of the cluster of each pixel
+// The commands are recorded in the command buffer of the lighting pass, before the lighting dispatch
+// After the recorded commands, the buffers are ready for VK_ACCESS_SHADER_READ_BIT in the compute stage
+// The clusters over cMaxLightsPerCluster lights drop the others, they are reported on std::cerr when the uniforms are updated
+class LightClusteringPass {
+public:
+	LightClusteringPass(Device* device);
+	~LightClusteringPass();
+
+	// Buffers read by the lighting shader
+	VkBuffer paramsBuffer() { return m_uniformBuffer.getBuffer(); }
+	size_t paramsSize() { return m_uniformBuffer.getSize(); }
+	VkBuffer lightBuffer() const { return m_lightBuffer; }
+	VkBuffer lightGridBuffer() const { return m_lightGridBuffer; }
+	VkBuffer lightIndexBuffer() const { return m_lightIndexBuffer; }
+
+	bool init();
+
+	// Creates the clusters for the given render target size
+	bool setup(uint32_t width, uint32_t height);
+	// Only the clusters of the rendered area are filled, it must not be larger than the size given to setup
+	// The commands must be recorded again for the extent to be used
+	void setRenderExtent(uint32_t width, uint32_t height);
+	void recordCommands(VkCommandBuffer cmd);
+	void clean();
+
+	// Copies the lights in the light buffer. Only the first cMaxPointLights lights are kept
+	void updateLights(const PointLight* lights, uint32_t lightCount);
+
+	// The cluster counts and the light count are filled by this method
+	// The previous frame must be finished, its overflow of the clusters is read and reset
+	void updateUniformBuffer(LightClusterParams& ubo);
+
+private:
+	bool createClusterBuffers();
+	void destroyClusterBuffers();
+	bool createDescriptorSet();
+	void destroyDescriptorSet();
+	void reportOverflow();
+
+private:
+	Device* m_device;
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorSet m_descriptorSet;
+	UniformBuffer<LightClusterParams> m_uniformBuffer;
+	uint32_t m_workgroupSize;  // the invocations of the 2D work groups of the device, in one dimension
+
+	// the light buffer stays mapped, it is updated every frame
+	VkBuffer m_lightBuffer;
+	VkDeviceMemory m_lightBufferMemory;
+	void* m_mappedLights;
+	uint32_t m_lightCount;
+
+	// number of lights per cluster
+	VkBuffer m_lightGridBuffer;
+	VkDeviceMemory m_lightGridBufferMemory;
+
+	// cMaxLightsPerCluster light indices per cluster
+	VkBuffer m_lightIndexBuffer;
+	VkDeviceMemory m_lightIndexBufferMemory;
+
+	// the clusters that overflowed, written by the shader and read back every frame
+	VkBuffer m_overflowBuffer;
+	VkDeviceMemory m_overflowBufferMemory;
+	void* m_mappedOverflow;
+	uint32_t m_maxReportedLightCount;  // an overflow is only reported when it is larger than the previous ones
+
+	uint32_t m_width;
+	uint32_t m_height;
+	glm::uvec3 m_clusterCounts;
+};
+
+}
@@ -0,0 +1,281 @@
+#include "LightProbeRelightingPass.h"
+#include "DeferredLightingPass.h"
+#include "MemoryBarrier.h"
+#include "../Image.h"
+#include "../LightProbeGrid.h"
+#include "../RaytracingScene.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+#include "../Builder/RaytracingPipelineBuilder.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// weight of the previous irradiance when a probe is relit
+const float cLightProbeHysteresis = 0.8f;
+
+}
+
+namespace Amano {
+
+LightProbeRelightingPass::LightProbeRelightingPass(Device* device)
+	: Pass(device, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR)
+	, m_grid{ nullptr }
+	, m_topLevelAccelerationStructure{ VK_NULL_HANDLE }
+	, m_descriptorSetLayout{ VK_NULL_HANDLE }
+	, m_pipelineLayout{ VK_NULL_HANDLE }
+	, m_pipeline{ VK_NULL_HANDLE }
+	, m_descriptorSet{ VK_NULL_HANDLE }
+	, m_shaderBindingTables()
+	, m_updateDescriptorSetLayout{ VK_NULL_HANDLE }
+	, m_updatePipelineLayout{ VK_NULL_HANDLE }
+	, m_updatePipeline{ VK_NULL_HANDLE }
+	, m_updateDescriptorSet{ VK_NULL_HANDLE }
+	, m_uniformBuffer(device)
+	, m_lightUniformBuffer(device)
+	, m_rayBuffer{ VK_NULL_HANDLE }
+	, m_rayBufferMemory{ VK_NULL_HANDLE }
+	, m_nextProbe{ 0 }
+	, m_generator(std::random_device{}())
+	, m_commandBuffer{ VK_NULL_HANDLE }
+{
+}
+
+LightProbeRelightingPass::~LightProbeRelightingPass() {
+	if (m_commandBuffer != VK_NULL_HANDLE)
+		m_device->getQueue(QueueType::eGraphics)->freeCommandBuffer(m_commandBuffer);
+
+	VkDescriptorSet descriptorSets[] = { m_descriptorSet, m_updateDescriptorSet };
+	for (VkDescriptorSet descriptorSet : descriptorSets) {
+		if (descriptorSet != VK_NULL_HANDLE)
+			vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &descriptorSet);
+	}
+
+	m_device->destroyBuffer(m_rayBuffer);
+	m_device->freeDeviceMemory(m_rayBufferMemory);
+
+	m_shaderBindingTables.clean(m_device);
+	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_updatePipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_updatePipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_updateDescriptorSetLayout, nullptr);
+}
+
+bool LightProbeRelightingPass::init(RaytracingScene* scene, DeferredLightingPass* lightingPass, Image* albedoImage) {
+	m_grid = lightingPass->lightProbeGrid();
+	m_topLevelAccelerationStructure = scene->topLevelAccelerationStructure();
+
+	if (!createRaytracingPipeline()
+		|| !createUpdatePipeline()
+		|| !createRayBuffer()
+		|| !createDescriptorSets(scene, lightingPass, albedoImage))
+		return false;
+
+	updateUniformBuffer(0);
+	recordCommands();
+
+	return m_commandBuffer != VK_NULL_HANDLE;
+}
+
+void LightProbeRelightingPass::updateUniformBuffer(uint32_t pointLightCount) {
+	uint32_t probeCount = m_grid->getProbeCount();
+
+	LightProbeRelightingParams ubo{};
+	ubo.firstProbe = m_nextProbe;
+	ubo.probeCount = std::min(probeCount, cLightProbesPerFrame);
+	ubo.hysteresis = cLightProbeHysteresis;
+	ubo.pointLightCount = pointLightCount;
+
+	// a new random rotation of the ray directions every frame
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	glm::vec3 axis = glm::vec3(2.0f * unit(m_generator) - 1.0f, 2.0f * unit(m_generator) - 1.0f, 2.0f * unit(m_generator) - 1.0f);
+	if (glm::dot(axis, axis) < 1e-6f)
+		axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	ubo.rayRotation = glm::rotate(glm::mat4(1.0f), 2.0f * glm::pi<float>() * unit(m_generator), glm::normalize(axis));
+
+	m_uniformBuffer.update(ubo);
+
+	if (probeCount > 0)
+		m_nextProbe = (m_nextProbe + ubo.probeCount) % probeCount;
+}
+
+void LightProbeRelightingPass::updateLightUniformBuffer(LightInformation& ubo) {
+	m_lightUniformBuffer.update(ubo);
+}
+
+bool LightProbeRelightingPass::submit() {
+	if (m_commandBuffer == VK_NULL_HANDLE)
+		return false;
+
+	// submit raytracing
+	// 1. wait for the semaphores
+	// 2. signal the pass semaphore
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_waitSemaphores.size());
+	submitInfo.pWaitSemaphores = m_waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = m_waitPipelineStages.data();
+
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_commandBuffer;
+
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_signalSemaphore;
+
+	auto pQueue = m_device->getQueue(QueueType::eGraphics);
+	if (!pQueue->submit(&submitInfo, VK_NULL_HANDLE))
+		return false;
+
+	return true;
+}
+
+bool LightProbeRelightingPass::createRaytracingPipeline() {
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, VK_SHADER_STAGE_RAYGEN_BIT_KHR)  // acceleration structure
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)              // relighting parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)              // grid parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)      // environment image
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)              // light information
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)              // rays
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)         // instance geometries
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)      // albedo image
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)              // point lights
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR);             // irradiance of the environment
+	m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+
+	PipelineLayoutBuilder pipelineLayoutBuilder;
+	pipelineLayoutBuilder.addDescriptorSetLayout(m_descriptorSetLayout);
+	m_pipelineLayout = pipelineLayoutBuilder.build(*m_device);
+
+	// the shadow rays are traced from the ray generation shader, so there is no recursion
+	RaytracingPipelineBuilder raytracingPipelineBuilder(m_device);
+	raytracingPipelineBuilder
+		.addShader("compiled_shaders/light_probe.rgen.spv", VK_SHADER_STAGE_RAYGEN_BIT_KHR)
+		.addShader("compiled_shaders/light_probe.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_KHR)
+		.addShader("compiled_shaders/light_probe.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+	m_pipeline = raytracingPipelineBuilder.build(m_pipelineLayout, 1);
+	if (m_pipeline == VK_NULL_HANDLE)
+		return false;
+
+	ShaderBindingTableBuilder sbtBuilder(m_device, m_pipeline);
+	sbtBuilder
+		.addShader(ShaderBindingTableBuilder::Stage::eRayGen, 0)
+		.addShader(ShaderBindingTableBuilder::Stage::eMiss, 1)
+		.addShader(ShaderBindingTableBuilder::Stage::eClosestHit, 2);
+	m_shaderBindingTables = sbtBuilder.build();
+
+	return true;
+}
+
+bool LightProbeRelightingPass::createUpdatePipeline() {
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // relighting parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // grid parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // rays
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);  // probes
+	m_updateDescriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+
+	PipelineLayoutBuilder pipelineLayoutBuilder;
+	pipelineLayoutBuilder.addDescriptorSetLayout(m_updateDescriptorSetLayout);
+	m_updatePipelineLayout = pipelineLayoutBuilder.build(*m_device);
+
+	ComputePipelineBuilder computePipelineBuilder(m_device);
+	computePipelineBuilder
+		.addShader("compiled_shaders/light_probe_update.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	m_updatePipeline = computePipelineBuilder.build(m_updatePipelineLayout);
+
+	return m_updatePipeline != VK_NULL_HANDLE;
+}
+
+bool LightProbeRelightingPass::createRayBuffer() {
+	// a direction and a radiance per ray
+	return m_device->createBufferAndMemory(
+		2 * sizeof(glm::vec4) * cLightProbesPerFrame * cLightProbeRayCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_rayBuffer,
+		m_rayBufferMemory);
+}
+
+bool LightProbeRelightingPass::createDescriptorSets(RaytracingScene* scene, DeferredLightingPass* lightingPass, Image* albedoImage) {
+	Image* environmentImage = lightingPass->environmentImage();
+
+	DescriptorSetBuilder descriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+	descriptorSetBuilder
+		.addAccelerationStructure(&m_topLevelAccelerationStructure, 0)
+		.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 1)
+		.addUniformBuffer(m_grid->paramsBuffer(), m_grid->paramsSize(), 2)
+		.addImage(environmentImage->sampler(), environmentImage->viewHandle(), 3)
+		.addUniformBuffer(m_lightUniformBuffer.getBuffer(), m_lightUniformBuffer.getSize(), 4)
+		.addStorageBuffer(m_rayBuffer, VK_WHOLE_SIZE, 5)
+		.addStorageBuffer(scene->instanceGeometryBuffer(), VK_WHOLE_SIZE, 6)
+		.addImage(albedoImage->sampler(), albedoImage->viewHandle(), 7)
+		.addStorageBuffer(lightingPass->pointLightBuffer(), VK_WHOLE_SIZE, 8)
+		.addUniformBuffer(lightingPass->irradianceBuffer(), lightingPass->irradianceSize(), 9);
+	m_descriptorSet = descriptorSetBuilder.buildAndUpdate();
+
+	DescriptorSetBuilder updateDescriptorSetBuilder(m_device, 2, m_updateDescriptorSetLayout);
+	updateDescriptorSetBuilder
+		.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 0)
+		.addUniformBuffer(m_grid->paramsBuffer(), m_grid->paramsSize(), 1)
+		.addStorageBuffer(m_rayBuffer, VK_WHOLE_SIZE, 2)
+		.addStorageBuffer(m_grid->probeBuffer(), VK_WHOLE_SIZE, 3);
+	m_updateDescriptorSet = updateDescriptorSetBuilder.buildAndUpdate();
+
+	return m_descriptorSet != VK_NULL_HANDLE && m_updateDescriptorSet != VK_NULL_HANDLE;
+}
+
+void LightProbeRelightingPass::recordCommands() {
+	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
+	m_commandBuffer = pQueue->beginCommands();
+
+	// the previous update must be done with the rays before they are overwritten
+	memoryBarrier(m_commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
+	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+	VkStridedDeviceAddressRegionKHR raygenShaderBindingTable = m_shaderBindingTables.rgenShaderBindingTable.getRegion(m_device);
+	VkStridedDeviceAddressRegionKHR missShaderBindingTable = m_shaderBindingTables.missShaderBindingTable.getRegion(m_device);
+	VkStridedDeviceAddressRegionKHR hitShaderBindingTable = m_shaderBindingTables.chitShaderBindingTable.getRegion(m_device);
+	VkStridedDeviceAddressRegionKHR callableShaderBindingTable = {};
+
+	// one ray per invocation, the probes beyond the probe count of the frame exit early
+	m_device->getExtensions().vkCmdTraceRaysKHR(m_commandBuffer,
+		&raygenShaderBindingTable,
+		&missShaderBindingTable,
+		&hitShaderBindingTable,
+		&callableShaderBindingTable,
+		cLightProbeRayCount, cLightProbesPerFrame, 1);
+
+	// the previous lighting must be done with the probes before they are overwritten
+	memoryBarrier(m_commandBuffer,
+		VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	// one work group per probe
+	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_updatePipeline);
+	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_updatePipelineLayout, 0, 1, &m_updateDescriptorSet, 0, nullptr);
+	vkCmdDispatch(m_commandBuffer, cLightProbesPerFrame, 1, 1);
+
+	memoryBarrier(m_commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+	pQueue->endCommands(m_commandBuffer);
+}
+
+}
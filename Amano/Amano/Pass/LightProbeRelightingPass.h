@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Pass.h"
+#include "../Device.h"
+#include "../Builder/ShaderBindingTableBuilder.h"
+#include "../Ubo.h"
+#include "../UniformBuffer.h"
+
+#include <random>
+
+namespace Amano {
+
+class DeferredLightingPass;
+class Image;
+class LightProbeGrid;
+class RaytracingScene;
+
+// Budget of the relighting: the trace is recorded once with these sizes,
+// so the cost of a frame stays the same whatever the size of the grid
+// cLightProbeRayCount must match LIGHT_PROBE_RAY_COUNT of light_probes.glsl
+const uint32_t cLightProbesPerFrame = 64;
+const uint32_t cLightProbeRayCount = 64;
+
+// This class relights the probes of a LightProbeGrid with raytracing
+// Every frame, the next cLightProbesPerFrame probes of the grid trace cLightProbeRayCount rays each,
+// then a compute shader projects the rays onto the spherical harmonics of the probes
+// The misses read the environment
+// The hits are lit like the GBuffer, with the diffuse part of the main light, the point lights and the environment
+// After submitting, the probe buffer is ready for VK_ACCESS_SHADER_READ_BIT in the compute stage
+class LightProbeRelightingPass : public Pass {
+public:
+	LightProbeRelightingPass(Device* device);
+	~LightProbeRelightingPass();
+
+	// The probes are the grid of the lighting pass, the hits read its environment and its lights
+	// The scene, the lighting pass and the albedo image must outlive this pass
+	// albedoImage is the texture of the meshes, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with a sampler
+	bool init(RaytracingScene* scene, DeferredLightingPass* lightingPass, Image* albedoImage);
+
+	// Selects the probes relit by the next submit, must be called once per frame
+	// pointLightCount is the number of lights given to the lighting pass
+	void updateUniformBuffer(uint32_t pointLightCount);
+	void updateLightUniformBuffer(LightInformation& ubo);
+
+	bool submit();
+
+private:
+	bool createRaytracingPipeline();
+	bool createUpdatePipeline();
+	bool createRayBuffer();
+	bool createDescriptorSets(RaytracingScene* scene, DeferredLightingPass* lightingPass, Image* albedoImage);
+	void recordCommands();
+
+private:
+	LightProbeGrid* m_grid;
+	VkAccelerationStructureKHR m_topLevelAccelerationStructure;
+
+	// trace of the rays
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorSet m_descriptorSet;
+	ShaderBindingTables m_shaderBindingTables;
+
+	// projection of the rays onto the probes
+	VkDescriptorSetLayout m_updateDescriptorSetLayout;
+	VkPipelineLayout m_updatePipelineLayout;
+	VkPipeline m_updatePipeline;
+	VkDescriptorSet m_updateDescriptorSet;
+
+	UniformBuffer<LightProbeRelightingParams> m_uniformBuffer;
+	UniformBuffer<LightInformation> m_lightUniformBuffer;
+
+	// direction and radiance of every ray
+	VkBuffer m_rayBuffer;
+	VkDeviceMemory m_rayBufferMemory;
+
+	uint32_t m_nextProbe;
+	std::mt19937 m_generator;
+
+	VkCommandBuffer m_commandBuffer;
+};
+
+}
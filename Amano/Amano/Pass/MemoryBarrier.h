@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace Amano {
+
+// Global memory barrier, for the buffers and the images that keep their layout
+inline void memoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask) {
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.pNext = nullptr;
+	memoryBarrier.srcAccessMask = srcAccessMask;
+	memoryBarrier.dstAccessMask = dstAccessMask;
+
+	vkCmdPipelineBarrier(cmd, srcStageMask, dstStageMask, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+// Memory barrier between two dispatches
+inline void computeMemoryBarrier(VkCommandBuffer cmd, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask) {
+	memoryBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, srcAccessMask, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstAccessMask);
+}
+
+}
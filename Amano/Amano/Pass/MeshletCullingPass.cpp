@@ -0,0 +1,180 @@
+#include "MeshletCullingPass.h"
+#include "MemoryBarrier.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+
+#include <algorithm>
+
+namespace Amano {
+
+MeshletCullingPass::MeshletCullingPass(Device* device)
+	: m_device{ device }
+	, m_descriptorSetLayout{ VK_NULL_HANDLE }
+	, m_pipelineLayout{ VK_NULL_HANDLE }
+	, m_pipeline{ VK_NULL_HANDLE }
+	, m_descriptorSet{ VK_NULL_HANDLE }
+	, m_uniformBuffer(device)
+	, m_indexBuffer{ VK_NULL_HANDLE }
+	, m_indexBufferMemory{ VK_NULL_HANDLE }
+	, m_drawCommandBuffer{ VK_NULL_HANDLE }
+	, m_drawCommandBufferMemory{ VK_NULL_HANDLE }
+	, m_mesh{ nullptr }
+	, m_meshletCount{ 0 }
+{
+}
+
+MeshletCullingPass::~MeshletCullingPass() {
+	clean();
+
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+}
+
+bool MeshletCullingPass::init() {
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // culling parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // meshlets
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // meshlet vertices
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // meshlet triangles
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)   // draw command
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);  // output indices
+	m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+
+	// create pipeline layout
+	PipelineLayoutBuilder computePipelineLayoutBuilder;
+	computePipelineLayoutBuilder.addDescriptorSetLayout(m_descriptorSetLayout);
+	m_pipelineLayout = computePipelineLayoutBuilder.build(*m_device);
+
+	// load the shaders and create the pipeline
+	ComputePipelineBuilder computePipelineBuilder(m_device);
+	computePipelineBuilder
+		.addShader("compiled_shaders/meshlet_culling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
+
+	return m_pipeline != VK_NULL_HANDLE;
+}
+
+bool MeshletCullingPass::setup(const Mesh* mesh) {
+	clean();
+
+	// the dispatch is recorded once, so it must cover every level of detail
+	for (uint32_t lod = 0; lod < mesh->getLodCount(); ++lod)
+		m_meshletCount = std::max(m_meshletCount, mesh->getLod(lod).meshletCount);
+	if (m_meshletCount == 0)
+		return false;
+
+	m_mesh = mesh;
+
+	return createOutputBuffers(mesh->getIndexCount())
+		&& createDescriptorSet(mesh);
+}
+
+void MeshletCullingPass::recordCommands(VkCommandBuffer cmd) {
+	// the previous draw must be done with the buffers before they are overwritten
+	memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	// reset the draw command, the visible triangles are appended by the shader
+	VkDrawIndexedIndirectCommand drawCommand{};
+	drawCommand.indexCount = 0;
+	drawCommand.instanceCount = 1;
+	drawCommand.firstIndex = 0;
+	drawCommand.vertexOffset = 0;
+	drawCommand.firstInstance = 0;
+	vkCmdUpdateBuffer(cmd, m_drawCommandBuffer, 0, sizeof(drawCommand), &drawCommand);
+
+	memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+	// one work group per meshlet, the extra work groups exit early
+	vkCmdDispatch(cmd, m_meshletCount, 1, 1);
+
+	// the results are consumed by the indirect draw
+	memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT);
+}
+
+void MeshletCullingPass::clean() {
+	destroyDescriptorSet();
+	destroyOutputBuffers();
+	m_mesh = nullptr;
+	m_meshletCount = 0;
+}
+
+void MeshletCullingPass::updateUniformBuffer(MeshletCullingParams& ubo, uint32_t lod) {
+	const MeshLod& meshLod = m_mesh->getLod(lod);
+	ubo.meshletOffset = meshLod.firstMeshlet;
+	ubo.meshletCount = meshLod.meshletCount;
+	m_uniformBuffer.update(ubo);
+}
+
+bool MeshletCullingPass::createOutputBuffers(uint32_t indexCount) {
+	// in the worst case, all the triangles of the full resolution mesh are visible
+	if (!m_device->createBufferAndMemory(
+		sizeof(uint32_t) * indexCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_indexBuffer,
+		m_indexBufferMemory))
+		return false;
+
+	if (!m_device->createBufferAndMemory(
+		sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_drawCommandBuffer,
+		m_drawCommandBufferMemory))
+		return false;
+
+	return true;
+}
+
+void MeshletCullingPass::destroyOutputBuffers() {
+	m_device->destroyBuffer(m_indexBuffer);
+	m_device->freeDeviceMemory(m_indexBufferMemory);
+	m_device->destroyBuffer(m_drawCommandBuffer);
+	m_device->freeDeviceMemory(m_drawCommandBufferMemory);
+	m_indexBuffer = VK_NULL_HANDLE;
+	m_indexBufferMemory = VK_NULL_HANDLE;
+	m_drawCommandBuffer = VK_NULL_HANDLE;
+	m_drawCommandBufferMemory = VK_NULL_HANDLE;
+}
+
+bool MeshletCullingPass::createDescriptorSet(const Mesh* mesh) {
+	DescriptorSetBuilder descriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+	descriptorSetBuilder
+		.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 0)
+		.addStorageBuffer(mesh->getMeshletBuffer(), VK_WHOLE_SIZE, 1)
+		.addStorageBuffer(mesh->getMeshletVertexBuffer(), VK_WHOLE_SIZE, 2)
+		.addStorageBuffer(mesh->getMeshletTriangleBuffer(), VK_WHOLE_SIZE, 3)
+		.addStorageBuffer(m_drawCommandBuffer, VK_WHOLE_SIZE, 4)
+		.addStorageBuffer(m_indexBuffer, VK_WHOLE_SIZE, 5);
+	m_descriptorSet = descriptorSetBuilder.buildAndUpdate();
+
+	return m_descriptorSet != VK_NULL_HANDLE;
+}
+
+void MeshletCullingPass::destroyDescriptorSet() {
+	if (m_descriptorSet != VK_NULL_HANDLE) {
+		vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_descriptorSet);
+		m_descriptorSet = VK_NULL_HANDLE;
+	}
+}
+
+}
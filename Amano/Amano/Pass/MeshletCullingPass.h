@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../Device.h"
+#include "../Mesh.h"
+#include "../Ubo.h"
+#include "../UniformBuffer.h"
+
+namespace Amano {
+
+// This class culls the meshlets of a mesh on the GPU (frustum and normal cone)
+// It generates an index buffer with the visible triangles and the indirect draw command to render them
+// The commands are recorded in the command buffer of the pass consuming the results, before its render pass
+// After the recorded commands, the buffers are ready for VK_ACCESS_INDIRECT_COMMAND_READ_BIT and VK_ACCESS_INDEX_READ_BIT
+class MeshletCullingPass {
+public:
+	MeshletCullingPass(Device* device);
+	~MeshletCullingPass();
+
+	VkBuffer indexBuffer() const { return m_indexBuffer; }
+	VkBuffer drawCommandBuffer() const { return m_drawCommandBuffer; }
+
+	bool init();
+
+	// Creates the output buffers and the descriptor set for the given mesh
+	bool setup(const Mesh* mesh);
+	void recordCommands(VkCommandBuffer cmd);
+	void clean();
+
+	// Culls the meshlets of the given level of detail
+	void updateUniformBuffer(MeshletCullingParams& ubo, uint32_t lod);
+
+private:
+	bool createOutputBuffers(uint32_t indexCount);
+	void destroyOutputBuffers();
+	bool createDescriptorSet(const Mesh* mesh);
+	void destroyDescriptorSet();
+
+private:
+	Device* m_device;
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorSet m_descriptorSet;
+	UniformBuffer<MeshletCullingParams> m_uniformBuffer;
+	VkBuffer m_indexBuffer;
+	VkDeviceMemory m_indexBufferMemory;
+	VkBuffer m_drawCommandBuffer;
+	VkDeviceMemory m_drawCommandBufferMemory;
+	const Mesh* m_mesh;
+	uint32_t m_meshletCount;  // the largest meshlet count of the levels of detail
+};
+
+}
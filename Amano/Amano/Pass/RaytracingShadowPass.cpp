@@ -1,4 +1,6 @@
 #include "RaytracingShadowPass.h"
+#include "MemoryBarrier.h"
+#include "../Builder/ComputePipelineBuilder.h"
 #include "../Builder/DescriptorSetBuilder.h"
 #include "../Builder/DescriptorSetLayoutBuilder.h"
 #include "../Builder/PipelineLayoutBuilder.h"
@@ -10,24 +12,19 @@
 
 namespace {
 
-// TODO: wrap device memory into a small class to perform those calls
-VkDeviceAddress GetDeviceAddress(Amano::Device* device, VkBuffer buffer) {
-	VkBufferDeviceAddressInfo info = {};
-	info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-	info.pNext = nullptr;
-	info.buffer = buffer;
+// Push constants of the raygen and tile shaders, see ShadowTraceSettings
+struct ShadowTraceInformation {
+	uint32_t resolutionScale;
+	uint32_t isCheckerboarded;
+	uint32_t renderWidth;   // rendered area of the GBuffer, its images can be larger
+	uint32_t renderHeight;
+};
 
-	return vkGetBufferDeviceAddress(device->handle(), &info);
-}
-
-// TODO: factorize, used in ShaderBindingTableBuilder
-uint32_t computeGroupSize(uint32_t inlineSize, uint32_t handleSize, uint32_t alignment)
-{
-	uint32_t size = handleSize + inlineSize;
-	// roundup
-	return (size + (alignment - 1)) & ~(alignment - 1);
-
-}
+// Header of the tile buffer, the tiles are appended after it by shadow_tiles.comp
+struct TileBufferHeader {
+	VkTraceRaysIndirectCommandKHR traceCommand;  // one ray per texel of a tile along x, one tile per row along y
+	uint32_t padding;
+};
 
 }
 
@@ -39,12 +36,22 @@ RaytracingShadowPass::RaytracingShadowPass(Device* device)
 	, m_pipelineLayout{ VK_NULL_HANDLE }
 	, m_pipeline{ VK_NULL_HANDLE }
 	, m_descriptorSet{ VK_NULL_HANDLE }
-	, m_accelerationStructures()
+	, m_topLevelAccelerationStructure{ VK_NULL_HANDLE }
 	, m_shaderBindingTables()
+	, m_isAdaptive{ false }
+	, m_tileDescriptorSetLayout{ VK_NULL_HANDLE }
+	, m_tilePipelineLayout{ VK_NULL_HANDLE }
+	, m_tilePipeline{ VK_NULL_HANDLE }
+	, m_tileDescriptorSet{ VK_NULL_HANDLE }
+	, m_refinementPipeline{ VK_NULL_HANDLE }
+	, m_refinementShaderBindingTables()
+	, m_tileBuffer{ VK_NULL_HANDLE }
+	, m_tileBufferMemory{ VK_NULL_HANDLE }
 	, m_nearestSampler{ VK_NULL_HANDLE }
 	, m_rayUniformBuffer(device)
 	, m_lightUniformBuffer(device)
 	, m_outputImage{ nullptr }
+	, m_traceSettings()
 	, m_commandBuffer{ VK_NULL_HANDLE }
 {
 }
@@ -52,7 +59,11 @@ RaytracingShadowPass::RaytracingShadowPass(Device* device)
 RaytracingShadowPass::~RaytracingShadowPass() {
 	cleanOnRenderTargetResized();
 
-	m_accelerationStructures.clean(m_device);
+	m_refinementShaderBindingTables.clean(m_device);
+	vkDestroyPipeline(m_device->handle(), m_refinementPipeline, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_tilePipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_tilePipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_tileDescriptorSetLayout, nullptr);
 	m_shaderBindingTables.clean(m_device);
 	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
 	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
@@ -60,7 +71,10 @@ RaytracingShadowPass::~RaytracingShadowPass() {
 	vkDestroySampler(m_device->handle(), m_nearestSampler, nullptr);
 }
 
-bool RaytracingShadowPass::init(std::vector<Mesh*>& meshes) {
+bool RaytracingShadowPass::init(RaytracingScene* scene) {
+	m_topLevelAccelerationStructure = scene->topLevelAccelerationStructure();
+	m_isAdaptive = m_device->getCapabilities().traceRaysIndirect;
+
 	// create layout for the raytracing pipeline
 	DescriptorSetLayoutBuilder raytracingDescriptorSetLayoutbuilder;
 	raytracingDescriptorSetLayoutbuilder
@@ -69,13 +83,21 @@ bool RaytracingShadowPass::init(std::vector<Mesh*>& meshes) {
 		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)              // ray parameters
 		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)      // depth image
 		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)      // normal image
-		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_RAYGEN_BIT_KHR)      // albedo image
 		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR);             // light information
+	if (m_isAdaptive)
+		raytracingDescriptorSetLayoutbuilder.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_RAYGEN_BIT_KHR);  // tiles
 	m_descriptorSetLayout = raytracingDescriptorSetLayoutbuilder.build(*m_device);
 
 	// create raytracing pipeline layout
+	VkPushConstantRange range;
+	range.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+	range.offset = 0;
+	range.size = sizeof(ShadowTraceInformation);
+
 	PipelineLayoutBuilder raytracingPipelineLayoutBuilder;
-	raytracingPipelineLayoutBuilder.addDescriptorSetLayout(m_descriptorSetLayout);
+	raytracingPipelineLayoutBuilder
+		.addDescriptorSetLayout(m_descriptorSetLayout)
+		.addPushConstantRange(range);
 	m_pipelineLayout = raytracingPipelineLayoutBuilder.build(*m_device);
 
 	// load the shaders and create the pipeline
@@ -94,13 +116,6 @@ bool RaytracingShadowPass::init(std::vector<Mesh*>& meshes) {
 		.addShader(ShaderBindingTableBuilder::Stage::eClosestHit, 2);
 	m_shaderBindingTables = sbtBuilder.build();
 
-	// build the acceleration structure for 1 model
-	// we should extend it to more models
-	RaytracingAccelerationStructureBuilder accelerationStructureBuilder(m_device, m_pipeline);
-	for (auto mesh : meshes)
-		accelerationStructureBuilder.addGeometry(*mesh);
-	m_accelerationStructures = accelerationStructureBuilder.build();
-
 	// create a sampler for the depth texture
 	SamplerBuilder samplerBuilder;
 	samplerBuilder
@@ -108,10 +123,50 @@ bool RaytracingShadowPass::init(std::vector<Mesh*>& meshes) {
 		.setFilter(VK_FILTER_NEAREST, VK_FILTER_NEAREST);
 	m_nearestSampler = samplerBuilder.build(*m_device);
 
-	return true;
+	if (!m_isAdaptive)
+		return true;
+
+	// the refinement uses the same bindings and shaders, only the raygen differs
+	RaytracingPipelineBuilder refinementPipelineBuilder(m_device);
+	refinementPipelineBuilder
+		.addShader("compiled_shaders/shadow_refine.rgen.spv", VK_SHADER_STAGE_RAYGEN_BIT_KHR)
+		.addShader("compiled_shaders/shadow.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_KHR)
+		.addShader("compiled_shaders/shadow.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+	m_refinementPipeline = refinementPipelineBuilder.build(m_pipelineLayout, 1);
+
+	ShaderBindingTableBuilder refinementSbtBuilder(m_device, m_refinementPipeline);
+	refinementSbtBuilder
+		.addShader(ShaderBindingTableBuilder::Stage::eRayGen, 0)
+		.addShader(ShaderBindingTableBuilder::Stage::eMiss, 1)
+		.addShader(ShaderBindingTableBuilder::Stage::eClosestHit, 2);
+	m_refinementShaderBindingTables = refinementSbtBuilder.build();
+
+	// create the tile classification pipeline
+	DescriptorSetLayoutBuilder tileDescriptorSetLayoutbuilder;
+	tileDescriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)   // visibility
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT); // tiles
+	m_tileDescriptorSetLayout = tileDescriptorSetLayoutbuilder.build(*m_device);
+
+	// the classification needs the size of the visibility, it shares the push constants of the trace
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	PipelineLayoutBuilder tilePipelineLayoutBuilder;
+	tilePipelineLayoutBuilder
+		.addDescriptorSetLayout(m_tileDescriptorSetLayout)
+		.addPushConstantRange(range);
+	m_tilePipelineLayout = tilePipelineLayoutBuilder.build(*m_device);
+
+	// the work groups are the tiles, their size is fixed in the shader
+	ComputePipelineBuilder tilePipelineBuilder(m_device);
+	tilePipelineBuilder
+		.addShader("compiled_shaders/shadow_tiles.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	m_tilePipeline = tilePipelineBuilder.build(m_tilePipelineLayout);
+
+	return m_refinementPipeline != VK_NULL_HANDLE && m_tilePipeline != VK_NULL_HANDLE;
 }
 
-void RaytracingShadowPass::recordCommands(uint32_t width, uint32_t height, Image* colorImage) {
+void RaytracingShadowPass::recordCommands(uint32_t width, uint32_t height) {
 	destroyCommandBuffer();
 
 	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
@@ -126,34 +181,87 @@ void RaytracingShadowPass::recordCommands(uint32_t width, uint32_t height, Image
 		.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
 		.execute(m_commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
+	if (m_isAdaptive) {
+		// the refinement of the previous frame must be done with the tile buffer before it is reset
+		memoryBarrier(m_commandBuffer,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT);
+
+		// reset the trace command, the tiles are appended by the classification
+		TileBufferHeader header{};
+		header.traceCommand.width = cShadowTileSize * cShadowTileSize;
+		header.traceCommand.height = 0;
+		header.traceCommand.depth = 1;
+		vkCmdUpdateBuffer(m_commandBuffer, m_tileBuffer, 0, sizeof(header), &header);
+
+		memoryBarrier(m_commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	}
+
 	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipeline);
 	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
-	// Describe the shader binding table.
-	VkPhysicalDeviceRayTracingPipelinePropertiesKHR pipelineProperties = m_device->getPhysicalRaytracingPipelineProperties();
-	VkStridedDeviceAddressRegionKHR raygenShaderBindingTable = {};
-	raygenShaderBindingTable.deviceAddress = GetDeviceAddress(m_device, m_shaderBindingTables.rgenShaderBindingTable.buffer);
-	raygenShaderBindingTable.stride = computeGroupSize(0, pipelineProperties.shaderGroupHandleSize, pipelineProperties.shaderGroupBaseAlignment);
-	raygenShaderBindingTable.size = raygenShaderBindingTable.stride; //  only 1 shader
-
-	VkStridedDeviceAddressRegionKHR missShaderBindingTable = {};
-	missShaderBindingTable.deviceAddress = GetDeviceAddress(m_device, m_shaderBindingTables.missShaderBindingTable.buffer);
-	missShaderBindingTable.stride = computeGroupSize(0, pipelineProperties.shaderGroupHandleSize, pipelineProperties.shaderGroupBaseAlignment);
-	missShaderBindingTable.size = missShaderBindingTable.stride; //  only 1 shader
-
-	VkStridedDeviceAddressRegionKHR hitShaderBindingTable = {};
-	hitShaderBindingTable.deviceAddress = GetDeviceAddress(m_device, m_shaderBindingTables.chitShaderBindingTable.buffer);
-	hitShaderBindingTable.stride = computeGroupSize(0, pipelineProperties.shaderGroupHandleSize, pipelineProperties.shaderGroupBaseAlignment);
-	hitShaderBindingTable.size = hitShaderBindingTable.stride; //  only 1 shader
+	ShadowTraceInformation traceInformation{};
+	traceInformation.resolutionScale = m_traceSettings.resolutionScale;
+	traceInformation.isCheckerboarded = m_traceSettings.isCheckerboarded ? 1 : 0;
+	traceInformation.renderWidth = width;
+	traceInformation.renderHeight = height;
+	vkCmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(ShadowTraceInformation), &traceInformation);
 
+	// Describe the shader binding table.
+	VkStridedDeviceAddressRegionKHR raygenShaderBindingTable = m_shaderBindingTables.rgenShaderBindingTable.getRegion(m_device);
+	VkStridedDeviceAddressRegionKHR missShaderBindingTable = m_shaderBindingTables.missShaderBindingTable.getRegion(m_device);
+	VkStridedDeviceAddressRegionKHR hitShaderBindingTable = m_shaderBindingTables.chitShaderBindingTable.getRegion(m_device);
 	VkStridedDeviceAddressRegionKHR callableShaderBindingTable = {};
 
+	// one ray per traced texel of the visibility
 	m_device->getExtensions().vkCmdTraceRaysKHR(m_commandBuffer,
 		&raygenShaderBindingTable,
 		&missShaderBindingTable,
 		&hitShaderBindingTable,
 		&callableShaderBindingTable,
-		width, height, 1);
+		m_traceSettings.getTraceWidth(width), m_traceSettings.getVisibilityHeight(height), 1);
+
+	if (m_isAdaptive) {
+		memoryBarrier(m_commandBuffer,
+			VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_READ_BIT);
+
+		// one work group per tile
+		vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_tilePipeline);
+		vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_tilePipelineLayout, 0, 1, &m_tileDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(m_commandBuffer, m_tilePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ShadowTraceInformation), &traceInformation);
+		vkCmdDispatch(m_commandBuffer, m_traceSettings.getTileCountX(width), m_traceSettings.getTileCountY(height), 1);
+
+		// the tile list is consumed by the indirect trace
+		memoryBarrier(m_commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+		vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_refinementPipeline);
+		vkCmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(ShadowTraceInformation), &traceInformation);
+
+		VkStridedDeviceAddressRegionKHR refinementRaygenShaderBindingTable = m_refinementShaderBindingTables.rgenShaderBindingTable.getRegion(m_device);
+		VkStridedDeviceAddressRegionKHR refinementMissShaderBindingTable = m_refinementShaderBindingTables.missShaderBindingTable.getRegion(m_device);
+		VkStridedDeviceAddressRegionKHR refinementHitShaderBindingTable = m_refinementShaderBindingTables.chitShaderBindingTable.getRegion(m_device);
+
+		// extra rays for the texels of the listed tiles only
+		m_device->getExtensions().vkCmdTraceRaysIndirectKHR(m_commandBuffer,
+			&refinementRaygenShaderBindingTable,
+			&refinementMissShaderBindingTable,
+			&refinementHitShaderBindingTable,
+			&callableShaderBindingTable,
+			m_device->getBufferAddress(m_tileBuffer));
+	}
 
 	// transition the raytracing output buffer from storage to src copy
 	transition
@@ -167,13 +275,20 @@ void RaytracingShadowPass::recordCommands(uint32_t width, uint32_t height, Image
 void RaytracingShadowPass::cleanOnRenderTargetResized() {
 	destroyDescriptorSet();
 	destroyCommandBuffer();
+	destroyTileBuffer();
 	destroyOutputImage();
 }
 
-void RaytracingShadowPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* depthImage, Image* normalImage, Image* colorImage) {
+void RaytracingShadowPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* depthImage, Image* normalImage) {
 	createOutputImage(width, height);
-	createDescriptorSet(depthImage, normalImage, colorImage);
-	recordCommands(width, height, colorImage);
+	// without the tile list, every texel is traced, the binding of the tiles is left unused
+	if (m_isAdaptive && !createTileBuffer(width, height)) {
+		std::cerr << "failed to create the shadow tile buffer, the adaptive tracing is disabled" << std::endl;
+		destroyTileBuffer();
+		m_isAdaptive = false;
+	}
+	createDescriptorSet(depthImage, normalImage);
+	recordCommands(width, height);
 }
 
 void RaytracingShadowPass::updateRayUniformBuffer(RayParams& ubo) {
@@ -214,10 +329,10 @@ bool RaytracingShadowPass::submit() {
 void RaytracingShadowPass::createOutputImage(uint32_t width, uint32_t height) {
 	m_outputImage = new Image(m_device);
 	m_outputImage->create2D(
-		width,
-		height,
+		m_traceSettings.getVisibilityWidth(width),
+		m_traceSettings.getVisibilityHeight(height),
 		1,
-		VK_FORMAT_R32G32B32A32_SFLOAT,
+		VK_FORMAT_R32_SFLOAT,
 		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 	m_outputImage->transitionLayout(*m_device->getQueue(QueueType::eGraphics), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
@@ -227,20 +342,49 @@ void RaytracingShadowPass::destroyOutputImage() {
 	m_outputImage = nullptr;
 }
 
-bool RaytracingShadowPass::createDescriptorSet(Image* depthImage, Image* normalImage, Image* colorImage) {
+bool RaytracingShadowPass::createTileBuffer(uint32_t width, uint32_t height) {
+	// in the worst case, all the tiles are listed
+	VkDeviceSize tileCount = m_traceSettings.getTileCountX(width) * m_traceSettings.getTileCountY(height);
+	return m_device->createBufferAndMemory(
+		sizeof(TileBufferHeader) + sizeof(uint32_t) * tileCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_tileBuffer,
+		m_tileBufferMemory);
+}
+
+void RaytracingShadowPass::destroyTileBuffer() {
+	m_device->destroyBuffer(m_tileBuffer);
+	m_device->freeDeviceMemory(m_tileBufferMemory);
+	m_tileBuffer = VK_NULL_HANDLE;
+	m_tileBufferMemory = VK_NULL_HANDLE;
+}
+
+bool RaytracingShadowPass::createDescriptorSet(Image* depthImage, Image* normalImage) {
 	// update the descriptor set for raytracing
 	DescriptorSetBuilder raytracingDescriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
 	raytracingDescriptorSetBuilder
-		.addAccelerationStructure(&m_accelerationStructures.top.handle, 0)
+		.addAccelerationStructure(&m_topLevelAccelerationStructure, 0)
 		.addStorageImage(m_outputImage->viewHandle(), 1)
 		.addUniformBuffer(m_rayUniformBuffer.getBuffer(), m_rayUniformBuffer.getSize(), 2)
 		.addImage(m_nearestSampler, depthImage->viewHandle(), 3)
 		.addImage(m_nearestSampler, normalImage->viewHandle(), 4)
-		.addImage(m_nearestSampler, colorImage->viewHandle(), 5)
-		.addUniformBuffer(m_lightUniformBuffer.getBuffer(), m_lightUniformBuffer.getSize(), 6);
+		.addUniformBuffer(m_lightUniformBuffer.getBuffer(), m_lightUniformBuffer.getSize(), 5);
+	if (m_isAdaptive)
+		raytracingDescriptorSetBuilder.addStorageBuffer(m_tileBuffer, VK_WHOLE_SIZE, 6);
 	m_descriptorSet = raytracingDescriptorSetBuilder.buildAndUpdate();
 
-	return m_descriptorSet != VK_NULL_HANDLE;
+	if (!m_isAdaptive)
+		return m_descriptorSet != VK_NULL_HANDLE;
+
+	DescriptorSetBuilder tileDescriptorSetBuilder(m_device, 2, m_tileDescriptorSetLayout);
+	tileDescriptorSetBuilder
+		.addStorageImage(m_outputImage->viewHandle(), 0)
+		.addStorageBuffer(m_tileBuffer, VK_WHOLE_SIZE, 1);
+	m_tileDescriptorSet = tileDescriptorSetBuilder.buildAndUpdate();
+
+	return m_descriptorSet != VK_NULL_HANDLE && m_tileDescriptorSet != VK_NULL_HANDLE;
 }
 
 void RaytracingShadowPass::destroyDescriptorSet() {
@@ -248,6 +392,10 @@ void RaytracingShadowPass::destroyDescriptorSet() {
 		vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_descriptorSet);
 		m_descriptorSet = VK_NULL_HANDLE;
 	}
+	if (m_tileDescriptorSet != VK_NULL_HANDLE) {
+		vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_tileDescriptorSet);
+		m_tileDescriptorSet = VK_NULL_HANDLE;
+	}
 }
 
 void RaytracingShadowPass::destroyCommandBuffer() {
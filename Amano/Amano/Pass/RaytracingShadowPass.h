@@ -1,21 +1,27 @@
 #pragma once
 
 #include "Pass.h"
+#include "ShadowTraceSettings.h"
 #include "../Device.h"
-#include "../Builder/RaytracingAccelerationStructureBuilder.h"
 #include "../Builder/ShaderBindingTableBuilder.h"
 #include "../Image.h"
+#include "../RaytracingScene.h"
 #include "../Ubo.h"
 #include "../UniformBuffer.h"
 
 namespace Amano {
 
 // This class raytraces the scene to generate some shadows
+// One ray per texel goes toward a random point of the spherical light, the output is the noisy visibility of the light
+// The visibility can be traced at a lower resolution than the GBuffer, see ShadowTraceSettings
+// When the device supports vkCmdTraceRaysIndirectKHR, the sampling is adaptive
+//   - a compute shader lists the tiles of the visibility which contain both lit and shadowed texels
+//   - an indirect trace over the listed tiles adds a few rays to their texels, the other tiles keep one ray
+// ShadowDenoisingPass converges it and applies it to the lit color
 // TEMPORARY: to work correctly, the pass expect the following states for the images
 //   - outputImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
 //   - depthImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
 //   - normalImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
-//   - colorImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
 // After submitting, the images states are he same
 class RaytracingShadowPass : public Pass {
 public:
@@ -23,13 +29,17 @@ public:
 	~RaytracingShadowPass();
 
 	Image* outputImage() const { return m_outputImage; }
+	// The scene must be kept up to date before the pass is submitted
+	bool init(RaytracingScene* scene);
 
-	bool init(std::vector<Mesh*>& meshes);
+	// width and height are the rendered area of the GBuffer, they can be smaller than the size given to recreateOnRenderTargetResized
+	void recordCommands(uint32_t width, uint32_t height);
 
-	void recordCommands(uint32_t width, uint32_t height, Image* colorImage);
+	// The settings are applied when the pass is recreated, the output image is smaller when the resolution is scaled down
+	void setTraceSettings(const ShadowTraceSettings& settings) { m_traceSettings = settings; }
 
 	void cleanOnRenderTargetResized();
-	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* depthImage, Image* normalImage, Image* colorImage);
+	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* depthImage, Image* normalImage);
 	
 	void updateRayUniformBuffer(RayParams& ubo);
 	void updateLightUniformBuffer(LightInformation& ubo);
@@ -39,7 +49,9 @@ public:
 private:
 	void createOutputImage(uint32_t width, uint32_t height);
 	void destroyOutputImage();
-	bool createDescriptorSet(Image* depthImage, Image* normalImage, Image* colorImage);
+	bool createTileBuffer(uint32_t width, uint32_t height);
+	void destroyTileBuffer();
+	bool createDescriptorSet(Image* depthImage, Image* normalImage);
 	void destroyDescriptorSet();
 	void destroyCommandBuffer();
 
@@ -48,12 +60,24 @@ private:
 	VkPipelineLayout m_pipelineLayout;
 	VkPipeline m_pipeline;
 	VkDescriptorSet m_descriptorSet;
-	AccelerationStructures m_accelerationStructures;
+	VkAccelerationStructureKHR m_topLevelAccelerationStructure;
 	ShaderBindingTables m_shaderBindingTables;
+	// adaptive sampling, only created when m_isAdaptive
+	bool m_isAdaptive;
+	VkDescriptorSetLayout m_tileDescriptorSetLayout;
+	VkPipelineLayout m_tilePipelineLayout;
+	VkPipeline m_tilePipeline;
+	VkDescriptorSet m_tileDescriptorSet;
+	VkPipeline m_refinementPipeline;
+	ShaderBindingTables m_refinementShaderBindingTables;
+	// indirect trace command followed by the list of tiles
+	VkBuffer m_tileBuffer;
+	VkDeviceMemory m_tileBufferMemory;
 	VkSampler m_nearestSampler;
 	UniformBuffer<RayParams> m_rayUniformBuffer;
 	UniformBuffer<LightInformation> m_lightUniformBuffer;
 	Image* m_outputImage;
+	ShadowTraceSettings m_traceSettings;
 
 	VkCommandBuffer m_commandBuffer;
 };
@@ -0,0 +1,112 @@
+#include "SHProjectionPass.h"
+#include "../Image.h"
+#include "../Ubo.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+
+#include <algorithm>
+
+namespace {
+
+// push constants of sh_projection.comp
+struct ProjectionInformation {
+	uint32_t faceSize;
+	float inputLod;
+};
+
+}
+
+namespace Amano {
+
+SHProjectionPass::SHProjectionPass(Device* device)
+	: m_device{ device }
+	, m_descriptorSetLayout{ VK_NULL_HANDLE }
+	, m_pipelineLayout{ VK_NULL_HANDLE }
+	, m_pipeline{ VK_NULL_HANDLE }
+	, m_descriptorSet{ VK_NULL_HANDLE }
+{
+}
+
+SHProjectionPass::~SHProjectionPass() {
+	clean();
+
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+}
+
+bool SHProjectionPass::init() {
+	DescriptorSetLayoutBuilder descriptorSetLayoutbuilder;
+	descriptorSetLayoutbuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // input sampler
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);         // coefficients
+	m_descriptorSetLayout = descriptorSetLayoutbuilder.build(*m_device);
+
+	// create pipeline layout
+	VkPushConstantRange range;
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	range.offset = 0;
+	range.size = sizeof(ProjectionInformation);
+
+	PipelineLayoutBuilder computePipelineLayoutBuilder;
+	computePipelineLayoutBuilder
+		.addDescriptorSetLayout(m_descriptorSetLayout)
+		.addPushConstantRange(range);
+	m_pipelineLayout = computePipelineLayoutBuilder.build(*m_device);
+
+	// load the shaders and create the pipeline
+	ComputePipelineBuilder computePipelineBuilder(m_device);
+	computePipelineBuilder
+		.addShader("compiled_shaders/sh_projection.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+	m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
+
+	return m_pipeline != VK_NULL_HANDLE;
+}
+
+void SHProjectionPass::setupAndRecord(VkCommandBuffer cmd, Image* inputImage, VkBuffer outputBuffer) {
+	destroyDescriptorSet();
+	if (!createDescriptorSet(inputImage, outputBuffer))
+		return;
+
+	// pick the mip to read, the texels of the larger mips would only add to the reduction
+	ProjectionInformation projectionInformation{};
+	projectionInformation.faceSize = inputImage->getWidth();
+	uint32_t lod = 0;
+	while (projectionInformation.faceSize > cSHProjectionFaceSize && lod + 1 < inputImage->getMipLevels()) {
+		projectionInformation.faceSize = std::max(projectionInformation.faceSize / 2, 1u);
+		++lod;
+	}
+	projectionInformation.inputLod = static_cast<float>(lod);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+	vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ProjectionInformation), &projectionInformation);
+
+	// the whole projection is done by one work group
+	vkCmdDispatch(cmd, 1, 1, 1);
+}
+
+void SHProjectionPass::clean() {
+	destroyDescriptorSet();
+}
+
+bool SHProjectionPass::createDescriptorSet(Image* inputImage, VkBuffer outputBuffer) {
+	DescriptorSetBuilder descriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+	descriptorSetBuilder
+		.addImage(inputImage->sampler(), inputImage->viewHandle(), 0)
+		.addStorageBuffer(outputBuffer, sizeof(IrradianceSH), 1);
+	m_descriptorSet = descriptorSetBuilder.buildAndUpdate();
+
+	return m_descriptorSet != VK_NULL_HANDLE;
+}
+
+void SHProjectionPass::destroyDescriptorSet() {
+	if (m_descriptorSet != VK_NULL_HANDLE) {
+		vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_descriptorSet);
+		m_descriptorSet = VK_NULL_HANDLE;
+	}
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../Device.h"
+
+namespace Amano {
+
+class Image;
+
+// The input is read at its first mip whose faces are not larger than this size
+// The irradiance is low frequency, a 64x64 face is enough and keeps the reduction short
+const uint32_t cSHProjectionFaceSize = 64;
+
+// This class projects a cubemap onto the L2 spherical harmonics with a compute shader
+// The 9 RGB coefficients are convolved with the clamped cosine: they give the diffuse irradiance, see IrradianceSH
+// A single work group reads the input and reduces the sums in shared memory
+// TEMPORARY: to work correctly, it expects the following states:
+//   - inputImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with a sampler
+//   - outputBuffer: sizeof(IrradianceSH) bytes with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+// After the recorded commands, the buffer is written by the compute stage, the caller adds the barrier for its use
+class SHProjectionPass {
+public:
+	SHProjectionPass(Device* device);
+	~SHProjectionPass();
+
+	bool init();
+
+	void setupAndRecord(VkCommandBuffer cmd, Image* inputImage, VkBuffer outputBuffer);
+	void clean();
+
+private:
+	bool createDescriptorSet(Image* inputImage, VkBuffer outputBuffer);
+	void destroyDescriptorSet();
+
+private:
+	Device* m_device;
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	VkDescriptorSet m_descriptorSet;
+};
+
+}
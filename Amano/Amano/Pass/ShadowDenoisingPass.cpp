@@ -0,0 +1,330 @@
+#include "ShadowDenoisingPass.h"
+#include "ComputeDispatch.h"
+#include "MemoryBarrier.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+#include "../Builder/SamplerBuilder.h"
+#include "../Builder/TransitionImageBarrierBuilder.h"
+
+#include <iostream>
+
+namespace {
+
+// Push constants of the a-trous filter
+struct FilterInformation {
+	int32_t stepSize;
+	uint32_t isLastIteration;
+	uint32_t renderWidth;
+	uint32_t renderHeight;
+};
+
+}
+
+namespace Amano {
+
+ShadowDenoisingPass::ShadowDenoisingPass(Device* device)
+	: Pass(device, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+	, m_temporalDescriptorSetLayout{ VK_NULL_HANDLE }
+	, m_temporalPipelineLayout{ VK_NULL_HANDLE }
+	, m_temporalPipeline{ VK_NULL_HANDLE }
+	, m_filterDescriptorSetLayout{ VK_NULL_HANDLE }
+	, m_filterPipelineLayout{ VK_NULL_HANDLE }
+	, m_filterPipeline{ VK_NULL_HANDLE }
+	, m_temporalDescriptorSets{ VK_NULL_HANDLE, VK_NULL_HANDLE }
+	, m_filterDescriptorSets{}
+	, m_nearestSampler{ VK_NULL_HANDLE }
+	, m_uniformBuffer(device)
+	, m_previousViewProj(1.0f)
+	, m_isHistoryValid{ false }
+	, m_renderSize(0)
+	, m_previousRenderSize(0)
+	, m_traceSettings()
+	, m_historyImages{ nullptr, nullptr }
+	, m_filterImages{ nullptr, nullptr }
+	, m_outputImage{ nullptr }
+	, m_commandBuffers{ VK_NULL_HANDLE, VK_NULL_HANDLE }
+	, m_frameIndex{ 0 }
+{
+}
+
+ShadowDenoisingPass::~ShadowDenoisingPass() {
+	cleanOnRenderTargetResized();
+
+	vkDestroyPipeline(m_device->handle(), m_filterPipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_filterPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_filterDescriptorSetLayout, nullptr);
+	vkDestroyPipeline(m_device->handle(), m_temporalPipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_temporalPipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_temporalDescriptorSetLayout, nullptr);
+	vkDestroySampler(m_device->handle(), m_nearestSampler, nullptr);
+}
+
+bool ShadowDenoisingPass::init() {
+	// temporal accumulation
+	DescriptorSetLayoutBuilder temporalDescriptorSetLayoutBuilder;
+	temporalDescriptorSetLayoutBuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // visibility image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // depth image
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // previous history
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // history
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)          // denoising parameters
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT); // normal image
+	m_temporalDescriptorSetLayout = temporalDescriptorSetLayoutBuilder.build(*m_device);
+
+	PipelineLayoutBuilder temporalPipelineLayoutBuilder;
+	temporalPipelineLayoutBuilder.addDescriptorSetLayout(m_temporalDescriptorSetLayout);
+	m_temporalPipelineLayout = temporalPipelineLayoutBuilder.build(*m_device);
+
+	ComputePipelineBuilder temporalPipelineBuilder(m_device);
+	temporalPipelineBuilder
+		.addShader("compiled_shaders/shadow_temporal.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
+	m_temporalPipeline = temporalPipelineBuilder.build(m_temporalPipelineLayout);
+
+	// a-trous filter
+	DescriptorSetLayoutBuilder filterDescriptorSetLayoutBuilder;
+	filterDescriptorSetLayoutBuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // input image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // normal image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // color image
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT);          // output image
+	m_filterDescriptorSetLayout = filterDescriptorSetLayoutBuilder.build(*m_device);
+
+	VkPushConstantRange range;
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	range.offset = 0;
+	range.size = sizeof(FilterInformation);
+
+	PipelineLayoutBuilder filterPipelineLayoutBuilder;
+	filterPipelineLayoutBuilder
+		.addDescriptorSetLayout(m_filterDescriptorSetLayout)
+		.addPushConstantRange(range);
+	m_filterPipelineLayout = filterPipelineLayoutBuilder.build(*m_device);
+
+	ComputePipelineBuilder filterPipelineBuilder(m_device);
+	filterPipelineBuilder
+		.addShader("compiled_shaders/shadow_atrous.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
+	m_filterPipeline = filterPipelineBuilder.build(m_filterPipelineLayout);
+
+	// the shaders fetch the texels, the sampler is only needed by the descriptors
+	SamplerBuilder samplerBuilder;
+	samplerBuilder
+		.setMaxLod(0)
+		.setFilter(VK_FILTER_NEAREST, VK_FILTER_NEAREST);
+	m_nearestSampler = samplerBuilder.build(*m_device);
+
+	return m_temporalPipeline != VK_NULL_HANDLE && m_filterPipeline != VK_NULL_HANDLE;
+}
+
+void ShadowDenoisingPass::recordCommands(uint32_t width, uint32_t height) {
+	destroyCommandBuffers();
+
+	// the temporal shader reads the rendered area from the uniform buffer
+	m_renderSize = glm::uvec2(width, height);
+
+	Queue* pQueue = m_device->getQueue(QueueType::eCompute);
+	for (uint32_t history = 0; history < 2; ++history) {
+		VkCommandBuffer cmd = pQueue->beginCommands();
+
+		// accumulate the visibility in the history
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_temporalPipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_temporalPipelineLayout, 0, 1, &m_temporalDescriptorSets[history], 0, nullptr);
+		dispatchCompute2D(cmd, m_device->getComputeWorkgroupSize(), width, height);
+
+		computeMemoryBarrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		TransitionImageBarrierBuilder<1> transition;
+		transition
+			.setImage(0, m_outputImage->handle())
+			.setLayouts(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL)
+			.setAccessMasks(0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+			.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
+			.execute(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+		// filter the history, the step doubles at each iteration
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_filterPipeline);
+		for (uint32_t i = 0; i < cShadowFilterIterationCount; ++i) {
+			FilterInformation filterInformation{};
+			filterInformation.stepSize = 1 << i;
+			filterInformation.isLastIteration = (i + 1 == cShadowFilterIterationCount) ? 1 : 0;
+			filterInformation.renderWidth = width;
+			filterInformation.renderHeight = height;
+
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_filterPipelineLayout, 0, 1, &m_filterDescriptorSets[history][i], 0, nullptr);
+			vkCmdPushConstants(cmd, m_filterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FilterInformation), &filterInformation);
+			dispatchCompute2D(cmd, m_device->getComputeWorkgroupSize(), width, height);
+
+			if (!filterInformation.isLastIteration)
+				computeMemoryBarrier(cmd, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+
+		transition
+			.setLayouts(0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			.setAccessMasks(0, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+			.execute(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+		pQueue->endCommands(cmd);
+		m_commandBuffers[history] = cmd;
+	}
+}
+
+void ShadowDenoisingPass::cleanOnRenderTargetResized() {
+	destroyDescriptorSets();
+	destroyCommandBuffers();
+	destroyImages();
+}
+
+void ShadowDenoisingPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* visibilityImage, Image* depthImage, Image* normalImage, Image* colorImage) {
+	createImages(width, height);
+	createDescriptorSets(visibilityImage, depthImage, normalImage, colorImage);
+	recordCommands(width, height);
+
+	// the new history images hold nothing
+	m_isHistoryValid = false;
+}
+
+void ShadowDenoisingPass::updateUniformBuffer(const glm::mat4& viewProj, uint32_t frameIndex) {
+	ShadowDenoisingParams ubo{};
+	ubo.viewProjInverse = glm::inverse(viewProj);
+	ubo.previousViewProj = m_isHistoryValid ? m_previousViewProj : viewProj;
+	ubo.isHistoryValid = m_isHistoryValid ? 1 : 0;
+	ubo.resolutionScale = m_traceSettings.resolutionScale;
+	ubo.isCheckerboarded = m_traceSettings.isCheckerboarded ? 1 : 0;
+	ubo.frameIndex = frameIndex;
+	ubo.renderSize = m_renderSize;
+	ubo.previousRenderSize = m_isHistoryValid ? m_previousRenderSize : m_renderSize;
+	m_uniformBuffer.update(ubo);
+
+	m_previousViewProj = viewProj;
+	m_previousRenderSize = m_renderSize;
+}
+
+bool ShadowDenoisingPass::submit() {
+	VkCommandBuffer commandBuffer = m_commandBuffers[m_frameIndex % 2];
+	if (commandBuffer == VK_NULL_HANDLE)
+		return false;
+
+	// submit the denoising
+	// 1. wait for the semaphores
+	// 2. signal the pass semaphore
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_waitSemaphores.size());
+	submitInfo.pWaitSemaphores = m_waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = m_waitPipelineStages.data();
+
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_signalSemaphore;
+
+	auto pComputeQueue = m_device->getQueue(QueueType::eCompute);
+	if (!pComputeQueue->submit(&submitInfo, VK_NULL_HANDLE))
+		return false;
+
+	// the next frame reads the history written by this one
+	++m_frameIndex;
+	m_isHistoryValid = true;
+
+	return true;
+}
+
+void ShadowDenoisingPass::createImages(uint32_t width, uint32_t height) {
+	Queue& queue = *m_device->getQueue(QueueType::eCompute);
+	for (uint32_t i = 0; i < 2; ++i) {
+		m_historyImages[i] = new Image(m_device);
+		m_historyImages[i]->create2D(width, height, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		m_historyImages[i]->transitionLayout(queue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+		m_filterImages[i] = new Image(m_device);
+		m_filterImages[i]->create2D(width, height, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		m_filterImages[i]->transitionLayout(queue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	m_outputImage = new Image(m_device);
+	m_outputImage->create2D(
+		width,
+		height,
+		1,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	m_outputImage->transitionLayout(queue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void ShadowDenoisingPass::destroyImages() {
+	for (uint32_t i = 0; i < 2; ++i) {
+		delete m_historyImages[i];
+		m_historyImages[i] = nullptr;
+		delete m_filterImages[i];
+		m_filterImages[i] = nullptr;
+	}
+
+	delete m_outputImage;
+	m_outputImage = nullptr;
+}
+
+bool ShadowDenoisingPass::createDescriptorSets(Image* visibilityImage, Image* depthImage, Image* normalImage, Image* colorImage) {
+	for (uint32_t history = 0; history < 2; ++history) {
+		DescriptorSetBuilder temporalDescriptorSetBuilder(m_device, 2, m_temporalDescriptorSetLayout);
+		temporalDescriptorSetBuilder
+			.addImage(m_nearestSampler, visibilityImage->viewHandle(), 0)
+			.addImage(m_nearestSampler, depthImage->viewHandle(), 1)
+			.addStorageImage(m_historyImages[1 - history]->viewHandle(), 2)
+			.addStorageImage(m_historyImages[history]->viewHandle(), 3)
+			.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 4)
+			.addImage(m_nearestSampler, normalImage->viewHandle(), 5);
+		m_temporalDescriptorSets[history] = temporalDescriptorSetBuilder.buildAndUpdate();
+		if (m_temporalDescriptorSets[history] == VK_NULL_HANDLE)
+			return false;
+
+		// the iterations go back and forth between the filter images, the last one writes the output
+		for (uint32_t i = 0; i < cShadowFilterIterationCount; ++i) {
+			Image* inputImage = (i == 0) ? m_historyImages[history] : m_filterImages[(i - 1) % 2];
+			Image* outputImage = (i + 1 == cShadowFilterIterationCount) ? m_outputImage : m_filterImages[i % 2];
+
+			DescriptorSetBuilder filterDescriptorSetBuilder(m_device, 2, m_filterDescriptorSetLayout);
+			filterDescriptorSetBuilder
+				.addStorageImage(inputImage->viewHandle(), 0)
+				.addImage(m_nearestSampler, normalImage->viewHandle(), 1)
+				.addImage(m_nearestSampler, colorImage->viewHandle(), 2)
+				.addStorageImage(outputImage->viewHandle(), 3);
+			m_filterDescriptorSets[history][i] = filterDescriptorSetBuilder.buildAndUpdate();
+			if (m_filterDescriptorSets[history][i] == VK_NULL_HANDLE)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void ShadowDenoisingPass::destroyDescriptorSets() {
+	for (uint32_t history = 0; history < 2; ++history) {
+		if (m_temporalDescriptorSets[history] != VK_NULL_HANDLE) {
+			vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_temporalDescriptorSets[history]);
+			m_temporalDescriptorSets[history] = VK_NULL_HANDLE;
+		}
+
+		for (uint32_t i = 0; i < cShadowFilterIterationCount; ++i) {
+			if (m_filterDescriptorSets[history][i] != VK_NULL_HANDLE) {
+				vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_filterDescriptorSets[history][i]);
+				m_filterDescriptorSets[history][i] = VK_NULL_HANDLE;
+			}
+		}
+	}
+}
+
+void ShadowDenoisingPass::destroyCommandBuffers() {
+	for (uint32_t history = 0; history < 2; ++history) {
+		if (m_commandBuffers[history] != VK_NULL_HANDLE) {
+			m_device->getQueue(QueueType::eCompute)->freeCommandBuffer(m_commandBuffers[history]);
+			m_commandBuffers[history] = VK_NULL_HANDLE;
+		}
+	}
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Pass.h"
+#include "ShadowTraceSettings.h"
+#include "../Device.h"
+#include "../Image.h"
+#include "../Ubo.h"
+#include "../UniformBuffer.h"
+
+namespace Amano {
+
+// Number of iterations of the a-trous filter, the footprint of the last one is 4 * 2^(count - 1) + 1 pixels wide
+const uint32_t cShadowFilterIterationCount = 3;
+
+// This class converges the noisy visibility traced by the shadow passes at one ray per pixel, then applies it to the lit color
+//   - the visibility traced at a lower resolution is upsampled with the depth and the normals of the GBuffer
+//   - the visibility is accumulated over the frames, the history being reprojected with the depth and the camera motion
+//   - an edge aware a-trous filter guided by the depth and the normals of the GBuffer removes the remaining noise
+// The history is double buffered, each frame reads the one written by the previous frame
+// TEMPORARY: to work correctly, the pass expect the following states for the images
+//   - outputImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - visibilityImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - depthImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - normalImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - colorImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+// After submitting, the images states are the same
+class ShadowDenoisingPass : public Pass {
+public:
+	ShadowDenoisingPass(Device* device);
+	~ShadowDenoisingPass();
+
+	Image* outputImage() const { return m_outputImage; }
+
+	bool init();
+	// width and height are the rendered area of the GBuffer, they can be smaller than the size given to recreateOnRenderTargetResized
+	// The history is kept when they change, it is reprojected in the rendered area of the previous frame
+	void recordCommands(uint32_t width, uint32_t height);
+
+	// The settings must match the ones of the shadow pass
+	void setTraceSettings(const ShadowTraceSettings& settings) { m_traceSettings = settings; }
+
+	void cleanOnRenderTargetResized();
+	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* visibilityImage, Image* depthImage, Image* normalImage, Image* colorImage);
+
+	// viewProj is the transform of the frame being rendered, the one of the previous frame is kept to reproject the history
+	// frameIndex must be the one given to the shadow pass
+	void updateUniformBuffer(const glm::mat4& viewProj, uint32_t frameIndex);
+
+	bool submit();
+
+private:
+	void createImages(uint32_t width, uint32_t height);
+	void destroyImages();
+	bool createDescriptorSets(Image* visibilityImage, Image* depthImage, Image* normalImage, Image* colorImage);
+	void destroyDescriptorSets();
+	void destroyCommandBuffers();
+
+private:
+	VkDescriptorSetLayout m_temporalDescriptorSetLayout;
+	VkPipelineLayout m_temporalPipelineLayout;
+	VkPipeline m_temporalPipeline;
+	VkDescriptorSetLayout m_filterDescriptorSetLayout;
+	VkPipelineLayout m_filterPipelineLayout;
+	VkPipeline m_filterPipeline;
+	// one set of descriptors per history
+	VkDescriptorSet m_temporalDescriptorSets[2];
+	VkDescriptorSet m_filterDescriptorSets[2][cShadowFilterIterationCount];
+	VkSampler m_nearestSampler;
+	UniformBuffer<ShadowDenoisingParams> m_uniformBuffer;
+	glm::mat4 m_previousViewProj;
+	bool m_isHistoryValid;
+	glm::uvec2 m_renderSize;
+	glm::uvec2 m_previousRenderSize;
+	ShadowTraceSettings m_traceSettings;
+
+	// the history and filter images stay in VK_IMAGE_LAYOUT_GENERAL
+	Image* m_historyImages[2];
+	Image* m_filterImages[2];
+	Image* m_outputImage;
+
+	// the command buffer of a frame writes the history m_frameIndex % 2
+	VkCommandBuffer m_commandBuffers[2];
+	uint32_t m_frameIndex;
+};
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Amano {
+
+// Size in texels of the tiles of the visibility which receive extra rays, must match SHADOW_TILE_SIZE (shadow_trace.glsl)
+const uint32_t cShadowTileSize = 8;
+
+// Resolution of the shadow rays, shared by the shadow passes and by ShadowDenoisingPass which upsamples their visibility
+// The ray of a texel of the visibility starts from the center pixel of its resolutionScale x resolutionScale block
+struct ShadowTraceSettings {
+	uint32_t resolutionScale = 1;   // 1, 2 or 4
+	bool isCheckerboarded = false;  // half of the texels are traced every frame, the others are traced the next frame
+
+	uint32_t getVisibilityWidth(uint32_t width) const { return (width + resolutionScale - 1) / resolutionScale; }
+	uint32_t getVisibilityHeight(uint32_t height) const { return (height + resolutionScale - 1) / resolutionScale; }
+	// the checkerboard halves the number of rays along x
+	uint32_t getTraceWidth(uint32_t width) const { return isCheckerboarded ? (getVisibilityWidth(width) + 1) / 2 : getVisibilityWidth(width); }
+	uint32_t getTileCountX(uint32_t width) const { return (getVisibilityWidth(width) + cShadowTileSize - 1) / cShadowTileSize; }
+	uint32_t getTileCountY(uint32_t height) const { return (getVisibilityHeight(height) + cShadowTileSize - 1) / cShadowTileSize; }
+
+	bool operator!=(const ShadowTraceSettings& other) const {
+		return resolutionScale != other.resolutionScale || isCheckerboarded != other.isCheckerboarded;
+	}
+};
+
+}
@@ -0,0 +1,256 @@
+#include "TemporalAntiAliasingPass.h"
+#include "ComputeDispatch.h"
+#include "../Builder/ComputePipelineBuilder.h"
+#include "../Builder/DescriptorSetBuilder.h"
+#include "../Builder/DescriptorSetLayoutBuilder.h"
+#include "../Builder/PipelineLayoutBuilder.h"
+#include "../Builder/SamplerBuilder.h"
+#include "../Builder/TransitionImageBarrierBuilder.h"
+
+#include <cmath>
+
+namespace {
+
+// radical inverse of index in the given base, the first element of the sequence is at index 1
+float halton(uint32_t index, uint32_t base) {
+	float result = 0.0f;
+	float fraction = 1.0f;
+	while (index > 0) {
+		fraction /= static_cast<float>(base);
+		result += fraction * static_cast<float>(index % base);
+		index /= base;
+	}
+	return result;
+}
+
+}
+
+namespace Amano {
+
+glm::vec2 getTemporalJitter(uint32_t frameIndex, float renderScale) {
+	// one render pixel covers 1 / renderScale^2 output pixels
+	uint32_t sampleCount = cTemporalJitterSampleCount * static_cast<uint32_t>(std::ceil(1.0f / (renderScale * renderScale)));
+	uint32_t sampleIndex = frameIndex % sampleCount + 1;
+	return glm::vec2(halton(sampleIndex, 2), halton(sampleIndex, 3)) - glm::vec2(0.5f);
+}
+
+TemporalAntiAliasingPass::TemporalAntiAliasingPass(Device* device)
+	: Pass(device, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+	, m_descriptorSetLayout{ VK_NULL_HANDLE }
+	, m_pipelineLayout{ VK_NULL_HANDLE }
+	, m_pipeline{ VK_NULL_HANDLE }
+	, m_descriptorSets{ VK_NULL_HANDLE, VK_NULL_HANDLE }
+	, m_nearestSampler{ VK_NULL_HANDLE }
+	, m_uniformBuffer(device)
+	, m_previousViewProj(1.0f)
+	, m_isHistoryValid{ false }
+	, m_isEnabled{ true }
+	, m_historyImages{ nullptr, nullptr }
+	, m_outputImage{ nullptr }
+	, m_commandBuffers{ VK_NULL_HANDLE, VK_NULL_HANDLE }
+	, m_frameIndex{ 0 }
+{
+}
+
+TemporalAntiAliasingPass::~TemporalAntiAliasingPass() {
+	cleanOnRenderTargetResized();
+
+	vkDestroyPipeline(m_device->handle(), m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_device->handle(), m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_device->handle(), m_descriptorSetLayout, nullptr);
+	vkDestroySampler(m_device->handle(), m_nearestSampler, nullptr);
+}
+
+bool TemporalAntiAliasingPass::init() {
+	DescriptorSetLayoutBuilder descriptorSetLayoutBuilder;
+	descriptorSetLayoutBuilder
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // color image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // depth image
+		.addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT)  // velocity image
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // previous history
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // history
+		.addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT)           // output image
+		.addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);         // anti-aliasing parameters
+	m_descriptorSetLayout = descriptorSetLayoutBuilder.build(*m_device);
+
+	PipelineLayoutBuilder pipelineLayoutBuilder;
+	pipelineLayoutBuilder.addDescriptorSetLayout(m_descriptorSetLayout);
+	m_pipelineLayout = pipelineLayoutBuilder.build(*m_device);
+
+	ComputePipelineBuilder pipelineBuilder(m_device);
+	pipelineBuilder
+		.addShader("compiled_shaders/taa_resolve.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
+	m_pipeline = pipelineBuilder.build(m_pipelineLayout);
+
+	// the shader fetches the texels, the sampler is only needed by the descriptors
+	SamplerBuilder samplerBuilder;
+	samplerBuilder
+		.setMaxLod(0)
+		.setFilter(VK_FILTER_NEAREST, VK_FILTER_NEAREST);
+	m_nearestSampler = samplerBuilder.build(*m_device);
+
+	return m_pipeline != VK_NULL_HANDLE;
+}
+
+void TemporalAntiAliasingPass::recordCommands(uint32_t width, uint32_t height) {
+	destroyCommandBuffers();
+
+	Queue* pQueue = m_device->getQueue(QueueType::eCompute);
+	for (uint32_t history = 0; history < 2; ++history) {
+		VkCommandBuffer cmd = pQueue->beginCommands();
+
+		TransitionImageBarrierBuilder<1> transition;
+		transition
+			.setImage(0, m_outputImage->handle())
+			.setLayouts(0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL)
+			.setAccessMasks(0, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+			.setAspectMask(0, VK_IMAGE_ASPECT_COLOR_BIT)
+			.execute(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[history], 0, nullptr);
+		dispatchCompute2D(cmd, m_device->getComputeWorkgroupSize(), width, height);
+
+		transition
+			.setLayouts(0, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			.setAccessMasks(0, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+			.execute(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+		pQueue->endCommands(cmd);
+		m_commandBuffers[history] = cmd;
+	}
+}
+
+void TemporalAntiAliasingPass::setEnabled(bool isEnabled) {
+	// the history accumulated before the anti-aliasing was disabled is stale
+	if (!isEnabled)
+		m_isHistoryValid = false;
+	m_isEnabled = isEnabled;
+}
+
+void TemporalAntiAliasingPass::cleanOnRenderTargetResized() {
+	destroyDescriptorSets();
+	destroyCommandBuffers();
+	destroyImages();
+}
+
+void TemporalAntiAliasingPass::recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* colorImage, Image* depthImage, Image* velocityImage) {
+	createImages(width, height);
+	createDescriptorSets(colorImage, depthImage, velocityImage);
+	recordCommands(width, height);
+
+	// the new history images hold nothing
+	m_isHistoryValid = false;
+}
+
+void TemporalAntiAliasingPass::updateUniformBuffer(const glm::mat4& viewProj, const glm::vec2& jitter, const glm::uvec2& renderSize) {
+	TemporalAntiAliasingParams ubo{};
+	ubo.viewProjInverse = glm::inverse(viewProj);
+	ubo.previousViewProj = m_isHistoryValid ? m_previousViewProj : viewProj;
+	ubo.jitter = jitter;
+	ubo.renderSize = renderSize;
+	ubo.isHistoryValid = (m_isHistoryValid && m_isEnabled) ? 1 : 0;
+	m_uniformBuffer.update(ubo);
+
+	m_previousViewProj = viewProj;
+}
+
+bool TemporalAntiAliasingPass::submit() {
+	VkCommandBuffer commandBuffer = m_commandBuffers[m_frameIndex % 2];
+	if (commandBuffer == VK_NULL_HANDLE)
+		return false;
+
+	// submit the resolve
+	// 1. wait for the semaphores
+	// 2. signal the pass semaphore
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(m_waitSemaphores.size());
+	submitInfo.pWaitSemaphores = m_waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = m_waitPipelineStages.data();
+
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &m_signalSemaphore;
+
+	auto pComputeQueue = m_device->getQueue(QueueType::eCompute);
+	if (!pComputeQueue->submit(&submitInfo, VK_NULL_HANDLE))
+		return false;
+
+	// the next frame reads the history written by this one
+	++m_frameIndex;
+	m_isHistoryValid = m_isEnabled;
+
+	return true;
+}
+
+void TemporalAntiAliasingPass::createImages(uint32_t width, uint32_t height) {
+	Queue& queue = *m_device->getQueue(QueueType::eCompute);
+	for (uint32_t i = 0; i < 2; ++i) {
+		m_historyImages[i] = new Image(m_device);
+		m_historyImages[i]->create2D(width, height, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT);
+		m_historyImages[i]->transitionLayout(queue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+	}
+
+	m_outputImage = new Image(m_device);
+	m_outputImage->create2D(
+		width,
+		height,
+		1,
+		VK_FORMAT_R16G16B16A16_SFLOAT,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	m_outputImage->transitionLayout(queue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void TemporalAntiAliasingPass::destroyImages() {
+	for (uint32_t i = 0; i < 2; ++i) {
+		delete m_historyImages[i];
+		m_historyImages[i] = nullptr;
+	}
+
+	delete m_outputImage;
+	m_outputImage = nullptr;
+}
+
+bool TemporalAntiAliasingPass::createDescriptorSets(Image* colorImage, Image* depthImage, Image* velocityImage) {
+	for (uint32_t history = 0; history < 2; ++history) {
+		DescriptorSetBuilder descriptorSetBuilder(m_device, 2, m_descriptorSetLayout);
+		descriptorSetBuilder
+			.addImage(m_nearestSampler, colorImage->viewHandle(), 0)
+			.addImage(m_nearestSampler, depthImage->viewHandle(), 1)
+			.addImage(m_nearestSampler, velocityImage->viewHandle(), 2)
+			.addStorageImage(m_historyImages[1 - history]->viewHandle(), 3)
+			.addStorageImage(m_historyImages[history]->viewHandle(), 4)
+			.addStorageImage(m_outputImage->viewHandle(), 5)
+			.addUniformBuffer(m_uniformBuffer.getBuffer(), m_uniformBuffer.getSize(), 6);
+		m_descriptorSets[history] = descriptorSetBuilder.buildAndUpdate();
+		if (m_descriptorSets[history] == VK_NULL_HANDLE)
+			return false;
+	}
+
+	return true;
+}
+
+void TemporalAntiAliasingPass::destroyDescriptorSets() {
+	for (uint32_t history = 0; history < 2; ++history) {
+		if (m_descriptorSets[history] != VK_NULL_HANDLE) {
+			vkFreeDescriptorSets(m_device->handle(), m_device->getDescriptorPool(), 1, &m_descriptorSets[history]);
+			m_descriptorSets[history] = VK_NULL_HANDLE;
+		}
+	}
+}
+
+void TemporalAntiAliasingPass::destroyCommandBuffers() {
+	for (uint32_t history = 0; history < 2; ++history) {
+		if (m_commandBuffers[history] != VK_NULL_HANDLE) {
+			m_device->getQueue(QueueType::eCompute)->freeCommandBuffer(m_commandBuffers[history]);
+			m_commandBuffers[history] = VK_NULL_HANDLE;
+		}
+	}
+}
+
+}
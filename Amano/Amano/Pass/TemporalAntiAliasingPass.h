@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Pass.h"
+#include "../Device.h"
+#include "../Image.h"
+#include "../Ubo.h"
+#include "../UniformBuffer.h"
+
+namespace Amano {
+
+// Number of sub-pixel offsets of the projection at full resolution, they follow the Halton (2, 3) sequence
+const uint32_t cTemporalJitterSampleCount = 8;
+
+// Returns the sub-pixel offset of the projection for the given frame, in render pixels within [-0.5, 0.5]
+// The sequence is longer when the frame is upscaled, so that every output pixel receives samples
+glm::vec2 getTemporalJitter(uint32_t frameIndex, float renderScale);
+
+// This class resolves the temporal anti-aliasing of the lit color, it also upscales it to the output resolution
+//   - the projection of the GBuffer is jittered every frame, see getTemporalJitter
+//   - the history is reprojected with the velocity of the GBuffer, and clamped to the colors of the neighborhood of each pixel
+//   - the input images can have a lower resolution than the output, the history accumulates the output resolution
+//   - only a part of the input images can be rendered, its size is given every frame
+// The history is double buffered, each frame reads the one written by the previous frame
+// TEMPORARY: to work correctly, the pass expect the following states for the images
+//   - outputImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - colorImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - depthImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+//   - velocityImage: VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT
+// After submitting, the images states are the same
+class TemporalAntiAliasingPass : public Pass {
+public:
+	TemporalAntiAliasingPass(Device* device);
+	~TemporalAntiAliasingPass();
+
+	Image* outputImage() const { return m_outputImage; }
+
+	bool init();
+	void recordCommands(uint32_t width, uint32_t height);
+
+	// When disabled, the output is the color of the current frame, the projection must not be jittered
+	void setEnabled(bool isEnabled);
+
+	void cleanOnRenderTargetResized();
+	// width and height are the output resolution, the input images are at the render resolution
+	void recreateOnRenderTargetResized(uint32_t width, uint32_t height, Image* colorImage, Image* depthImage, Image* velocityImage);
+
+	// viewProj is the transform of the frame being rendered without the jitter, the one of the previous frame is kept
+	// jitter is the offset of the projection in render pixels, see getTemporalJitter
+	// renderSize is the area rendered in the input images, which can be larger
+	void updateUniformBuffer(const glm::mat4& viewProj, const glm::vec2& jitter, const glm::uvec2& renderSize);
+
+	bool submit();
+
+private:
+	void createImages(uint32_t width, uint32_t height);
+	void destroyImages();
+	bool createDescriptorSets(Image* colorImage, Image* depthImage, Image* velocityImage);
+	void destroyDescriptorSets();
+	void destroyCommandBuffers();
+
+private:
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkPipelineLayout m_pipelineLayout;
+	VkPipeline m_pipeline;
+	// one descriptor set per history
+	VkDescriptorSet m_descriptorSets[2];
+	VkSampler m_nearestSampler;
+	UniformBuffer<TemporalAntiAliasingParams> m_uniformBuffer;
+	glm::mat4 m_previousViewProj;
+	bool m_isHistoryValid;
+	bool m_isEnabled;
+
+	// the history images stay in VK_IMAGE_LAYOUT_GENERAL
+	Image* m_historyImages[2];
+	Image* m_outputImage;
+
+	// the command buffer of a frame writes the history m_frameIndex % 2
+	VkCommandBuffer m_commandBuffers[2];
+	uint32_t m_frameIndex;
+};
+
+}
@@ -1,4 +1,5 @@
 #include "ToneMappingPass.h"
+#include "ComputeDispatch.h"
 #include "../Builder/ComputePipelineBuilder.h"
 #include "../Builder/DescriptorSetBuilder.h"
 #include "../Builder/DescriptorSetLayoutBuilder.h"
@@ -44,7 +45,8 @@ bool ToneMappingPass::init() {
 	// load the shaders and create the pipeline
 	ComputePipelineBuilder computePipelineBuilder(m_device);
 	computePipelineBuilder
-		.addShader("compiled_shaders/tonemapping.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+		.addShader("compiled_shaders/tonemapping.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT)
+		.setWorkgroupSize(m_device->getComputeWorkgroupSize());
 	m_pipeline = computePipelineBuilder.build(m_pipelineLayout);
 
 	// create a sampler for the textures
@@ -87,12 +89,7 @@ void ToneMappingPass::recordCommands(uint32_t width, uint32_t height) {
 	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
 	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
-	// local size is 32 for x and y
-	const uint32_t locaSizeX = 32;
-	const uint32_t locaSizeY = 32;
-	uint32_t dispatchX = (width + locaSizeX - 1) / locaSizeX;
-	uint32_t dispatchY = (height + locaSizeY - 1) / locaSizeY;
-	vkCmdDispatch(m_commandBuffer, dispatchX, dispatchY, 1);
+	dispatchCompute2D(m_commandBuffer, m_device->getComputeWorkgroupSize(), width, height);
 
 	// transition the compute image to shader sampler
 	transition
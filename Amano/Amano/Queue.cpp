@@ -5,13 +5,13 @@
 
 namespace Amano {
 
-Queue::Queue(Device* device, uint32_t familyIndex)
+Queue::Queue(Device* device, uint32_t familyIndex, uint32_t queueIndex)
 	: m_device{ device }
 	, m_familyIndex{ familyIndex }
 	, m_queue{ VK_NULL_HANDLE }
 	, m_commandPool{ VK_NULL_HANDLE }
 {
-	vkGetDeviceQueue(m_device->handle(), familyIndex, 0, &m_queue);
+	vkGetDeviceQueue(m_device->handle(), familyIndex, queueIndex, &m_queue);
 
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
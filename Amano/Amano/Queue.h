@@ -11,7 +11,8 @@ class Device;
 class Queue
 {
 public:
-	Queue(Device* device, uint32_t familyIndex);
+	// queueIndex selects one of the queues created in the family
+	Queue(Device* device, uint32_t familyIndex, uint32_t queueIndex = 0);
 	~Queue();
 
 	uint32_t familyIndex() const { return m_familyIndex; }
@@ -0,0 +1,481 @@
+#include "RaytracingScene.h"
+#include "Pass/MemoryBarrier.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+VkDeviceAddress GetAccelerationStructureAddress(Amano::Device* device, VkAccelerationStructureKHR accelerationStructure) {
+	VkAccelerationStructureDeviceAddressInfoKHR info = {};
+	info.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+	info.accelerationStructure = accelerationStructure;
+
+	return device->getExtensions().vkGetAccelerationStructureDeviceAddressKHR(device->handle(), &info);
+}
+
+const uint32_t cInvalidInstanceSlot = UINT32_MAX;
+
+// The builds must be done before their results are read by the next builds or by the rays
+void accelerationStructureBarrier(VkCommandBuffer cmd, VkPipelineStageFlags dstStageMask) {
+	Amano::memoryBarrier(cmd,
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		dstStageMask, VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+}
+
+}
+
+namespace Amano {
+
+RaytracingScene::RaytracingScene(Device* device)
+	: m_device{ device }
+	, m_scratchBuffer(device)
+	, m_buildQueue(device)
+	, m_accelerationStructures()
+	, m_bottomLevelStates()
+	, m_meshBottomLevels()
+	, m_meshAddresses()
+	, m_instances()
+	, m_instanceIds()
+	, m_instanceMeshes()
+	, m_instanceSlots()
+	, m_freeInstanceIds()
+	, m_instanceGeometryBuffer{ VK_NULL_HANDLE }
+	, m_instanceGeometryMemory{ VK_NULL_HANDLE }
+	, m_mappedInstanceGeometries{ nullptr }
+	, m_needsRebuild{ false }
+	, m_needsRefit{ false }
+	, m_finishedBottomLevels()
+	, m_commandBuffer{ VK_NULL_HANDLE }
+{
+}
+
+RaytracingScene::~RaytracingScene() {
+	destroyCommandBuffer();
+	m_accelerationStructures.clean(m_device);
+
+	if (m_instanceGeometryBuffer != VK_NULL_HANDLE)
+		m_device->destroyBuffer(m_instanceGeometryBuffer);
+	if (m_instanceGeometryMemory != VK_NULL_HANDLE)
+		m_device->freeDeviceMemory(m_instanceGeometryMemory);
+}
+
+bool RaytracingScene::create(const std::vector<Mesh*>& meshes, const std::vector<Mesh*>& deformableMeshes) {
+	// the top level structure is created empty, the bottom level ones are built in the background
+	RaytracingAccelerationStructureBuilder accelerationStructureBuilder(m_device, VK_NULL_HANDLE);
+	accelerationStructureBuilder.setMaxInstanceCount(cMaxRaytracingInstances);
+	m_accelerationStructures = accelerationStructureBuilder.build(&m_scratchBuffer);
+
+	m_scratchBuffer.destroy();
+
+	if (m_accelerationStructures.top.handle == VK_NULL_HANDLE || m_accelerationStructures.top.mappedInstances == nullptr) {
+		std::cerr << "failed to create the raytracing scene!" << std::endl;
+		return false;
+	}
+
+	VkDeviceSize geometryBufferSize = sizeof(RaytracingInstanceGeometry) * cMaxRaytracingInstances;
+	if (!m_device->createBufferAndMemory(
+		geometryBufferSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		m_instanceGeometryBuffer,
+		m_instanceGeometryMemory))
+		return false;
+
+	void* mappedGeometries = nullptr;
+	if (vkMapMemory(m_device->handle(), m_instanceGeometryMemory, 0, geometryBufferSize, 0, &mappedGeometries) != VK_SUCCESS) {
+		std::cerr << "failed to map the instance geometry buffer!" << std::endl;
+		return false;
+	}
+	m_mappedInstanceGeometries = static_cast<RaytracingInstanceGeometry*>(mappedGeometries);
+
+	// the first meshes are built in one batch
+	size_t firstBottomLevel = m_bottomLevelStates.size();
+	for (auto mesh : meshes) {
+		auto it = std::find_if(m_bottomLevelStates.begin(), m_bottomLevelStates.end(), [&](const BottomLevelState& state) { return state.mesh == mesh; });
+		m_meshBottomLevels.push_back(static_cast<uint32_t>(it - m_bottomLevelStates.begin()));
+		m_meshAddresses.push_back(0);
+		if (it == m_bottomLevelStates.end()) {
+			BottomLevelState state;
+			state.mesh = mesh;
+			state.isDeformable = std::find(deformableMeshes.begin(), deformableMeshes.end(), mesh) != deformableMeshes.end();
+			state.needsUpdate = false;
+			state.isRebuilding = false;
+			state.refitCount = 0;
+			m_bottomLevelStates.push_back(state);
+			m_accelerationStructures.bottoms.push_back(AccelerationStructureInfo());
+		}
+	}
+
+	std::vector<BottomLevelBuildRequest> requests;
+	for (size_t i = firstBottomLevel; i < m_bottomLevelStates.size(); ++i)
+		requests.push_back({ static_cast<uint32_t>(i), m_bottomLevelStates[i].mesh, m_bottomLevelStates[i].isDeformable });
+
+	if (!m_buildQueue.push(requests)) {
+		std::cerr << "failed to queue the bottom acceleration structures!" << std::endl;
+		return false;
+	}
+
+	// the instances are inactive until the structures of their mesh are ready
+	for (uint32_t i = 0; i < meshes.size(); ++i)
+		addInstance(i);
+
+	return true;
+}
+
+uint32_t RaytracingScene::addMesh(const Mesh* mesh, bool isDeformable) {
+	uint32_t meshIndex = static_cast<uint32_t>(m_meshBottomLevels.size());
+
+	// the instances of a mesh already added share its structure
+	auto it = std::find_if(m_bottomLevelStates.begin(), m_bottomLevelStates.end(), [&](const BottomLevelState& state) { return state.mesh == mesh; });
+	if (it != m_bottomLevelStates.end()) {
+		uint32_t bottomLevel = static_cast<uint32_t>(it - m_bottomLevelStates.begin());
+		auto sameMesh = std::find(m_meshBottomLevels.begin(), m_meshBottomLevels.end(), bottomLevel);
+		m_meshBottomLevels.push_back(bottomLevel);
+		m_meshAddresses.push_back(m_meshAddresses[sameMesh - m_meshBottomLevels.begin()]);
+		return meshIndex;
+	}
+
+	uint32_t bottomLevel = static_cast<uint32_t>(m_bottomLevelStates.size());
+	if (!m_buildQueue.push({ { bottomLevel, mesh, isDeformable } })) {
+		std::cerr << "failed to queue the bottom acceleration structure!" << std::endl;
+		return UINT32_MAX;
+	}
+
+	BottomLevelState state;
+	state.mesh = mesh;
+	state.isDeformable = isDeformable;
+	state.needsUpdate = false;
+	state.isRebuilding = false;
+	state.refitCount = 0;
+	m_bottomLevelStates.push_back(state);
+	m_accelerationStructures.bottoms.push_back(AccelerationStructureInfo());
+
+	m_meshBottomLevels.push_back(bottomLevel);
+	m_meshAddresses.push_back(0);
+
+	return meshIndex;
+}
+
+uint32_t RaytracingScene::addInstance(uint32_t meshIndex, const glm::mat4& transform, uint32_t mask, uint32_t hitGroupOffset) {
+	if (m_instances.size() >= cMaxRaytracingInstances) {
+		std::cerr << "too many raytracing instances!" << std::endl;
+		return UINT32_MAX;
+	}
+
+	uint32_t instanceId;
+	if (!m_freeInstanceIds.empty()) {
+		instanceId = m_freeInstanceIds.back();
+		m_freeInstanceIds.pop_back();
+	}
+	else {
+		instanceId = static_cast<uint32_t>(m_instanceSlots.size());
+		m_instanceSlots.push_back(cInvalidInstanceSlot);
+	}
+
+	VkAccelerationStructureInstanceKHR instance{};
+	instance.transform = getTransformMatrix(transform);
+	instance.instanceCustomIndex = instanceId;
+	instance.mask = mask;
+	instance.instanceShaderBindingTableRecordOffset = hitGroupOffset;
+	instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+	instance.accelerationStructureReference = m_meshAddresses[meshIndex];
+
+	const Mesh* mesh = m_bottomLevelStates[m_meshBottomLevels[meshIndex]].mesh;
+	m_mappedInstanceGeometries[instanceId].vertices = mesh->getVertexBufferAddress();
+	m_mappedInstanceGeometries[instanceId].indices = mesh->getIndexBufferAddress();
+
+	m_instanceSlots[instanceId] = static_cast<uint32_t>(m_instances.size());
+	m_instances.push_back(instance);
+	m_instanceIds.push_back(instanceId);
+	m_instanceMeshes.push_back(meshIndex);
+
+	// the number of instances changed, the structure can't be refitted
+	m_needsRebuild = true;
+
+	return instanceId;
+}
+
+void RaytracingScene::removeInstance(uint32_t instanceId) {
+	uint32_t slot = m_instanceSlots[instanceId];
+	if (slot == cInvalidInstanceSlot)
+		return;
+
+	// move the last instance in the free slot to keep them packed
+	uint32_t lastSlot = static_cast<uint32_t>(m_instances.size()) - 1;
+	m_instances[slot] = m_instances[lastSlot];
+	m_instanceIds[slot] = m_instanceIds[lastSlot];
+	m_instanceMeshes[slot] = m_instanceMeshes[lastSlot];
+	m_instanceSlots[m_instanceIds[slot]] = slot;
+	m_instances.pop_back();
+	m_instanceIds.pop_back();
+	m_instanceMeshes.pop_back();
+
+	m_instanceSlots[instanceId] = cInvalidInstanceSlot;
+	m_freeInstanceIds.push_back(instanceId);
+
+	m_needsRebuild = true;
+}
+
+void RaytracingScene::setInstanceTransform(uint32_t instanceId, const glm::mat4& transform) {
+	uint32_t slot = m_instanceSlots[instanceId];
+	if (slot == cInvalidInstanceSlot)
+		return;
+
+	m_instances[slot].transform = getTransformMatrix(transform);
+
+	// the previous frame is finished, the mapped instance can be written directly
+	// with a pending rebuild, all the instances are written at submission
+	if (!m_needsRebuild) {
+		m_accelerationStructures.top.mappedInstances[slot].transform = m_instances[slot].transform;
+		m_needsRefit = true;
+	}
+}
+
+void RaytracingScene::updateMeshVertices(uint32_t meshIndex) {
+	BottomLevelState& state = m_bottomLevelStates[m_meshBottomLevels[meshIndex]];
+	if (!state.isDeformable) {
+		std::cerr << "the vertices of a mesh that isn't deformable can't be updated!" << std::endl;
+		return;
+	}
+
+	// the structure is still built from the vertices of the mesh
+	if (!isMeshReady(meshIndex))
+		return;
+
+	state.needsUpdate = true;
+
+	// the bounds of the instances of the mesh changed
+	m_needsRefit = true;
+}
+
+bool RaytracingScene::submit() {
+	// the scratch memory is only kept while the scene changes
+	m_scratchBuffer.releaseIfIdle();
+
+	activateFinishedBottomLevels();
+	queueBottomLevelRebuilds();
+
+	if (!m_needsRebuild && !m_needsRefit)
+		return true;
+
+	if (m_needsRebuild)
+		memcpy(m_accelerationStructures.top.mappedInstances, m_instances.data(), sizeof(VkAccelerationStructureInstanceKHR) * m_instances.size());
+
+	// the command buffer is recorded when the scene changes, the previous one is already executed
+	destroyCommandBuffer();
+
+	Queue* pQueue = m_device->getQueue(QueueType::eGraphics);
+	m_commandBuffer = pQueue->beginCommands();
+
+	// the finished structures were built on the async compute queue, they are used from now on
+	m_buildQueue.recordAcquire(m_commandBuffer, m_finishedBottomLevels);
+
+	// all the builds of the command buffer allocate their scratch memory from the same batch
+	// when it fails, the command buffer is dropped and the updates are recorded again at the next submission
+	VkBuildAccelerationStructureModeKHR topLevelMode = m_needsRebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+	if (!m_scratchBuffer.beginBatch(getScratchSize(topLevelMode))
+		|| !recordBottomLevelUpdates(m_commandBuffer)
+		|| !recordTopLevelUpdate(m_commandBuffer, topLevelMode)) {
+		destroyCommandBuffer();
+		return false;
+	}
+
+	// the rays are traced by the next submissions
+	accelerationStructureBarrier(m_commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR);
+
+	pQueue->endCommands(m_commandBuffer);
+
+	m_needsRebuild = false;
+	m_needsRefit = false;
+
+	// the host writes are visible to the device once submitted, no semaphore is needed
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_commandBuffer;
+
+	if (!pQueue->submit(&submitInfo, VK_NULL_HANDLE))
+		return false;
+
+	m_finishedBottomLevels.clear();
+
+	return true;
+}
+
+void RaytracingScene::activateFinishedBottomLevels() {
+	if (m_buildQueue.isEmpty())
+		return;
+
+	std::vector<BottomLevelBuildResult> results;
+	m_buildQueue.poll(results);
+	m_finishedBottomLevels.insert(m_finishedBottomLevels.end(), results.begin(), results.end());
+
+	for (const auto& result : results) {
+		// a rebuilt structure replaces the refitted one, which isn't used by the previous frame anymore
+		// the vertices may have moved during the build, so it is refitted once before its first use
+		BottomLevelState& state = m_bottomLevelStates[result.id];
+		if (state.isRebuilding) {
+			m_accelerationStructures.bottoms[result.id].clean(m_device);
+			state.isRebuilding = false;
+			state.refitCount = 0;
+			state.needsUpdate = true;
+		}
+
+		m_accelerationStructures.bottoms[result.id] = result.structure;
+		VkDeviceAddress address = GetAccelerationStructureAddress(m_device, result.structure.handle);
+
+		for (uint32_t meshIndex = 0; meshIndex < m_meshBottomLevels.size(); ++meshIndex) {
+			if (m_meshBottomLevels[meshIndex] != result.id)
+				continue;
+
+			m_meshAddresses[meshIndex] = address;
+			for (uint32_t slot = 0; slot < m_instances.size(); ++slot) {
+				if (m_instanceMeshes[slot] == meshIndex)
+					m_instances[slot].accelerationStructureReference = address;
+			}
+		}
+
+		// the active instances change, the structure can't be refitted
+		m_needsRebuild = true;
+	}
+}
+
+void RaytracingScene::queueBottomLevelRebuilds() {
+	// refitting is much faster than building, but the tree is rebuilt regularly to keep the traversal fast
+	// the new structure is built in the background from the current vertices, the current one is refitted meanwhile
+	std::vector<BottomLevelBuildRequest> requests;
+	for (uint32_t i = 0; i < m_bottomLevelStates.size(); ++i) {
+		const BottomLevelState& state = m_bottomLevelStates[i];
+		if (state.isDeformable && !state.isRebuilding && state.refitCount >= cMaxBottomLevelRefits)
+			requests.push_back({ i, state.mesh, true });
+	}
+
+	if (requests.empty())
+		return;
+
+	if (!m_buildQueue.push(requests)) {
+		std::cerr << "failed to queue the rebuild of the bottom acceleration structures!" << std::endl;
+		return;
+	}
+
+	for (const auto& request : requests)
+		m_bottomLevelStates[request.id].isRebuilding = true;
+}
+
+VkDeviceSize RaytracingScene::getScratchSize(VkBuildAccelerationStructureModeKHR topLevelMode) const {
+	VkDeviceSize scratchSize = 0;
+	for (uint32_t i = 0; i < m_bottomLevelStates.size(); ++i) {
+		if (m_bottomLevelStates[i].needsUpdate)
+			scratchSize += m_accelerationStructures.bottoms[i].updateScratchSize;
+	}
+
+	const AccelerationStructureInfo& top = m_accelerationStructures.top;
+	scratchSize += topLevelMode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR ? top.buildScratchSize : top.updateScratchSize;
+
+	return scratchSize;
+}
+
+bool RaytracingScene::recordBottomLevelUpdates(VkCommandBuffer cmd) {
+	uint32_t updateCount = 0;
+	for (const auto& state : m_bottomLevelStates)
+		updateCount += state.needsUpdate ? 1 : 0;
+
+	std::vector<VkAccelerationStructureGeometryKHR> geometries(updateCount);
+	std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos(updateCount);
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos(updateCount);
+	std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos(updateCount);
+
+	uint32_t updateIndex = 0;
+	for (uint32_t i = 0; i < m_bottomLevelStates.size(); ++i) {
+		const BottomLevelState& state = m_bottomLevelStates[i];
+		if (!state.needsUpdate)
+			continue;
+
+		const AccelerationStructureInfo& bottom = m_accelerationStructures.bottoms[i];
+
+		geometries[updateIndex] = getMeshGeometry(state.mesh);
+
+		auto& buildRangeInfo = buildRangeInfos[updateIndex];
+		buildRangeInfo.primitiveCount = state.mesh->getIndexCount() / 3;
+
+		// the structure is updated in place
+		auto& buildGeometryInfo = buildGeometryInfos[updateIndex];
+		buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		buildGeometryInfo.pNext = nullptr;
+		buildGeometryInfo.flags = bottom.flags;
+		buildGeometryInfo.geometryCount = 1;
+		buildGeometryInfo.pGeometries = &geometries[updateIndex];
+		buildGeometryInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+		buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+		buildGeometryInfo.srcAccelerationStructure = bottom.handle;
+		buildGeometryInfo.dstAccelerationStructure = bottom.handle;
+		buildGeometryInfo.scratchData.deviceAddress = m_scratchBuffer.allocate(bottom.updateScratchSize);
+		if (buildGeometryInfo.scratchData.deviceAddress == 0)
+			return false;
+
+		pBuildRangeInfos[updateIndex] = &buildRangeInfo;
+		++updateIndex;
+	}
+
+	if (updateCount == 0)
+		return true;
+
+	m_device->getExtensions().vkCmdBuildAccelerationStructuresKHR(cmd, updateCount, buildGeometryInfos.data(), pBuildRangeInfos.data());
+
+	// the top level structure reads the bottom level ones
+	accelerationStructureBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR);
+
+	// the states only change once the whole batch is recorded, an aborted batch is recorded again
+	for (auto& state : m_bottomLevelStates) {
+		if (!state.needsUpdate)
+			continue;
+		++state.refitCount;
+		state.needsUpdate = false;
+	}
+
+	return true;
+}
+
+bool RaytracingScene::recordTopLevelUpdate(VkCommandBuffer cmd, VkBuildAccelerationStructureModeKHR mode) {
+	VkAccelerationStructureGeometryKHR geometry{};
+	geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+	geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+	geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+	geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+	geometry.geometry.instances.data.deviceAddress = m_device->getBufferAddress(m_accelerationStructures.top.instance);
+
+	// the flags must be the same as the ones of the first build
+	VkAccelerationStructureBuildGeometryInfoKHR buildGeometryInfo{};
+	buildGeometryInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+	buildGeometryInfo.pNext = nullptr;
+	buildGeometryInfo.flags = m_accelerationStructures.top.flags;
+	buildGeometryInfo.geometryCount = 1;
+	buildGeometryInfo.pGeometries = &geometry;
+	buildGeometryInfo.mode = mode;
+	buildGeometryInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+	buildGeometryInfo.srcAccelerationStructure = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? m_accelerationStructures.top.handle : VK_NULL_HANDLE;
+	buildGeometryInfo.dstAccelerationStructure = m_accelerationStructures.top.handle;
+	buildGeometryInfo.scratchData.deviceAddress = m_scratchBuffer.allocate(mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR ? m_accelerationStructures.top.buildScratchSize : m_accelerationStructures.top.updateScratchSize);
+	if (buildGeometryInfo.scratchData.deviceAddress == 0)
+		return false;
+
+	VkAccelerationStructureBuildRangeInfoKHR buildOffsetInfo = {};
+	buildOffsetInfo.primitiveCount = static_cast<uint32_t>(m_instances.size());
+
+	const VkAccelerationStructureBuildRangeInfoKHR* pBuildOffsetInfo = &buildOffsetInfo;
+
+	m_device->getExtensions().vkCmdBuildAccelerationStructuresKHR(cmd, 1, &buildGeometryInfo, &pBuildOffsetInfo);
+
+	return true;
+}
+
+void RaytracingScene::destroyCommandBuffer() {
+	if (m_commandBuffer != VK_NULL_HANDLE) {
+		m_device->getQueue(QueueType::eGraphics)->freeCommandBuffer(m_commandBuffer);
+		m_commandBuffer = VK_NULL_HANDLE;
+	}
+}
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "AccelerationStructureBuildQueue.h"
+#include "Device.h"
+#include "glm.h"
+#include "Mesh.h"
+#include "ScratchBuffer.h"
+#include "Builder/RaytracingAccelerationStructureBuilder.h"
+
+#include <vector>
+
+namespace Amano {
+
+// Maximum number of instances of the top level acceleration structure
+const uint32_t cMaxRaytracingInstances = 1024;
+
+// Number of refits of a deformable mesh before its bottom level structure is rebuilt
+// A refit keeps the topology of the tree, which gets looser as the triangles move away from where they were built
+// The rebuild runs in the background, the current structure is still refitted until the new one is ready
+const uint32_t cMaxBottomLevelRefits = 60;
+
+// Geometry of an instance for the hit shaders, indexed by gl_InstanceCustomIndexEXT which is the id of the instance
+// The layout matches the std430 structure of the shaders, the addresses are buffer references
+// The vertices are the Vertex structure, the indices are uint32_t
+struct RaytracingInstanceGeometry {
+	VkDeviceAddress vertices;
+	VkDeviceAddress indices;
+};
+
+// This class owns the acceleration structures of the raytraced scene and keeps them up to date
+// The instances are written in a persistently mapped buffer:
+//   - moving instances only refits the top level structure (VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR)
+//   - adding or removing instances rebuilds it
+// The top level structure is allocated for cMaxRaytracingInstances, so its handle never changes
+// The bottom level structures of deformable meshes are refitted when their vertices change, and rebuilt in the background after cMaxBottomLevelRefits refits
+// All the builds share one scratch arena, released when the scene doesn't change
+// The bottom level structures are built in the background on the async compute queue, the instances of a mesh are inactive until its structure is ready
+class RaytracingScene {
+public:
+	RaytracingScene(Device* device);
+	~RaytracingScene();
+
+	VkAccelerationStructureKHR topLevelAccelerationStructure() const { return m_accelerationStructures.top.handle; }
+	uint32_t getInstanceCount() const { return static_cast<uint32_t>(m_instances.size()); }
+	// Storage buffer of cMaxRaytracingInstances RaytracingInstanceGeometry, written when the instances are added
+	VkBuffer instanceGeometryBuffer() const { return m_instanceGeometryBuffer; }
+
+	// Creates one instance per mesh with an identity transform, their ids are the indices of the meshes
+	// The vertices of deformableMeshes can be updated later, they must also be in meshes
+	bool create(const std::vector<Mesh*>& meshes, const std::vector<Mesh*>& deformableMeshes = {});
+
+	// Queues the build of the bottom level structure of the mesh and returns its index immediately
+	// The mesh must stay alive as long as the scene
+	uint32_t addMesh(const Mesh* mesh, bool isDeformable = false);
+	bool isMeshReady(uint32_t meshIndex) const { return m_meshAddresses[meshIndex] != 0; }
+
+	// meshIndex is the index of the mesh in the vector given to create, or the one returned by addMesh
+	// The returned id stays valid until the instance is removed, UINT32_MAX is returned when the scene is full
+	uint32_t addInstance(uint32_t meshIndex, const glm::mat4& transform = glm::mat4(1.0f), uint32_t mask = 0xFF, uint32_t hitGroupOffset = 0);
+	void removeInstance(uint32_t instanceId);
+	void setInstanceTransform(uint32_t instanceId, const glm::mat4& transform);
+
+	// The vertex buffer of the deformable mesh was written, its bottom level structure is updated at the next submission
+	// The writes must be submitted before this scene
+	void updateMeshVertices(uint32_t meshIndex);
+
+	// Activates the instances of the meshes whose bottom level structure is built
+	// Then submits the updates of the acceleration structures on the graphics queue if the scene changed
+	// It must be submitted before the passes tracing rays, the command buffer ends with a barrier for them
+	bool submit();
+
+private:
+	struct BottomLevelState {
+		const Mesh* mesh;
+		bool isDeformable;
+		bool needsUpdate;
+		bool isRebuilding;    // a new structure is built in the background
+		uint32_t refitCount;  // since the last build
+	};
+
+	void activateFinishedBottomLevels();
+	void queueBottomLevelRebuilds();
+	VkDeviceSize getScratchSize(VkBuildAccelerationStructureModeKHR topLevelMode) const;
+	// Both return false when the scratch batch is too small, the command buffer must then be dropped
+	bool recordBottomLevelUpdates(VkCommandBuffer cmd);
+	bool recordTopLevelUpdate(VkCommandBuffer cmd, VkBuildAccelerationStructureModeKHR mode);
+	void destroyCommandBuffer();
+
+private:
+	Device* m_device;
+	ScratchBuffer m_scratchBuffer;
+	AccelerationStructureBuildQueue m_buildQueue;
+	AccelerationStructures m_accelerationStructures;
+	std::vector<BottomLevelState> m_bottomLevelStates;
+
+	// index of the bottom level structure of each mesh, and its device address, 0 while it is built
+	std::vector<uint32_t> m_meshBottomLevels;
+	std::vector<VkDeviceAddress> m_meshAddresses;
+
+	// the instances are packed, m_instanceIds gives the id of each instance and m_instanceSlots the position of each id
+	// m_instanceMeshes gives the mesh of each instance, to activate it when its bottom level structure is ready
+	std::vector<VkAccelerationStructureInstanceKHR> m_instances;
+	std::vector<uint32_t> m_instanceIds;
+	std::vector<uint32_t> m_instanceMeshes;
+	std::vector<uint32_t> m_instanceSlots;
+	std::vector<uint32_t> m_freeInstanceIds;
+
+	// persistently mapped, like the instances of the top level structure
+	VkBuffer m_instanceGeometryBuffer;
+	VkDeviceMemory m_instanceGeometryMemory;
+	RaytracingInstanceGeometry* m_mappedInstanceGeometries;
+
+	bool m_needsRebuild;
+	bool m_needsRefit;
+
+	// the structures finished by the build queue, until a submission acquires them for the graphics queue
+	std::vector<BottomLevelBuildResult> m_finishedBottomLevels;
+
+	VkCommandBuffer m_commandBuffer;
+};
+
+}
@@ -0,0 +1,80 @@
+#include "ScratchBuffer.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace Amano {
+
+ScratchBuffer::ScratchBuffer(Device* device)
+	: m_device{ device }
+	, m_buffer{ VK_NULL_HANDLE }
+	, m_bufferMemory{ VK_NULL_HANDLE }
+	, m_size{ 0 }
+	, m_offset{ 0 }
+	, m_deviceAddress{ 0 }
+	, m_offsetAlignment{ std::max<VkDeviceSize>(device->getPhysicalAccelerationStructureProperties().minAccelerationStructureScratchOffsetAlignment, 1) }
+	, m_idleFrameCount{ 0 }
+{
+}
+
+ScratchBuffer::~ScratchBuffer() {
+	destroy();
+}
+
+bool ScratchBuffer::beginBatch(VkDeviceSize size) {
+	m_offset = 0;
+	m_idleFrameCount = 0;
+
+	if (size <= m_size)
+		return true;
+
+	destroy();
+
+	if (!m_device->createBufferAndMemory(
+		size,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_buffer,
+		m_bufferMemory))
+		return false;
+
+	m_size = size;
+	m_deviceAddress = m_device->getBufferAddress(m_buffer);
+
+	return true;
+}
+
+VkDeviceAddress ScratchBuffer::allocate(VkDeviceSize size) {
+	VkDeviceSize offset = (m_offset + m_offsetAlignment - 1) / m_offsetAlignment * m_offsetAlignment;
+	if (offset + size > m_size) {
+		std::cerr << "the scratch buffer is too small for the batch!" << std::endl;
+		return 0;
+	}
+
+	m_offset = offset + size;
+
+	return m_deviceAddress + offset;
+}
+
+void ScratchBuffer::releaseIfIdle() {
+	if (m_buffer == VK_NULL_HANDLE)
+		return;
+
+	// the frames are serialized, so the last builds are finished
+	if (++m_idleFrameCount > cScratchBufferIdleFrames)
+		destroy();
+}
+
+void ScratchBuffer::destroy() {
+	m_device->destroyBuffer(m_buffer);
+	m_device->freeDeviceMemory(m_bufferMemory);
+	m_buffer = VK_NULL_HANDLE;
+	m_bufferMemory = VK_NULL_HANDLE;
+	m_size = 0;
+	m_offset = 0;
+	m_deviceAddress = 0;
+	m_idleFrameCount = 0;
+}
+
+}
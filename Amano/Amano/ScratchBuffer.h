@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Device.h"
+
+namespace Amano {
+
+// Number of frames without any build before the scratch memory is released
+const uint32_t cScratchBufferIdleFrames = 120;
+
+// A device local arena used as scratch memory by the acceleration structure builds and updates
+// One arena is shared by all the builds of a scene. The builds of a batch run at the same time, so each of them allocates its own range
+// The arena grows to the size of the largest batch, and is released when no build used it for cScratchBufferIdleFrames frames
+class ScratchBuffer {
+public:
+	ScratchBuffer(Device* device);
+	~ScratchBuffer();
+
+	VkDeviceSize getSize() const { return m_size; }
+
+	// The sizes of the ranges must be aligned on this value
+	VkDeviceSize getOffsetAlignment() const { return m_offsetAlignment; }
+
+	// Starts a batch of builds needing size bytes in total, the builds of the previous batch must be finished
+	bool beginBatch(VkDeviceSize size);
+
+	// Returns the address of a range of the current batch, 0 when the batch is too small
+	// The builds of the batch must then be aborted
+	VkDeviceAddress allocate(VkDeviceSize size);
+
+	// Must be called once per frame, releases the memory once the arena is idle
+	void releaseIfIdle();
+
+	void destroy();
+
+private:
+	Device* m_device;
+	VkBuffer m_buffer;
+	VkDeviceMemory m_bufferMemory;
+	VkDeviceSize m_size;
+	VkDeviceSize m_offset;
+	VkDeviceAddress m_deviceAddress;
+	VkDeviceSize m_offsetAlignment;
+	uint32_t m_idleFrameCount;
+};
+
+}
@@ -8,7 +8,9 @@ namespace Amano {
 struct PerFrameUniformBufferObject {
 	glm::mat4 model;
 	glm::mat4 view;
-	glm::mat4 proj;
+	glm::mat4 proj;              // jittered by a sub-pixel offset for the temporal anti-aliasing
+	glm::mat4 previousViewProj;  // without the jitter, the velocity is computed from it, it also undoes the motion of the model
+	glm::vec4 jitter;            // xy is the offset of the projection in clip space, zw are unused
 };
 
 // Uniform buffer for raygen shader
@@ -20,6 +22,78 @@ struct RayParams {
 
 struct LightInformation {
 	glm::vec3 lightPosition;
+	float lightRadius;    // the shadow passes sample one point of the spherical light per pixel
+	uint32_t frameIndex;  // changes the sampled points every frame
+};
+
+// Uniform buffer for the temporal accumulation of the shadow denoising
+struct ShadowDenoisingParams {
+	glm::mat4 viewProjInverse;   // reconstructs the world positions of the current frame from the depth
+	glm::mat4 previousViewProj;  // projects them in the previous frame
+	uint32_t isHistoryValid;     // 0 when the history images were just created
+	uint32_t resolutionScale;    // the visibility traced by the shadow passes is upsampled, see ShadowTraceSettings
+	uint32_t isCheckerboarded;
+	uint32_t frameIndex;         // selects the texels traced this frame with the checkerboard
+	glm::uvec2 renderSize;          // rendered area of the GBuffer, the images can be larger
+	glm::uvec2 previousRenderSize;  // rendered area of the previous frame, in which the history is reprojected
+};
+
+// Uniform buffer for the resolve of the temporal anti-aliasing
+struct TemporalAntiAliasingParams {
+	glm::mat4 viewProjInverse;   // without the jitter, reprojects the background which has no velocity
+	glm::mat4 previousViewProj;
+	glm::vec2 jitter;            // offset of the projection in render pixels
+	glm::uvec2 renderSize;       // rendered area of the input images, they can be larger
+	uint32_t isHistoryValid;     // 0 when the history images were just created or when the anti-aliasing is disabled
+	uint32_t padding[3];
+};
+
+// A point light of the clustered light list
+// The layout matches the std430 structure used by the shaders
+struct PointLight {
+	glm::vec4 positionAndRadius;   // xyz is the world space position, w is the radius of influence
+	glm::vec4 colorAndIntensity;
+};
+
+// Uniform buffer for the light clustering and the deferred lighting compute shaders
+struct LightClusterParams {
+	glm::mat4 view;
+	glm::mat4 projInverse;
+	glm::uvec4 clusterCounts;           // xyz is the number of clusters along each axis, w is the number of lights
+	glm::vec4 screenSizeAndDepthRange;  // xy is the screen size in pixels, zw are the near and far planes
+};
+
+// Diffuse irradiance of the environment as L2 spherical harmonics, computed by SHProjectionPass
+// The coefficients are convolved with the clamped cosine and divided by PI, see spherical_harmonics.glsl
+// The layout matches both the std140 and the std430 structures used by the shaders
+struct IrradianceSH {
+	glm::vec4 coefficients[9];  // rgb, w is unused
+};
+
+// Uniform buffer of the light probe grid, read by the lighting and by the probe relighting shaders
+struct LightProbeGridParams {
+	glm::vec4 origin;        // xyz is the position of the first probe, w is 1 when the lighting samples the grid
+	glm::vec4 spacing;       // xyz is the distance between two neighbour probes, w is unused
+	glm::uvec4 probeCounts;  // xyz is the number of probes along each axis, w is the total number of probes
+};
+
+// Uniform buffer of the probe relighting shaders, updated every frame
+struct LightProbeRelightingParams {
+	glm::mat4 rayRotation;   // random rotation of the ray directions, so that the probes converge over the frames
+	uint32_t firstProbe;     // the probes firstProbe to firstProbe + probeCount - 1 are relit, modulo the probe count
+	uint32_t probeCount;
+	float hysteresis;        // weight of the previous irradiance of the probes
+	uint32_t pointLightCount;   // number of lights in the light buffer of the lighting pass
+};
+
+// Uniform buffer for the meshlet culling compute shader
+struct MeshletCullingParams {
+	glm::mat4 model;
+	glm::vec4 frustumPlanes[6];        // world space planes, xyz is the normal pointing inside, w is the distance
+	glm::vec4 cameraPositionAndScale;  // xyz is the camera position, w is the maximum scale of the model matrix
+	uint32_t meshletOffset;            // first meshlet of the selected level of detail
+	uint32_t meshletCount;
+	uint32_t padding[2];
 };
 
 }
@@ -0,0 +1,41 @@
+//////////////////////////////////////////////////////
+// Stochastic sampling of the spherical light of the shadow passes
+// One point of the light is sampled per pixel and per frame, the shadow denoising converges them
+//////////////////////////////////////////////////////
+
+// R2 sequence, its points cover the unit square evenly over the frames
+const vec2 R2_ALPHA = vec2(0.7548776662, 0.5698402910);
+
+//////////////////////////////////////////////////////
+// FUNCTIONS
+//////////////////////////////////////////////////////
+
+// Hash of a pixel, decorrelates the sequences of the neighbour pixels
+vec2 hashPixel(uvec2 pixel) {
+    uvec2 v = pixel * uvec2(1664525u, 1013904223u);
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v ^= v >> 16u;
+    v.x += v.y * 1664525u;
+    v.y += v.x * 1664525u;
+    v ^= v >> 16u;
+    return vec2(v) * (1.0 / 4294967296.0);
+}
+
+// Random point in [0, 1)^2, the R2 sequence is shifted by a different offset for each pixel
+vec2 getLightSample(uvec2 pixel, uint frameIndex) {
+    return fract(hashPixel(pixel) + R2_ALPHA * float(frameIndex % 4096u));
+}
+
+// Returns a point of the disk of the light facing origin
+// The disk subtends almost the same solid angle as the sphere while the light is far compared to its radius
+vec3 sampleSphereLight(vec3 origin, vec3 lightPosition, float lightRadius, vec2 xi) {
+    vec3 w = normalize(lightPosition - origin);
+    vec3 up = abs(w.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 u = normalize(cross(up, w));
+    vec3 v = cross(w, u);
+
+    float radius = lightRadius * sqrt(xi.x);
+    float angle = 2.0 * 3.14159265358979 * xi.y;
+    return lightPosition + radius * (cos(angle) * u + sin(angle) * v);
+}
@@ -0,0 +1,110 @@
+//////////////////////////////////////////////////////
+// Bounding volume hierarchy traversal
+// The buffers hold the nodes and the triangles of Bvh (Bvh.h), uploaded as they are
+// The including shader defines BVH_NODE_BINDING and BVH_TRIANGLE_BINDING
+//////////////////////////////////////////////////////
+
+// Maximum depth of the tree, the traversal stack never holds more nodes
+// The value must match cBvhMaxDepth of Bvh.h
+const uint BVH_MAX_DEPTH = 64;
+
+// Determinants below this are rays parallel to the triangle
+const float BVH_DETERMINANT_EPSILON = 1e-12;
+
+// The first child of an interior node follows it, offset is the index of the second child
+// The offset of a leaf is its first triangle
+struct BvhNode {
+    vec3 boundsMin;
+    uint offset;
+    vec3 boundsMax;
+    uint triangleCount;  // 0 for interior nodes
+};
+
+layout(binding = BVH_NODE_BINDING, std430) readonly buffer bvhNodeBuffer
+{
+    BvhNode bvhNodes[];
+};
+// three positions per triangle, in the order of the leaves
+layout(binding = BVH_TRIANGLE_BINDING, std430) readonly buffer bvhTriangleBuffer
+{
+    vec4 bvhTrianglePositions[];
+};
+
+//////////////////////////////////////////////////////
+// FUNCTIONS
+//////////////////////////////////////////////////////
+
+bool intersectBvhBounds(uint nodeIndex, vec3 origin, vec3 inverseDirection, float tMin, float tMax) {
+    vec3 t0 = (bvhNodes[nodeIndex].boundsMin - origin) * inverseDirection;
+    vec3 t1 = (bvhNodes[nodeIndex].boundsMax - origin) * inverseDirection;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+
+    float tEntry = max(max(tNear.x, tNear.y), max(tNear.z, tMin));
+    float tExit = min(min(tFar.x, tFar.y), min(tFar.z, tMax));
+
+    return tEntry <= tExit;
+}
+
+// Moller-Trumbore, both faces are hit
+bool intersectBvhTriangle(uint triangle, vec3 origin, vec3 direction, float tMin, float tMax) {
+    vec3 v0 = bvhTrianglePositions[3 * triangle].xyz;
+    vec3 edge1 = bvhTrianglePositions[3 * triangle + 1].xyz - v0;
+    vec3 edge2 = bvhTrianglePositions[3 * triangle + 2].xyz - v0;
+
+    vec3 p = cross(direction, edge2);
+    float determinant = dot(edge1, p);
+    if (abs(determinant) < BVH_DETERMINANT_EPSILON)
+        return false;
+
+    float inverseDeterminant = 1.0 / determinant;
+    vec3 s = origin - v0;
+    float u = dot(s, p) * inverseDeterminant;
+    vec3 q = cross(s, edge1);
+    float v = dot(direction, q) * inverseDeterminant;
+    float t = dot(edge2, q) * inverseDeterminant;
+
+    return u >= 0.0 && v >= 0.0 && u + v <= 1.0 && t >= tMin && t <= tMax;
+}
+
+// Returns true when the ray hits a triangle between tMin and tMax, the traversal stops at the first hit
+bool isBvhOccluded(vec3 origin, vec3 direction, float tMin, float tMax) {
+    vec3 inverseDirection = 1.0 / direction;
+    if (!intersectBvhBounds(0, origin, inverseDirection, tMin, tMax))
+        return false;
+
+    uint stack[BVH_MAX_DEPTH];
+    uint stackSize = 0;
+    uint nodeIndex = 0;
+    while (true) {
+        uint offset = bvhNodes[nodeIndex].offset;
+        uint triangleCount = bvhNodes[nodeIndex].triangleCount;
+        if (triangleCount > 0) {
+            for (uint i = offset; i < offset + triangleCount; ++i) {
+                if (intersectBvhTriangle(i, origin, direction, tMin, tMax))
+                    return true;
+            }
+        }
+        else {
+            // any hit ends the traversal, so the children are visited in their order
+            bool isFirstHit = intersectBvhBounds(nodeIndex + 1, origin, inverseDirection, tMin, tMax);
+            bool isSecondHit = intersectBvhBounds(offset, origin, inverseDirection, tMin, tMax);
+            if (isFirstHit) {
+                if (isSecondHit)
+                    stack[stackSize++] = offset;
+                nodeIndex = nodeIndex + 1;
+                continue;
+            }
+            if (isSecondHit) {
+                nodeIndex = offset;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        nodeIndex = stack[--stackSize];
+    }
+
+    return false;
+}
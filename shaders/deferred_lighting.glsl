@@ -0,0 +1,167 @@
+//////////////////////////////////////////////////////
+// Common code of the deferred lighting shaders
+// deferred_lighting_clustered.glsl reads the light lists of the clusters
+// deferred_lighting_tiled.glsl builds the light lists of its tile in shared memory
+// deferred_lighting_subpass.frag reads the GBuffer from input attachments, it defines DEFERRED_LIGHTING_SUBPASS
+// The compute kernels define FUSED_TONE_MAPPING to tone map the lighting and store it in the final LDR image
+//////////////////////////////////////////////////////
+
+#include "gbuffer.glsl"
+#include "light_clusters.glsl"
+#include "light_probes.glsl"
+#include "spherical_harmonics.glsl"
+#include "tonemapping.glsl"
+
+#ifndef DEFERRED_LIGHTING_SUBPASS
+layout(binding = 0) uniform sampler2D albedoSampler;
+layout(binding = 1) uniform sampler2D worldNormalSampler;
+layout(binding = 2) uniform sampler2D depthSampler;
+#endif
+layout(binding = 3) uniform samplerCube environmentSampler;
+layout(binding = 4, std140, set = 0) uniform cameraTransformations
+{
+    mat4 viewInverse;
+    mat4 projInverse;
+    vec3 rayOrigin;
+};
+layout(binding = 5) uniform lightInformation
+{
+    vec3 lightPosition;
+};
+
+#ifndef DEFERRED_LIGHTING_SUBPASS
+#ifdef FUSED_TONE_MAPPING
+layout(binding = 6, rgba8) uniform image2D outputImage;
+#else
+layout(binding = 6, rgba16f) uniform image2D outputImage;
+#endif
+#endif
+layout(binding = 7, std140) uniform lightClusterParams
+{
+    mat4 view;
+    mat4 projInverse;
+    uvec4 clusterCounts;
+    vec4 screenSizeAndDepthRange;
+} clusterParams;
+layout(binding = 8, std430) readonly buffer lightBuffer
+{
+    PointLight lights[];
+};
+// bindings 9 and 10 are the light clusters, see deferred_lighting_clustered.glsl
+layout(binding = 11, std140) uniform irradianceSH
+{
+    vec4 irradianceCoefficients[SH_COEFFICIENT_COUNT];
+};
+layout(binding = 12) uniform samplerCube specularSampler;
+layout(binding = 13) uniform sampler2D brdfLutSampler;
+layout(binding = 14, std140) uniform lightProbeGridParams
+{
+    vec4 origin;
+    vec4 spacing;
+    uvec4 probeCounts;
+} probeGrid;
+layout(binding = 15, std430) readonly buffer lightProbeBuffer
+{
+    vec4 probeCoefficients[];
+};
+
+// the materials are dielectric, the roughness is stored in the GBuffer
+const vec3 MATERIAL_F0 = vec3(0.04);
+
+#ifndef DEFERRED_LIGHTING_SUBPASS
+void storeColor(ivec2 pixel, vec4 color) {
+#ifdef FUSED_TONE_MAPPING
+    color.rgb = toneMap(color.rgb);
+#endif
+    imageStore(outputImage, pixel, color);
+}
+#endif
+
+vec3 getWorldPosition(vec2 uv, float depth) {
+    vec2 clipPosition = 2.0 * uv - vec2(1.0);
+    vec4 worldPosition = viewInverse * projInverse * vec4(clipPosition, depth, 1.0);
+    return worldPosition.xyz / worldPosition.w;
+}
+
+vec4 getEnvironmentColor(vec3 worldPosition) {
+    vec3 rayDir = normalize(worldPosition - rayOrigin);
+    return texture(environmentSampler, rayDir.xzy);
+}
+
+// Diffuse contribution of a point light
+vec3 computePointLight(PointLight light, vec3 worldPosition, vec3 worldNormal) {
+    vec3 toLight = light.positionAndRadius.xyz - worldPosition;
+    float lightDistance = length(toLight);
+    float attenuation = getLightAttenuation(lightDistance, light.positionAndRadius.w);
+    float diffuseIntensity = clamp(dot(worldNormal, toLight / max(lightDistance, 1e-4)), 0.0, 1.0);
+    return light.colorAndIntensity.rgb * (light.colorAndIntensity.w * attenuation * diffuseIntensity);
+}
+
+// Lighting of the main light
+vec4 computeMainLight(vec3 worldPosition, vec3 worldNormal, vec4 albedo) {
+    // diffuse
+    vec3 lightDir = normalize(lightPosition - worldPosition);
+    float diffuseIntensity = clamp(dot(worldNormal, lightDir), 0.0, 1.0);
+
+    // fake specular for test
+    vec3 eyeDir = normalize(rayOrigin - worldPosition);
+    float specular = pow(clamp(dot(reflect(-lightDir, worldNormal), eyeDir), 0.0, 1.0), 16.0);
+    const vec4 specularColor = vec4(1.0, 1.0, 1.0, 0.0);
+
+    // sum everything
+    return (diffuseIntensity * albedo) + (specular * specularColor);
+}
+
+// Irradiance of the light probe grid, N is in the axes of the environment
+// The 8 probes around the position are blended trilinearly, the probes behind the surface are faded out to limit the leaks
+// https://jcgt.org/published/0008/02/01/
+vec3 sampleLightProbes(vec3 worldPosition, vec3 worldNormal, vec3 N) {
+    float basis[SH_COEFFICIENT_COUNT];
+    evaluateSHBasis(N, basis);
+
+    vec3 gridPosition = (worldPosition - probeGrid.origin.xyz) / probeGrid.spacing.xyz;
+    uvec3 maxCoordinates = probeGrid.probeCounts.xyz - uvec3(1);
+    uvec3 baseCoordinates = uvec3(clamp(floor(gridPosition), vec3(0.0), vec3(maxCoordinates - uvec3(1))));
+    vec3 alpha = clamp(gridPosition - vec3(baseCoordinates), 0.0, 1.0);
+
+    vec3 irradiance = vec3(0.0);
+    float totalWeight = 0.0;
+    for (uint i = 0; i < 8; ++i) {
+        uvec3 offset = uvec3(i & 1u, (i >> 1u) & 1u, (i >> 2u) & 1u);
+        uvec3 coordinates = baseCoordinates + offset;
+
+        vec3 trilinear = mix(vec3(1.0) - alpha, alpha, vec3(offset));
+        vec3 toProbe = getProbePosition(coordinates, probeGrid.origin.xyz, probeGrid.spacing.xyz) - worldPosition;
+        float backface = 0.5 * (dot(worldNormal, toProbe) * inversesqrt(max(dot(toProbe, toProbe), 1e-6)) + 1.0);
+        float weight = trilinear.x * trilinear.y * trilinear.z * (backface * backface + 0.2);
+
+        uint coefficientOffset = getProbeIndex(coordinates, probeGrid.probeCounts.xyz) * SH_COEFFICIENT_COUNT;
+        vec3 probeIrradiance = vec3(0.0);
+        for (uint j = 0; j < SH_COEFFICIENT_COUNT; ++j)
+            probeIrradiance += probeCoefficients[coefficientOffset + j].rgb * basis[j];
+
+        irradiance += max(probeIrradiance, vec3(0.0)) * weight;
+        totalWeight += weight;
+    }
+
+    return irradiance / max(totalWeight, 1e-4);
+}
+
+// Image based lighting of the environment
+vec3 computeAmbientLight(vec3 worldPosition, vec3 worldNormal, vec3 albedo, float roughness) {
+    vec3 eyeDir = normalize(rayOrigin - worldPosition);
+    float NdotV = clamp(dot(worldNormal, eyeDir), 0.0, 1.0);
+    vec3 reflectedDir = reflect(-eyeDir, worldNormal);
+
+    // the spherical harmonics and the cubemaps use the same axes as the environment
+    vec3 irradiance;
+    if (probeGrid.origin.w > 0.5)
+        irradiance = sampleLightProbes(worldPosition, worldNormal, worldNormal.xzy);
+    else
+        irradiance = evaluateSHIrradiance(worldNormal.xzy, irradianceCoefficients);
+    float specularLod = roughness * float(textureQueryLevels(specularSampler) - 1);
+    vec3 prefilteredColor = textureLod(specularSampler, reflectedDir.xzy, specularLod).rgb;
+    vec2 brdf = texture(brdfLutSampler, vec2(NdotV, roughness)).xy;
+
+    return albedo * irradiance * (vec3(1.0) - MATERIAL_F0) + prefilteredColor * (MATERIAL_F0 * brdf.x + brdf.y);
+}
@@ -0,0 +1,65 @@
+// Lighting kernel that reads the light lists of the clusters
+// Included by deferred_lighting.comp, and by deferred_lighting_fused.comp which defines FUSED_TONE_MAPPING
+
+#include "deferred_lighting.glsl"
+
+// the work group size is chosen per device through specialization constants
+layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
+
+layout(binding = 9, std430) readonly buffer lightGridBuffer
+{
+    uint clusterLightCounts[];
+};
+layout(binding = 10, std430) readonly buffer lightIndexBuffer
+{
+    uint clusterLightIndices[];
+};
+
+// Sums the diffuse contribution of the point lights of the cluster of the pixel
+vec3 computePointLights(vec3 worldPosition, vec3 worldNormal, vec3 albedo) {
+    float viewDepth = -(clusterParams.view * vec4(worldPosition, 1.0)).z;
+    uvec3 cluster = uvec3(
+        gl_GlobalInvocationID.xy / CLUSTER_TILE_SIZE,
+        getClusterSlice(viewDepth, clusterParams.clusterCounts.z, clusterParams.screenSizeAndDepthRange.z, clusterParams.screenSizeAndDepthRange.w));
+    uint clusterIndex = getClusterIndex(cluster, clusterParams.clusterCounts.xyz);
+
+    vec3 color = vec3(0.0);
+    uint lightCount = clusterLightCounts[clusterIndex];
+    for (uint i = 0; i < lightCount; ++i)
+        color += computePointLight(lights[clusterLightIndices[clusterIndex * MAX_LIGHTS_PER_CLUSTER + i]], worldPosition, worldNormal);
+
+    return color * albedo;
+}
+
+void main() {
+    // the images can be larger than the rendered area, see DeferredLightingPass::recordCommands
+    ivec2 renderSize = ivec2(clusterParams.screenSizeAndDepthRange.xy);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (pixel.x >= renderSize.x || pixel.y >= renderSize.y)
+        return;
+
+    vec4 outColor = vec4(0.0);
+
+    // get uv
+    vec2 uv = (vec2(pixel) + vec2(0.5)) / vec2(renderSize);
+
+    float depth = texelFetch(depthSampler, pixel, 0).x;
+
+    // get world position
+    vec3 worldPosition = getWorldPosition(uv, depth);
+
+    if (depth >= 1.0) {
+        outColor = getEnvironmentColor(worldPosition);
+    }
+    else {
+        vec4 albedoRoughness = texelFetch(albedoSampler, pixel, 0);
+        vec4 albedo = vec4(albedoRoughness.rgb, 1.0);
+        vec3 worldNormal = decodeNormal(texelFetch(worldNormalSampler, pixel, 0).xy);
+
+        outColor = computeMainLight(worldPosition, worldNormal, albedo);
+        outColor.rgb += computePointLights(worldPosition, worldNormal, albedo.rgb);
+        outColor.rgb += computeAmbientLight(worldPosition, worldNormal, albedo.rgb, albedoRoughness.a);
+    }
+    // store
+    storeColor(pixel, outColor);
+}
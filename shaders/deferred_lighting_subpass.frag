@@ -0,0 +1,64 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// This shader performs the lighting in the second subpass of the GBuffer render pass
+// The GBuffer is read from input attachments, on tile based GPUs it never leaves the tile memory
+// The lighting is tone mapped, only the final color is stored
+// The point lights come from the clusters, like deferred_lighting_clustered.glsl
+
+#define DEFERRED_LIGHTING_SUBPASS
+#include "deferred_lighting.glsl"
+
+layout(input_attachment_index = 0, binding = 0) uniform subpassInput albedoInput;
+layout(input_attachment_index = 1, binding = 1) uniform subpassInput worldNormalInput;
+layout(input_attachment_index = 2, binding = 2) uniform subpassInput depthInput;
+
+layout(binding = 9, std430) readonly buffer lightGridBuffer
+{
+    uint clusterLightCounts[];
+};
+layout(binding = 10, std430) readonly buffer lightIndexBuffer
+{
+    uint clusterLightIndices[];
+};
+
+layout(location = 0) out vec4 outColor;
+
+// Sums the diffuse contribution of the point lights of the cluster of the pixel
+vec3 computePointLights(vec3 worldPosition, vec3 worldNormal, vec3 albedo) {
+    float viewDepth = -(clusterParams.view * vec4(worldPosition, 1.0)).z;
+    uvec3 cluster = uvec3(
+        uvec2(gl_FragCoord.xy) / CLUSTER_TILE_SIZE,
+        getClusterSlice(viewDepth, clusterParams.clusterCounts.z, clusterParams.screenSizeAndDepthRange.z, clusterParams.screenSizeAndDepthRange.w));
+    uint clusterIndex = getClusterIndex(cluster, clusterParams.clusterCounts.xyz);
+
+    vec3 color = vec3(0.0);
+    uint lightCount = clusterLightCounts[clusterIndex];
+    for (uint i = 0; i < lightCount; ++i)
+        color += computePointLight(lights[clusterLightIndices[clusterIndex * MAX_LIGHTS_PER_CLUSTER + i]], worldPosition, worldNormal);
+
+    return color * albedo;
+}
+
+void main() {
+    vec2 uv = gl_FragCoord.xy / clusterParams.screenSizeAndDepthRange.xy;
+    float depth = subpassLoad(depthInput).x;
+
+    vec3 worldPosition = getWorldPosition(uv, depth);
+
+    vec4 color = vec4(0.0);
+    if (depth >= 1.0) {
+        color = getEnvironmentColor(worldPosition);
+    }
+    else {
+        vec4 albedoRoughness = subpassLoad(albedoInput);
+        vec4 albedo = vec4(albedoRoughness.rgb, 1.0);
+        vec3 worldNormal = decodeNormal(subpassLoad(worldNormalInput).xy);
+
+        color = computeMainLight(worldPosition, worldNormal, albedo);
+        color.rgb += computePointLights(worldPosition, worldNormal, albedo.rgb);
+        color.rgb += computeAmbientLight(worldPosition, worldNormal, albedo.rgb, albedoRoughness.a);
+    }
+
+    outColor = vec4(toneMap(color.rgb), color.a);
+}
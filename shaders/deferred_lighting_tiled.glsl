@@ -0,0 +1,106 @@
+// Variant of deferred_lighting_clustered.glsl that doesn't need the light clusters
+// Each work group computes the depth bounds of its tile, culls the point lights against them
+// and keeps the light list of the tile in shared memory
+// Included by deferred_lighting_tiled.comp, and by deferred_lighting_tiled_fused.comp which defines FUSED_TONE_MAPPING
+
+#include "deferred_lighting.glsl"
+
+// the work group size is chosen per device through specialization constants
+layout(local_size_x_id = 0, local_size_y_id = 1, local_size_z_id = 2) in;
+
+const uint MAX_LIGHTS_PER_TILE = 256;
+
+// view depths are positive, their bits can be compared as integers
+shared uint tileMinDepthBits;
+shared uint tileMaxDepthBits;
+shared uint tileLightCount;
+shared uint tileLightIndices[MAX_LIGHTS_PER_TILE];
+
+void cullTileLights(float minDepth, float maxDepth) {
+    vec2 screenSize = clusterParams.screenSizeAndDepthRange.xy;
+    vec2 tileMin = vec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy);
+    vec2 tileMax = min(vec2((gl_WorkGroupID.xy + uvec2(1)) * gl_WorkGroupSize.xy), screenSize);
+
+    // bounding box of the tile in view space
+    vec3 boxMin = vec3(1e30);
+    vec3 boxMax = vec3(-1e30);
+    for (uint i = 0; i < 4; ++i) {
+        vec2 corner = vec2((i & 1u) == 0u ? tileMin.x : tileMax.x, (i & 2u) == 0u ? tileMin.y : tileMax.y);
+        vec3 nearCorner = getViewPosition(corner, minDepth, screenSize, clusterParams.projInverse);
+        vec3 farCorner = getViewPosition(corner, maxDepth, screenSize, clusterParams.projInverse);
+        boxMin = min(boxMin, min(nearCorner, farCorner));
+        boxMax = max(boxMax, max(nearCorner, farCorner));
+    }
+
+    // the invocations of the work group test the lights in parallel
+    uint lightCount = clusterParams.clusterCounts.w;
+    uint invocationCount = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    for (uint lightIndex = gl_LocalInvocationIndex; lightIndex < lightCount; lightIndex += invocationCount) {
+        vec4 positionAndRadius = lights[lightIndex].positionAndRadius;
+        vec4 sphere = vec4((clusterParams.view * vec4(positionAndRadius.xyz, 1.0)).xyz, positionAndRadius.w);
+        if (intersectsSphere(boxMin, boxMax, sphere)) {
+            uint tileIndex = atomicAdd(tileLightCount, 1u);
+            if (tileIndex < MAX_LIGHTS_PER_TILE)
+                tileLightIndices[tileIndex] = lightIndex;
+        }
+    }
+}
+
+void main() {
+    // the images can be larger than the rendered area, see DeferredLightingPass::recordCommands
+    ivec2 renderSize = ivec2(clusterParams.screenSizeAndDepthRange.xy);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    bool isInside = pixel.x < renderSize.x && pixel.y < renderSize.y;
+
+    if (gl_LocalInvocationIndex == 0) {
+        tileMinDepthBits = floatBitsToUint(clusterParams.screenSizeAndDepthRange.w);
+        tileMaxDepthBits = 0u;
+        tileLightCount = 0u;
+    }
+
+    barrier();
+
+    // depth bounds of the tile, the environment pixels are ignored
+    vec2 uv = (vec2(pixel) + vec2(0.5)) / vec2(renderSize);
+    float depth = isInside ? texelFetch(depthSampler, pixel, 0).x : 1.0;
+    vec3 worldPosition = getWorldPosition(uv, depth);
+    if (depth < 1.0) {
+        float viewDepth = -(clusterParams.view * vec4(worldPosition, 1.0)).z;
+        atomicMin(tileMinDepthBits, floatBitsToUint(max(viewDepth, 0.0)));
+        atomicMax(tileMaxDepthBits, floatBitsToUint(max(viewDepth, 0.0)));
+    }
+
+    barrier();
+
+    // the bounds are the same for the whole work group, the control flow stays uniform
+    float minDepth = uintBitsToFloat(tileMinDepthBits);
+    float maxDepth = uintBitsToFloat(tileMaxDepthBits);
+    if (minDepth <= maxDepth)
+        cullTileLights(minDepth, maxDepth);
+
+    barrier();
+
+    if (!isInside)
+        return;
+
+    vec4 outColor = vec4(0.0);
+    if (depth >= 1.0) {
+        outColor = getEnvironmentColor(worldPosition);
+    }
+    else {
+        vec4 albedoRoughness = texelFetch(albedoSampler, pixel, 0);
+        vec4 albedo = vec4(albedoRoughness.rgb, 1.0);
+        vec3 worldNormal = decodeNormal(texelFetch(worldNormalSampler, pixel, 0).xy);
+
+        outColor = computeMainLight(worldPosition, worldNormal, albedo);
+        outColor.rgb += computeAmbientLight(worldPosition, worldNormal, albedo.rgb, albedoRoughness.a);
+
+        vec3 pointLightColor = vec3(0.0);
+        uint lightCount = min(tileLightCount, MAX_LIGHTS_PER_TILE);
+        for (uint i = 0; i < lightCount; ++i)
+            pointLightColor += computePointLight(lights[tileLightIndices[i]], worldPosition, worldNormal);
+        outColor.rgb += pointLightColor * albedo.rgb;
+    }
+
+    storeColor(pixel, outColor);
+}
@@ -1,16 +1,25 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+#include "gbuffer.glsl"
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec3 worldNormal;
 layout(location = 2) in vec2 fragTexCoord;
+layout(location = 3) in vec4 currentClipPosition;
+layout(location = 4) in vec4 previousClipPosition;
 
 layout(location = 0) out vec4 outAlbedo;
-layout(location = 1) out vec4 outNormal;
+layout(location = 1) out vec2 outNormal;
+layout(location = 2) out vec2 outVelocity;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// the mesh has no material yet, every surface has the same roughness
+const float MATERIAL_ROUGHNESS = 0.5;
+
 void main() {
-    outAlbedo = texture(texSampler, fragTexCoord);
-    outNormal = vec4(normalize(worldNormal), 0.0);
-}
\ No newline at end of file
+    outAlbedo = vec4(texture(texSampler, fragTexCoord).rgb, MATERIAL_ROUGHNESS);
+    outNormal = encodeNormal(normalize(worldNormal));
+    outVelocity = getVelocity(currentClipPosition, previousClipPosition);
+}
@@ -0,0 +1,32 @@
+//////////////////////////////////////////////////////
+// Layout of the GBuffer, it matches GBufferPass::getFormats (GBufferPass.cpp)
+//   - albedo: rgb is the albedo (sRGB encoded by the format), a is the roughness
+//   - normal: world normal, octahedral encoding in two signed channels
+//   - depth
+//   - velocity: motion of the surface in uv since the previous frame, without the jitter of the projection
+//////////////////////////////////////////////////////
+
+// Octahedral mapping of a unit vector onto [-1, 1]^2
+// https://jcgt.org/published/0003/02/01/
+vec2 signNotZero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encodeNormal(vec3 n) {
+    vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    return (n.z <= 0.0) ? ((1.0 - abs(p.yx)) * signNotZero(p)) : p;
+}
+
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * signNotZero(n.xy);
+    return normalize(n);
+}
+
+// The velocity is the current uv minus the previous uv, the history of a pixel is found at uv - velocity
+vec2 getVelocity(vec4 currentClipPosition, vec4 previousClipPosition) {
+    vec2 currentNdc = currentClipPosition.xy / currentClipPosition.w;
+    vec2 previousNdc = previousClipPosition.xy / previousClipPosition.w;
+    return (currentNdc - previousNdc) * 0.5;
+}
@@ -9,11 +9,15 @@ layout(location = 3) in vec3 inColor;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec3 worldNormal;
 layout(location = 2) out vec2 fragTexCoord;
+layout(location = 3) out vec4 currentClipPosition;
+layout(location = 4) out vec4 previousClipPosition;
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
-    mat4 proj;
+    mat4 proj;              // jittered for the temporal anti-aliasing
+    mat4 previousViewProj;  // without the jitter, from the current world position, it includes the motion of the model
+    vec4 jitter;            // xy is the offset of the projection in clip space
 } ubo;
 
 void main() {
@@ -22,6 +26,10 @@ void main() {
     worldNormal = normalize(worldNormal4.xyz);
 
     gl_Position = ubo.proj * ubo.view * worldPos4;
+
+    // the velocity ignores the jitter, otherwise the static surfaces would move
+    currentClipPosition = gl_Position - vec4(ubo.jitter.xy * gl_Position.w, 0.0, 0.0);
+    previousClipPosition = ubo.previousViewProj * worldPos4;
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
\ No newline at end of file
@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////
+// CONSTANTS
+//////////////////////////////////////////////////////
+// These values must match the ones of LightClusteringPass.h
+const uint CLUSTER_TILE_SIZE = 64;
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+
+//////////////////////////////////////////////////////
+// STRUCTURES
+//////////////////////////////////////////////////////
+struct PointLight {
+    vec4 positionAndRadius;  // xyz is the world space position, w is the radius of influence
+    vec4 colorAndIntensity;
+};
+
+//////////////////////////////////////////////////////
+// FUNCTIONS
+//////////////////////////////////////////////////////
+
+// The depth slices are distributed exponentially between the near and far planes
+float getClusterSliceDepth(uint slice, uint sliceCount, float nearPlane, float farPlane) {
+    return nearPlane * pow(farPlane / nearPlane, float(slice) / float(sliceCount));
+}
+
+uint getClusterSlice(float viewDepth, uint sliceCount, float nearPlane, float farPlane) {
+    float slice = log(viewDepth / nearPlane) / log(farPlane / nearPlane) * float(sliceCount);
+    return uint(clamp(slice, 0.0, float(sliceCount - 1)));
+}
+
+uint getClusterIndex(uvec3 cluster, uvec3 clusterCounts) {
+    return cluster.x + clusterCounts.x * (cluster.y + clusterCounts.y * cluster.z);
+}
+
+// Smooth falloff reaching 0 at the radius of the light
+float getLightAttenuation(float lightDistance, float radius) {
+    float ratio = lightDistance / radius;
+    float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+    return window * window / (lightDistance * lightDistance + 1.0);
+}
+
+// Returns the view space position at the given view depth along the ray of a screen position
+vec3 getViewPosition(vec2 screenPosition, float viewDepth, vec2 screenSize, mat4 projInverse) {
+    vec2 clipPosition = 2.0 * screenPosition / screenSize - vec2(1.0);
+    vec4 farPosition = projInverse * vec4(clipPosition, 1.0, 1.0);
+    vec3 ray = farPosition.xyz / farPosition.w;
+    return ray * (viewDepth / -ray.z);
+}
+
+bool intersectsSphere(vec3 boxMin, vec3 boxMax, vec4 sphere) {
+    vec3 closestPoint = clamp(sphere.xyz, boxMin, boxMax);
+    vec3 difference = closestPoint - sphere.xyz;
+    return dot(difference, difference) <= sphere.w * sphere.w;
+}
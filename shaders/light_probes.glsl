@@ -0,0 +1,37 @@
+//////////////////////////////////////////////////////
+// Light probe grid
+// The layouts match LightProbeGridParams and LightProbeRelightingParams of Ubo.h
+//////////////////////////////////////////////////////
+
+// Number of rays traced from a probe when it is relit
+// The value must match cLightProbeRayCount of LightProbeRelightingPass.h
+const uint LIGHT_PROBE_RAY_COUNT = 64;
+
+//////////////////////////////////////////////////////
+// STRUCTURES
+//////////////////////////////////////////////////////
+
+// Payload of the rays of the relighting
+struct LightProbeHit {
+    vec3 normal;      // world space, interpolated from the vertices
+    float distance;   // negative on a miss
+    vec2 texCoord;
+};
+
+//////////////////////////////////////////////////////
+// FUNCTIONS
+//////////////////////////////////////////////////////
+
+uvec3 getProbeCoordinates(uint probeIndex, uvec3 probeCounts) {
+    return uvec3(probeIndex % probeCounts.x,
+                 (probeIndex / probeCounts.x) % probeCounts.y,
+                 probeIndex / (probeCounts.x * probeCounts.y));
+}
+
+uint getProbeIndex(uvec3 coordinates, uvec3 probeCounts) {
+    return coordinates.x + probeCounts.x * (coordinates.y + probeCounts.y * coordinates.z);
+}
+
+vec3 getProbePosition(uvec3 coordinates, vec3 gridOrigin, vec3 probeSpacing) {
+    return gridOrigin + vec3(coordinates) * probeSpacing;
+}
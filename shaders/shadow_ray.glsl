@@ -0,0 +1,28 @@
+//////////////////////////////////////////////////////
+// Shadow ray of the raytracing shadow passes
+// The including shader declares the payload at location 0 and the acceleration structure acc
+//////////////////////////////////////////////////////
+
+// Returns 1 when target is visible from origin, 0 when it is occluded or behind the surface
+vec4 getLightIntensity(vec3 origin, vec3 target, vec3 normal) {
+    vec3 direction = target - origin;
+    vec4 lightIntensity = vec4(0.0, 0.0, 0.0, 1.0);
+    if (dot(normal, direction) > 0.0) {
+        payload = vec4(1.0, 1.0, 1.0, 1.0);
+        float maxLength = length(direction);
+        traceRayEXT(
+            acc,
+            gl_RayFlagsOpaqueEXT | gl_RayFlagsTerminateOnFirstHitEXT,
+            0xff,
+            0,
+            0,
+            0,
+            origin,
+            0.001,
+            normalize(direction),
+            maxLength,
+            0);
+        lightIntensity = payload;
+    }
+    return lightIntensity;
+}
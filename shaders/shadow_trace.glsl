@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////
+// Mapping between the rays of the shadow passes, the texels of the visibility and the pixels
+// It matches ShadowTraceSettings (ShadowTraceSettings.h)
+//   - the visibility has one texel per resolutionScale x resolutionScale pixels
+//   - a texel is traced from the center pixel of its block
+//   - with the checkerboard, the texels with an even x + y + frameIndex are traced
+//   - the images can be larger than the rendered area, the sizes are given by the passes instead of queried
+//////////////////////////////////////////////////////
+
+// Texel of the visibility traced by a ray of the dispatch
+ivec2 getShadowTraceTexel(uvec2 rayIndex, uint isCheckerboarded, uint frameIndex) {
+    if (isCheckerboarded == 0)
+        return ivec2(rayIndex);
+    return ivec2(2 * rayIndex.x + ((rayIndex.y + frameIndex) & 1u), rayIndex.y);
+}
+
+bool isShadowTexelTraced(ivec2 texel, uint isCheckerboarded, uint frameIndex) {
+    return isCheckerboarded == 0 || ((uint(texel.x + texel.y) + frameIndex) & 1u) == 0;
+}
+
+// Size of the visibility of the rendered area, it matches ShadowTraceSettings::getVisibilityWidth and getVisibilityHeight
+ivec2 getShadowVisibilitySize(ivec2 renderSize, uint resolutionScale) {
+    return (renderSize + ivec2(resolutionScale - 1)) / int(resolutionScale);
+}
+
+// Pixel from which the ray of a texel starts
+ivec2 getShadowSourcePixel(ivec2 texel, uint resolutionScale, ivec2 size) {
+    return min(texel * int(resolutionScale) + int(resolutionScale / 2), size - ivec2(1));
+}
+
+//////////////////////////////////////////////////////
+// Adaptive sampling, it matches cShadowTileSize (ShadowTraceSettings.h)
+//   - the visibility is split in tiles of SHADOW_TILE_SIZE x SHADOW_TILE_SIZE texels
+//   - the tiles crossed by a shadow edge or a penumbra are listed and receive extra rays
+//////////////////////////////////////////////////////
+
+const uint SHADOW_TILE_SIZE = 8;
+
+uint packShadowTile(uvec2 tile) {
+    return tile.x | (tile.y << 16u);
+}
+
+uvec2 unpackShadowTile(uint packedTile) {
+    return uvec2(packedTile & 0xffffu, packedTile >> 16u);
+}
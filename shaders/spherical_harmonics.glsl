@@ -0,0 +1,43 @@
+//////////////////////////////////////////////////////
+// CONSTANTS
+//////////////////////////////////////////////////////
+
+// Number of coefficients of the L2 spherical harmonics
+const uint SH_COEFFICIENT_COUNT = 9;
+
+// Convolution of the bands with the clamped cosine, divided by PI
+// The evaluated irradiance is then the cosine weighted average of the radiance, like the old irradiance cubemap
+// https://cseweb.ucsd.edu/~ravir/papers/envmap/envmap.pdf
+const float SH_COSINE_LOBE[SH_COEFFICIENT_COUNT] = {
+    1.0,
+    2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0,
+    0.25, 0.25, 0.25, 0.25, 0.25
+};
+
+//////////////////////////////////////////////////////
+// FUNCTIONS
+//////////////////////////////////////////////////////
+
+// Real spherical harmonics basis up to the band 2, d must be normalized
+void evaluateSHBasis(vec3 d, out float basis[SH_COEFFICIENT_COUNT]) {
+    basis[0] = 0.282095;
+    basis[1] = 0.488603 * d.y;
+    basis[2] = 0.488603 * d.z;
+    basis[3] = 0.488603 * d.x;
+    basis[4] = 1.092548 * d.x * d.y;
+    basis[5] = 1.092548 * d.y * d.z;
+    basis[6] = 0.315392 * (3.0 * d.z * d.z - 1.0);
+    basis[7] = 1.092548 * d.x * d.z;
+    basis[8] = 0.546274 * (d.x * d.x - d.y * d.y);
+}
+
+// Irradiance in the direction N from coefficients already convolved with SH_COSINE_LOBE
+vec3 evaluateSHIrradiance(vec3 N, vec4 coefficients[SH_COEFFICIENT_COUNT]) {
+    float basis[SH_COEFFICIENT_COUNT];
+    evaluateSHBasis(N, basis);
+
+    vec3 irradiance = vec3(0.0);
+    for (uint i = 0; i < SH_COEFFICIENT_COUNT; ++i)
+        irradiance += coefficients[i].rgb * basis[i];
+    return max(irradiance, vec3(0.0));
+}
@@ -0,0 +1,8 @@
+//////////////////////////////////////////////////////
+// FUNCTIONS
+//////////////////////////////////////////////////////
+
+// Maps the HDR color to [0, 1]
+vec3 toneMap(vec3 color) {
+    return color / (color + 1.0);
+}